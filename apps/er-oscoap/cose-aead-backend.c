@@ -0,0 +1,178 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      AEAD backend glue and the software reference backend.
+ */
+
+#include "cose-aead-backend.h"
+#include "cose-aes-ccm.h"
+#include "opt-cose.h"
+#include "lib/list.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* AES blocks the software worker encrypts before it lets other processes run */
+#ifdef COSE_AEAD_SW_CONF_SLICE_BLOCKS
+#define COSE_AEAD_SW_SLICE_BLOCKS COSE_AEAD_SW_CONF_SLICE_BLOCKS
+#else /* COSE_AEAD_SW_CONF_SLICE_BLOCKS */
+#define COSE_AEAD_SW_SLICE_BLOCKS 4
+#endif /* COSE_AEAD_SW_CONF_SLICE_BLOCKS */
+
+/* AES-CCM can only be sliced when it runs on the software CCM* driver */
+#ifdef COSE_AES_CCM_CONF
+#define COSE_AEAD_SW_SLICED 0
+#else /* COSE_AES_CCM_CONF */
+#define COSE_AEAD_SW_SLICED 1
+#endif /* COSE_AES_CCM_CONF */
+
+PROCESS(cose_aead_sw_process, "COSE AEAD worker");
+LIST(sw_jobs);
+/*---------------------------------------------------------------------------*/
+uint8_t
+cose_aead_run(cose_aead_job_t *job)
+{
+  uint8_t tag[COSE_AEAD_MAX_TAG_LEN];
+
+  job->aead->set_key(job->key);
+  if(job->forward) {
+    job->aead->aead(job->nonce, job->m, job->m_len, job->a, job->a_len,
+        job->tag, 1);
+    return COSE_AEAD_JOB_DONE;
+  }
+
+  job->aead->aead(job->nonce, job->m, job->m_len, job->a, job->a_len, tag, 0);
+  if(memcmp(tag, job->tag, job->aead->tag_len) != 0) {
+    PRINTF("cose-aead: tag mismatch\n");
+    return COSE_AEAD_JOB_AUTH_FAILED;
+  }
+  return COSE_AEAD_JOB_DONE;
+}
+/*---------------------------------------------------------------------------*/
+void
+cose_aead_job_done(cose_aead_job_t *job, uint8_t status)
+{
+  job->status = status;
+  if(job->process != NULL) {
+    process_poll(job->process);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+cose_aead_submit(cose_aead_job_t *job)
+{
+  job->status = COSE_AEAD_JOB_PENDING;
+  if(!COSE_AEAD_BACKEND.submit(job)) {
+    PRINTF("cose-aead: %s cannot run alg %u, using software\n",
+        COSE_AEAD_BACKEND.name, job->aead->alg);
+    cose_aead_sw_backend.submit(job);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+cose_aead_backend_init(void)
+{
+  /* the software worker also runs what the configured backend rejects */
+  cose_aead_sw_backend.init();
+  COSE_AEAD_BACKEND.init();
+}
+/*---------------------------------------------------------------------------*/
+static void
+sw_init(void)
+{
+  if(!process_is_running(&cose_aead_sw_process)) {
+    list_init(sw_jobs);
+    process_start(&cose_aead_sw_process, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+sw_submit(cose_aead_job_t *job)
+{
+  list_add(sw_jobs, job);
+  process_poll(&cose_aead_sw_process);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Runs the queued jobs one by one. AES-CCM jobs are split into slices of
+   COSE_AEAD_SW_SLICE_BLOCKS AES blocks with a pause in between, so that the
+   CoAP engine and other processes are not starved by long messages. */
+PROCESS_THREAD(cose_aead_sw_process, ev, data)
+{
+#if COSE_AEAD_SW_SLICED
+  static struct cose_aes_ccm_op op;
+  static uint8_t tag[COSE_AEAD_MAX_TAG_LEN];
+#endif /* COSE_AEAD_SW_SLICED */
+  static cose_aead_job_t *job;
+  static uint8_t status;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    while(list_head(sw_jobs) == NULL) {
+      PROCESS_WAIT_EVENT();
+    }
+    job = list_pop(sw_jobs);
+
+#if COSE_AEAD_SW_SLICED
+    if(job->aead->alg == COSE_Algorithm_AES_CCM_16_64_128
+       || job->aead->alg == COSE_Algorithm_AES_CCM_64_64_128) {
+      cose_aes_ccm_op_init(&op, job->key, job->nonce, job->aead->nonce_len,
+          job->m, job->m_len, job->a, job->a_len,
+          job->forward ? job->tag : tag, job->aead->tag_len, job->forward);
+      while(!cose_aes_ccm_op_step(&op, COSE_AEAD_SW_SLICE_BLOCKS)) {
+        PROCESS_PAUSE();
+      }
+      status = COSE_AEAD_JOB_DONE;
+      if(!job->forward && memcmp(tag, job->tag, job->aead->tag_len) != 0) {
+        PRINTF("cose-aead: tag mismatch\n");
+        status = COSE_AEAD_JOB_AUTH_FAILED;
+      }
+    } else
+#endif /* COSE_AEAD_SW_SLICED */
+    {
+      status = cose_aead_run(job);
+    }
+    cose_aead_job_done(job, status);
+    PROCESS_PAUSE();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+const struct cose_aead_backend cose_aead_sw_backend = {
+  "software",
+  sw_init,
+  sw_submit
+};
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,122 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Asynchronous AEAD backends for OSCOAP. A backend runs a whole COSE
+ *      AEAD operation (nonce, AAD and payload) and polls the submitting
+ *      process when the job is done, so that protection can be offloaded to
+ *      a crypto accelerator without blocking the CoAP engine. The software
+ *      backend queues jobs to a worker process that runs them in slices.
+ */
+
+#ifndef _COSE_AEAD_BACKEND_H
+#define _COSE_AEAD_BACKEND_H
+
+#include "contiki.h"
+#include "cose-aead.h"
+
+/* Job status */
+#define COSE_AEAD_JOB_DONE         0
+#define COSE_AEAD_JOB_PENDING      1
+#define COSE_AEAD_JOB_AUTH_FAILED  2
+#define COSE_AEAD_JOB_ERROR        3
+
+/**
+ * A single AEAD operation. All buffers are owned by the submitter and must
+ * stay untouched until the job is done.
+ */
+typedef struct cose_aead_job {
+  struct cose_aead_job *next;
+  const struct cose_aead_driver *aead;
+  const uint8_t *key;
+  const uint8_t *nonce;
+  const uint8_t *a;
+  uint8_t a_len;
+  /* payload, encrypted or decrypted in place */
+  uint8_t *m;
+  uint8_t m_len;
+  /* encryption: the tag is written here, decryption: the received tag */
+  uint8_t *tag;
+  uint8_t forward;
+  volatile uint8_t status;
+  /* polled when the job is done, may be NULL */
+  struct process *process;
+} cose_aead_job_t;
+
+/**
+ * Structure of AEAD backends.
+ */
+struct cose_aead_backend {
+  char *name;
+
+  /** Initializes the backend */
+  void (* init)(void);
+
+  /**
+   * \brief         Starts a job.
+   * \param job     The job, job->status is COSE_AEAD_JOB_PENDING
+   * \return        0 if the backend cannot run the job (algorithm or buffer
+   *                layout not supported), the job then runs in software.
+   *                Otherwise the backend calls cose_aead_job_done() later,
+   *                or before returning.
+   */
+  int (* submit)(cose_aead_job_t *job);
+};
+
+#ifdef COSE_AEAD_CONF_BACKEND
+#define COSE_AEAD_BACKEND COSE_AEAD_CONF_BACKEND
+#else /* COSE_AEAD_CONF_BACKEND */
+#define COSE_AEAD_BACKEND cose_aead_sw_backend
+#endif /* COSE_AEAD_CONF_BACKEND */
+
+extern const struct cose_aead_backend COSE_AEAD_BACKEND;
+extern const struct cose_aead_backend cose_aead_sw_backend;
+
+void cose_aead_backend_init(void);
+
+/**
+ * \brief         Hands a job to the configured backend.
+ * \param job     The job, job->process is polled when job->status is no
+ *                longer COSE_AEAD_JOB_PENDING
+ */
+void cose_aead_submit(cose_aead_job_t *job);
+
+/**
+ * \brief         Runs a job in software on the calling stack.
+ * \param job     The job
+ * \return        The job status
+ */
+uint8_t cose_aead_run(cose_aead_job_t *job);
+
+/**
+ * \brief         Completes a job, called by backends.
+ * \param job     The job
+ * \param status  COSE_AEAD_JOB_DONE, COSE_AEAD_JOB_AUTH_FAILED or
+ *                COSE_AEAD_JOB_ERROR
+ */
+void cose_aead_job_done(cose_aead_job_t *job, uint8_t status);
+
+#endif /* _COSE_AEAD_BACKEND_H */
@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      AEAD backend for the cc2538 AES engine. A whole AES-CCM operation is
+ *      started on the crypto processor and the job completes from the
+ *      backend process, which the crypto interrupt polls.
+ *
+ *      Enable with COSE_AEAD_CONF_WITH_CC2538 and select it with
+ *      COSE_AEAD_CONF_BACKEND cose_aead_cc2538_backend.
+ */
+
+#include "cose-aead-backend.h"
+
+#ifdef COSE_AEAD_CONF_WITH_CC2538
+#define COSE_AEAD_WITH_CC2538 COSE_AEAD_CONF_WITH_CC2538
+#else /* COSE_AEAD_CONF_WITH_CC2538 */
+#define COSE_AEAD_WITH_CC2538 0
+#endif /* COSE_AEAD_CONF_WITH_CC2538 */
+
+#if COSE_AEAD_WITH_CC2538
+
+#include "opt-cose.h"
+#include "lib/list.h"
+#include "dev/crypto.h"
+#include "dev/aes.h"
+#include "dev/ccm.h"
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+/* Key area 0 is used by the cc2538 AES-128 and CCM* drivers */
+#ifdef COSE_AEAD_CC2538_CONF_KEY_AREA
+#define COSE_AEAD_CC2538_KEY_AREA COSE_AEAD_CC2538_CONF_KEY_AREA
+#else /* COSE_AEAD_CC2538_CONF_KEY_AREA */
+#define COSE_AEAD_CC2538_KEY_AREA 1
+#endif /* COSE_AEAD_CC2538_CONF_KEY_AREA */
+
+PROCESS(cose_aead_cc2538_process, "COSE AEAD cc2538");
+
+LIST(job_list);
+static uint8_t crypto_enabled;
+/*---------------------------------------------------------------------------*/
+static uint8_t
+start(cose_aead_job_t *job)
+{
+  uint8_t len_len = CCM_NONCE_LEN_LEN - job->aead->nonce_len;
+  uint8_t ret;
+
+  crypto_enabled = CRYPTO_IS_ENABLED();
+  if(!crypto_enabled) {
+    crypto_enable();
+  }
+
+  ret = aes_load_keys(job->key, AES_KEY_STORE_SIZE_KEY_SIZE_128, 1,
+                      COSE_AEAD_CC2538_KEY_AREA);
+  if(ret != CRYPTO_SUCCESS) {
+    return ret;
+  }
+
+  if(job->forward) {
+    return ccm_auth_encrypt_start(len_len, COSE_AEAD_CC2538_KEY_AREA,
+                                  job->nonce, job->a, job->a_len,
+                                  job->m, job->m_len, job->m,
+                                  job->aead->tag_len,
+                                  &cose_aead_cc2538_process);
+  }
+  return ccm_auth_decrypt_start(len_len, COSE_AEAD_CC2538_KEY_AREA,
+                                job->nonce, job->a, job->a_len,
+                                job->m, job->m_len + job->aead->tag_len, job->m,
+                                job->aead->tag_len,
+                                &cose_aead_cc2538_process);
+}
+/*---------------------------------------------------------------------------*/
+static void
+finish(cose_aead_job_t *job, uint8_t ret)
+{
+  uint8_t mic[COSE_AEAD_MAX_TAG_LEN];
+  uint8_t status;
+
+  if(ret == CRYPTO_SUCCESS) {
+    if(job->forward) {
+      ret = ccm_auth_encrypt_get_result(job->tag, job->aead->tag_len);
+    } else {
+      ret = ccm_auth_decrypt_get_result(job->m,
+                                        job->m_len + job->aead->tag_len,
+                                        mic, job->aead->tag_len);
+    }
+  }
+
+  if(!crypto_enabled) {
+    crypto_disable();
+  }
+
+  if(ret == CRYPTO_SUCCESS) {
+    status = COSE_AEAD_JOB_DONE;
+  } else if(ret == AES_AUTHENTICATION_FAILED) {
+    status = COSE_AEAD_JOB_AUTH_FAILED;
+  } else {
+    /* engine in use or key RAM error, do the job in software */
+    PRINTF("cose-aead-cc2538: error %u, running in software\n", ret);
+    status = cose_aead_run(job);
+  }
+  cose_aead_job_done(job, status);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(cose_aead_cc2538_process, ev, data)
+{
+  static cose_aead_job_t *job;
+  static uint8_t ret;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    /* PROCESS_WAIT_EVENT_UNTIL always yields once, which would leave a
+       job queued behind the previous one until the next submission */
+    while(list_head(job_list) == NULL) {
+      PROCESS_WAIT_EVENT();
+    }
+
+    job = list_head(job_list);
+    ret = start(job);
+    if(ret == CRYPTO_SUCCESS) {
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL
+                               && aes_auth_crypt_check_status());
+    }
+    list_remove(job_list, job);
+    finish(job, ret);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  list_init(job_list);
+  process_start(&cose_aead_cc2538_process, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static int
+submit(cose_aead_job_t *job)
+{
+  if(job->aead->alg != COSE_Algorithm_AES_CCM_16_64_128
+     && job->aead->alg != COSE_Algorithm_AES_CCM_64_64_128) {
+    return 0;
+  }
+  /* the engine reads the tag right after the ciphertext */
+  if(!job->forward && job->tag != job->m + job->m_len) {
+    return 0;
+  }
+
+  list_add(job_list, job);
+  process_poll(&cose_aead_cc2538_process);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+const struct cose_aead_backend cose_aead_cc2538_backend = {
+  "cc2538",
+  init,
+  submit
+};
+/*---------------------------------------------------------------------------*/
+#endif /* COSE_AEAD_WITH_CC2538 */
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Simulated AEAD accelerator. Jobs are queued to a single engine and
+ *      complete, computed in software, after the modelled latency expires.
+ */
+
+#include "cose-aead-sim.h"
+#include "opt-cose.h"
+#include "lib/list.h"
+#include "sys/ctimer.h"
+#include <string.h>
+
+#define DEBUG 0
+#if DEBUG
+#include <stdio.h>
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define AES_BLOCKS(len) (((uint16_t)(len) + 15) / 16)
+
+LIST(job_list);
+static struct ctimer timer;
+static struct cose_aead_sim_stats stats;
+static uint8_t faults;
+
+static void start_next(void);
+/*---------------------------------------------------------------------------*/
+static uint32_t
+job_latency_us(cose_aead_job_t *job)
+{
+  /* CBC-MAC over B0, the length prefixed AAD and the payload, then CTR over
+     the payload and the tag block */
+  uint16_t blocks = 1 + (job->a_len ? AES_BLOCKS(job->a_len + 2) : 0)
+    + 2 * AES_BLOCKS(job->m_len) + 1;
+
+  return COSE_AEAD_SIM_SETUP_US + (uint32_t)blocks * COSE_AEAD_SIM_BLOCK_US;
+}
+/*---------------------------------------------------------------------------*/
+static void
+complete(void *ptr)
+{
+  cose_aead_job_t *job = list_pop(job_list);
+  uint8_t status;
+
+  if(job == NULL) {
+    return;
+  }
+
+  if(faults > 0) {
+    faults--;
+    status = COSE_AEAD_JOB_ERROR;
+  } else {
+    status = cose_aead_run(job);
+  }
+  stats.jobs++;
+  PRINTF("cose-aead-sim: job %p done, status %u\n", job, status);
+
+  cose_aead_job_done(job, status);
+  start_next();
+}
+/*---------------------------------------------------------------------------*/
+static void
+start_next(void)
+{
+  cose_aead_job_t *job = list_head(job_list);
+  uint32_t us;
+
+  if(job == NULL) {
+    return;
+  }
+
+  us = job_latency_us(job);
+  stats.busy_us += us;
+  ctimer_set(&timer, (us * CLOCK_SECOND + 999999UL) / 1000000UL, complete, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  list_init(job_list);
+  memset(&stats, 0, sizeof(stats));
+  faults = 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+submit(cose_aead_job_t *job)
+{
+  uint8_t queued;
+
+  /* the modelled engine only does AES-CCM */
+  if(job->aead->alg != COSE_Algorithm_AES_CCM_16_64_128
+     && job->aead->alg != COSE_Algorithm_AES_CCM_64_64_128) {
+    return 0;
+  }
+
+  list_add(job_list, job);
+  queued = list_length(job_list);
+  if(queued > stats.max_queued) {
+    stats.max_queued = queued;
+  }
+  if(queued == 1) {
+    start_next();
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+cose_aead_sim_fail_next(uint8_t count)
+{
+  faults = count;
+}
+/*---------------------------------------------------------------------------*/
+const struct cose_aead_sim_stats *
+cose_aead_sim_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
+const struct cose_aead_backend cose_aead_sim_backend = {
+  "sim",
+  init,
+  submit
+};
+/*---------------------------------------------------------------------------*/
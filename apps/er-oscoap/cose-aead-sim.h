@@ -0,0 +1,68 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Simulated AEAD accelerator. Models a single crypto engine with a
+ *      setup latency and a per AES block latency, and doubles as a test
+ *      backend that can be told to fail jobs.
+ */
+
+#ifndef _COSE_AEAD_SIM_H
+#define _COSE_AEAD_SIM_H
+
+#include "cose-aead-backend.h"
+
+/* Latency of starting a job, in microseconds */
+#ifdef COSE_AEAD_SIM_CONF_SETUP_US
+#define COSE_AEAD_SIM_SETUP_US COSE_AEAD_SIM_CONF_SETUP_US
+#else /* COSE_AEAD_SIM_CONF_SETUP_US */
+#define COSE_AEAD_SIM_SETUP_US 50
+#endif /* COSE_AEAD_SIM_CONF_SETUP_US */
+
+/* Latency of one AES block, in microseconds */
+#ifdef COSE_AEAD_SIM_CONF_BLOCK_US
+#define COSE_AEAD_SIM_BLOCK_US COSE_AEAD_SIM_CONF_BLOCK_US
+#else /* COSE_AEAD_SIM_CONF_BLOCK_US */
+#define COSE_AEAD_SIM_BLOCK_US 4
+#endif /* COSE_AEAD_SIM_CONF_BLOCK_US */
+
+struct cose_aead_sim_stats {
+  uint32_t jobs;
+  uint32_t busy_us;
+  uint8_t max_queued;
+};
+
+extern const struct cose_aead_backend cose_aead_sim_backend;
+
+/**
+ * \brief         Makes the next jobs complete with COSE_AEAD_JOB_ERROR.
+ * \param count   Number of jobs to fail
+ */
+void cose_aead_sim_fail_next(uint8_t count);
+
+const struct cose_aead_sim_stats *cose_aead_sim_get_stats(void);
+
+#endif /* _COSE_AEAD_SIM_H */
@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      AEAD dispatch table for OSCOAP.
+ */
+
+#include "cose-aead.h"
+#include "cose-aes-ccm.h"
+#include "opt-cose.h"
+#if COSE_AEAD_WITH_CHACHA20_POLY1305
+#include "cose-chacha20-poly1305.h"
+#endif /* COSE_AEAD_WITH_CHACHA20_POLY1305 */
+#include <stddef.h>
+
+#define COSE_AES_CCM_TAG_LEN 8
+
+/*---------------------------------------------------------------------------*/
+static void
+aes_ccm_set_key(const uint8_t *key)
+{
+  COSE_AES_CCM.set_key(key);
+}
+/*---------------------------------------------------------------------------*/
+static void
+aes_ccm_16_64_128_aead(const uint8_t *nonce,
+    uint8_t *m, uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result,
+    int forward)
+{
+  COSE_AES_CCM.aead(nonce, COSE_AES_CCM_16_NONCE_LENGTH, m, m_len, a, a_len,
+      result, COSE_AES_CCM_TAG_LEN, forward);
+}
+/*---------------------------------------------------------------------------*/
+static void
+aes_ccm_64_64_128_aead(const uint8_t *nonce,
+    uint8_t *m, uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result,
+    int forward)
+{
+  COSE_AES_CCM.aead(nonce, COSE_AES_CCM_64_NONCE_LENGTH, m, m_len, a, a_len,
+      result, COSE_AES_CCM_TAG_LEN, forward);
+}
+/*---------------------------------------------------------------------------*/
+static const struct cose_aead_driver cose_aead_drivers[] = {
+  { COSE_Algorithm_AES_CCM_16_64_128, 16, COSE_AES_CCM_16_NONCE_LENGTH,
+    COSE_AES_CCM_TAG_LEN, aes_ccm_set_key, aes_ccm_16_64_128_aead },
+  { COSE_Algorithm_AES_CCM_64_64_128, 16, COSE_AES_CCM_64_NONCE_LENGTH,
+    COSE_AES_CCM_TAG_LEN, aes_ccm_set_key, aes_ccm_64_64_128_aead },
+#if COSE_AEAD_WITH_CHACHA20_POLY1305
+  { COSE_Algorithm_ChaCha20_Poly1305, CHACHA20_POLY1305_KEY_LEN,
+    CHACHA20_POLY1305_NONCE_LEN, CHACHA20_POLY1305_TAG_LEN,
+    chacha20_poly1305_set_key, chacha20_poly1305_aead },
+#endif /* COSE_AEAD_WITH_CHACHA20_POLY1305 */
+};
+
+#define COSE_AEAD_DRIVERS_NUM (sizeof(cose_aead_drivers) / sizeof(cose_aead_drivers[0]))
+/*---------------------------------------------------------------------------*/
+const struct cose_aead_driver *
+cose_aead_get(uint8_t alg)
+{
+  uint8_t i;
+
+  for(i = 0; i < COSE_AEAD_DRIVERS_NUM; i++) {
+    if(cose_aead_drivers[i].alg == alg) {
+      return &cose_aead_drivers[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+const struct cose_aead_driver *
+cose_aead_get_by_index(uint8_t i)
+{
+  if(i >= COSE_AEAD_DRIVERS_NUM) {
+    return NULL;
+  }
+  return &cose_aead_drivers[i];
+}
+/*---------------------------------------------------------------------------*/
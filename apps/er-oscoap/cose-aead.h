@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      AEAD dispatch for OSCOAP, selects the COSE content encryption algorithm
+ *      implementation by its COSE algorithm identifier.
+ */
+
+#ifndef _COSE_AEAD_H
+#define _COSE_AEAD_H
+
+#include "contiki.h"
+#include <inttypes.h>
+
+/* Software ChaCha20/Poly1305 for nodes without AES acceleration, needs 32 byte keys */
+#ifdef COSE_AEAD_CONF_WITH_CHACHA20_POLY1305
+#define COSE_AEAD_WITH_CHACHA20_POLY1305 COSE_AEAD_CONF_WITH_CHACHA20_POLY1305
+#else /* COSE_AEAD_CONF_WITH_CHACHA20_POLY1305 */
+#define COSE_AEAD_WITH_CHACHA20_POLY1305 0
+#endif /* COSE_AEAD_CONF_WITH_CHACHA20_POLY1305 */
+
+/* Upper bounds over all compiled in algorithms, used to size context and message buffers */
+#if COSE_AEAD_WITH_CHACHA20_POLY1305
+#define COSE_AEAD_MAX_KEY_LEN   32
+#define COSE_AEAD_MAX_TAG_LEN   16
+#else /* COSE_AEAD_WITH_CHACHA20_POLY1305 */
+#define COSE_AEAD_MAX_KEY_LEN   16
+#define COSE_AEAD_MAX_TAG_LEN   8
+#endif /* COSE_AEAD_WITH_CHACHA20_POLY1305 */
+#define COSE_AEAD_MAX_NONCE_LEN 13
+
+/**
+ * Structure of COSE AEAD drivers.
+ */
+struct cose_aead_driver {
+  /** COSE algorithm identifier */
+  uint8_t alg;
+  uint8_t key_len;
+  uint8_t nonce_len;
+  uint8_t tag_len;
+
+  /**
+   * \brief         Sets the key in use.
+   * \param key     The key to use, key_len bytes long.
+   */
+  void (* set_key)(const uint8_t *key);
+
+  /**
+   * \brief         Combines authentication and encryption.
+   * \param nonce   The nonce to use, nonce_len bytes long.
+   * \param m       message to encrypt or decrypt in place
+   * \param a       Additional authenticated data
+   * \param result  The generated tag, tag_len bytes, will be put here
+   * \param forward != 0 if used in forward direction.
+   */
+  void (* aead)(const uint8_t *nonce,
+      uint8_t *m, uint8_t m_len,
+      const uint8_t *a, uint8_t a_len,
+      uint8_t *result,
+      int forward);
+};
+
+/**
+ * \brief         Looks up the AEAD driver of a COSE algorithm.
+ * \param alg     COSE algorithm identifier
+ * \return        The driver, or NULL if the algorithm is not compiled in.
+ */
+const struct cose_aead_driver *cose_aead_get(uint8_t alg);
+
+/**
+ * \brief         Iterates over the compiled in AEAD drivers.
+ * \param i       Index of the driver
+ * \return        The driver, or NULL if i is past the last driver.
+ */
+const struct cose_aead_driver *cose_aead_get_by_index(uint8_t i);
+
+#endif /* _COSE_AEAD_H */
@@ -46,32 +46,30 @@
 #include "cose-aes-ccm.h"
 #include "lib/aes-128.h"
 #include <string.h>
-#include "er-oscoap.h"
 
-/* see RFC 3610 */
-#define CCM_STAR_AUTH_FLAGS(Adata, M) ((Adata ? (1u << 6) : 0) | (((M - 2u) >> 1) << 3) | 7u) //7u for the L' parameter (8 bytes counter)
-//#define CCM_STAR_AUTH_FLAGS(Adata, M) ((Adata ? (1u << 6) : 0) | (((M - 2u) >> 1) << 3) | 1u)
-#define CCM_STAR_ENCRYPTION_FLAGS     7
+/* see RFC 3610, the length field L is 15 - nonce length */
+#define CCM_STAR_AUTH_FLAGS(Adata, M, L) ((Adata ? (1u << 6) : 0) | (((M - 2u) >> 1) << 3) | (L - 1u))
+#define CCM_STAR_ENCRYPTION_FLAGS(L)     (L - 1u)
+#define CCM_STAR_L(nonce_len)            (15u - (nonce_len))
 
 /*---------------------------------------------------------------------------*/
 static void
 set_iv(uint8_t *iv,
     uint8_t flags,
-    const uint8_t *nonce,
+    const uint8_t *nonce, uint8_t nonce_len,
     uint8_t counter)
 {
   memset(iv, 0x00, AES_128_BLOCK_SIZE);
   iv[0] = flags;
-  memcpy(iv + 1, nonce, COSE_AES_CCM_NONCE_LENGTH);
-  iv[14] = 0;
+  memcpy(iv + 1, nonce, nonce_len);
   iv[15] = counter;
 }
 
 /*---------------------------------------------------------------------------*/
 /* XORs the block m[pos] ... m[pos + 15] with K_{counter} */
 static void
-ctr_step(const uint8_t *nonce,
-    uint8_t pos,
+ctr_step(const uint8_t *nonce, uint8_t nonce_len,
+    uint16_t pos,
     uint8_t *m_and_result,
     uint8_t m_len,
     uint8_t counter)
@@ -79,7 +77,7 @@ ctr_step(const uint8_t *nonce,
   uint8_t a[AES_128_BLOCK_SIZE];
   uint8_t i;
   
-  set_iv(a, CCM_STAR_ENCRYPTION_FLAGS, nonce, counter);
+  set_iv(a, CCM_STAR_ENCRYPTION_FLAGS(CCM_STAR_L(nonce_len)), nonce, nonce_len, counter);
   AES_128.encrypt(a);
   
   for(i = 0; (pos + i < m_len) && (i < AES_128_BLOCK_SIZE); i++) {
@@ -88,18 +86,18 @@ ctr_step(const uint8_t *nonce,
 }
 /*---------------------------------------------------------------------------*/
 static void
-mic(const uint8_t *nonce,
+mic(const uint8_t *nonce, uint8_t nonce_len,
     const uint8_t *m, uint8_t m_len,
     const uint8_t *a, uint8_t a_len,
     uint8_t *result,
     uint8_t mic_len)
 {
   uint8_t x[AES_128_BLOCK_SIZE];
-  uint8_t pos;
+  uint16_t pos;
   uint8_t i;
   
   
-  set_iv(x, CCM_STAR_AUTH_FLAGS(a_len, mic_len), nonce, m_len);
+  set_iv(x, CCM_STAR_AUTH_FLAGS(a_len, mic_len, CCM_STAR_L(nonce_len)), nonce, nonce_len, m_len);
   AES_128.encrypt(x);
 
   if(a_len) {
@@ -132,21 +130,21 @@ mic(const uint8_t *nonce,
     }
   }
 
-  ctr_step(nonce, 0, x, AES_128_BLOCK_SIZE, 0);
+  ctr_step(nonce, nonce_len, 0, x, AES_128_BLOCK_SIZE, 0);
   
   memcpy(result, x, mic_len);
 }
 /*---------------------------------------------------------------------------*/
 static void
-ctr(const uint8_t *nonce, uint8_t *m, uint8_t m_len)
+ctr(const uint8_t *nonce, uint8_t nonce_len, uint8_t *m, uint8_t m_len)
 {
-  uint8_t pos;
+  uint16_t pos;
   uint8_t counter;
   
   pos = 0;
   counter = 1;
   while(pos < m_len) {
-    ctr_step(nonce, pos, m, m_len, counter++);
+    ctr_step(nonce, nonce_len, pos, m, m_len, counter++);
     pos += AES_128_BLOCK_SIZE;
   }
 }
@@ -158,7 +156,7 @@ set_key(const uint8_t *key)
 }
 /*---------------------------------------------------------------------------*/
 static void
-aead(const uint8_t* nonce,
+aead(const uint8_t* nonce, uint8_t nonce_len,
     uint8_t* m, uint8_t m_len,
     const uint8_t* a, uint8_t a_len,
     uint8_t *result, uint8_t mic_len,
@@ -166,10 +164,10 @@ aead(const uint8_t* nonce,
 {
   if(!forward) {
     /* decrypt */
-    ctr(nonce, m, m_len);
+    ctr(nonce, nonce_len, m, m_len);
   }
   
-  mic(nonce,
+  mic(nonce, nonce_len,
     m, m_len,
     a, a_len,
     result,
@@ -177,7 +175,7 @@ aead(const uint8_t* nonce,
   
   if(forward) {
     /* encrypt */
-    ctr(nonce, m, m_len);
+    ctr(nonce, nonce_len, m, m_len);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -186,3 +184,103 @@ const struct cose_aes_ccm_driver cose_aes_ccm_driver = {
   aead
 };
 /*---------------------------------------------------------------------------*/
+/* States of a sliced operation, each step encrypts one AES block */
+#define OP_CTR      0
+#define OP_MIC_B0   1
+#define OP_MIC_A    2
+#define OP_MIC_M    3
+#define OP_MIC_TAG  4
+#define OP_DONE     5
+/*---------------------------------------------------------------------------*/
+void
+cose_aes_ccm_op_init(struct cose_aes_ccm_op *op, const uint8_t *key,
+    const uint8_t *nonce, uint8_t nonce_len,
+    uint8_t *m, uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result, uint8_t mic_len,
+    int forward)
+{
+  op->key = key;
+  op->nonce = nonce;
+  op->nonce_len = nonce_len;
+  op->m = m;
+  op->m_len = m_len;
+  op->a = a;
+  op->a_len = a_len;
+  op->result = result;
+  op->mic_len = mic_len;
+  op->forward = forward;
+  op->pos = 0;
+  op->counter = 1;
+  /* decryption runs CTR first, encryption last */
+  op->state = (forward || m_len == 0) ? OP_MIC_B0 : OP_CTR;
+}
+/*---------------------------------------------------------------------------*/
+static void
+op_step(struct cose_aes_ccm_op *op)
+{
+  uint8_t i;
+
+  switch(op->state) {
+  case OP_CTR:
+    ctr_step(op->nonce, op->nonce_len, op->pos, op->m, op->m_len, op->counter++);
+    op->pos += AES_128_BLOCK_SIZE;
+    if(op->pos >= op->m_len) {
+      op->pos = 0;
+      op->state = op->forward ? OP_DONE : OP_MIC_B0;
+    }
+    break;
+  case OP_MIC_B0:
+    set_iv(op->x, CCM_STAR_AUTH_FLAGS(op->a_len, op->mic_len, CCM_STAR_L(op->nonce_len)),
+        op->nonce, op->nonce_len, op->m_len);
+    AES_128.encrypt(op->x);
+    op->state = op->a_len ? OP_MIC_A : (op->m_len ? OP_MIC_M : OP_MIC_TAG);
+    break;
+  case OP_MIC_A:
+    if(op->pos == 0) {
+      op->x[1] ^= op->a_len;
+      for(i = 2; (i - 2 < op->a_len) && (i < AES_128_BLOCK_SIZE); i++) {
+        op->x[i] ^= op->a[i - 2];
+      }
+      op->pos = 14;
+    } else {
+      for(i = 0; (op->pos + i < op->a_len) && (i < AES_128_BLOCK_SIZE); i++) {
+        op->x[i] ^= op->a[op->pos + i];
+      }
+      op->pos += AES_128_BLOCK_SIZE;
+    }
+    AES_128.encrypt(op->x);
+    if(op->pos >= op->a_len) {
+      op->pos = 0;
+      op->state = op->m_len ? OP_MIC_M : OP_MIC_TAG;
+    }
+    break;
+  case OP_MIC_M:
+    for(i = 0; (op->pos + i < op->m_len) && (i < AES_128_BLOCK_SIZE); i++) {
+      op->x[i] ^= op->m[op->pos + i];
+    }
+    op->pos += AES_128_BLOCK_SIZE;
+    AES_128.encrypt(op->x);
+    if(op->pos >= op->m_len) {
+      op->pos = 0;
+      op->state = OP_MIC_TAG;
+    }
+    break;
+  case OP_MIC_TAG:
+    ctr_step(op->nonce, op->nonce_len, 0, op->x, AES_128_BLOCK_SIZE, 0);
+    memcpy(op->result, op->x, op->mic_len);
+    op->state = (op->forward && op->m_len) ? OP_CTR : OP_DONE;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+cose_aes_ccm_op_step(struct cose_aes_ccm_op *op, uint8_t blocks)
+{
+  AES_128.set_key(op->key);
+  while(blocks-- > 0 && op->state != OP_DONE) {
+    op_step(op);
+  }
+  return op->state == OP_DONE;
+}
+/*---------------------------------------------------------------------------*/
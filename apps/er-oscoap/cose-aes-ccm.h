@@ -48,12 +48,14 @@
 #include "contiki.h"
 
 #ifdef COSE_AES_CCM_CONF
-#define COSE_AES_CCM CCM_STAR_CONF
-#else /* CCM_STAR_CONF */
+#define COSE_AES_CCM COSE_AES_CCM_CONF
+#else /* COSE_AES_CCM_CONF */
 #define COSE_AES_CCM cose_aes_ccm_driver
-#endif /* CCM_STAR_CONF */
+#endif /* COSE_AES_CCM_CONF */
 
-#define COSE_AES_CCM_NONCE_LENGTH 7
+/* Nonce lengths of the COSE AES-CCM variants, the length field L is 15 - nonce length */
+#define COSE_AES_CCM_16_NONCE_LENGTH 13
+#define COSE_AES_CCM_64_NONCE_LENGTH 7
 
 /**
  * Structure of CCM* drivers.
@@ -68,14 +70,15 @@ struct cose_aes_ccm_driver {
   
   /**
    * \brief         Combines authentication and encryption.
-   * \param nonce   The nonce to use. CCM_STAR_NONCE_LENGTH bytes long.
+   * \param nonce   The nonce to use.
+   * \param nonce_len Length of the nonce, 7 to 13 bytes.
    * \param m       message to encrypt or decrypt
    * \param a       Additional authenticated data
    * \param result  The generated MIC will be put here
    * \param mic_len The size of the MIC to be generated. <= 16.
    * \param forward != 0 if used in forward direction.
    */
-  void (* aead)(const uint8_t* nonce,
+  void (* aead)(const uint8_t* nonce, uint8_t nonce_len,
       uint8_t* m, uint8_t m_len,
       const uint8_t* a, uint8_t a_len,
       uint8_t *result, uint8_t mic_len,
@@ -84,4 +87,44 @@ struct cose_aes_ccm_driver {
 
 extern const struct cose_aes_ccm_driver COSE_AES_CCM;
 
+/**
+ * State of an AES-CCM operation of cose_aes_ccm_driver that is run a few
+ * AES blocks at a time, so that long messages do not stall other processes.
+ */
+struct cose_aes_ccm_op {
+  const uint8_t *key;
+  const uint8_t *nonce;
+  const uint8_t *a;
+  uint8_t *m;
+  uint8_t *result;
+  uint8_t nonce_len;
+  uint8_t m_len;
+  uint8_t a_len;
+  uint8_t mic_len;
+  uint8_t forward;
+  uint8_t state;
+  uint8_t counter;
+  uint16_t pos;
+  uint8_t x[16];
+};
+
+/**
+ * \brief         Sets up an operation, parameters as for aead(). All buffers
+ *                must stay valid until the operation is finished.
+ */
+void cose_aes_ccm_op_init(struct cose_aes_ccm_op *op, const uint8_t *key,
+    const uint8_t *nonce, uint8_t nonce_len,
+    uint8_t *m, uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result, uint8_t mic_len,
+    int forward);
+
+/**
+ * \brief         Continues an operation. Sets the key each time, as other
+ *                users of AES_128 may have run since the last step.
+ * \param blocks  Maximum number of AES blocks to encrypt
+ * \return        Non-zero when the operation is finished.
+ */
+int cose_aes_ccm_op_step(struct cose_aes_ccm_op *op, uint8_t blocks);
+
 #endif /*  COSE_AES_CCM_H_ */
@@ -0,0 +1,360 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Software ChaCha20/Poly1305 AEAD (RFC 7539) for OSCOAP. Poly1305 uses
+ *      26 bit limbs so that only 32x32 bit multiplications are needed.
+ */
+
+#include "cose-chacha20-poly1305.h"
+#include "cose-aead.h"
+#include <string.h>
+
+#if COSE_AEAD_WITH_CHACHA20_POLY1305
+
+#define CHACHA20_BLOCK_SIZE  64
+#define POLY1305_BLOCK_SIZE  16
+#define POLY1305_LIMB_MASK   0x3ffffff
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(x, a, b, c, d) do {              \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL32(x[d], 16); \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL32(x[b], 12); \
+    x[a] += x[b]; x[d] ^= x[a]; x[d] = ROTL32(x[d], 8);  \
+    x[c] += x[d]; x[b] ^= x[c]; x[b] = ROTL32(x[b], 7);  \
+  } while(0)
+
+typedef struct {
+  uint32_t r[5];
+  uint32_t h[5];
+  uint32_t pad[4];
+} poly1305_state_t;
+
+static uint8_t chacha20_key[CHACHA20_POLY1305_KEY_LEN];
+
+/*---------------------------------------------------------------------------*/
+static uint32_t
+load32_le(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+/*---------------------------------------------------------------------------*/
+static void
+store32_le(uint8_t *p, uint32_t v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static void
+chacha20_block(const uint8_t *nonce, uint32_t counter, uint8_t *out)
+{
+  uint32_t state[16];
+  uint32_t x[16];
+  uint8_t i;
+
+  state[0] = 0x61707865;
+  state[1] = 0x3320646e;
+  state[2] = 0x79622d32;
+  state[3] = 0x6b206574;
+  for(i = 0; i < 8; i++) {
+    state[4 + i] = load32_le(&chacha20_key[4 * i]);
+  }
+  state[12] = counter;
+  state[13] = load32_le(&nonce[0]);
+  state[14] = load32_le(&nonce[4]);
+  state[15] = load32_le(&nonce[8]);
+
+  memcpy(x, state, sizeof(x));
+  for(i = 0; i < 10; i++) {
+    QUARTERROUND(x, 0, 4, 8, 12);
+    QUARTERROUND(x, 1, 5, 9, 13);
+    QUARTERROUND(x, 2, 6, 10, 14);
+    QUARTERROUND(x, 3, 7, 11, 15);
+    QUARTERROUND(x, 0, 5, 10, 15);
+    QUARTERROUND(x, 1, 6, 11, 12);
+    QUARTERROUND(x, 2, 7, 8, 13);
+    QUARTERROUND(x, 3, 4, 9, 14);
+  }
+  for(i = 0; i < 16; i++) {
+    store32_le(&out[4 * i], x[i] + state[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* XORs m with the key stream starting at block counter 1 */
+static void
+chacha20_xor(const uint8_t *nonce, uint8_t *m, uint8_t m_len)
+{
+  uint8_t block[CHACHA20_BLOCK_SIZE];
+  uint16_t pos;
+  uint8_t i;
+  uint32_t counter;
+
+  pos = 0;
+  counter = 1;
+  while(pos < m_len) {
+    chacha20_block(nonce, counter++, block);
+    for(i = 0; (pos + i < m_len) && (i < CHACHA20_BLOCK_SIZE); i++) {
+      m[pos + i] ^= block[i];
+    }
+    pos += CHACHA20_BLOCK_SIZE;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+poly1305_init(poly1305_state_t *st, const uint8_t *key)
+{
+  /* r is clamped as required by RFC 7539 */
+  st->r[0] = load32_le(&key[0]) & 0x3ffffff;
+  st->r[1] = (load32_le(&key[3]) >> 2) & 0x3ffff03;
+  st->r[2] = (load32_le(&key[6]) >> 4) & 0x3ffc0ff;
+  st->r[3] = (load32_le(&key[9]) >> 6) & 0x3f03fff;
+  st->r[4] = (load32_le(&key[12]) >> 8) & 0x00fffff;
+
+  memset(st->h, 0, sizeof(st->h));
+
+  st->pad[0] = load32_le(&key[16]);
+  st->pad[1] = load32_le(&key[20]);
+  st->pad[2] = load32_le(&key[24]);
+  st->pad[3] = load32_le(&key[28]);
+}
+/*---------------------------------------------------------------------------*/
+static void
+poly1305_block(poly1305_state_t *st, const uint8_t *m)
+{
+  uint32_t r0, r1, r2, r3, r4;
+  uint32_t s1, s2, s3, s4;
+  uint32_t h0, h1, h2, h3, h4;
+  uint64_t d0, d1, d2, d3, d4;
+  uint32_t c;
+
+  r0 = st->r[0];
+  r1 = st->r[1];
+  r2 = st->r[2];
+  r3 = st->r[3];
+  r4 = st->r[4];
+  s1 = r1 * 5;
+  s2 = r2 * 5;
+  s3 = r3 * 5;
+  s4 = r4 * 5;
+
+  h0 = st->h[0] + (load32_le(&m[0]) & POLY1305_LIMB_MASK);
+  h1 = st->h[1] + ((load32_le(&m[3]) >> 2) & POLY1305_LIMB_MASK);
+  h2 = st->h[2] + ((load32_le(&m[6]) >> 4) & POLY1305_LIMB_MASK);
+  h3 = st->h[3] + ((load32_le(&m[9]) >> 6) & POLY1305_LIMB_MASK);
+  h4 = st->h[4] + ((load32_le(&m[12]) >> 8) | (1UL << 24));
+
+  d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 +
+       (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+  d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 +
+       (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+  d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 +
+       (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+  d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 +
+       (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+  d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 +
+       (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+  c = (uint32_t)(d0 >> 26);
+  h0 = (uint32_t)d0 & POLY1305_LIMB_MASK;
+  d1 += c;
+  c = (uint32_t)(d1 >> 26);
+  h1 = (uint32_t)d1 & POLY1305_LIMB_MASK;
+  d2 += c;
+  c = (uint32_t)(d2 >> 26);
+  h2 = (uint32_t)d2 & POLY1305_LIMB_MASK;
+  d3 += c;
+  c = (uint32_t)(d3 >> 26);
+  h3 = (uint32_t)d3 & POLY1305_LIMB_MASK;
+  d4 += c;
+  c = (uint32_t)(d4 >> 26);
+  h4 = (uint32_t)d4 & POLY1305_LIMB_MASK;
+  h0 += c * 5;
+  c = h0 >> 26;
+  h0 &= POLY1305_LIMB_MASK;
+  h1 += c;
+
+  st->h[0] = h0;
+  st->h[1] = h1;
+  st->h[2] = h2;
+  st->h[3] = h3;
+  st->h[4] = h4;
+}
+/*---------------------------------------------------------------------------*/
+/* Feeds data zero padded to a multiple of the block size, as the AEAD construction does */
+static void
+poly1305_padded(poly1305_state_t *st, const uint8_t *m, uint8_t m_len)
+{
+  uint8_t block[POLY1305_BLOCK_SIZE];
+  uint16_t pos;
+
+  for(pos = 0; pos + POLY1305_BLOCK_SIZE <= m_len; pos += POLY1305_BLOCK_SIZE) {
+    poly1305_block(st, &m[pos]);
+  }
+  if(pos < m_len) {
+    memset(block, 0, POLY1305_BLOCK_SIZE);
+    memcpy(block, &m[pos], m_len - pos);
+    poly1305_block(st, block);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+poly1305_finish(poly1305_state_t *st, uint8_t *mac)
+{
+  uint32_t h0, h1, h2, h3, h4;
+  uint32_t g0, g1, g2, g3, g4;
+  uint32_t c, mask;
+  uint64_t f;
+
+  h0 = st->h[0];
+  h1 = st->h[1];
+  h2 = st->h[2];
+  h3 = st->h[3];
+  h4 = st->h[4];
+
+  /* fully carry h */
+  c = h1 >> 26;
+  h1 &= POLY1305_LIMB_MASK;
+  h2 += c;
+  c = h2 >> 26;
+  h2 &= POLY1305_LIMB_MASK;
+  h3 += c;
+  c = h3 >> 26;
+  h3 &= POLY1305_LIMB_MASK;
+  h4 += c;
+  c = h4 >> 26;
+  h4 &= POLY1305_LIMB_MASK;
+  h0 += c * 5;
+  c = h0 >> 26;
+  h0 &= POLY1305_LIMB_MASK;
+  h1 += c;
+
+  /* compute h + -p */
+  g0 = h0 + 5;
+  c = g0 >> 26;
+  g0 &= POLY1305_LIMB_MASK;
+  g1 = h1 + c;
+  c = g1 >> 26;
+  g1 &= POLY1305_LIMB_MASK;
+  g2 = h2 + c;
+  c = g2 >> 26;
+  g2 &= POLY1305_LIMB_MASK;
+  g3 = h3 + c;
+  c = g3 >> 26;
+  g3 &= POLY1305_LIMB_MASK;
+  g4 = h4 + c - (1UL << 26);
+
+  /* select h if h < p, or h + -p if h >= p, without branching */
+  mask = (g4 >> 31) - 1;
+  g0 &= mask;
+  g1 &= mask;
+  g2 &= mask;
+  g3 &= mask;
+  g4 &= mask;
+  mask = ~mask;
+  h0 = (h0 & mask) | g0;
+  h1 = (h1 & mask) | g1;
+  h2 = (h2 & mask) | g2;
+  h3 = (h3 & mask) | g3;
+  h4 = (h4 & mask) | g4;
+
+  /* h = h % 2^128 */
+  h0 = h0 | (h1 << 26);
+  h1 = (h1 >> 6) | (h2 << 20);
+  h2 = (h2 >> 12) | (h3 << 14);
+  h3 = (h3 >> 18) | (h4 << 8);
+
+  /* mac = (h + pad) % 2^128 */
+  f = (uint64_t)h0 + st->pad[0];
+  h0 = (uint32_t)f;
+  f = (uint64_t)h1 + st->pad[1] + (f >> 32);
+  h1 = (uint32_t)f;
+  f = (uint64_t)h2 + st->pad[2] + (f >> 32);
+  h2 = (uint32_t)f;
+  f = (uint64_t)h3 + st->pad[3] + (f >> 32);
+  h3 = (uint32_t)f;
+
+  store32_le(&mac[0], h0);
+  store32_le(&mac[4], h1);
+  store32_le(&mac[8], h2);
+  store32_le(&mac[12], h3);
+}
+/*---------------------------------------------------------------------------*/
+static void
+tag(const uint8_t *nonce,
+    const uint8_t *c, uint8_t c_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result)
+{
+  poly1305_state_t st;
+  uint8_t block[CHACHA20_BLOCK_SIZE];
+
+  /* the one-time Poly1305 key is the first half of key stream block 0 */
+  chacha20_block(nonce, 0, block);
+  poly1305_init(&st, block);
+
+  poly1305_padded(&st, a, a_len);
+  poly1305_padded(&st, c, c_len);
+
+  memset(block, 0, POLY1305_BLOCK_SIZE);
+  block[0] = a_len;
+  block[8] = c_len;
+  poly1305_block(&st, block);
+
+  poly1305_finish(&st, result);
+}
+/*---------------------------------------------------------------------------*/
+void
+chacha20_poly1305_set_key(const uint8_t *key)
+{
+  memcpy(chacha20_key, key, CHACHA20_POLY1305_KEY_LEN);
+}
+/*---------------------------------------------------------------------------*/
+void
+chacha20_poly1305_aead(const uint8_t *nonce,
+    uint8_t *m, uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result,
+    int forward)
+{
+  if(forward) {
+    /* encrypt */
+    chacha20_xor(nonce, m, m_len);
+  }
+
+  tag(nonce, m, m_len, a, a_len, result);
+
+  if(!forward) {
+    /* decrypt */
+    chacha20_xor(nonce, m, m_len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#endif /* COSE_AEAD_WITH_CHACHA20_POLY1305 */
@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Software ChaCha20/Poly1305 AEAD (RFC 7539) for OSCOAP, for nodes
+ *      without an AES engine.
+ */
+
+#ifndef _COSE_CHACHA20_POLY1305_H
+#define _COSE_CHACHA20_POLY1305_H
+
+#include "contiki.h"
+#include <inttypes.h>
+
+#define CHACHA20_POLY1305_KEY_LEN   32
+#define CHACHA20_POLY1305_NONCE_LEN 12
+#define CHACHA20_POLY1305_TAG_LEN   16
+
+/**
+ * \brief         Sets the key in use.
+ * \param key     The key to use, CHACHA20_POLY1305_KEY_LEN bytes long.
+ */
+void chacha20_poly1305_set_key(const uint8_t *key);
+
+/**
+ * \brief         Combines authentication and encryption.
+ * \param nonce   The nonce to use, CHACHA20_POLY1305_NONCE_LEN bytes long.
+ * \param m       message to encrypt or decrypt in place
+ * \param a       Additional authenticated data
+ * \param result  The generated tag, CHACHA20_POLY1305_TAG_LEN bytes, will be put here
+ * \param forward != 0 if used in forward direction.
+ */
+void chacha20_poly1305_aead(const uint8_t *nonce,
+    uint8_t *m, uint8_t m_len,
+    const uint8_t *a, uint8_t a_len,
+    uint8_t *result,
+    int forward);
+
+#endif /* _COSE_CHACHA20_POLY1305_H */
@@ -63,6 +63,12 @@
 #define COAP_MAX_HEADER_SIZE           (4 + COAP_TOKEN_LEN + 3 + 1 + COAP_ETAG_LEN + 4 + 4 + 30)  /* 65 */
 #endif /* COAP_MAX_HEADER_SIZE */
 
+/* Number of OSCOAP exchanges whose decryption and response encryption can run on the AEAD backend
+   (the crypto worker process by default), 0 runs the AEAD on the engine stack */
+#ifndef COAP_CRYPTO_SLOTS
+#define COAP_CRYPTO_SLOTS              1
+#endif /* COAP_CRYPTO_SLOTS */
+
 /* Number of observer slots (each takes abot xxx bytes) */
 #ifndef COAP_MAX_OBSERVERS
 #define COAP_MAX_OBSERVERS    COAP_MAX_OPEN_TRANSACTIONS - 1
@@ -122,7 +122,8 @@ typedef enum {
 
   /* Erbium hooks */
   MANUAL_RESPONSE,
-  PING_RESPONSE
+  PING_RESPONSE,
+  OSCOAP_CRYPTO_PENDING         /* AEAD job submitted to the backend */
 } coap_status_t;
 
 /* CoAP header option numbers */
@@ -42,6 +42,7 @@
 #include <string.h>
 #include "er-coap-engine.h"
 #include "er-coap.h"
+#include "er-oscoap.h"
 
 #define DEBUG 1
 #if DEBUG
@@ -62,284 +63,423 @@ PROCESS(coap_engine, "CoAP Engine");
 /*---------------------------------------------------------------------------*/
 static service_callback_t service_cbk = NULL;
 
+/* A received message waiting for its AEAD job, or the response to it
+   waiting for its encryption when transaction is set */
+typedef struct coap_crypto_slot {
+  coap_packet_t message[1];
+  coap_packet_t response[1];
+  oscoap_crypto_job_t job;
+  coap_transaction_t *transaction;
+  uip_ipaddr_t addr;
+  uint16_t port;
+  uint8_t busy;
+  uint8_t buffer[COAP_MAX_PACKET_SIZE + 1];
+} coap_crypto_slot_t;
+
+#if COAP_CRYPTO_SLOTS
+static coap_crypto_slot_t crypto_slots[COAP_CRYPTO_SLOTS];
+#endif /* COAP_CRYPTO_SLOTS */
+
 /*---------------------------------------------------------------------------*/
 /*- Internal API ------------------------------------------------------------*/
 /*---------------------------------------------------------------------------*/
+/* Handles a parsed message. Error replies are serialized into buffer, the
+   buffer the message was parsed from.
+   With a slot, an OSCOAP response is encrypted by the AEAD backend and
+   OSCOAP_CRYPTO_PENDING returned, the slot then stays busy until it is sent. */
 static int
-coap_receive(void)
+coap_handle_message(coap_packet_t *message, uint8_t *buffer,
+                    coap_crypto_slot_t *slot)
 {
-  erbium_status_code = NO_ERROR;
-
-  PRINTF("handle_incoming_data(): received uip_datalen=%u \n",
-         (uint16_t)uip_datalen());
-
   /* static declaration reduces stack peaks and program code size */
-  static coap_packet_t message[1]; /* this way the packet can be treated as pointer as usual */
-  static coap_packet_t response[1];
+  static coap_packet_t sync_response[1];
   static coap_transaction_t *transaction = NULL;
+  coap_packet_t *response = slot ? slot->response : sync_response;
+
+  if(erbium_status_code == NO_ERROR) {
+
+    /*TODO duplicates suppression, if required by application */
+
+    PRINTF("  Parsed: v %u, t %u, tkl %u, c %u, mid %u\n", message->version,
+           message->type, message->token_len, message->code, message->mid);
+    PRINTF("  URL: %.*s\n", message->uri_path_len, message->uri_path);
+    PRINTF("  Payload: %.*s\n", message->payload_len, message->payload);
+
+    /* handle requests */
+    if(message->code >= COAP_GET && message->code <= COAP_DELETE) {
+
+      /* use transaction buffer for response to confirmable request */
+      if((transaction =
+            coap_new_transaction(message->mid, message->ipaddr,
+                                 message->port))) {
+        uint32_t block_num = 0;
+        uint16_t block_size = COAP_MAX_BLOCK_SIZE;
+        uint32_t block_offset = 0;
+        int32_t new_offset = 0;
+
+        /* prepare response */
+        if(message->type == COAP_TYPE_CON) {
+          /* reliable CON requests are answered with an ACK */
+          coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05,
+                            message->mid);
+        } else {
+          /* unreliable NON requests are answered with a NON as well */
+          coap_init_message(response, COAP_TYPE_NON, CONTENT_2_05,
+                            coap_get_mid());
+          /* mirror token */
+        } if(message->token_len) {
+          coap_set_token(response, message->token, message->token_len);
+          /* get offset for blockwise transfers */
+        }
+        /* an OSCOAP response is protected with the sequence number of its request */
+        response->request_seq = message->request_seq;
+        if(coap_get_header_block2
+             (message, &block_num, NULL, &block_size, &block_offset)) {
+          PRINTF("Blockwise: block request %lu (%u/%u) @ %lu bytes\n",
+                 block_num, block_size, COAP_MAX_BLOCK_SIZE, block_offset);
+          block_size = MIN(block_size, COAP_MAX_BLOCK_SIZE);
+          new_offset = block_offset;
+        }
 
-  if(uip_newdata()) {
-
-    PRINTF("receiving UDP datagram from: ");
-    PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
-    PRINTF(":%u\n  Length: %u\n", uip_ntohs(UIP_UDP_BUF->srcport),
-           uip_datalen());
-
-    erbium_status_code =
-     oscoap_parser(message, uip_appdata, uip_datalen(), ROLE_COAP);
-
-    if(erbium_status_code == NO_ERROR) {
-
-      /*TODO duplicates suppression, if required by application */
-
-      PRINTF("  Parsed: v %u, t %u, tkl %u, c %u, mid %u\n", message->version,
-             message->type, message->token_len, message->code, message->mid);
-      PRINTF("  URL: %.*s\n", message->uri_path_len, message->uri_path);
-      PRINTF("  Payload: %.*s\n", message->payload_len, message->payload);
-
-      /* handle requests */
-      if(message->code >= COAP_GET && message->code <= COAP_DELETE) {
-
-        /* use transaction buffer for response to confirmable request */
-        if((transaction =
-              coap_new_transaction(message->mid, &UIP_IP_BUF->srcipaddr,
-                                   UIP_UDP_BUF->srcport))) {
-          uint32_t block_num = 0;
-          uint16_t block_size = COAP_MAX_BLOCK_SIZE;
-          uint32_t block_offset = 0;
-          int32_t new_offset = 0;
-
-          /* prepare response */
-          if(message->type == COAP_TYPE_CON) {
-            /* reliable CON requests are answered with an ACK */
-            coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05,
-                              message->mid);
-          } else {
-            /* unreliable NON requests are answered with a NON as well */
-            coap_init_message(response, COAP_TYPE_NON, CONTENT_2_05,
-                              coap_get_mid());
-            /* mirror token */
-          } if(message->token_len) {
-            coap_set_token(response, message->token, message->token_len);
-            /* get offset for blockwise transfers */
-          }
-          if(coap_get_header_block2
-               (message, &block_num, NULL, &block_size, &block_offset)) {
-            PRINTF("Blockwise: block request %lu (%u/%u) @ %lu bytes\n",
-                   block_num, block_size, COAP_MAX_BLOCK_SIZE, block_offset);
-            block_size = MIN(block_size, COAP_MAX_BLOCK_SIZE);
-            new_offset = block_offset;
-          }
-
-          /* invoke resource handler */
-          if(service_cbk) {
+        /* invoke resource handler */
+        if(service_cbk) {
 
-            /* call REST framework and check if found and allowed */
-            if(service_cbk
-                 (message, response, transaction->packet + COAP_MAX_HEADER_SIZE,
-                 block_size, &new_offset)) {
+          /* call REST framework and check if found and allowed */
+          if(service_cbk
+               (message, response, transaction->packet + COAP_MAX_HEADER_SIZE,
+               block_size, &new_offset)) {
 
-              if(erbium_status_code == NO_ERROR) {
+            if(erbium_status_code == NO_ERROR) {
 
-                /* TODO coap_handle_blockwise(request, response, start_offset, end_offset); */
+              /* TODO coap_handle_blockwise(request, response, start_offset, end_offset); */
 
-                /* resource is unaware of Block1 */
-                if(IS_OPTION(message, COAP_OPTION_BLOCK1)
-                   && response->code < BAD_REQUEST_4_00
-                   && !IS_OPTION(response, COAP_OPTION_BLOCK1)) {
-                  PRINTF("Block1 NOT IMPLEMENTED\n");
+              /* resource is unaware of Block1 */
+              if(IS_OPTION(message, COAP_OPTION_BLOCK1)
+                 && response->code < BAD_REQUEST_4_00
+                 && !IS_OPTION(response, COAP_OPTION_BLOCK1)) {
+                PRINTF("Block1 NOT IMPLEMENTED\n");
 
-                  erbium_status_code = NOT_IMPLEMENTED_5_01;
-                  coap_error_message = "NoBlock1Support";
+                erbium_status_code = NOT_IMPLEMENTED_5_01;
+                coap_error_message = "NoBlock1Support";
 
-                  /* client requested Block2 transfer */
-                } else if(IS_OPTION(message, COAP_OPTION_BLOCK2)) {
+                /* client requested Block2 transfer */
+              } else if(IS_OPTION(message, COAP_OPTION_BLOCK2)) {
 
-                  /* unchanged new_offset indicates that resource is unaware of blockwise transfer */
-                  if(new_offset == block_offset) {
+                /* unchanged new_offset indicates that resource is unaware of blockwise transfer */
+                if(new_offset == block_offset) {
+                  PRINTF
+                    ("Blockwise: unaware resource with payload length %u/%u\n",
+                    response->payload_len, block_size);
+                  if(block_offset >= response->payload_len) {
                     PRINTF
-                      ("Blockwise: unaware resource with payload length %u/%u\n",
-                      response->payload_len, block_size);
-                    if(block_offset >= response->payload_len) {
-                      PRINTF
-                        ("handle_incoming_data(): block_offset >= response->payload_len\n");
-
-                      response->code = BAD_OPTION_4_02;
-                      coap_set_payload(response, "BlockOutOfScope", 15); /* a const char str[] and sizeof(str) produces larger code size */
-                    } else {
-                      coap_set_header_block2(response, block_num,
-                                             response->payload_len -
-                                             block_offset > block_size,
-                                             block_size);
-                      coap_set_payload(response,
-                                       response->payload + block_offset,
-                                       MIN(response->payload_len -
-                                           block_offset, block_size));
-                    } /* if(valid offset) */
-
-                    /* resource provides chunk-wise data */
+                      ("handle_incoming_data(): block_offset >= response->payload_len\n");
+
+                    response->code = BAD_OPTION_4_02;
+                    coap_set_payload(response, "BlockOutOfScope", 15); /* a const char str[] and sizeof(str) produces larger code size */
                   } else {
-                    PRINTF("Blockwise: blockwise resource, new offset %ld\n",
-                           new_offset);
                     coap_set_header_block2(response, block_num,
-                                           new_offset != -1
-                                           || response->payload_len >
-                                           block_size, block_size);
-
-                    if(response->payload_len > block_size) {
-                      coap_set_payload(response, response->payload,
-                                       block_size);
-                    }
-                  } /* if(resource aware of blockwise) */
-
-                  /* Resource requested Block2 transfer */
-                } else if(new_offset != 0) {
-                  PRINTF
-                    ("Blockwise: no block option for blockwise resource, using block size %u\n",
-                    COAP_MAX_BLOCK_SIZE);
-
-                  coap_set_header_block2(response, 0, new_offset != -1,
-                                         COAP_MAX_BLOCK_SIZE);
-                  coap_set_payload(response, response->payload,
-                                   MIN(response->payload_len,
-                                       COAP_MAX_BLOCK_SIZE));
-                } /* blockwise transfer handling */
-              } /* no errors/hooks */
-                /* successful service callback */
-                /* serialize response */
-            }
-            if(erbium_status_code == NO_ERROR) {
-              if((transaction->packet_len = coap_serialize_message(response,
-                                                                   transaction->
-                                                                   packet)) ==
-                 0) {
-                erbium_status_code = PACKET_SERIALIZATION_ERROR;
-              }
+                                           response->payload_len -
+                                           block_offset > block_size,
+                                           block_size);
+                    coap_set_payload(response,
+                                     response->payload + block_offset,
+                                     MIN(response->payload_len -
+                                         block_offset, block_size));
+                  } /* if(valid offset) */
+
+                  /* resource provides chunk-wise data */
+                } else {
+                  PRINTF("Blockwise: blockwise resource, new offset %ld\n",
+                         new_offset);
+                  coap_set_header_block2(response, block_num,
+                                         new_offset != -1
+                                         || response->payload_len >
+                                         block_size, block_size);
+
+                  if(response->payload_len > block_size) {
+                    coap_set_payload(response, response->payload,
+                                     block_size);
+                  }
+                } /* if(resource aware of blockwise) */
+
+                /* Resource requested Block2 transfer */
+              } else if(new_offset != 0) {
+                PRINTF
+                  ("Blockwise: no block option for blockwise resource, using block size %u\n",
+                  COAP_MAX_BLOCK_SIZE);
+
+                coap_set_header_block2(response, 0, new_offset != -1,
+                                       COAP_MAX_BLOCK_SIZE);
+                coap_set_payload(response, response->payload,
+                                 MIN(response->payload_len,
+                                     COAP_MAX_BLOCK_SIZE));
+              } /* blockwise transfer handling */
+            } /* no errors/hooks */
+              /* successful service callback */
+              /* serialize response */
+          }
+          if(erbium_status_code == NO_ERROR) {
+#if COAP_CRYPTO_SLOTS
+            if(slot && IS_OPTION(response, COAP_OPTION_OBJECT_SECURITY)) {
+              /* the transaction is sent by coap_crypto_resume() */
+              slot->transaction = transaction;
+              erbium_status_code =
+                oscoap_prepare_message_start(response, &slot->job);
+            } else
+#endif /* COAP_CRYPTO_SLOTS */
+            if((transaction->packet_len = coap_serialize_message(response,
+                                                                 transaction->
+                                                                 packet)) ==
+               0) {
+              erbium_status_code = PACKET_SERIALIZATION_ERROR;
             }
-          } else {
-            erbium_status_code = NOT_IMPLEMENTED_5_01;
-            coap_error_message = "NoServiceCallbck"; /* no 'a' to fit into 16 bytes */
-          } /* if(service callback) */
+          }
         } else {
-          erbium_status_code = SERVICE_UNAVAILABLE_5_03;
-          coap_error_message = "NoFreeTraBuffer";
-        } /* if(transaction buffer) */
-
-        /* handle responses */
+          erbium_status_code = NOT_IMPLEMENTED_5_01;
+          coap_error_message = "NoServiceCallbck"; /* no 'a' to fit into 16 bytes */
+        } /* if(service callback) */
       } else {
+        erbium_status_code = SERVICE_UNAVAILABLE_5_03;
+        coap_error_message = "NoFreeTraBuffer";
+      } /* if(transaction buffer) */
 
-        if(message->type == COAP_TYPE_CON && message->code == 0) {
-          PRINTF("Received Ping\n");
-          erbium_status_code = PING_RESPONSE;
-        } else if(message->type == COAP_TYPE_ACK) {
-          /* transactions are closed through lookup below */
-          PRINTF("Received ACK\n");
-        } else if(message->type == COAP_TYPE_RST) {
-          PRINTF("Received RST\n");
-          /* cancel possible subscriptions */
-          coap_remove_observer_by_mid(&UIP_IP_BUF->srcipaddr,
-                                      UIP_UDP_BUF->srcport, message->mid);
-        }
+      /* handle responses */
+    } else {
+
+      if(message->type == COAP_TYPE_CON && message->code == 0) {
+        PRINTF("Received Ping\n");
+        erbium_status_code = PING_RESPONSE;
+      } else if(message->type == COAP_TYPE_ACK) {
+        /* transactions are closed through lookup below */
+        PRINTF("Received ACK\n");
+      } else if(message->type == COAP_TYPE_RST) {
+        PRINTF("Received RST\n");
+        /* cancel possible subscriptions */
+        coap_remove_observer_by_mid(message->ipaddr,
+                                    message->port, message->mid);
+      }
 
-        if((transaction = coap_get_transaction_by_mid(message->mid))) {
-          /* free transaction memory before callback, as it may create a new transaction */
-          restful_response_handler callback = transaction->callback;
-          void *callback_data = transaction->callback_data;
+      if((transaction = coap_get_transaction_by_mid(message->mid))) {
+        /* free transaction memory before callback, as it may create a new transaction */
+        restful_response_handler callback = transaction->callback;
+        void *callback_data = transaction->callback_data;
 
-          coap_clear_transaction(transaction);
+        coap_clear_transaction(transaction);
 
-          /* check if someone registered for the response */
-          if(callback) {
-            callback(callback_data, message);
-          }
+        /* check if someone registered for the response */
+        if(callback) {
+          callback(callback_data, message);
         }
-        /* if(ACKed transaction) */
-        transaction = NULL;
+      }
+      /* if(ACKed transaction) */
+      transaction = NULL;
 
 #if COAP_OBSERVE_CLIENT
-        /* if observe notification */
-        if((message->type == COAP_TYPE_CON || message->type == COAP_TYPE_NON)
-           && IS_OPTION(message, COAP_OPTION_OBSERVE)) {
-          PRINTF("Observe [%u]\n", message->observe);
-          coap_handle_notification(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
-                                   message);
-        }
+      /* if observe notification */
+      if((message->type == COAP_TYPE_CON || message->type == COAP_TYPE_NON)
+         && IS_OPTION(message, COAP_OPTION_OBSERVE)) {
+        PRINTF("Observe [%u]\n", message->observe);
+        coap_handle_notification(message->ipaddr, message->port,
+                                 message);
+      }
 #endif /* COAP_OBSERVE_CLIENT */
-      } /* request or response */
-    } /* parsed correctly */
+    } /* request or response */
+  } /* parsed correctly */
+
+  /* if(parsed correctly) */
+  if(erbium_status_code == NO_ERROR) {
+    if(transaction) {
+      coap_send_transaction(transaction);
+    }
+  } else if(erbium_status_code == OSCOAP_CRYPTO_PENDING) {
+    PRINTF("Encrypting response to MID %u\n", message->mid);
+  } else if(erbium_status_code == MANUAL_RESPONSE) {
+    PRINTF("Clearing transaction for manual response");
+    coap_clear_transaction(transaction);
+  } else {
+   /*
+    if(!(message->code >= COAP_GET && message->code <= COAP_DELETE) && erbium_status_code == OSCOAP_CRYPTO_ERROR) { //message is response
+      printf("ERROR IN RESPONSE %u: %s\n", erbium_status_code, coap_error_message);
+      coap_transaction_t * t = coap_get_transaction_by_mid(message->mid);
+      coap_clear_transaction(t);
+      coap_init_message(message, COAP_TYPE_ACK, NULL,
+                      message->mid);
+
+      coap_send_message(message->ipaddr, message->port,
+                      uip_appdata, coap_serialize_message(message,
+                                                          uip_appdata));
+      if(t->callback) {
+        t->callback(t->callback_data, NULL);
+      }
 
-    /* if(parsed correctly) */
-    if(erbium_status_code == NO_ERROR) {
-      if(transaction) {
-        coap_send_transaction(transaction);
+      return erbium_status_code;
+    }
+*/
+    coap_message_type_t reply_type = COAP_TYPE_ACK;
+
+    PRINTF("ERROR %u: %s\n", erbium_status_code, coap_error_message);
+    coap_clear_transaction(transaction);
+    if(slot) {
+      slot->transaction = NULL;
+    }
+
+    if(erbium_status_code == PING_RESPONSE) {
+      erbium_status_code = 0;
+      reply_type = COAP_TYPE_RST;
+    } else if(erbium_status_code >= 192) {
+      /* set to sendable error code */
+      erbium_status_code = INTERNAL_SERVER_ERROR_5_00;
+      /* reuse input buffer for error message */
+      printf("HERE!\n");
+    }
+   
+    //Respond with empty ACK
+  if(!(message->code >= COAP_GET && message->code <= COAP_DELETE)) {
+      printf("SPECIAL (OUR) CASE!!!!\n");
+      coap_transaction_t * t = coap_get_transaction_by_mid(message->mid);
+      restful_response_handler callback = t->callback;
+      void *callback_data = t->callback_data;
+      coap_clear_transaction(t);
+      
+      coap_init_message(message, COAP_TYPE_ACK, 0,
+                      message->mid);
+      coap_send_message(message->ipaddr, message->port,
+                        buffer, coap_serialize_message(message, buffer));
+      if(callback) {
+        printf("calling callback\n");
+        callback(callback_data, NULL);
       }
-    } else if(erbium_status_code == MANUAL_RESPONSE) {
-      PRINTF("Clearing transaction for manual response");
-      coap_clear_transaction(transaction);
+      return erbium_status_code;
     } else {
-     /*
-      if(!(message->code >= COAP_GET && message->code <= COAP_DELETE) && erbium_status_code == OSCOAP_CRYPTO_ERROR) { //message is response
-        printf("ERROR IN RESPONSE %u: %s\n", erbium_status_code, coap_error_message);
-        coap_transaction_t * t = coap_get_transaction_by_mid(message->mid);
-        coap_clear_transaction(t);
-        coap_init_message(message, COAP_TYPE_ACK, NULL,
-                        message->mid);
-
-        coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
-                        uip_appdata, coap_serialize_message(message,
-                                                            uip_appdata));
-        if(t->callback) {
-          t->callback(t->callback_data, NULL);
-        }
+      printf("USUAL CASE!!!\n");
+      coap_init_message(message, reply_type, erbium_status_code,
+                      message->mid);
+      coap_set_payload(message, coap_error_message,
+                     strlen(coap_error_message));
+      coap_send_message(message->ipaddr, message->port,
+                        buffer, coap_serialize_message(message, buffer));
+    }
+    
+  }
+
+  return erbium_status_code;
+}
+/*---------------------------------------------------------------------------*/
+#if COAP_CRYPTO_SLOTS
+static coap_crypto_slot_t *
+coap_crypto_slot_alloc(void)
+{
+  uint8_t i;
+
+  if(uip_datalen() > sizeof(crypto_slots[0].buffer)) {
+    return NULL;
+  }
+  for(i = 0; i < COAP_CRYPTO_SLOTS; i++) {
+    if(!crypto_slots[i].busy) {
+      return &crypto_slots[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Continues with the messages whose AEAD job is done */
+static void
+coap_crypto_resume(void)
+{
+  coap_crypto_slot_t *slot;
+  coap_transaction_t *t;
 
-        return erbium_status_code;
+  for(slot = crypto_slots; slot < &crypto_slots[COAP_CRYPTO_SLOTS]; slot++) {
+    if(!slot->busy || slot->job.aead.status == COSE_AEAD_JOB_PENDING) {
+      continue;
+    }
+    if(slot->transaction) {
+      /* response encrypted */
+      t = slot->transaction;
+      slot->transaction = NULL;
+      slot->busy = 0;
+      if((t->packet_len = oscoap_prepare_message_finish(slot->response,
+                                                        t->packet,
+                                                        &slot->job)) == 0) {
+        PRINTF("Dropping response to MID %u, encryption failed\n",
+               slot->message->mid);
+        coap_clear_transaction(t);
+      } else {
+        coap_send_transaction(t);
       }
-  */
-      coap_message_type_t reply_type = COAP_TYPE_ACK;
-
-      PRINTF("ERROR %u: %s\n", erbium_status_code, coap_error_message);
-      coap_clear_transaction(transaction);
-
-      if(erbium_status_code == PING_RESPONSE) {
-        erbium_status_code = 0;
-        reply_type = COAP_TYPE_RST;
-      } else if(erbium_status_code >= 192) {
-        /* set to sendable error code */
-        erbium_status_code = INTERNAL_SERVER_ERROR_5_00;
-        /* reuse input buffer for error message */
-        printf("HERE!\n");
+    } else {
+      /* request or response decrypted */
+      PRINTF("Resuming MID %u after AEAD job\n", slot->message->mid);
+      erbium_status_code =
+        oscoap_decode_packet_finish(slot->message, &slot->job);
+      if(coap_handle_message(slot->message, slot->buffer, slot)
+         != OSCOAP_CRYPTO_PENDING) {
+        slot->busy = 0;
       }
-     
-      //Respond with empty ACK
-    if(!(message->code >= COAP_GET && message->code <= COAP_DELETE)) {
-        printf("SPECIAL (OUR) CASE!!!!\n");
-        coap_transaction_t * t = coap_get_transaction_by_mid(message->mid);
-        restful_response_handler callback = t->callback;
-        void *callback_data = t->callback_data;
-        coap_clear_transaction(t);
-        
-        coap_init_message(message, COAP_TYPE_ACK, 0,
-                        message->mid);
-        coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
-                        uip_appdata, coap_serialize_message(message,
-                                                            uip_appdata));
-        if(callback) {
-          printf("calling callback\n");
-          callback(callback_data, NULL);
+    }
+  }
+}
+#endif /* COAP_CRYPTO_SLOTS */
+/*---------------------------------------------------------------------------*/
+static int
+coap_receive(void)
+{
+  /* static declaration reduces stack peaks and program code size */
+  static coap_packet_t message[1]; /* this way the packet can be treated as pointer as usual */
+  static uip_ipaddr_t src_addr;
+#if COAP_CRYPTO_SLOTS
+  coap_crypto_slot_t *slot;
+#endif /* COAP_CRYPTO_SLOTS */
+
+  erbium_status_code = NO_ERROR;
+
+  PRINTF("handle_incoming_data(): received uip_datalen=%u \n",
+         (uint16_t)uip_datalen());
+
+  if(uip_newdata()) {
+
+    PRINTF("receiving UDP datagram from: ");
+    PRINT6ADDR(&UIP_IP_BUF->srcipaddr);
+    PRINTF(":%u\n  Length: %u\n", uip_ntohs(UIP_UDP_BUF->srcport),
+           uip_datalen());
+
+#if COAP_CRYPTO_SLOTS
+    /* copy the datagram so that decryption can finish after uip_buf is reused */
+    if((slot = coap_crypto_slot_alloc())) {
+      slot->busy = 1;
+      slot->transaction = NULL;
+      memcpy(slot->buffer, uip_appdata, uip_datalen());
+      uip_ipaddr_copy(&slot->addr, &UIP_IP_BUF->srcipaddr);
+      slot->port = UIP_UDP_BUF->srcport;
+
+      erbium_status_code = oscoap_parser_async(slot->message, slot->buffer,
+                                               uip_datalen(), &slot->job);
+      slot->message->ipaddr = &slot->addr;
+      slot->message->port = slot->port;
+
+      if(erbium_status_code == OSCOAP_CRYPTO_PENDING) {
+        if(slot->job.aead.status == COSE_AEAD_JOB_PENDING) {
+          /* the engine is polled when the job is done */
+          return erbium_status_code;
         }
-        return;
-      } else {
-        printf("USUAL CASE!!!\n");
-        coap_init_message(message, reply_type, erbium_status_code,
-                        message->mid);
-        coap_set_payload(message, coap_error_message,
-                       strlen(coap_error_message));
-        coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
-                        uip_appdata, coap_serialize_message(message,
-                                                            uip_appdata));
+        erbium_status_code =
+          oscoap_decode_packet_finish(slot->message, &slot->job);
       }
-      
+      if(coap_handle_message(slot->message, slot->buffer, slot)
+         != OSCOAP_CRYPTO_PENDING) {
+        slot->busy = 0;
+      }
+      return erbium_status_code;
     }
+#endif /* COAP_CRYPTO_SLOTS */
+
+    erbium_status_code =
+     oscoap_parser(message, uip_appdata, uip_datalen(), ROLE_COAP);
+    uip_ipaddr_copy(&src_addr, &UIP_IP_BUF->srcipaddr);
+    message->ipaddr = &src_addr;
+    message->port = UIP_UDP_BUF->srcport;
+
+    coap_handle_message(message, uip_appdata, NULL);
   }
 
   /* if(new data) */
@@ -384,6 +524,7 @@ PROCESS_THREAD(coap_engine, ev, data)
 
   coap_register_as_transaction_handler();
   coap_init_connection(SERVER_LISTEN_PORT);
+  cose_aead_backend_init();
 
   while(1) {
     PROCESS_YIELD();
@@ -393,6 +534,11 @@ PROCESS_THREAD(coap_engine, ev, data)
     } else if(ev == PROCESS_EVENT_TIMER) {
       /* retransmissions are handled here */
       coap_check_transactions();
+#if COAP_CRYPTO_SLOTS
+    } else if(ev == PROCESS_EVENT_POLL) {
+      /* the AEAD backend finished a job */
+      coap_crypto_resume();
+#endif /* COAP_CRYPTO_SLOTS */
     }
   } /* while (1) */
 
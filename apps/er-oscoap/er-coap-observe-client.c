@@ -70,9 +70,23 @@
 #define PRINTLLADDR(addr)
 #endif
 
+/* The client process delivers coalesced notifications and refreshes
+   registrations, it is only needed if either is enabled */
+#define WITH_CLIENT_PROCESS (COAP_OBS_CLIENT_COALESCE \
+                             || COAP_OBS_CLIENT_REFRESH_INTERVAL > 0)
+
 MEMB(obs_subjects_memb, coap_observee_t, COAP_MAX_OBSERVEES);
 LIST(obs_subjects_list);
 
+static struct coap_obs_client_stats stats;
+
+#if WITH_CLIENT_PROCESS
+PROCESS(coap_obs_client_process, "CoAP observe client");
+#endif /* WITH_CLIENT_PROCESS */
+
+static int send_registration(coap_observee_t *obs,
+                             restful_response_handler callback);
+
 /*----------------------------------------------------------------------------*/
 static size_t
 get_token(void *packet, const uint8_t **token)
@@ -95,6 +109,20 @@ set_token(void *packet, const uint8_t *token, size_t token_len)
   return coap_pkt->token_len;
 }
 /*----------------------------------------------------------------------------*/
+static int
+is_observee(coap_observee_t *o)
+{
+  coap_observee_t *obs;
+
+  for(obs = (coap_observee_t *)list_head(obs_subjects_list); obs;
+      obs = obs->next) {
+    if(obs == o) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*----------------------------------------------------------------------------*/
 coap_observee_t *
 coap_obs_add_observee(uip_ipaddr_t *addr, uint16_t port,
                       const uint8_t *token, size_t token_len, const char *url,
@@ -107,18 +135,23 @@ coap_obs_add_observee(uip_ipaddr_t *addr, uint16_t port,
   coap_obs_remove_observee_by_url(addr, port, url);
   o = memb_alloc(&obs_subjects_memb);
   if(o) {
+    memset(o, 0, sizeof(coap_observee_t));
     o->url = url;
     uip_ipaddr_copy(&o->addr, addr);
     o->port = port;
     o->token_len = token_len;
     memcpy(o->token, token, token_len);
-    /* o->last_mid = 0; */
     o->notification_callback = notification_callback;
     o->data = data;
-    /* stimer_set(&o->refresh_timer, COAP_OBSERVING_REFRESH_INTERVAL); */
+    o->registered = clock_seconds();
     PRINTF("Adding obs_subject for /%s [0x%02X%02X]\n", o->url, o->token[0],
            o->token[1]);
     list_add(obs_subjects_list, o);
+#if WITH_CLIENT_PROCESS
+    if(!process_is_running(&coap_obs_client_process)) {
+      process_start(&coap_obs_client_process, NULL);
+    }
+#endif /* WITH_CLIENT_PROCESS */
   }
 
   return o;
@@ -129,8 +162,12 @@ coap_obs_remove_observee(coap_observee_t *o)
 {
   PRINTF("Removing obs_subject for /%s [0x%02X%02X]\n", o->url, o->token[0],
          o->token[1]);
-  memb_free(&obs_subjects_memb, o);
+  if(o->context) {
+    /* drop the registration sequence number kept for the notifications */
+    remove_seq_from_token(o->token, o->token_len);
+  }
   list_remove(obs_subjects_list, o);
+  memb_free(&obs_subjects_memb, o);
 }
 /*----------------------------------------------------------------------------*/
 coap_observee_t *
@@ -149,7 +186,6 @@ coap_get_obs_subject_by_token(const uint8_t *token, size_t token_len)
 
   return NULL;
 }
-/*----------------------------------------------------------------------------*/
 int
 coap_obs_remove_observee_by_token(uip_ipaddr_t *addr, uint16_t port,
                                   uint8_t *token, size_t token_len)
@@ -228,6 +264,59 @@ classify_notification(void *response, int first)
   return NOTIFICATION_OK;
 }
 /*----------------------------------------------------------------------------*/
+static int
+is_fresh(coap_observee_t *obs, uint32_t v2)
+{
+  uint32_t v1 = obs->last_observe;
+
+  /* RFC 7641, Section 3.4: Observe values are 24-bit serial numbers, and
+     after 128 seconds any notification is newer than the last one */
+  return (v1 < v2 && v2 - v1 < (1UL << 23))
+         || (v1 > v2 && v1 - v2 > (1UL << 23))
+         || clock_seconds() > obs->last_notification + 128;
+}
+/*----------------------------------------------------------------------------*/
+static void
+update_freshness(coap_observee_t *obs, coap_packet_t *notification)
+{
+  coap_get_header_observe(notification, &obs->last_observe);
+  obs->last_notification = clock_seconds();
+}
+/*----------------------------------------------------------------------------*/
+static void
+deliver(coap_observee_t *obs, coap_packet_t *notification,
+        coap_notification_flag_t flag)
+{
+#if COAP_OBS_CLIENT_COALESCE
+  if(flag == NOTIFICATION_OK
+     && notification->payload_len <= COAP_OBS_CLIENT_PAYLOAD_LEN) {
+    /* latest value wins, the process hands it to the application */
+    if(obs->pending) {
+      stats.coalesced++;
+    }
+    obs->pending = 1;
+    obs->pending_type = notification->type;
+    obs->pending_code = notification->code;
+    obs->pending_content_format = -1;
+    if(IS_OPTION(notification, COAP_OPTION_CONTENT_FORMAT)) {
+      obs->pending_content_format = notification->content_format;
+    }
+    obs->pending_len = notification->payload_len;
+    memcpy(obs->pending_payload, notification->payload,
+           notification->payload_len);
+    process_poll(&coap_obs_client_process);
+    return;
+  }
+  if(obs->pending) {
+    /* superseded by this one */
+    obs->pending = 0;
+    stats.coalesced++;
+  }
+#endif /* COAP_OBS_CLIENT_COALESCE */
+  stats.delivered++;
+  obs->notification_callback(obs, notification, flag);
+}
+/*----------------------------------------------------------------------------*/
 void
 coap_handle_notification(uip_ipaddr_t *addr, uint16_t port,
                          coap_packet_t *notification)
@@ -259,19 +348,19 @@ coap_handle_notification(uip_ipaddr_t *addr, uint16_t port,
   if(notification->type == COAP_TYPE_CON) {
     simple_reply(COAP_TYPE_ACK, addr, port, notification);
   }
+  stats.received++;
   if(obs->notification_callback != NULL) {
     flag = classify_notification(notification, 0);
-    /* TODO: the following mechanism for discarding duplicates is too trivial */
-    /* refer to Observe RFC for a better solution */
     if(flag == NOTIFICATION_OK) {
       coap_get_header_observe(notification, &observe);
-      if(observe == obs->last_observe) {
-        PRINTF("Discarding duplicate\n");
+      if(!is_fresh(obs, observe)) {
+        PRINTF("Discarding stale notification %lu\n", (unsigned long)observe);
+        stats.duplicates++;
         return;
       }
-      obs->last_observe = observe;
+      update_freshness(obs, notification);
     }
-    obs->notification_callback(obs, notification, flag);
+    deliver(obs, notification, flag);
   }
 }
 /*----------------------------------------------------------------------------*/
@@ -284,9 +373,17 @@ handle_obs_registration_response(void *data, void *response)
 
   PRINTF("handle_obs_registration_response(): ");
   obs = (coap_observee_t *)data;
+  if(!is_observee(obs)) {
+    /* removed while the registration was in flight */
+    return;
+  }
   notification_callback = obs->notification_callback;
   flag = classify_notification(response, 1);
+  if(flag == OBSERVE_OK) {
+    update_freshness(obs, (coap_packet_t *)response);
+  }
   if(notification_callback) {
+    stats.delivered++;
     notification_callback(obs, response, flag);
   }
   if(flag != OBSERVE_OK) {
@@ -294,89 +391,248 @@ handle_obs_registration_response(void *data, void *response)
   }
 }
 /*----------------------------------------------------------------------------*/
+#if COAP_OBS_CLIENT_REFRESH_INTERVAL > 0
+static void
+handle_obs_refresh_response(void *data, void *response)
+{
+  coap_observee_t *obs;
+  coap_notification_flag_t flag;
+
+  obs = (coap_observee_t *)data;
+  if(!is_observee(obs)) {
+    return;
+  }
+  obs->refreshing = 0;
+  flag = classify_notification(response, 0);
+  if(flag != NOTIFICATION_OK) {
+    PRINTF("Refresh of /%s failed\n", obs->url);
+    if(obs->notification_callback) {
+      stats.delivered++;
+      obs->notification_callback(obs, response, flag);
+    }
+    coap_obs_remove_observee(obs);
+    return;
+  }
+  obs->registered = clock_seconds();
+  stats.received++;
+  /* the response is the current state and restarts the Observe sequence */
+  update_freshness(obs, (coap_packet_t *)response);
+  if(obs->notification_callback) {
+    deliver(obs, (coap_packet_t *)response, flag);
+  }
+}
+/*----------------------------------------------------------------------------*/
+static int
+refresh_batch(coap_observee_t *due, unsigned long now)
+{
+  coap_observee_t *obs;
+  int sent = 0;
+
+  /* share the radio wake-up with the other observees of this server that
+     would become due soon */
+  for(obs = (coap_observee_t *)list_head(obs_subjects_list); obs;
+      obs = obs->next) {
+    if(!obs->refreshing
+       && obs->port == due->port
+       && uip_ipaddr_cmp(&obs->addr, &due->addr)
+       && now - obs->registered + COAP_OBS_CLIENT_REFRESH_WINDOW
+       >= COAP_OBS_CLIENT_REFRESH_INTERVAL) {
+      if(!send_registration(obs, handle_obs_refresh_response)) {
+        /* out of transactions, retried with the next check */
+        break;
+      }
+      obs->refreshing = 1;
+      stats.reregistrations++;
+      sent++;
+    }
+  }
+  if(sent) {
+    stats.batches++;
+  }
+  return sent;
+}
+/*----------------------------------------------------------------------------*/
+static clock_time_t
+refresh_due(void)
+{
+  coap_observee_t *obs;
+  unsigned long now;
+  unsigned long next;
+  unsigned long age;
+
+  now = clock_seconds();
+  for(obs = (coap_observee_t *)list_head(obs_subjects_list); obs;
+      obs = obs->next) {
+    if(!obs->refreshing
+       && now - obs->registered >= COAP_OBS_CLIENT_REFRESH_INTERVAL) {
+      refresh_batch(obs, now);
+    }
+  }
+
+  next = COAP_OBS_CLIENT_REFRESH_INTERVAL;
+  for(obs = (coap_observee_t *)list_head(obs_subjects_list); obs;
+      obs = obs->next) {
+    if(!obs->refreshing) {
+      age = now - obs->registered;
+      if(age >= COAP_OBS_CLIENT_REFRESH_INTERVAL) {
+        next = 1;
+      } else if(COAP_OBS_CLIENT_REFRESH_INTERVAL - age < next) {
+        next = COAP_OBS_CLIENT_REFRESH_INTERVAL - age;
+      }
+    }
+  }
+  return next * CLOCK_SECOND;
+}
+#endif /* COAP_OBS_CLIENT_REFRESH_INTERVAL > 0 */
+/*----------------------------------------------------------------------------*/
+#if COAP_OBS_CLIENT_COALESCE
+static int
+deliver_pending(void)
+{
+  static coap_packet_t notification[1];
+  coap_observee_t *obs;
+  int delivered = 0;
+
+  obs = (coap_observee_t *)list_head(obs_subjects_list);
+  while(obs) {
+    if(!obs->pending) {
+      obs = obs->next;
+      continue;
+    }
+    obs->pending = 0;
+    coap_init_message(notification, obs->pending_type, obs->pending_code, 0);
+    set_token(notification, obs->token, obs->token_len);
+    coap_set_header_observe(notification, obs->last_observe);
+    if(obs->pending_content_format != (uint16_t)-1) {
+      coap_set_header_content_format(notification,
+                                     obs->pending_content_format);
+    }
+    coap_set_payload(notification, obs->pending_payload, obs->pending_len);
+    notification->context = obs->context;
+    stats.delivered++;
+    delivered++;
+    obs->notification_callback(obs, notification, NOTIFICATION_OK);
+    /* the callback may have changed the list */
+    obs = (coap_observee_t *)list_head(obs_subjects_list);
+  }
+  return delivered;
+}
+#endif /* COAP_OBS_CLIENT_COALESCE */
+/*----------------------------------------------------------------------------*/
+#if WITH_CLIENT_PROCESS
+PROCESS_THREAD(coap_obs_client_process, ev, data)
+{
+#if COAP_OBS_CLIENT_COALESCE
+  static struct etimer delivery_timer;
+#endif
+#if COAP_OBS_CLIENT_REFRESH_INTERVAL > 0
+  static struct etimer refresh_timer;
+#endif
+
+  PROCESS_BEGIN();
+
+#if COAP_OBS_CLIENT_REFRESH_INTERVAL > 0
+  etimer_set(&refresh_timer, COAP_OBS_CLIENT_REFRESH_INTERVAL * CLOCK_SECOND);
+#endif
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+#if COAP_OBS_CLIENT_COALESCE
+    if((ev == PROCESS_EVENT_POLL && etimer_expired(&delivery_timer))
+       || (ev == PROCESS_EVENT_TIMER && data == &delivery_timer)) {
+      if(deliver_pending() && COAP_OBS_CLIENT_MIN_INTERVAL > 0) {
+        etimer_set(&delivery_timer, COAP_OBS_CLIENT_MIN_INTERVAL);
+      }
+    }
+#endif /* COAP_OBS_CLIENT_COALESCE */
+#if COAP_OBS_CLIENT_REFRESH_INTERVAL > 0
+    if(ev == PROCESS_EVENT_TIMER && data == &refresh_timer) {
+      etimer_set(&refresh_timer, refresh_due());
+    }
+#endif /* COAP_OBS_CLIENT_REFRESH_INTERVAL > 0 */
+  }
+
+  PROCESS_END();
+}
+#endif /* WITH_CLIENT_PROCESS */
+/*----------------------------------------------------------------------------*/
+const struct coap_obs_client_stats *
+coap_obs_client_get_stats(void)
+{
+  return &stats;
+}
+/*----------------------------------------------------------------------------*/
 uint8_t
 coap_generate_token(uint8_t **token_ptr)
 {
   static uint8_t token = 0;
 
-  token++;
-  /* FIXME: we should check that this token is not already used */
+  /* skip tokens still in use by an observe relationship */
+  do {
+    token++;
+  } while(coap_get_obs_subject_by_token(&token, sizeof(token)) != NULL
+          && list_length(obs_subjects_list) < 256);
   *token_ptr = (uint8_t *)&token;
   return sizeof(token);
 }
 /*----------------------------------------------------------------------------*/
-coap_observee_t *
-coap_obs_request_registration(uip_ipaddr_t *addr, uint16_t port, char *uri,
-                              notification_callback_t notification_callback,
-                              void *data)
+static int
+send_registration(coap_observee_t *obs, restful_response_handler callback)
 {
   coap_packet_t request[1];
   coap_transaction_t *t;
-  uint8_t *token;
-  uint8_t token_len;
-  coap_observee_t *obs;
 
-  obs = NULL;
-  coap_init_message(request, COAP_TYPE_CON, COAP_GET, coap_get_mid());
-  coap_set_header_uri_path(request, uri);
-  coap_set_header_observe(request, 0);
-  token_len = coap_generate_token(&token);
-  set_token(request, token, token_len);
-  t = coap_new_transaction(request->mid, addr, port);
-  if(t) {
-    obs = coap_obs_add_observee(addr, port, (uint8_t *)token, token_len, uri,
-                                notification_callback, data);
-    if(obs) {
-      t->callback = handle_obs_registration_response;
-      t->callback_data = obs;
-      t->packet_len = coap_serialize_message(request, t->packet);
-      coap_send_transaction(t);
-    } else {
-      PRINTF("Could not allocate obs_subject resource buffer");
-      coap_clear_transaction(t);
-    }
-  } else {
+  t = coap_new_transaction(coap_get_mid(), &obs->addr, obs->port);
+  if(!t) {
     PRINTF("Could not allocate transaction buffer");
+    return 0;
   }
-  return obs;
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, t->mid);
+  coap_set_header_uri_path(request, obs->url);
+  coap_set_header_observe(request, 0);
+  set_token(request, obs->token, obs->token_len);
+  if(obs->context) {
+    request->context = obs->context;
+    coap_set_header_object_security(request);
+    /* a re-registration replaces the sequence number of the previous one */
+    remove_seq_from_token(obs->token, obs->token_len);
+  }
+  t->callback = callback;
+  t->callback_data = obs;
+  t->packet_len = coap_serialize_message(request, t->packet);
+  coap_send_transaction(t);
+  return 1;
 }
-
+/*----------------------------------------------------------------------------*/
+coap_observee_t *
+coap_obs_request_registration(uip_ipaddr_t *addr, uint16_t port, char *uri,
+                              notification_callback_t notification_callback,
+                              void *data)
+{
+  return oscoap_obs_request_registration(addr, port, uri,
+                                         notification_callback, data, NULL);
+}
+/*----------------------------------------------------------------------------*/
 coap_observee_t *
 oscoap_obs_request_registration(uip_ipaddr_t *addr, uint16_t port, char *uri,
                               notification_callback_t notification_callback,
                               void *data, oscoap_ctx_t* ctx)
 {
-  coap_packet_t request[1];
-  coap_transaction_t *t;
   uint8_t *token;
   uint8_t token_len;
   coap_observee_t *obs;
 
-  obs = NULL;
-  coap_init_message(request, COAP_TYPE_CON, COAP_GET, coap_get_mid());
-  coap_set_header_uri_path(request, uri);
-  coap_set_header_observe(request, 0);
-  request->context = ctx;
-
-  coap_set_header_object_security(request); //Seting OSCOAP option here
   token_len = coap_generate_token(&token);
-  set_token(request, token, token_len);
-
-  t = coap_new_transaction(request->mid, addr, port);
-  if(t) {
-    obs = coap_obs_add_observee(addr, port, (uint8_t *)token, token_len, uri,
-                                notification_callback, data);
-    if(obs) {
-      t->callback = handle_obs_registration_response;
-      t->callback_data = obs;
-      t->packet_len = coap_serialize_message(request, t->packet);
-      coap_send_transaction(t);
-    } else {
-      PRINTF("Could not allocate obs_subject resource buffer");
-      coap_clear_transaction(t);
-    }
-  } else {
-    PRINTF("Could not allocate transaction buffer");
+  obs = coap_obs_add_observee(addr, port, (uint8_t *)token, token_len, uri,
+                              notification_callback, data);
+  if(!obs) {
+    PRINTF("Could not allocate obs_subject resource buffer");
+    return NULL;
+  }
+  obs->context = ctx;
+  if(!send_registration(obs, handle_obs_registration_response)) {
+    coap_obs_remove_observee(obs);
+    return NULL;
   }
   return obs;
 }
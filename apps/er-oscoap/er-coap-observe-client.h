@@ -58,6 +58,44 @@
   "this may be a problem"
 #endif
 
+/* Coalesce notifications that arrive before the application consumed the
+   previous one: only the latest value per observee is delivered */
+#ifdef COAP_OBS_CLIENT_CONF_COALESCE
+#define COAP_OBS_CLIENT_COALESCE COAP_OBS_CLIENT_CONF_COALESCE
+#else
+#define COAP_OBS_CLIENT_COALESCE 0
+#endif /* COAP_OBS_CLIENT_CONF_COALESCE */
+
+/* Payload kept per observee for a pending notification, larger ones are
+   delivered immediately */
+#ifdef COAP_OBS_CLIENT_CONF_PAYLOAD_LEN
+#define COAP_OBS_CLIENT_PAYLOAD_LEN COAP_OBS_CLIENT_CONF_PAYLOAD_LEN
+#else
+#define COAP_OBS_CLIENT_PAYLOAD_LEN 16
+#endif /* COAP_OBS_CLIENT_CONF_PAYLOAD_LEN */
+
+/* Minimum time between two deliveries, models a slow consumer */
+#ifdef COAP_OBS_CLIENT_CONF_MIN_INTERVAL
+#define COAP_OBS_CLIENT_MIN_INTERVAL COAP_OBS_CLIENT_CONF_MIN_INTERVAL
+#else
+#define COAP_OBS_CLIENT_MIN_INTERVAL 0
+#endif /* COAP_OBS_CLIENT_CONF_MIN_INTERVAL */
+
+/* Re-register every observee after this many seconds, 0 disables */
+#ifdef COAP_OBS_CLIENT_CONF_REFRESH_INTERVAL
+#define COAP_OBS_CLIENT_REFRESH_INTERVAL COAP_OBS_CLIENT_CONF_REFRESH_INTERVAL
+#else
+#define COAP_OBS_CLIENT_REFRESH_INTERVAL 0
+#endif /* COAP_OBS_CLIENT_CONF_REFRESH_INTERVAL */
+
+/* Observees of the same server that are due within this many seconds are
+   re-registered in the same burst */
+#ifdef COAP_OBS_CLIENT_CONF_REFRESH_WINDOW
+#define COAP_OBS_CLIENT_REFRESH_WINDOW COAP_OBS_CLIENT_CONF_REFRESH_WINDOW
+#else
+#define COAP_OBS_CLIENT_REFRESH_WINDOW (COAP_OBS_CLIENT_REFRESH_INTERVAL / 4)
+#endif /* COAP_OBS_CLIENT_CONF_REFRESH_WINDOW */
+
 #define IS_RESPONSE_CODE_2_XX(message) (64 < message->code \
                                         && message->code < 128)
 
@@ -87,6 +125,27 @@ struct coap_observee_s {
   void *data;                   /* generic pointer for storing user data */
   notification_callback_t notification_callback;
   uint32_t last_observe;
+  unsigned long last_notification;  /* clock_seconds() of last_observe */
+  unsigned long registered;         /* clock_seconds() of last registration */
+  uint8_t refreshing;
+  oscoap_ctx_t *context;            /* NULL for unprotected registrations */
+#if COAP_OBS_CLIENT_COALESCE
+  uint8_t pending;
+  uint8_t pending_type;
+  uint8_t pending_code;
+  uint16_t pending_content_format;
+  uint16_t pending_len;
+  uint8_t pending_payload[COAP_OBS_CLIENT_PAYLOAD_LEN];
+#endif /* COAP_OBS_CLIENT_COALESCE */
+};
+
+struct coap_obs_client_stats {
+  uint32_t received;        /* notifications that matched an observee */
+  uint32_t delivered;       /* notification callbacks */
+  uint32_t coalesced;       /* replaced by a newer value before delivery */
+  uint32_t duplicates;      /* stale or reordered notifications */
+  uint32_t reregistrations; /* refresh requests sent */
+  uint32_t batches;         /* refresh bursts */
 };
 
 /*----------------------------------------------------------------------------*/
@@ -122,6 +181,8 @@ coap_observee_t *oscoap_obs_request_registration(uip_ipaddr_t *addr,
                                                notification_callback,
                                                void *data, oscoap_ctx_t* ctx);
 
+const struct coap_obs_client_stats *coap_obs_client_get_stats(void);
+
 /* TODO: this function may be moved to er-coap.c */
 uint8_t coap_generate_token(uint8_t **token_ptr);
 
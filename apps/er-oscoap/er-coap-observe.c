@@ -39,6 +39,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "er-coap-observe.h"
+#include "er-oscoap.h"
 
 #define DEBUG 0
 #if DEBUG
@@ -192,6 +193,8 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
   coap_packet_t notification[1]; /* this way the packet can be treated as pointer as usual */
   coap_packet_t request[1]; /* this way the packet can be treated as pointer as usual */
   coap_observer_t *obs = NULL;
+  coap_observer_t *next;
+  oscoap_ctx_t *context;
   int url_len, obs_url_len;
   char url[COAP_OBSERVER_URL_LEN];
 
@@ -212,8 +215,8 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
 
   /* iterate over observers */
   url_len = strlen(url);
-  for(obs = (coap_observer_t *)list_head(observers_list); obs;
-      obs = obs->next) {
+  for(obs = (coap_observer_t *)list_head(observers_list); obs; obs = next) {
+    next = obs->next;
     obs_url_len = strlen(obs->url);
 
     /* Do a match based on the parent/sub-resource match so that it is
@@ -225,6 +228,17 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
        && strncmp(url, obs->url, url_len) == 0) {
       coap_transaction_t *transaction = NULL;
 
+      context = NULL;
+      if(obs->context_id) {
+        context = oscoap_find_ctx_by_id(obs->context_id);
+        if(context == NULL) {
+          /* the context was freed, its slot may hold another peer's keys */
+          PRINTF("Observe: context gone, removing observer\n");
+          coap_remove_observer(obs);
+          continue;
+        }
+      }
+
       /*TODO implement special transaction for CON, sharing the same buffer to allow for more observers */
 
       if((transaction = coap_new_transaction(coap_get_mid(), &obs->addr, obs->port))) {
@@ -239,13 +253,13 @@ coap_notify_observers_sub(resource_t *resource, const char *subpath)
 
         /* update last MID for RST matching */
         obs->last_mid = transaction->mid;
-        printf("OBSERVE TOKEN!!!\n");
-        oscoap_printf_hex(obs->token, obs->token_len);
-        uint32_t seq;
-        if(get_seq_from_token(obs->token, obs->token_len, &seq)){
-          oscoap_ctx_t* ctx = oscoap_find_ctx_by_token(obs->token, obs->token_len);
-          notification->context = ctx;
+        /* protect like the response to the registration */
+        if(context) {
           coap_set_header_object_security(notification);
+          notification->context = context;
+          notification->request_seq = obs->request_seq;
+        } else {
+          CLEAR_OPTION(notification, COAP_OPTION_OBJECT_SECURITY);
         }
         /* prepare response */
         notification->mid = transaction->mid;
@@ -279,10 +293,17 @@ coap_observe_handler(resource_t *resource, void *request, void *response)
   if(coap_req->code == COAP_GET && coap_res->code < 128) { /* GET request and response without error code */
     if(IS_OPTION(coap_req, COAP_OPTION_OBSERVE)) {
       if(coap_req->observe == 0) {
-        obs = add_observer(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
+        obs = add_observer(coap_req->ipaddr, coap_req->port,
                            coap_req->token, coap_req->token_len,
                            coap_req->uri_path, coap_req->uri_path_len);
        if(obs) {
+          if(IS_OPTION(coap_req, COAP_OPTION_OBJECT_SECURITY)
+             && coap_req->context != NULL) {
+            obs->context_id = coap_req->context->id;
+            obs->request_seq = coap_req->request_seq;
+          } else {
+            obs->context_id = 0;
+          }
           coap_set_header_observe(coap_res, (obs->obs_counter)++);
           /*
            * Following payload is for demonstration purposes only.
@@ -304,8 +325,8 @@ coap_observe_handler(resource_t *resource, void *request, void *response)
       } else if(coap_req->observe == 1) {
 
         /* remove client if it is currently observe */
-        coap_remove_observer_by_token(&UIP_IP_BUF->srcipaddr,
-                                      UIP_UDP_BUF->srcport, coap_req->token,
+        coap_remove_observer_by_token(coap_req->ipaddr,
+                                      coap_req->port, coap_req->token,
                                       coap_req->token_len);
       }
     }
@@ -67,6 +67,11 @@ typedef struct coap_observer {
 
   struct etimer retrans_timer;
   uint8_t retrans_counter;
+
+  /* OSCOAP context id and registration sequence number, the id is 0 if
+     the registration was not protected */
+  uint16_t context_id;
+  uint32_t request_seq;
 } coap_observer_t;
 
 list_t coap_get_observers(void);
@@ -100,7 +100,7 @@ coap_separate_accept(void *request, coap_separate_t *separate_store)
       /* ACK with empty code (0) */
       coap_init_message(ack, COAP_TYPE_ACK, 0, coap_req->mid);
       /* serializing into IPBUF: Only overwrites header parts that are already parsed into the request struct */
-      coap_send_message(&UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport,
+      coap_send_message(coap_req->ipaddr, coap_req->port,
                         (uip_appdata), coap_serialize_message(ack,
                                                               uip_appdata));
     }
@@ -123,6 +123,15 @@ coap_separate_accept(void *request, coap_separate_t *separate_store)
     separate_store->block2_num = coap_req->block2_num;
     separate_store->block2_size = coap_req->block2_size > 0 ? MIN(COAP_MAX_BLOCK_SIZE, coap_req->block2_size) : COAP_MAX_BLOCK_SIZE;
 
+    /* the response nonce is derived from the request sequence number */
+    if(IS_OPTION(coap_req, COAP_OPTION_OBJECT_SECURITY)
+       && coap_req->context != NULL) {
+      separate_store->context_id = coap_req->context->id;
+      separate_store->request_seq = coap_req->request_seq;
+    } else {
+      separate_store->context_id = 0;
+    }
+
     /* signal the engine to skip automatic response and clear transaction by engine */
     erbium_status_code = MANUAL_RESPONSE;
   } else {
@@ -145,5 +154,13 @@ coap_separate_resume(void *response, coap_separate_t *separate_store,
     coap_set_header_block1(response, separate_store->block1_num,
                            0, separate_store->block1_size);
   }
+  if(separate_store->context_id) {
+    /* if the context was freed, the response stays without one and is not
+       serialized, rather than protected with another peer's keys */
+    coap_set_header_object_security(response);
+    ((coap_packet_t *)response)->context =
+      oscoap_find_ctx_by_id(separate_store->context_id);
+    ((coap_packet_t *)response)->request_seq = separate_store->request_seq;
+  }
 }
 /*---------------------------------------------------------------------------*/
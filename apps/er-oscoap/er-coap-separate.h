@@ -57,6 +57,11 @@ typedef struct coap_separate {
 
   uint32_t block2_num;
   uint16_t block2_size;
+
+  /* OSCOAP context id and request sequence number, the id is 0 if the
+     request was not protected */
+  uint16_t context_id;
+  uint32_t request_seq;
 } coap_separate_t;
 
 int coap_separate_handler(resource_t *resource, void *request,
@@ -75,6 +75,9 @@ coap_new_transaction(uint16_t mid, uip_ipaddr_t *addr, uint16_t port)
   if(t) {
     t->mid = mid;
     t->retrans_counter = 0;
+    /* a reused slot must not call back the previous owner */
+    t->callback = NULL;
+    t->callback_data = NULL;
 
     /* save client address */
     uip_ipaddr_copy(&t->addr, addr);
@@ -740,6 +740,8 @@ coap_status_t coap_parse_message(void *packet, uint8_t *data,
     if(OSCOAP){
       if(coap_pkt->object_security_len == 0 && coap_pkt->payload_len == 0){
         return OSCOAP_MALFORMED_PACKET;
+      } else if(job != NULL){
+        return oscoap_decode_packet_start(coap_pkt, job);
       } else {
         return oscoap_decode_packet(coap_pkt);
       }
@@ -747,6 +749,16 @@ coap_status_t coap_parse_message(void *packet, uint8_t *data,
     }
 
     return NO_ERROR;
+}
+
+coap_status_t oscoap_parser(void *packet, uint8_t *data,
+                                         uint16_t data_len, uint8_t role){
+  return oscoap_parse(packet, data, data_len, role, NULL);
+}
+
+coap_status_t oscoap_parser_async(void *packet, uint8_t *data,
+                                         uint16_t data_len, oscoap_crypto_job_t *job){
+  return oscoap_parse(packet, data, data_len, ROLE_COAP, job);
 } */
 /*---------------------------------------------------------------------------*/
 /*- REST Engine API ---------------------------------------------------------*/
@@ -1473,8 +1485,9 @@ oscoap_serializer(void *packet, uint8_t *buffer, uint8_t role)
   }
 }
 
-coap_status_t oscoap_parser(void *packet, uint8_t *data,
-                                         uint16_t data_len, uint8_t role){
+static coap_status_t oscoap_parse(void *packet, uint8_t *data,
+                                         uint16_t data_len, uint8_t role,
+                                         oscoap_crypto_job_t *job){
 
   int OSCOAP = 0;    
   uint8_t* original_buffer;
@@ -1759,6 +1772,8 @@ coap_status_t oscoap_parser(void *packet, uint8_t *data,
       coap_pkt->buffer = original_buffer;
       if(coap_pkt->object_security_len == 0 && coap_pkt->payload_len == 0){
         return OSCOAP_MALFORMED_PACKET;
+      } else if(job != NULL){
+        return oscoap_decode_packet_start(coap_pkt, job);
       } else {
         return oscoap_decode_packet(coap_pkt);
       }
@@ -1767,3 +1782,13 @@ coap_status_t oscoap_parser(void *packet, uint8_t *data,
 
     return NO_ERROR;
 }
+
+coap_status_t oscoap_parser(void *packet, uint8_t *data,
+                                         uint16_t data_len, uint8_t role){
+  return oscoap_parse(packet, data, data_len, role, NULL);
+}
+
+coap_status_t oscoap_parser_async(void *packet, uint8_t *data,
+                                         uint16_t data_len, oscoap_crypto_job_t *job){
+  return oscoap_parse(packet, data, data_len, ROLE_COAP, job);
+}
@@ -142,8 +142,10 @@ typedef struct {
       //This is for OSCOAP
       size_t object_security_len;
       uint8_t* object_security;
-      uip_ipaddr_t* ipaddr;
+      uip_ipaddr_t* ipaddr; /* remote endpoint of a received message */
+      uint16_t port;
       oscoap_ctx_t* context;
+      uint32_t request_seq; /* OSCOAP sequence number of the request, nonce material of its response */
 
 } coap_packet_t;
 
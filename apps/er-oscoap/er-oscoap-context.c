@@ -26,6 +26,7 @@
 //sender_key
 //sender_iv
 oscoap_ctx_t *common_context_store = NULL;
+static uint16_t last_ctx_id = 0;
 token_seq_t *token_seq_store = NULL;
 
 MEMB(common_contexts, oscoap_ctx_t, CONTEXT_NUM);
@@ -41,25 +42,28 @@ void oscoap_ctx_store_init(){
   memb_init(&recipient_contexts);
 }
 
-uint8_t get_info_len(uint8_t id_len, uint8_t out_len){
+uint8_t get_info_len(uint8_t id_len, uint8_t is_key, uint8_t out_len){
   uint8_t len = id_len;
-  if(out_len == 16){
+  if(is_key){
     len += 3;
   } else {
     len += 2;
   }
   len += 6;
+  if(out_len > 0x17){
+    len++;
+  }
   return len;
 }
 
-uint8_t compose_info(uint8_t* buffer, uint8_t alg, uint8_t* id, uint8_t id_len, uint8_t out_len){
+uint8_t compose_info(uint8_t* buffer, uint8_t alg, uint8_t* id, uint8_t id_len, uint8_t is_key, uint8_t out_len){
     uint8_t ret = 0;
     ret += OPT_CBOR_put_array(&buffer, 4);
     ret += OPT_CBOR_put_bytes(&buffer, id_len, id);
     ret += OPT_CBOR_put_unsigned(&buffer, alg);
     char* text;
     uint8_t text_len;
-    if( out_len == 16 ){
+    if( is_key ){
         text = "key";
         text_len = 3;
     } else {
@@ -73,11 +77,24 @@ uint8_t compose_info(uint8_t* buffer, uint8_t alg, uint8_t* id, uint8_t id_len,
 }
 
 
+static uint16_t new_ctx_id(){
+  if(++last_ctx_id == 0){
+    last_ctx_id = 1;
+  }
+  return last_ctx_id;
+}
+
 oscoap_ctx_t* oscoap_derrive_ctx(uint8_t* master_secret,uint8_t master_secret_len,
        uint8_t* master_salt, uint8_t master_salt_len, uint8_t alg, uint8_t hkdf_alg,
             uint8_t* sid, uint8_t sid_len, uint8_t* rid, uint8_t rid_len, uint8_t replay_window){
   //  PRINTF("derrive context\n");
 
+    const struct cose_aead_driver* aead = cose_aead_get(alg);
+    if(aead == NULL){
+      PRINTF("Error: algorithm %d not supported\n", alg);
+      return 0;
+    }
+
     oscoap_ctx_t* common_ctx = memb_alloc(&common_contexts);
     if(common_ctx == NULL) return 0;
 
@@ -88,7 +105,8 @@ oscoap_ctx_t* oscoap_derrive_ctx(uint8_t* master_secret,uint8_t master_secret_le
     if(sender_ctx == NULL) return 0;
 
     uint8_t zeroes[32];
-    uint8_t info_buffer[15]; 
+    /* 2 bytes of slack for alg and length values above 23 */
+    uint8_t info_buffer[(sid_len > rid_len ? sid_len : rid_len) + 11];
 
     uint8_t* salt;
     uint8_t  salt_len;
@@ -106,32 +124,32 @@ oscoap_ctx_t* oscoap_derrive_ctx(uint8_t* master_secret,uint8_t master_secret_le
     uint8_t info_len;
 
     //sender_ key
- //   info_buffer_size = get_info_len( sid_len, CONTEXT_KEY_LEN);
-    info_len = compose_info(info_buffer, alg, sid, sid_len, CONTEXT_KEY_LEN);
+ //   info_buffer_size = get_info_len( sid_len, 1, aead->key_len);
+    info_len = compose_info(info_buffer, alg, sid, sid_len, 1, aead->key_len);
   //  PRINTF("sender_ key info len: %d\n", info_len);
   //  PRINTF_HEX(info_buffer, info_len);
-    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, sender_ctx->sender_key, CONTEXT_KEY_LEN );
+    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, sender_ctx->sender_key, aead->key_len );
 
     //sender_ IV
- //   info_buffer_size = get_info_len( sid_len, CONTEXT_INIT_VECT_LEN);
-    info_len = compose_info(info_buffer, alg, sid, sid_len, CONTEXT_INIT_VECT_LEN);
+ //   info_buffer_size = get_info_len( sid_len, 0, aead->nonce_len);
+    info_len = compose_info(info_buffer, alg, sid, sid_len, 0, aead->nonce_len);
  //   PRINTF("sender_ IV info len: %d\n", info_len);
  //   PRINTF_HEX(info_buffer, info_len);
-    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, sender_ctx->sender_iv, CONTEXT_INIT_VECT_LEN );
+    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, sender_ctx->sender_iv, aead->nonce_len );
 
     //Receiver key
-   // info_buffer_size = get_info_len( rid_len, CONTEXT_KEY_LEN);
-    info_len = compose_info(info_buffer, alg, rid, rid_len, CONTEXT_KEY_LEN);
+   // info_buffer_size = get_info_len( rid_len, 1, aead->key_len);
+    info_len = compose_info(info_buffer, alg, rid, rid_len, 1, aead->key_len);
  //   PRINTF("Receiver key info len: %d\n", info_len);
  //   PRINTF_HEX(info_buffer, info_len);
-    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, recipient_ctx->recipient_key, CONTEXT_KEY_LEN );
+    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, recipient_ctx->recipient_key, aead->key_len );
 
     //Receiver IV
-  //  info_buffer_size = get_info_len( rid_len, CONTEXT_INIT_VECT_LEN);
-    info_len = compose_info(info_buffer, alg, rid, rid_len, CONTEXT_INIT_VECT_LEN);
+  //  info_buffer_size = get_info_len( rid_len, 0, aead->nonce_len);
+    info_len = compose_info(info_buffer, alg, rid, rid_len, 0, aead->nonce_len);
   //  PRINTF("Receiver IV info len: %d\n", info_len);
   //  PRINTF_HEX(info_buffer, info_len);
-    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, recipient_ctx->recipient_iv, CONTEXT_INIT_VECT_LEN );
+    hkdf(SHA256, salt, salt_len, master_secret, master_secret_len, info_buffer, info_len, recipient_ctx->recipient_iv, aead->nonce_len );
 
     common_ctx->master_secret = master_secret;
     common_ctx->master_secret_len = master_secret_len;
@@ -152,12 +170,11 @@ oscoap_ctx_t* oscoap_derrive_ctx(uint8_t* master_secret,uint8_t master_secret_le
     recipient_ctx->last_seq = 0;
     recipient_ctx->highest_seq = 0;
     recipient_ctx->replay_window_size = replay_window;
-    recipient_ctx->rollback_last_seq = 0;
     recipient_ctx->sliding_window = 0;
-    recipient_ctx->rollback_sliding_window = 0;
     recipient_ctx->initial_state = 1;
    
 
+    common_ctx->id = new_ctx_id();
     common_ctx->next_context = common_context_store;
     common_context_store = common_ctx;
     return common_ctx;
@@ -178,20 +195,22 @@ oscoap_ctx_t* oscoap_new_ctx( uint8_t* sw_k, uint8_t* sw_iv, uint8_t* rw_k, uint
     oscoap_sender_ctx_t* sender_ctx = memb_alloc(&sender_contexts);
     if(sender_ctx == NULL) return 0;
 
+    /* Pre-shared keys and IVs given here are AES-CCM-64-64-128 sized */
     common_ctx->alg = COSE_Algorithm_AES_CCM_64_64_128;
+    const struct cose_aead_driver* aead = cose_aead_get(common_ctx->alg);
 
     common_ctx->recipient_context = recipient_ctx;
     common_ctx->sender_context = sender_ctx;
 
-    memcpy(sender_ctx->sender_key, sw_k, CONTEXT_KEY_LEN);
-    memcpy(sender_ctx->sender_iv, sw_iv, CONTEXT_INIT_VECT_LEN);
+    memcpy(sender_ctx->sender_key, sw_k, aead->key_len);
+    memcpy(sender_ctx->sender_iv, sw_iv, aead->nonce_len);
     
     sender_ctx->sender_id =  s_id;
     sender_ctx->sender_id_len = s_id_len;
     sender_ctx->seq = 0;
 
-    memcpy(recipient_ctx->recipient_key, rw_k, CONTEXT_KEY_LEN);
-    memcpy(recipient_ctx->recipient_iv, rw_iv, CONTEXT_INIT_VECT_LEN);
+    memcpy(recipient_ctx->recipient_key, rw_k, aead->key_len);
+    memcpy(recipient_ctx->recipient_iv, rw_iv, aead->nonce_len);
    
 
     recipient_ctx->recipient_id = r_id;
@@ -199,11 +218,10 @@ oscoap_ctx_t* oscoap_new_ctx( uint8_t* sw_k, uint8_t* sw_iv, uint8_t* rw_k, uint
     recipient_ctx->last_seq = 0;
     recipient_ctx->highest_seq = 0;
     recipient_ctx->replay_window_size = replay_window;
-    recipient_ctx->rollback_last_seq = 0;
     recipient_ctx->sliding_window = 0;
-    recipient_ctx->rollback_sliding_window = 0;
     recipient_ctx->initial_state = 1;
 
+    common_ctx->id = new_ctx_id();
     common_ctx->next_context = common_context_store;
     common_context_store = common_ctx;
     
@@ -264,6 +282,11 @@ oscoap_ctx_t* oscoap_find_ctx_by_token(uint8_t* token, uint8_t token_len){
     if(common_context_store == NULL){
       return NULL;
     }
+
+    oscoap_ctx_t *ctx = get_ctx_from_token(token, token_len);
+    if(ctx != NULL){
+      return ctx;
+    }
     PRINTF("looking for:\n");
     PRINTF_HEX(token, token_len);
 
@@ -281,6 +304,15 @@ oscoap_ctx_t* oscoap_find_ctx_by_token(uint8_t* token, uint8_t token_len){
     return ctx_ptr;
 }
 
+oscoap_ctx_t* oscoap_find_ctx_by_id(uint16_t id){
+    oscoap_ctx_t *ctx_ptr = common_context_store;
+
+    while(ctx_ptr != NULL && ctx_ptr->id != id){
+      ctx_ptr = ctx_ptr->next_context;
+    }
+    return ctx_ptr;
+}
+
 int oscoap_free_ctx(oscoap_ctx_t *ctx){
 
     if(common_context_store == ctx){
@@ -333,16 +365,22 @@ void init_token_seq_store(){
   memb_init(&token_seq);
 }
 
-uint8_t get_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t* seq){
-   token_seq_t* ptr = token_seq_store;
+static token_seq_t* find_token_seq(uint8_t* token, uint8_t token_len){
+  token_seq_t* ptr;
 
-  while(!bytes_equal(ptr->token, ptr->token_len,  token, token_len)){
-    
-    ptr = ptr->next;
-    if(ptr == NULL){
-      return 0; //TODO handle error
+  for(ptr = token_seq_store; ptr != NULL; ptr = ptr->next){
+    if(bytes_equal(ptr->token, ptr->token_len, token, token_len)){
+      return ptr;
     }
+  }
+  return NULL;
+}
+
+uint8_t get_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t* seq){
+  token_seq_t* ptr = find_token_seq(token, token_len);
 
+  if(ptr == NULL){
+    return 0; //TODO handle error
   }
 
   *seq = ptr->seq;
@@ -353,38 +391,29 @@ uint8_t get_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t* seq){
 
 }
 
-void remove_seq_from_token(uint8_t* token, uint8_t token_len){
-  token_seq_t* ptr = token_seq_store;
+/* Context of an outstanding request, several requests of one context may be
+   outstanding while the sender token only holds the latest one */
+oscoap_ctx_t* get_ctx_from_token(uint8_t* token, uint8_t token_len){
+  token_seq_t* ptr = find_token_seq(token, token_len);
 
+  return ptr == NULL ? NULL : ptr->ctx;
+}
 
-  if(bytes_equal(ptr->token, ptr->token_len, token, token_len)){ // first element
-    token_seq_store = ptr->next;
-    memb_free(&token_seq, ptr);
-    return;
-  }
+void remove_seq_from_token(uint8_t* token, uint8_t token_len){
+  token_seq_t** prev = &token_seq_store;
 
-  ptr = ptr->next;
-  
-  while(1){
-    if(ptr == NULL){
-      return;
-    }
-    
-    if(bytes_equal(ptr->next->token, ptr->token_len, token, token_len)){
-      token_seq_t* tmp = ptr->next;
-      ptr->next = ptr->next->next;
+  while(*prev != NULL){
+    if(bytes_equal((*prev)->token, (*prev)->token_len, token, token_len)){
+      token_seq_t* tmp = *prev;
+      *prev = tmp->next;
       memb_free(&token_seq, tmp);
       return;
     }
-
-    ptr = ptr->next;
-    
+    prev = &(*prev)->next;
   }
-
-
 }
 
-uint8_t set_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t seq){
+uint8_t set_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t seq, oscoap_ctx_t* ctx){
   token_seq_t* token_seq_ptr = memb_alloc(&token_seq);
   if(token_seq_ptr == NULL){
     return 0;
@@ -393,6 +422,7 @@ uint8_t set_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t seq){
   memcpy(token_seq_ptr->token, token, token_len);
   token_seq_ptr->token_len = token_len;
   token_seq_ptr->seq = seq;
+  token_seq_ptr->ctx = ctx;
   token_seq_ptr->next = token_seq_store;
   token_seq_store = token_seq_ptr;
   PRINTF("storing seq %" PRIu32 "\n with token :", seq);
@@ -11,13 +11,22 @@
 #include "lib/memb.h"
 #include "er-coap-conf.h"
 #include "er-coap-constants.h"
+#include "cose-aead.h"
 
-#define CONTEXT_KEY_LEN 16 
-#define CONTEXT_INIT_VECT_LEN 7
+/* Key and IV storage is sized for the largest compiled in algorithm, see cose-aead.h */
+#define CONTEXT_KEY_LEN COSE_AEAD_MAX_KEY_LEN
+#define CONTEXT_INIT_VECT_LEN COSE_AEAD_MAX_NONCE_LEN
 #define CONTEXT_SEQ_LEN sizeof(uint32_t) 
 
 
 #define OSCOAP_SEQ_MAX 10000 //TODO calculate the real value
+
+/* Algorithm for applications that do not pick one, choose the fastest AEAD of the platform */
+#ifdef OSCOAP_CONF_DEFAULT_ALG
+#define OSCOAP_DEFAULT_ALG OSCOAP_CONF_DEFAULT_ALG
+#else /* OSCOAP_CONF_DEFAULT_ALG */
+#define OSCOAP_DEFAULT_ALG 12 /* COSE_Algorithm_AES_CCM_64_64_128 */
+#endif /* OSCOAP_CONF_DEFAULT_ALG */
 //oscoap_ctx_t
 //oscoap_sender_ctx_t
 //oscoap_recipient_ctx_t
@@ -45,8 +54,6 @@ struct oscoap_recipient_ctx_t
   uint32_t  last_seq;
   uint32_t  highest_seq;
   uint32_t  sliding_window;
-  uint32_t  rollback_sliding_window;
-  uint32_t  rollback_last_seq;
   oscoap_recipient_ctx_t* recipient_context; //This field facilitates easy integration of OSCOAP multicast
   uint8_t   recipient_key[CONTEXT_KEY_LEN];
   uint8_t   recipient_iv[CONTEXT_INIT_VECT_LEN];
@@ -67,22 +74,35 @@ struct oscoap_ctx_t{
   uint8_t    master_salt_len;
 
   uint8_t alg;
+  /* never reused for a later context, so holders of a pointer can tell
+     whether the context they saw is still in the store; 0 is no context */
+  uint16_t id;
 };
 
 struct token_seq_t{
   uint8_t token[8];
   uint8_t  token_len;
   uint32_t seq;
+  oscoap_ctx_t* ctx;
   token_seq_t* next;
 };
 
 /* This is the number of contexts that the store can handle */
+#ifdef OSCOAP_CONF_CONTEXT_NUM
+#define CONTEXT_NUM OSCOAP_CONF_CONTEXT_NUM
+#else /* OSCOAP_CONF_CONTEXT_NUM */
 #define CONTEXT_NUM 1
+#endif /* OSCOAP_CONF_CONTEXT_NUM */
+/* This is the number of requests that can wait for their response */
+#ifdef OSCOAP_CONF_TOKEN_SEQ_NUM
+#define TOKEN_SEQ_NUM OSCOAP_CONF_TOKEN_SEQ_NUM
+#else /* OSCOAP_CONF_TOKEN_SEQ_NUM */
 #define TOKEN_SEQ_NUM 2
+#endif /* OSCOAP_CONF_TOKEN_SEQ_NUM */
 
 void oscoap_ctx_store_init();
 
-uint8_t get_info_len(uint8_t id_len, uint8_t out_len);
+uint8_t get_info_len(uint8_t id_len, uint8_t is_key, uint8_t out_len);
 
 //uint8_t compose_info(uint8_t* buffer, uint8_t alg, uint8_t* id, uint8_t id_len, uint8_t out_len);
 oscoap_ctx_t* oscoap_derrive_ctx(uint8_t* master_secret,
@@ -96,10 +116,12 @@ oscoap_ctx_t* oscoap_new_ctx( uint8_t* sw_k, uint8_t* sw_iv, uint8_t* rw_k, uint
 
 oscoap_ctx_t* oscoap_find_ctx_by_rid(uint8_t* rid, uint8_t rid_len);
 oscoap_ctx_t* oscoap_find_ctx_by_token(uint8_t* token, uint8_t token_len);
+oscoap_ctx_t* oscoap_find_ctx_by_id(uint16_t id);
 
 void init_token_seq_store();
 uint8_t get_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t* seq);
-uint8_t set_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t seq);
+uint8_t set_seq_from_token(uint8_t* token, uint8_t token_len, uint32_t seq, oscoap_ctx_t* ctx);
+oscoap_ctx_t* get_ctx_from_token(uint8_t* token, uint8_t token_len);
 void remove_seq_from_token(uint8_t* token, uint8_t token_len);
 
 int oscoap_free_ctx(oscoap_ctx_t *ctx);
@@ -41,6 +41,7 @@ USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <inttypes.h>
 #include <sys/types.h>
 #include "cose-compression.h"
+#include "cose-aead.h"
 
 #define DEBUG 1
 #if DEBUG
@@ -57,10 +58,6 @@ USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define PRINTF_BIN(data, len)
 #endif /* OSCOAP_DEBUG */
 
-//TODO this is a hotfix, maybe have this in the context instead
-uint32_t observe_seq = 0;
-uint32_t observing_seq = 0;
-
 void parse_int(uint64_t in, uint8_t* bytes, int out_len){ 
 	int x = out_len - 1;
 	while(x >= 0){
@@ -125,7 +122,8 @@ size_t oscoap_prepare_external_aad(coap_packet_t* coap_pkt, opt_cose_encrypt_t*
   if(!coap_is_request(coap_pkt) && IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)){
 
     if( sending == 1){
-      coap_set_header_observe(coap_pkt, observe_seq);
+      /* the Observe value of a notification is its sequence number */
+      coap_set_header_observe(coap_pkt, coap_pkt->context->sender_context->seq);
     } else {
       int s = coap_get_header_observe(coap_pkt, &obs);
     }
@@ -148,7 +146,8 @@ size_t oscoap_prepare_external_aad(coap_packet_t* coap_pkt, opt_cose_encrypt_t*
       ret += OPT_CBOR_put_bytes(&buffer, coap_pkt->context->sender_context->sender_id_len, coap_pkt->context->sender_context->sender_id);
       ret += OPT_CBOR_put_bytes(&buffer, seq_len, seq_buffer);
     } else {
-        uint8_t seq_len = to_bytes(coap_pkt->context->recipient_context->last_seq, seq_buffer);
+        /* a separate response or notification may be sent after later requests arrived */
+        uint8_t seq_len = to_bytes(coap_pkt->request_seq, seq_buffer);
       
       ret += OPT_CBOR_put_bytes(&buffer, coap_pkt->context->recipient_context->recipient_id_len, coap_pkt->context->recipient_context->recipient_id);
       ret += OPT_CBOR_put_bytes(&buffer, seq_len, seq_buffer);
@@ -156,13 +155,14 @@ size_t oscoap_prepare_external_aad(coap_packet_t* coap_pkt, opt_cose_encrypt_t*
   } else {
     
     if(coap_is_request(coap_pkt)){
-        uint8_t seq_len = to_bytes(coap_pkt->context->recipient_context->last_seq, seq_buffer);
+        /* the replay window only moves once the request is authenticated */
+        uint8_t seq_len = to_bytes(coap_pkt->request_seq, seq_buffer);
 
         ret += OPT_CBOR_put_bytes(&buffer, coap_pkt->context->recipient_context->recipient_id_len, coap_pkt->context->recipient_context->recipient_id);
         ret += OPT_CBOR_put_bytes(&buffer, seq_len, seq_buffer);
     } else {
         if( IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE) ){
-          uint8_t seq_len = to_bytes(observing_seq, seq_buffer);
+          uint8_t seq_len = to_bytes(coap_pkt->request_seq, seq_buffer);
           
           ret += OPT_CBOR_put_bytes(&buffer, coap_pkt->context->sender_context->sender_id_len, coap_pkt->context->sender_context->sender_id);
           ret += OPT_CBOR_put_bytes(&buffer, seq_len, seq_buffer);
@@ -211,35 +211,25 @@ uint8_t oscoap_increment_sender_seq(oscoap_ctx_t* ctx){
 }
 
 
-uint8_t oscoap_validate_receiver_seq(oscoap_recipient_ctx_t* ctx, opt_cose_encrypt_t *cose){
+/* Checks the sequence number of an incoming request against the replay
+   window without changing it. The window is only updated by
+   oscoap_accept_receiver_seq() once the request is authenticated, so that
+   a forged request cannot move it. */
+uint8_t oscoap_validate_receiver_seq(oscoap_recipient_ctx_t* ctx, uint32_t incomming_seq){
 
-  uint32_t incomming_seq = bytes_to_uint32(cose->partial_iv, cose->partial_iv_len);
   PRINTF("SEQ: incomming %" PRIu32 "\n", incomming_seq);
   PRINTF("SEQ: last %" PRIu32 "\n", ctx->last_seq);
-  PRINTF_HEX(cose->partial_iv, cose->partial_iv_len);
    if (ctx->last_seq >= OSCOAP_SEQ_MAX) {
             PRINTF("SEQ ERROR: wrapped\n");
             return OSCOAP_SEQ_WRAPPED;
    }
-  
-  ctx->rollback_last_seq = ctx->last_seq; //recipient_seq;
-  ctx->rollback_sliding_window = ctx->sliding_window;
 
   if (incomming_seq > ctx->highest_seq) {
-     //Update the replay window
-     int shift = incomming_seq - ctx->last_seq;
-     ctx->sliding_window = ctx->sliding_window << shift;
-     ctx->highest_seq = incomming_seq;
-            
-            
+     return 0;
   } else if (incomming_seq == ctx->highest_seq) {
      // Special case since we do not use unisgned int for seq
      if(ctx->initial_state == 1 ){ 
-        ctx->initial_state = 0;
-        int shift = incomming_seq - ctx->highest_seq;
-        ctx->sliding_window = ctx->sliding_window << shift;
-        ctx->highest_seq = incomming_seq;
-        
+        return 0;
      } else {
         PRINTF("SEQ ERROR: replay\n");
         return OSCOAP_SEQ_REPLAY;
@@ -258,34 +248,37 @@ uint8_t oscoap_validate_receiver_seq(oscoap_recipient_ctx_t* ctx, opt_cose_encry
         PRINTF("SEQ ERROR: replay\n");
         return OSCOAP_SEQ_REPLAY;
      }
-     ctx->sliding_window = ctx->sliding_window | pattern;
   }
-
-  ctx->last_seq = incomming_seq;
   return 0;
-
 }
 
-void roll_back_seq(oscoap_recipient_ctx_t* ctx) {
-  if (ctx->rollback_sliding_window != 0) {
-      ctx->sliding_window =  ctx->rollback_sliding_window; 
-      ctx->rollback_sliding_window = 0;
-  }
-  if (ctx->rollback_last_seq != 0) {
-      ctx->last_seq = ctx->rollback_last_seq;
-      ctx->rollback_last_seq = 0;
+/* Records the sequence number of an authenticated request in the replay
+   window. The caller has checked it with oscoap_validate_receiver_seq(). */
+void oscoap_accept_receiver_seq(oscoap_recipient_ctx_t* ctx, uint32_t incomming_seq){
+
+  if (incomming_seq > ctx->highest_seq) {
+     //Update the replay window
+     int shift = incomming_seq - ctx->last_seq;
+     ctx->sliding_window = ctx->sliding_window << shift;
+     ctx->highest_seq = incomming_seq;
+  } else if (incomming_seq == ctx->highest_seq) {
+     ctx->initial_state = 0;
+  } else {
+     ctx->sliding_window = ctx->sliding_window | (1 << (ctx->highest_seq - incomming_seq));
   }
 
+  ctx->last_seq = incomming_seq;
 }
 
 /* Compose the nonce by XORing the static IV (Client Write IV) with
-   the Partial IV parameter, received in the COSE Object.   */
-void create_nonce(uint8_t* iv, uint8_t* out, uint8_t* seq, int seq_len ){
+   the Partial IV parameter, received in the COSE Object.
+   The Partial IV is right aligned to the nonce length of the algorithm. */
+void create_nonce(uint8_t* iv, uint8_t* out, uint8_t* seq, int seq_len, uint8_t nonce_len ){
 
-  memcpy(out, iv, 7);
-	int i = 6;
+  memcpy(out, iv, nonce_len);
+	int i = nonce_len - 1;
 	int j = seq_len - 1;
-	while(i > (6-seq_len)){
+	while(i > (nonce_len - 1 - seq_len)){
 		out[i] = out[i] ^ seq[j];
 		j--;
 		i--;
@@ -293,73 +286,72 @@ void create_nonce(uint8_t* iv, uint8_t* out, uint8_t* seq, int seq_len ){
 
 }
 
-size_t oscoap_prepare_message(void* packet, uint8_t *buffer){
-    
-  PRINTF("PREPARE MESAGE\n");
-  static coap_packet_t * coap_pkt;
+/* Serializes the confidential part of an outgoing message into
+   job->plaintext, reserves its sequence number and prepares the AEAD job
+   that encrypts it in place. */
+static size_t oscoap_protect_prepare(coap_packet_t* coap_pkt, oscoap_crypto_job_t* job){
+
   opt_cose_encrypt_t cose;
-  uint8_t plaintext_buffer[50]; //TODO, workaround this to decrease memory footprint
-  uint8_t seq_buffer[CONTEXT_SEQ_LEN];
-  uint8_t nonce_buffer[CONTEXT_INIT_VECT_LEN];
+  const struct cose_aead_driver* aead;
 
-  coap_pkt = (coap_packet_t *)packet;
   OPT_COSE_Init(&cose);
-  memset(plaintext_buffer, 0, 50);
+  memset(job->plaintext, 0, sizeof(job->plaintext));
 
   if(coap_pkt->context == NULL){
     PRINTF("ERROR: NO CONTEXT IN PREPARE MESSAGE!\n");
     return 0;
   }
 
+  aead = cose_aead_get(coap_pkt->context->alg);
+  if(aead == NULL){
+    PRINTF("ERROR: ALGORITHM %d NOT SUPPORTED!\n", coap_pkt->context->alg);
+    return 0;
+  }
+
   //Serialize options and payload
-  size_t plaintext_size = oscoap_serializer(packet, plaintext_buffer, ROLE_CONFIDENTIAL);
+  size_t plaintext_size = oscoap_serializer(coap_pkt, job->plaintext, ROLE_CONFIDENTIAL);
   
   PRINTF("plaintext:\n");
-  PRINTF_HEX(plaintext_buffer, plaintext_size);
-
-  OPT_COSE_SetContent(&cose, plaintext_buffer, plaintext_size);
-  OPT_COSE_SetAlg(&cose, COSE_Algorithm_AES_CCM_64_64_128);
+  PRINTF_HEX(job->plaintext, plaintext_size);
 
+  OPT_COSE_SetContent(&cose, job->plaintext, plaintext_size);
+  OPT_COSE_SetAlg(&cose, aead->alg);
 
-  uint8_t seq_bytes_len;
   if(coap_is_request(coap_pkt)){
-    seq_bytes_len = to_bytes(coap_pkt->context->sender_context->seq, seq_buffer);
+    job->seq_len = to_bytes(coap_pkt->context->sender_context->seq, job->seq);
 
     OPT_COSE_SetKeyID(&cose, coap_pkt->context->sender_context->sender_id,
             coap_pkt->context->sender_context->sender_id_len);
-    OPT_COSE_SetPartialIV(&cose, seq_buffer, seq_bytes_len);
+    OPT_COSE_SetPartialIV(&cose, job->seq, job->seq_len);
   } else {
-    seq_bytes_len = to_bytes(coap_pkt->context->recipient_context->last_seq, seq_buffer);
+    job->seq_len = to_bytes(coap_pkt->request_seq, job->seq);
   
     if(IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)){
-      seq_bytes_len = to_bytes(observe_seq, seq_buffer);
-      
+      /* notifications carry their own partial IV from the sender sequence */
+      job->seq_len = to_bytes(coap_pkt->context->sender_context->seq, job->seq);
     }
   }
 
   PRINTF("seq + context iv\n");
-  PRINTF_HEX(seq_buffer, seq_bytes_len);
-  PRINTF_HEX(coap_pkt->context->sender_context->sender_iv, 7);
+  PRINTF_HEX(job->seq, job->seq_len);
+  PRINTF_HEX(coap_pkt->context->sender_context->sender_iv, aead->nonce_len);
 
-  create_nonce(coap_pkt->context->sender_context->sender_iv, nonce_buffer, seq_buffer, seq_bytes_len);
+  create_nonce(coap_pkt->context->sender_context->sender_iv, job->nonce, job->seq, job->seq_len, aead->nonce_len);
  
   if( (!IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)) && (!coap_is_request(coap_pkt))){ 
     //Non observe reply
-    nonce_buffer[0] = nonce_buffer[0] ^ (1 << 7);
+    job->nonce[0] = job->nonce[0] ^ (1 << 7);
   }
   
-  OPT_COSE_SetNonce(&cose, nonce_buffer, CONTEXT_INIT_VECT_LEN);
+  OPT_COSE_SetNonce(&cose, job->nonce, aead->nonce_len);
  
   size_t external_aad_size = oscoap_external_aad_size(coap_pkt); // this is a upper bound of the size
   uint8_t external_aad_buffer[external_aad_size]; 
   
   external_aad_size = oscoap_prepare_external_aad(coap_pkt, &cose, external_aad_buffer, 1);
 
-  if(coap_is_request(coap_pkt) && IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)){
-    observing_seq = coap_pkt->context->sender_context->seq;
-  }
   if(coap_is_request(coap_pkt)){
-      set_seq_from_token(coap_pkt->token, coap_pkt->token_len, coap_pkt->context->sender_context->seq);
+      set_seq_from_token(coap_pkt->token, coap_pkt->token_len, coap_pkt->context->sender_context->seq, coap_pkt->context);
       if( !oscoap_increment_sender_seq(coap_pkt->context) ){
         PRINTF("SEQ overrrun, send errors\n");
         //TODO send errors
@@ -369,25 +361,57 @@ size_t oscoap_prepare_message(void* packet, uint8_t *buffer){
 
   //This is a hotfix to get the AAD creation working
   if(IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE) && !coap_is_request(coap_pkt)){
-    OPT_COSE_SetPartialIV(&cose, seq_buffer, seq_bytes_len);
+    OPT_COSE_SetPartialIV(&cose, job->seq, job->seq_len);
+    if( !oscoap_increment_sender_seq(coap_pkt->context) ){
+      PRINTF("SEQ overrrun, send errors\n");
+    }
   }
   PRINTF("external aad \n");
   PRINTF_HEX(external_aad_buffer, external_aad_size);
 
+  if(OPT_COSE_AAD_length(&cose) > OSCOAP_AAD_MAX_LEN){
+    PRINTF("ERROR: AAD TOO LONG!\n");
+    return 0;
+  }
+  size_t aad_length = OPT_COSE_Build_AAD(&cose, job->aad);
 
-  size_t aad_length = OPT_COSE_AAD_length(&cose);
-  uint8_t aad_buffer[aad_length];
-  aad_length = OPT_COSE_Build_AAD(&cose, aad_buffer);
-
-  OPT_COSE_SetAAD(&cose, aad_buffer, aad_length);
   PRINTF("serialized aad\n");
-  PRINTF_HEX(aad_buffer, aad_length);
- 
+  PRINTF_HEX(job->aad, aad_length);
+
+  job->ctx = coap_pkt->context;
+  job->aead.aead = aead;
+  job->aead.key = coap_pkt->context->sender_context->sender_key;
+  job->aead.nonce = job->nonce;
+  job->aead.a = job->aad;
+  job->aead.a_len = aad_length;
+  job->aead.m = job->plaintext;
+  job->aead.m_len = plaintext_size;
+  job->aead.tag = job->plaintext + plaintext_size;
+  job->aead.forward = 1;
+
+  return plaintext_size + aead->tag_len;
+}
+
+size_t oscoap_prepare_message_finish(void* packet, uint8_t *buffer, oscoap_crypto_job_t* job){
 
-  size_t ciphertext_len = cose.plaintext_len + 8; 
+  coap_packet_t* coap_pkt = (coap_packet_t *)packet;
+  opt_cose_encrypt_t cose;
+
+  if(job->aead.status != COSE_AEAD_JOB_DONE){
+    PRINTF("Error: Crypto Error %d!\n", job->aead.status);
+    return 0;
+  }
 
-  OPT_COSE_SetCiphertextBuffer(&cose, plaintext_buffer, ciphertext_len);
-  OPT_COSE_Encrypt(&cose, coap_pkt->context->sender_context->sender_key, CONTEXT_KEY_LEN);
+  OPT_COSE_Init(&cose);
+  OPT_COSE_SetAlg(&cose, job->aead.aead->alg);
+  if(coap_is_request(coap_pkt)){
+    OPT_COSE_SetKeyID(&cose, job->ctx->sender_context->sender_id,
+            job->ctx->sender_context->sender_id_len);
+    OPT_COSE_SetPartialIV(&cose, job->seq, job->seq_len);
+  } else if(IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)){
+    OPT_COSE_SetPartialIV(&cose, job->seq, job->seq_len);
+  }
+  OPT_COSE_SetCiphertextBuffer(&cose, job->plaintext, job->aead.m_len + job->aead.aead->tag_len);
   
   //TODO Here we need to fix stuff with compression and without
   size_t serialized_len = OPT_COSE_Encoded_length(&cose);
@@ -410,27 +434,48 @@ size_t oscoap_prepare_message(void* packet, uint8_t *buffer){
   if(serialized_size == 0){
     PRINTF("%s\n", coap_error_message);
   }
-  
-  if(IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE) && !coap_is_request(coap_pkt)){
-      observe_seq++;
-  }
 
   /*TODO it is unclear what this does. old comment: break this to new function */
-  memset(coap_pkt->context->sender_context->token, 0, COAP_TOKEN_LEN);
-  memcpy(coap_pkt->context->sender_context->token, coap_pkt->token, coap_pkt->token_len);
-  coap_pkt->context->sender_context->token_len = coap_pkt->token_len;
+  memset(job->ctx->sender_context->token, 0, COAP_TOKEN_LEN);
+  memcpy(job->ctx->sender_context->token, coap_pkt->token, coap_pkt->token_len);
+  job->ctx->sender_context->token_len = coap_pkt->token_len;
 
   PRINTF("Serialized size = %d\n", serialized_size);
   PRINTF_HEX(buffer, serialized_size);
   return serialized_size;
-  
 }
 
+coap_status_t oscoap_prepare_message_start(void* packet, oscoap_crypto_job_t* job){
+
+  if(oscoap_protect_prepare((coap_packet_t *)packet, job) == 0){
+    coap_error_message = "Encryption failed";
+    return INTERNAL_SERVER_ERROR_5_00;
+  }
+
+  job->aead.process = PROCESS_CURRENT();
+  cose_aead_submit(&job->aead);
+  return OSCOAP_CRYPTO_PENDING;
+}
+
+size_t oscoap_prepare_message(void* packet, uint8_t *buffer){
+    
+  PRINTF("PREPARE MESAGE\n");
+  oscoap_crypto_job_t job;
+
+  if(oscoap_protect_prepare((coap_packet_t *)packet, &job) == 0){
+    return 0;
+  }
+
+  job.aead.status = cose_aead_run(&job.aead);
+  return oscoap_prepare_message_finish(packet, buffer, &job);
+}
 
-coap_status_t oscoap_decode_packet(coap_packet_t* coap_pkt){
+
+/* Looks up the context, checks replay protection and prepares the AEAD job
+   that decrypts the COSE object in place. */
+static coap_status_t oscoap_decode_prepare(coap_packet_t* coap_pkt, oscoap_crypto_job_t* job){
 
   uint8_t seq_buffer[CONTEXT_SEQ_LEN];
-  uint8_t nonce_buffer[CONTEXT_INIT_VECT_LEN];
   opt_cose_encrypt_t cose;
   
   OPT_COSE_Init(&cose);
@@ -462,21 +507,28 @@ coap_status_t oscoap_decode_packet(coap_packet_t* coap_pkt){
       coap_error_message = "Security context not found";
       return UNAUTHORIZED_4_01;
   }
+
+  const struct cose_aead_driver* aead = cose_aead_get(ctx->alg);
+  if(aead == NULL || cose.ciphertext_len < aead->tag_len){
+      PRINTF("Error: algorithm %d not supported or ciphertext too short\n", ctx->alg);
+      coap_error_message = "Decryption failed";
+      return BAD_REQUEST_4_00;
+  }
   
   size_t seq_len;
   uint8_t *seq;
 
   if(coap_is_request(coap_pkt)){  //TODO add check to se that we do not have observe to
       
-        uint8_t seq_result = oscoap_validate_receiver_seq(ctx->recipient_context, &cose);
-        if(seq_result != 0){
+        seq = OPT_COSE_GetPartialIV(&cose, &seq_len);
+        coap_pkt->request_seq = bytes_to_uint32(seq, seq_len);
+        PRINTF_HEX(seq, seq_len);
+
+        if(oscoap_validate_receiver_seq(ctx->recipient_context, coap_pkt->request_seq) != 0){
           PRINTF("SEQ Error!\n");
           coap_error_message = "Replay protection failed";
 	        return BAD_REQUEST_4_00;
         }
-
-        seq = OPT_COSE_GetPartialIV(&cose, &seq_len);
-        observe_seq = bytes_to_uint32(seq, seq_len);
   } else if(! IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)){ //Reply with no Observe
 
         uint32_t sequence_number;
@@ -489,21 +541,25 @@ coap_status_t oscoap_decode_packet(coap_packet_t* coap_pkt){
         PRINTF("seq bytes\n");
         PRINTF_HEX(seq, seq_len);
         OPT_COSE_SetPartialIV(&cose, seq, seq_len);
-    	  observe_seq = sequence_number;
-  } else { //Observe reply
+        coap_pkt->request_seq = sequence_number;
+  } else { //Observe reply, the registration stays in the token store while observing
+        if(!get_seq_from_token(coap_pkt->token, coap_pkt->token_len, &coap_pkt->request_seq)){
+          coap_error_message = "Security context not found";
+          return UNAUTHORIZED_4_01;
+        }
         seq = OPT_COSE_GetPartialIV(&cose, &seq_len);
   }
 
-  create_nonce((uint8_t*)ctx->recipient_context->recipient_iv, nonce_buffer, seq, seq_len);
+  create_nonce((uint8_t*)ctx->recipient_context->recipient_iv, job->nonce, seq, seq_len, aead->nonce_len);
 
   if( (!IS_OPTION(coap_pkt, COAP_OPTION_OBSERVE)) && (!coap_is_request(coap_pkt))){ 
       //Non observe reply
-      nonce_buffer[0] = nonce_buffer[0] ^ (1 << 7);
+      job->nonce[0] = job->nonce[0] ^ (1 << 7);
   }
 
     coap_pkt->context = ctx; //THIS IS IMPORTANT, breaks AAD creation
-    OPT_COSE_SetNonce(&cose, nonce_buffer, CONTEXT_INIT_VECT_LEN); 
-    OPT_COSE_SetAlg(&cose, COSE_Algorithm_AES_CCM_64_64_128);
+    OPT_COSE_SetNonce(&cose, job->nonce, aead->nonce_len); 
+    OPT_COSE_SetAlg(&cose, aead->alg);
 
     size_t external_aad_size = 25; 
     uint8_t external_aad_buffer[external_aad_size]; 
@@ -514,43 +570,78 @@ coap_status_t oscoap_decode_packet(coap_packet_t* coap_pkt){
   PRINTF("external aad\n");
   PRINTF_HEX(external_aad_buffer, external_aad_size);
 
+    if(OPT_COSE_AAD_length(&cose) > OSCOAP_AAD_MAX_LEN){
+      coap_error_message = "Decryption failed";
+      return BAD_REQUEST_4_00;
+    }
+    size_t aad_len = OPT_COSE_Build_AAD(&cose, job->aad);
+
+    job->ctx = ctx;
+    job->aead.aead = aead;
+    job->aead.key = ctx->recipient_context->recipient_key;
+    job->aead.nonce = job->nonce;
+    job->aead.a = job->aad;
+    job->aead.a_len = aad_len;
+    job->aead.m = cose.ciphertext;
+    job->aead.m_len = cose.ciphertext_len - aead->tag_len;
+    job->aead.tag = cose.ciphertext + job->aead.m_len;
+    job->aead.forward = 0;
 
-           
-
-    size_t aad_len = OPT_COSE_AAD_length(&cose);
-    uint8_t aad_buffer[aad_len];
-    aad_len = OPT_COSE_Build_AAD(&cose, aad_buffer);
-    OPT_COSE_SetAAD(&cose, aad_buffer, aad_len);
+    return NO_ERROR;
+}
 
-    size_t plaintext_len = cose.ciphertext_len - 8;
-    uint8_t plaintext_buffer[plaintext_len];
-    
-    OPT_COSE_SetContent(&cose, plaintext_buffer, plaintext_len);
+coap_status_t oscoap_decode_packet_finish(coap_packet_t* coap_pkt, oscoap_crypto_job_t* job){
 
-    if(OPT_COSE_Decrypt(&cose, ctx->recipient_context->recipient_key, CONTEXT_KEY_LEN)){
-      roll_back_seq(ctx->recipient_context);
-      PRINTF("Error: Crypto Error!\n");
+    if(job->aead.status != COSE_AEAD_JOB_DONE){
+      PRINTF("Error: Crypto Error %d!\n", job->aead.status);
       coap_error_message = "Decryption failed";
       return BAD_REQUEST_4_00;
     }
 
-    PRINTF("PLAINTEXT DECRYPTED len %d\n", cose.plaintext_len);
-    PRINTF_HEX(cose.plaintext, cose.plaintext_len);
+    if(coap_is_request(coap_pkt)){
+      /* Another request with the same sequence number may have been
+         accepted while this one was decrypted */
+      if(oscoap_validate_receiver_seq(job->ctx->recipient_context, coap_pkt->request_seq) != 0){
+        coap_error_message = "Replay protection failed";
+        return BAD_REQUEST_4_00;
+      }
+      oscoap_accept_receiver_seq(job->ctx->recipient_context, coap_pkt->request_seq);
+    }
+
+    PRINTF("PLAINTEXT DECRYPTED len %d\n", job->aead.m_len);
+    PRINTF_HEX(job->aead.m, job->aead.m_len);
     
     //TODO it is unclear what happens here
-    memcpy(coap_pkt->object_security, cose.plaintext, cose.plaintext_len);     
-    coap_pkt->object_security_len = cose.plaintext_len;
-
+    memmove(coap_pkt->object_security, job->aead.m, job->aead.m_len);
+    coap_pkt->object_security_len = job->aead.m_len;
 
-   // PRINTF("buffer before restore pkt\n");
-   // PRINTF_HEX(coap_pkt->buffer, 50);
-   // oscoap_restore_packet(coap_pkt);
     oscoap_parser(coap_pkt, coap_pkt->object_security, coap_pkt->object_security_len, ROLE_CONFIDENTIAL);
-   // PRINTF("buffer after restore pkt\n");
-   // PRINTF_HEX(coap_pkt->buffer, 50);
-   // PRINTF("SEQ last in func decode %" PRIu32 "\n", ctx->recipient_context->last_seq);
     return NO_ERROR;
-    
+}
+
+coap_status_t oscoap_decode_packet_start(coap_packet_t* coap_pkt, oscoap_crypto_job_t* job){
+
+  coap_status_t ret = oscoap_decode_prepare(coap_pkt, job);
+  if(ret != NO_ERROR){
+    return ret;
+  }
+
+  job->aead.process = PROCESS_CURRENT();
+  cose_aead_submit(&job->aead);
+  return OSCOAP_CRYPTO_PENDING;
+}
+
+coap_status_t oscoap_decode_packet(coap_packet_t* coap_pkt){
+
+  oscoap_crypto_job_t job;
+
+  coap_status_t ret = oscoap_decode_prepare(coap_pkt, &job);
+  if(ret != NO_ERROR){
+    return ret;
+  }
+
+  job.aead.status = cose_aead_run(&job.aead);
+  return oscoap_decode_packet_finish(coap_pkt, &job);
 }
 
 void clear_options(coap_packet_t* coap_pkt){
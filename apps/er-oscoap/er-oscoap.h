@@ -37,6 +37,7 @@ USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "er-coap.h"
 #include <sys/types.h>
 #include "opt-cose.h"
+#include "cose-aead-backend.h"
 
 #define CLEAR_OPTION(packet, opt) ((packet)->options[opt / OPTION_MAP_SIZE] &= ~(1 << (opt % OPTION_MAP_SIZE))) //clear one bit
 
@@ -50,9 +51,40 @@ size_t oscoap_prepare_external_aad(coap_packet_t* coap_pkt, opt_cose_encrypt_t*
 
 void clear_options(coap_packet_t* coap_pkt);
 
+/* Upper bound of the serialized COSE Enc_structure */
+#define OSCOAP_AAD_MAX_LEN 64
+/* Upper bound of the confidential part of an outgoing message */
+#define OSCOAP_PLAINTEXT_MAX_LEN 50
+
+/* An OSCOAP message whose AEAD operation runs on the backend */
+typedef struct oscoap_crypto_job {
+  cose_aead_job_t aead;
+  oscoap_ctx_t* ctx;
+  uint8_t nonce[CONTEXT_INIT_VECT_LEN];
+  uint8_t aad[OSCOAP_AAD_MAX_LEN];
+  uint8_t plaintext[OSCOAP_PLAINTEXT_MAX_LEN + COSE_AEAD_MAX_TAG_LEN]; /* outgoing only */
+  uint8_t seq[CONTEXT_SEQ_LEN];
+  uint8_t seq_len;
+} oscoap_crypto_job_t;
+
 size_t oscoap_prepare_message(void* packet, uint8_t* buffer);
 coap_status_t oscoap_decode_packet(coap_packet_t* coap_pkt);
 
+/* Like oscoap_parser() with ROLE_COAP, but an OSCOAP message is decrypted by
+   the AEAD backend. Returns OSCOAP_CRYPTO_PENDING when the job is submitted,
+   the calling process is polled when it is done and then has to call
+   oscoap_decode_packet_finish(). The packet buffer must stay untouched. */
+coap_status_t oscoap_parser_async(void *packet, uint8_t *data, uint16_t data_len, oscoap_crypto_job_t* job);
+coap_status_t oscoap_decode_packet_start(coap_packet_t* coap_pkt, oscoap_crypto_job_t* job);
+coap_status_t oscoap_decode_packet_finish(coap_packet_t* coap_pkt, oscoap_crypto_job_t* job);
+
+/* Like oscoap_prepare_message(), but the encryption runs on the AEAD backend.
+   Returns OSCOAP_CRYPTO_PENDING when the job is submitted, the calling
+   process is polled when it is done and then serializes the message with
+   oscoap_prepare_message_finish(). The packet must stay untouched. */
+coap_status_t oscoap_prepare_message_start(void* packet, oscoap_crypto_job_t* job);
+size_t oscoap_prepare_message_finish(void* packet, uint8_t* buffer, oscoap_crypto_job_t* job);
+
 void oscoap_restore_packet(void* packet);
 size_t oscoap_prepare_plaintext(void* packet, uint8_t* plaintext_buffer);
 
@@ -31,7 +31,7 @@ USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "opt-cose.h"
 #include "opt-cbor.h"
-#include "cose-aes-ccm.h"
+#include "cose-aead.h"
 #include <string.h>
 #include "er-oscoap.h"
 
@@ -322,12 +322,9 @@ uint8_t OPT_COSE_Encrypt(opt_cose_encrypt_t *cose, uint8_t *key, size_t key_len)
 
 	int ret = 0;
 
+	const struct cose_aead_driver *aead = cose_aead_get(cose->alg);
 
-    size_t TSize = 8; //Sort this out
-
-    if(cose->alg == COSE_Algorithm_AES_CCM_64_64_128 && key_len == 16){
-		//cipher = MBEDTLS_CIPHER_ID_AES;
-	}else{
+	if(aead == NULL || key_len != aead->key_len || cose->nonce_len != aead->nonce_len){
 		PRINTF("Error in Encrypt with key and algorithm\n");
 		return 1;
 	}
@@ -350,8 +347,8 @@ uint8_t OPT_COSE_Encrypt(opt_cose_encrypt_t *cose, uint8_t *key, size_t key_len)
  // memcpy(cose->ciphertext, cose->plaintext, cose->plaintext_len);
 
 
-  COSE_AES_CCM.set_key(key);
-  COSE_AES_CCM.aead(cose->nonce, cose->ciphertext, cose->plaintext_len, cose->aad, cose->aad_len, &cose->ciphertext[cose->plaintext_len], TSize, 1);
+  aead->set_key(key);
+  aead->aead(cose->nonce, cose->ciphertext, cose->plaintext_len, cose->aad, cose->aad_len, &cose->ciphertext[cose->plaintext_len], 1);
   PRINTF("CCM STAR ciphertext:\n");
   PRINTF_HEX(cose->ciphertext, cose->ciphertext_len);
 
@@ -370,14 +367,12 @@ uint8_t OPT_COSE_Decrypt(opt_cose_encrypt_t *cose, uint8_t *key, size_t key_len)
 
 	int ret = 0;
 	
+	const struct cose_aead_driver *aead = cose_aead_get(cose->alg);
 
-    if(cose->alg == COSE_Algorithm_AES_CCM_64_64_128 && key_len == 16){
-//		cipher = MBEDTLS_CIPHER_ID_AES;
-	}else{
+	if(aead == NULL || key_len != aead->key_len || cose->nonce_len != aead->nonce_len){
 		PRINTF("Error in Decrypt with key and algorithm\n");
 		return 1;
 	}
-	size_t TagSize = 8; //Sort this out
 	
 
 	PRINTF("Decrypting:\n");
@@ -391,12 +386,12 @@ uint8_t OPT_COSE_Decrypt(opt_cose_encrypt_t *cose, uint8_t *key, size_t key_len)
 
   
 
-  uint8_t tag[TagSize];
+  uint8_t tag[COSE_AEAD_MAX_TAG_LEN];
 
-  COSE_AES_CCM.set_key(key);
-  COSE_AES_CCM.aead(cose->nonce, cose->ciphertext, cose->plaintext_len, cose->aad, cose->aad_len, tag, TagSize, 0);
+  aead->set_key(key);
+  aead->aead(cose->nonce, cose->ciphertext, cose->plaintext_len, cose->aad, cose->aad_len, tag, 0);
 
-  if(memcmp(tag, &cose->ciphertext[cose->plaintext_len], TagSize) != 0){
+  if(memcmp(tag, &cose->ciphertext[cose->plaintext_len], aead->tag_len) != 0){
   	PRINTF("ERROR vadidating AES-CCM tag\n");
   	return 1;
   }
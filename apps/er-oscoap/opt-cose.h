@@ -68,7 +68,9 @@ typedef struct opt_cose_encrypt_t{
 #define INCLUDE_KID 					  1
 #define INCLUDE_PARTIAL_IV 				  2
 
+#define COSE_Algorithm_AES_CCM_16_64_128 10
 #define COSE_Algorithm_AES_CCM_64_64_128 12 
+#define COSE_Algorithm_ChaCha20_Poly1305 24
 #define COSE_Header_KID 				  4 
 #define COSE_Header_Partial_IV 			  6
 
@@ -49,6 +49,9 @@
 #define ORCHESTRA_RULES { &eb_per_time_source, &unicast_per_neighbor_rpl_storing, &default_common }
 /* Example configuration for RPL non-storing mode: */
 /* #define ORCHESTRA_RULES { &eb_per_time_source, &unicast_per_neighbor_rpl_ns, &default_common } */
+/* Example configuration with extra cells allocated to loaded links (RPL storing mode,
+ * requires LINK_STATS_CONF_PACKET_COUNTERS): */
+/* #define ORCHESTRA_RULES { &eb_per_time_source, &unicast_traffic_adaptive, &unicast_per_neighbor_rpl_storing, &default_common } */
 
 #endif /* ORCHESTRA_CONF_RULES */
 
@@ -102,4 +105,59 @@
 #define ORCHESTRA_COLLISION_FREE_HASH             0 /* Set to 1 if ORCHESTRA_LINKADDR_HASH returns unique hashes */
 #endif /* ORCHESTRA_CONF_COLLISION_FREE_HASH */
 
+/* Length of the slotframe holding the traffic-adaptive cells. Use a period
+ * co-prime with the other slotframes. */
+#ifdef ORCHESTRA_CONF_ADAPTIVE_PERIOD
+#define ORCHESTRA_ADAPTIVE_PERIOD                 ORCHESTRA_CONF_ADAPTIVE_PERIOD
+#else /* ORCHESTRA_CONF_ADAPTIVE_PERIOD */
+#define ORCHESTRA_ADAPTIVE_PERIOD                 13
+#endif /* ORCHESTRA_CONF_ADAPTIVE_PERIOD */
+
+/* Maximum number of adaptive cells per link and direction, per slotframe */
+#ifdef ORCHESTRA_CONF_ADAPTIVE_MAX_CELLS
+#define ORCHESTRA_ADAPTIVE_MAX_CELLS              ORCHESTRA_CONF_ADAPTIVE_MAX_CELLS
+#else /* ORCHESTRA_CONF_ADAPTIVE_MAX_CELLS */
+#define ORCHESTRA_ADAPTIVE_MAX_CELLS              3
+#endif /* ORCHESTRA_CONF_ADAPTIVE_MAX_CELLS */
+
+/* Period over which the traffic of each link is measured, in clock ticks */
+#ifdef ORCHESTRA_CONF_ADAPTIVE_EPOCH
+#define ORCHESTRA_ADAPTIVE_EPOCH                  ORCHESTRA_CONF_ADAPTIVE_EPOCH
+#else /* ORCHESTRA_CONF_ADAPTIVE_EPOCH */
+#define ORCHESTRA_ADAPTIVE_EPOCH                  (16 * CLOCK_SECOND)
+#endif /* ORCHESTRA_CONF_ADAPTIVE_EPOCH */
+
+/* Hysteresis: add a cell when the link used ORCHESTRA_ADAPTIVE_UP_PERCENT of its
+ * capacity over the last epoch, remove one when the remaining cells would still
+ * be used less than ORCHESTRA_ADAPTIVE_DOWN_PERCENT */
+#ifdef ORCHESTRA_CONF_ADAPTIVE_UP_PERCENT
+#define ORCHESTRA_ADAPTIVE_UP_PERCENT             ORCHESTRA_CONF_ADAPTIVE_UP_PERCENT
+#else /* ORCHESTRA_CONF_ADAPTIVE_UP_PERCENT */
+#define ORCHESTRA_ADAPTIVE_UP_PERCENT             75
+#endif /* ORCHESTRA_CONF_ADAPTIVE_UP_PERCENT */
+
+#ifdef ORCHESTRA_CONF_ADAPTIVE_DOWN_PERCENT
+#define ORCHESTRA_ADAPTIVE_DOWN_PERCENT           ORCHESTRA_CONF_ADAPTIVE_DOWN_PERCENT
+#else /* ORCHESTRA_CONF_ADAPTIVE_DOWN_PERCENT */
+#define ORCHESTRA_ADAPTIVE_DOWN_PERCENT           40
+#endif /* ORCHESTRA_CONF_ADAPTIVE_DOWN_PERCENT */
+
+/* Senders count the frames acknowledged, receivers the frames received, which
+ * also include those whose ACK was lost. Receivers use thresholds lowered by
+ * this many percentage points so that they add listening cells no later than
+ * their neighbor adds transmitting cells */
+#ifdef ORCHESTRA_CONF_ADAPTIVE_RX_MARGIN
+#define ORCHESTRA_ADAPTIVE_RX_MARGIN              ORCHESTRA_CONF_ADAPTIVE_RX_MARGIN
+#else /* ORCHESTRA_CONF_ADAPTIVE_RX_MARGIN */
+#define ORCHESTRA_ADAPTIVE_RX_MARGIN              20
+#endif /* ORCHESTRA_CONF_ADAPTIVE_RX_MARGIN */
+
+/* Expected number of transmissions (queued packets times ETX) above which a
+ * sender also uses the spare cell its receiver listens to */
+#ifdef ORCHESTRA_CONF_ADAPTIVE_BACKLOG
+#define ORCHESTRA_ADAPTIVE_BACKLOG                ORCHESTRA_CONF_ADAPTIVE_BACKLOG
+#else /* ORCHESTRA_CONF_ADAPTIVE_BACKLOG */
+#define ORCHESTRA_ADAPTIVE_BACKLOG                4
+#endif /* ORCHESTRA_CONF_ADAPTIVE_BACKLOG */
+
 #endif /* __ORCHESTRA_CONF_H__ */
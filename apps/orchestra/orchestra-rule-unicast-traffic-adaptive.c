@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2015, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ */
+/**
+ * \file
+ *         Orchestra: a slotframe with extra unicast cells for loaded links.
+ *         Every epoch, each node counts the frames its RPL parent and children
+ *         acknowledged and the frames it received from them (link-stats packet
+ *         counters, so both ends count the frames that got through) and
+ *         raises or lowers, with hysteresis, the number of cells of each link
+ *         and direction. The k-th cell from sender S to receiver R is at
+ *         timeslot (7*hash(S) + 3*hash(R) + k*ORCHESTRA_ADAPTIVE_PERIOD/ORCHESTRA_ADAPTIVE_MAX_CELLS)
+ *         so that both ends compute it without negotiation. Receivers listen to one
+ *         spare cell, that senders use when their queue to the receiver builds up.
+ *         Designed for RPL storing mode, to be placed before the per-neighbor
+ *         unicast rule, which keeps carrying the traffic of idle links.
+ */
+
+#include "contiki.h"
+#include "orchestra.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/link-stats.h"
+#include "net/nbr-table.h"
+#include "net/mac/tsch/tsch-private.h"
+#include <string.h>
+
+/* Without the packet counters, the rule is left out and orchestra.h does not
+ * declare it */
+#if LINK_STATS_PACKET_COUNTERS
+
+/* Number of times per epoch the queues are checked for a backlog */
+#define TICKS_PER_EPOCH 4
+
+/* Adaptive state of a link to an RPL parent or child */
+struct adaptive_nbr {
+  uint16_t last_acked;  /* Counter snapshots at the start of the epoch */
+  uint16_t last_rx;
+  uint8_t tx_level;     /* Number of cells we transmit to the neighbor in */
+  uint8_t rx_level;     /* Number of cells we expect the neighbor to use */
+  uint8_t tx_spare;     /* Do we also use the spare cell? */
+  uint8_t next_cell;    /* Round-robin index of the next packet cell */
+  uint8_t is_linked;    /* Is the neighbor still our parent or a child? */
+};
+
+NBR_TABLE(struct adaptive_nbr, adaptive_nbrs);
+
+static uint16_t slotframe_handle = 0;
+static uint16_t channel_offset = 0;
+static struct tsch_slotframe *sf_adaptive;
+static struct ctimer tick_timer;
+static uint8_t tick_count;
+
+/*---------------------------------------------------------------------------*/
+static uint16_t
+get_cell_timeslot(const linkaddr_t *sender, const linkaddr_t *receiver, uint8_t k)
+{
+  return ((uint16_t)ORCHESTRA_LINKADDR_HASH(sender) * 7
+          + (uint16_t)ORCHESTRA_LINKADDR_HASH(receiver) * 3
+          + k * (ORCHESTRA_ADAPTIVE_PERIOD / ORCHESTRA_ADAPTIVE_MAX_CELLS))
+         % ORCHESTRA_ADAPTIVE_PERIOD;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+get_tx_cells(const struct adaptive_nbr *n)
+{
+  return n->tx_level > 0 ? n->tx_level + n->tx_spare : 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+get_rx_cells(const struct adaptive_nbr *n)
+{
+  return n->rx_level > 0 ? n->rx_level + 1 : 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Marks the cells that packets queued to a neighbor are bound to, so that they
+ * are kept until the packets are gone. Returns the number of such packets. */
+static int
+mark_bound_cells(const linkaddr_t *addr, uint8_t *options)
+{
+  struct tsch_neighbor *n = tsch_queue_get_nbr(addr);
+  struct tsch_packet *p;
+  int count = 0;
+  int i;
+
+  for(i = 0; (p = tsch_queue_get_packet_at(n, i)) != NULL; i++) {
+    if(queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_SLOTFRAME) == slotframe_handle) {
+      uint16_t timeslot = queuebuf_attr(p->qb, PACKETBUF_ATTR_TSCH_TIMESLOT);
+      if(options != NULL && timeslot < ORCHESTRA_ADAPTIVE_PERIOD) {
+        options[timeslot] |= LINK_OPTION_TX | LINK_OPTION_SHARED;
+      }
+      count++;
+    }
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+/* Brings the slotframe in line with the current levels */
+static void
+update_cells(void)
+{
+  uint8_t options[ORCHESTRA_ADAPTIVE_PERIOD];
+  struct adaptive_nbr *n;
+  uint16_t timeslot;
+  uint8_t k;
+
+  memset(options, 0, sizeof(options));
+  for(n = nbr_table_head(adaptive_nbrs); n != NULL; n = nbr_table_next(adaptive_nbrs, n)) {
+    const linkaddr_t *addr = nbr_table_get_lladdr(adaptive_nbrs, n);
+    for(k = 0; k < get_tx_cells(n); k++) {
+      options[get_cell_timeslot(&linkaddr_node_addr, addr, k)] |= LINK_OPTION_TX | LINK_OPTION_SHARED;
+    }
+    for(k = 0; k < get_rx_cells(n); k++) {
+      options[get_cell_timeslot(addr, &linkaddr_node_addr, k)] |= LINK_OPTION_RX;
+    }
+    mark_bound_cells(addr, options);
+  }
+
+  for(timeslot = 0; timeslot < ORCHESTRA_ADAPTIVE_PERIOD; timeslot++) {
+    struct tsch_link *l = tsch_schedule_get_link_by_timeslot(sf_adaptive, timeslot);
+    if(options[timeslot] == 0) {
+      if(l != NULL) {
+        tsch_schedule_remove_link(sf_adaptive, l);
+      }
+    } else if(l == NULL || l->link_options != options[timeslot]) {
+      tsch_schedule_add_link(sf_adaptive, options[timeslot], LINK_TYPE_NORMAL,
+                             &tsch_broadcast_address, timeslot, channel_offset);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the level for the next epoch, given the frames of the last one */
+static uint8_t
+get_next_level(uint8_t level, uint16_t count, uint8_t margin)
+{
+  /* Number of slotframe repetitions within an epoch */
+  uint32_t epoch_slots = (uint32_t)ORCHESTRA_ADAPTIVE_EPOCH * RTIMER_SECOND / CLOCK_SECOND
+                         / tsch_timing[tsch_ts_timeslot_length];
+  uint32_t base_capacity = epoch_slots / ORCHESTRA_UNICAST_PERIOD;
+  uint32_t cell_capacity = epoch_slots / ORCHESTRA_ADAPTIVE_PERIOD;
+  /* Frames the base unicast cell and our cells can carry in an epoch */
+  uint32_t capacity = base_capacity + level * cell_capacity;
+
+  if(level < ORCHESTRA_ADAPTIVE_MAX_CELLS - 1
+     && (uint32_t)count * 100 >= capacity * (ORCHESTRA_ADAPTIVE_UP_PERCENT - margin)) {
+    return level + 1;
+  }
+  if(level > 0
+     && (uint32_t)count * 100 < (capacity - cell_capacity) * (ORCHESTRA_ADAPTIVE_DOWN_PERCENT - margin)) {
+    return level - 1;
+  }
+  return level;
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_levels(struct adaptive_nbr *n, const linkaddr_t *addr)
+{
+  uint16_t tx = 0;
+  uint16_t rx = 0;
+  const struct link_stats *stats = link_stats_from_lladdr(addr);
+  if(stats != NULL) {
+    /* Frames, not transmissions: the receiver cannot count retransmissions,
+     * and a sender that did would outgrow the cells its receiver listens to
+     * on lossy links */
+    tx = stats->cnt_total.num_packets_acked - n->last_acked;
+    rx = stats->cnt_total.num_packets_rx - n->last_rx;
+    n->last_acked = stats->cnt_total.num_packets_acked;
+    n->last_rx = stats->cnt_total.num_packets_rx;
+  }
+
+  if(n->is_linked) {
+    n->tx_level = get_next_level(n->tx_level, tx, 0);
+    n->rx_level = get_next_level(n->rx_level, rx, ORCHESTRA_ADAPTIVE_RX_MARGIN);
+  } else {
+    n->tx_level = 0;
+    n->rx_level = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+update_spare(struct adaptive_nbr *n, const linkaddr_t *addr)
+{
+  struct tsch_neighbor *tsch_n = tsch_queue_get_nbr(addr);
+  const struct link_stats *stats = link_stats_from_lladdr(addr);
+  uint16_t etx = stats != NULL ? stats->etx : LINK_STATS_ETX_DIVISOR;
+  int queued = 0;
+
+  while(tsch_queue_get_packet_at(tsch_n, queued) != NULL) {
+    queued++;
+  }
+  /* Expected number of transmissions needed to empty the queue */
+  if((uint32_t)queued * etx >= (uint32_t)ORCHESTRA_ADAPTIVE_BACKLOG * LINK_STATS_ETX_DIVISOR) {
+    n->tx_spare = 1;
+  } else if(queued == 0) {
+    n->tx_spare = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+tick(void *ptr)
+{
+  struct adaptive_nbr *n = nbr_table_head(adaptive_nbrs);
+  int is_new_epoch;
+
+  ctimer_reset(&tick_timer);
+  tick_count = (tick_count + 1) % TICKS_PER_EPOCH;
+  is_new_epoch = tick_count == 0;
+
+  while(n != NULL) {
+    struct adaptive_nbr *next = nbr_table_next(adaptive_nbrs, n);
+    const linkaddr_t *addr = nbr_table_get_lladdr(adaptive_nbrs, n);
+    if(is_new_epoch) {
+      update_levels(n, addr);
+    }
+    update_spare(n, addr);
+    if(!n->is_linked && get_tx_cells(n) == 0 && get_rx_cells(n) == 0
+       && mark_bound_cells(addr, NULL) == 0) {
+      /* Former parent or child with no packet left in our cells */
+      nbr_table_remove(adaptive_nbrs, n);
+    }
+    n = next;
+  }
+  update_cells();
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_nbr(const linkaddr_t *addr)
+{
+  struct adaptive_nbr *n;
+  if(addr == NULL || linkaddr_cmp(addr, &linkaddr_null)) {
+    return;
+  }
+  n = nbr_table_get_from_lladdr(adaptive_nbrs, addr);
+  if(n == NULL) {
+    n = nbr_table_add_lladdr(adaptive_nbrs, addr, NBR_TABLE_REASON_MAC, NULL);
+    if(n == NULL) {
+      return;
+    }
+    {
+      const struct link_stats *stats = link_stats_from_lladdr(addr);
+      if(stats != NULL) {
+        n->last_acked = stats->cnt_total.num_packets_acked;
+        n->last_rx = stats->cnt_total.num_packets_rx;
+      }
+    }
+    nbr_table_lock(adaptive_nbrs, n);
+  }
+  n->is_linked = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_nbr(const linkaddr_t *addr)
+{
+  struct adaptive_nbr *n;
+  if(addr == NULL) {
+    return;
+  }
+  n = nbr_table_get_from_lladdr(adaptive_nbrs, addr);
+  if(n != NULL) {
+    /* Release the cells now, the entry itself goes once the packets
+     * already bound to our cells are sent */
+    n->is_linked = 0;
+    n->tx_level = 0;
+    n->rx_level = 0;
+    update_cells();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+child_added(const linkaddr_t *linkaddr)
+{
+  add_nbr(linkaddr);
+}
+/*---------------------------------------------------------------------------*/
+static void
+child_removed(const linkaddr_t *linkaddr)
+{
+  remove_nbr(linkaddr);
+}
+/*---------------------------------------------------------------------------*/
+static int
+select_packet(uint16_t *slotframe, uint16_t *timeslot)
+{
+  /* Select data packets to loaded links, spread over the link cells */
+  const linkaddr_t *dest = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  if(packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE) == FRAME802154_DATAFRAME
+     && !linkaddr_cmp(dest, &linkaddr_null)) {
+    struct adaptive_nbr *n = nbr_table_get_from_lladdr(adaptive_nbrs, dest);
+    uint8_t cells = n != NULL && n->is_linked ? get_tx_cells(n) : 0;
+    if(cells > 0) {
+      n->next_cell = (n->next_cell + 1) % cells;
+      if(slotframe != NULL) {
+        *slotframe = slotframe_handle;
+      }
+      if(timeslot != NULL) {
+        *timeslot = get_cell_timeslot(&linkaddr_node_addr, dest, n->next_cell);
+      }
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+new_time_source(const struct tsch_neighbor *old, const struct tsch_neighbor *new)
+{
+  if(new != old) {
+    remove_nbr(old != NULL ? &old->addr : NULL);
+    add_nbr(new != NULL ? &new->addr : NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(uint16_t sf_handle)
+{
+  slotframe_handle = sf_handle;
+  channel_offset = sf_handle;
+  nbr_table_register(adaptive_nbrs, NULL);
+  /* Slotframe for traffic-adaptive unicast cells, empty until links get loaded */
+  sf_adaptive = tsch_schedule_add_slotframe(slotframe_handle, ORCHESTRA_ADAPTIVE_PERIOD);
+  ctimer_set(&tick_timer, ORCHESTRA_ADAPTIVE_EPOCH / TICKS_PER_EPOCH, tick, NULL);
+}
+/*---------------------------------------------------------------------------*/
+struct orchestra_rule unicast_traffic_adaptive = {
+  init,
+  new_time_source,
+  select_packet,
+  child_added,
+  child_removed,
+};
+
+#endif /* LINK_STATS_PACKET_COUNTERS */
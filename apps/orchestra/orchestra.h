@@ -41,6 +41,7 @@
 #include "net/mac/tsch/tsch.h"
 #include "net/mac/tsch/tsch-conf.h"
 #include "net/mac/tsch/tsch-schedule.h"
+#include "net/link-stats.h"
 #include "orchestra-conf.h"
 
 /* The structure of an Orchestra rule */
@@ -55,6 +56,12 @@ struct orchestra_rule {
 struct orchestra_rule eb_per_time_source;
 struct orchestra_rule unicast_per_neighbor_rpl_storing;
 struct orchestra_rule unicast_per_neighbor_rpl_ns;
+#if LINK_STATS_PACKET_COUNTERS
+/* Sizes its cells from the link-stats packet counters: without
+ * LINK_STATS_CONF_PACKET_COUNTERS, naming it in ORCHESTRA_CONF_RULES
+ * fails to compile */
+struct orchestra_rule unicast_traffic_adaptive;
+#endif /* LINK_STATS_PACKET_COUNTERS */
 struct orchestra_rule default_common;
 
 extern linkaddr_t orchestra_parent_linkaddr;
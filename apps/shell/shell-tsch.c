@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         TSCH commands of the Contiki shell
+ */
+
+#include "contiki.h"
+#include "shell.h"
+#include "net/mac/tsch/tsch-slot-timing.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if TSCH_SLOT_TIMING_ENABLED
+#include "net/mac/tsch/tsch-slot-operation.h"
+#endif /* TSCH_SLOT_TIMING_ENABLED */
+
+/*---------------------------------------------------------------------------*/
+PROCESS(shell_tsch_timing_process, "tsch-timing");
+SHELL_COMMAND(tsch_timing_command,
+	      "tsch-timing",
+	      "tsch-timing [slots|reset]: print TSCH slot phase timings",
+	      &shell_tsch_timing_process);
+/*---------------------------------------------------------------------------*/
+#if TSCH_SLOT_TIMING_ENABLED
+static void
+print_stats(void)
+{
+  struct tsch_slot_timing_stats s[TSCH_SLOT_PHASE_COUNT];
+  char buf[128];
+  int len;
+  int i;
+  int j;
+
+  /* Copy the stats with slot operation held off, print them after */
+  if(!tsch_get_lock()) {
+    shell_output_str(&tsch_timing_command, "TSCH busy, try again", "");
+    return;
+  }
+  for(i = 0; i < TSCH_SLOT_PHASE_COUNT; i++) {
+    s[i] = *tsch_slot_timing_stats(i);
+  }
+  tsch_release_lock();
+
+  for(i = 0; i < TSCH_SLOT_PHASE_COUNT; i++) {
+    len = snprintf(buf, sizeof(buf), "%s n %lu min %u max %u bins",
+                   tsch_slot_timing_phase_name(i), (unsigned long)s[i].count,
+                   (unsigned)s[i].min, (unsigned)s[i].max);
+    for(j = 0; j < TSCH_SLOT_TIMING_BINS && len < sizeof(buf); j++) {
+      len += snprintf(buf + len, sizeof(buf) - len, " %lu",
+                      (unsigned long)s[i].bins[j]);
+    }
+    shell_output_str(&tsch_timing_command, buf, "");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_slots(void)
+{
+  struct tsch_slot_timing slots[TSCH_SLOT_TIMING_HISTORY_LEN];
+  char buf[80];
+  int count;
+  int len;
+  int i;
+  int j;
+
+  if(!tsch_get_lock()) {
+    shell_output_str(&tsch_timing_command, "TSCH busy, try again", "");
+    return;
+  }
+  for(count = 0; count < TSCH_SLOT_TIMING_HISTORY_LEN; count++) {
+    if(!tsch_slot_timing_get_slot(count, &slots[count])) {
+      break;
+    }
+  }
+  tsch_release_lock();
+
+  len = snprintf(buf, sizeof(buf), "asn");
+  for(j = 0; j < TSCH_SLOT_PHASE_COUNT && len < sizeof(buf); j++) {
+    len += snprintf(buf + len, sizeof(buf) - len, " %s",
+                    tsch_slot_timing_phase_name(j));
+  }
+  shell_output_str(&tsch_timing_command, buf, "");
+
+  /* Oldest slot first; phases that did not run are printed as - */
+  for(i = count - 1; i >= 0; i--) {
+    len = snprintf(buf, sizeof(buf), "asn %02x.%08lx",
+                   slots[i].asn.ms1b, (unsigned long)slots[i].asn.ls4b);
+    for(j = 0; j < TSCH_SLOT_PHASE_COUNT && len < sizeof(buf); j++) {
+      if(slots[i].phases & (1 << j)) {
+        len += snprintf(buf + len, sizeof(buf) - len, " %u",
+                        (unsigned)slots[i].time[j]);
+      } else {
+        len += snprintf(buf + len, sizeof(buf) - len, " -");
+      }
+    }
+    shell_output_str(&tsch_timing_command, buf, "");
+  }
+}
+#endif /* TSCH_SLOT_TIMING_ENABLED */
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(shell_tsch_timing_process, ev, data)
+{
+#if TSCH_SLOT_TIMING_ENABLED
+  const char *args;
+#endif /* TSCH_SLOT_TIMING_ENABLED */
+
+  PROCESS_BEGIN();
+
+#if TSCH_SLOT_TIMING_ENABLED
+  args = data;
+  while(args != NULL && *args == ' ') {
+    args++;
+  }
+
+  if(args == NULL || *args == '\0') {
+    print_stats();
+  } else if(strcmp(args, "slots") == 0) {
+    print_slots();
+  } else if(strcmp(args, "reset") == 0) {
+    if(tsch_get_lock()) {
+      tsch_slot_timing_reset();
+      tsch_release_lock();
+    } else {
+      shell_output_str(&tsch_timing_command, "TSCH busy, try again", "");
+    }
+  } else {
+    shell_output_str(&tsch_timing_command,
+                     "usage: tsch-timing [slots|reset]", "");
+  }
+#else /* TSCH_SLOT_TIMING_ENABLED */
+  shell_output_str(&tsch_timing_command,
+                   "TSCH slot timing disabled, set TSCH_SLOT_TIMING_CONF_ENABLED", "");
+#endif /* TSCH_SLOT_TIMING_ENABLED */
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+void
+shell_tsch_init(void)
+{
+  shell_register_command(&tsch_timing_command);
+}
+/*---------------------------------------------------------------------------*/
@@ -41,6 +41,9 @@
 #include "contiki-net.h"
 #include "net/ip/uip-split.h"
 #include "net/ip/uip-packetqueue.h"
+#include "net/ip/uip-udp-packet.h"
+#include "lib/list.h"
+#include "lib/memb.h"
 
 #if NETSTACK_CONF_WITH_IPV6
 #include "net/ipv6/uip-nd6.h"
@@ -108,7 +111,8 @@ static struct internal_state {
 enum {
   TCP_POLL,
   UDP_POLL,
-  PACKET_INPUT
+  PACKET_INPUT,
+  UDP_QUEUE_SEND
 };
 
 /* Called on IP packet output. */
@@ -157,6 +161,26 @@ tcpip_set_outputfunc(uint8_t (*f)(void))
 unsigned char tcpip_is_forwarding; /* Forwarding right now? */
 #endif /* UIP_CONF_IP_FORWARD */
 
+#if UIP_UDP && TCPIP_UDP_QUEUE_NUM
+/* A datagram in the UDP transmit queue */
+struct udp_queue_entry {
+  struct udp_queue_entry *next;
+  struct uip_udp_conn *conn;
+  uip_ipaddr_t toaddr;
+  uint16_t toport;
+  uint16_t len;
+  uint8_t priority;
+  uint8_t data[TCPIP_UDP_QUEUE_DATA_LEN];
+};
+
+MEMB(udp_queue_memb, struct udp_queue_entry, TCPIP_UDP_QUEUE_NUM);
+/* Sorted by decreasing priority, in order within a priority */
+LIST(udp_queue);
+static uint8_t udp_priority[UIP_UDP_CONNS];
+/* A UDP_QUEUE_SEND event is pending */
+static uint8_t udp_queue_posted;
+#endif /* UIP_UDP && TCPIP_UDP_QUEUE_NUM */
+
 PROCESS(tcpip_process, "TCP/IP stack");
 
 /*---------------------------------------------------------------------------*/
@@ -406,7 +430,7 @@ eventhandler(process_event_t ev, process_data_t data)
       for(cptr = &uip_udp_conns[0];
           cptr < &uip_udp_conns[UIP_UDP_CONNS]; ++cptr) {
         if(cptr->appstate.p == p) {
-          cptr->lport = 0;
+          uip_udp_remove(cptr);
         }
       }
     }
@@ -515,6 +539,14 @@ eventhandler(process_event_t ev, process_data_t data)
   case PACKET_INPUT:
     packet_input();
     break;
+
+#if UIP_UDP && TCPIP_UDP_QUEUE_NUM
+  case UDP_QUEUE_SEND:
+  case PROCESS_EVENT_POLL:
+    udp_queue_posted = 0;
+    tcpip_udp_queue_flush();
+    break;
+#endif /* UIP_UDP && TCPIP_UDP_QUEUE_NUM */
   };
 }
 /*---------------------------------------------------------------------------*/
@@ -756,6 +788,106 @@ tcpip_poll_udp(struct uip_udp_conn *conn)
 }
 #endif /* UIP_UDP */
 /*---------------------------------------------------------------------------*/
+#if UIP_UDP && TCPIP_UDP_QUEUE_NUM
+void
+tcpip_udp_set_priority(struct uip_udp_conn *conn, uint8_t priority)
+{
+  udp_priority[conn - uip_udp_conns] = priority;
+}
+/*---------------------------------------------------------------------------*/
+int
+tcpip_udp_queue(struct uip_udp_conn *conn, const void *data, int len,
+                const uip_ipaddr_t *toaddr, uint16_t toport)
+{
+  struct udp_queue_entry *e;
+  struct udp_queue_entry *prev;
+  struct udp_queue_entry *next;
+
+  e = NULL;
+  if(len <= TCPIP_UDP_QUEUE_DATA_LEN) {
+    e = memb_alloc(&udp_queue_memb);
+  }
+  if(e == NULL) {
+    /* The datagram goes out right away, after the queued ones. Sending
+       them would overwrite a payload in uip_buf, which goes first. */
+    if((const uint8_t *)data < uip_buf ||
+       (const uint8_t *)data >= uip_buf + sizeof(uip_buf)) {
+      tcpip_udp_queue_flush();
+    }
+    return 0;
+  }
+
+  e->conn = conn;
+  uip_ipaddr_copy(&e->toaddr, toaddr);
+  e->toport = toport;
+  e->len = len;
+  e->priority = udp_priority[conn - uip_udp_conns];
+  memcpy(e->data, data, len);
+
+  /* After the datagrams of the same or a higher priority */
+  prev = NULL;
+  for(next = list_head(udp_queue);
+      next != NULL && next->priority >= e->priority;
+      next = list_item_next(next)) {
+    prev = next;
+  }
+  list_insert(udp_queue, prev, e);
+
+  /* An event rather than a poll, so that processes with events already
+     pending can queue their datagrams before the queue is sent */
+  if(!udp_queue_posted) {
+    if(process_post(&tcpip_process, UDP_QUEUE_SEND, NULL) == PROCESS_ERR_OK) {
+      udp_queue_posted = 1;
+    } else {
+      process_poll(&tcpip_process);
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tcpip_udp_queue_flush(void)
+{
+  struct udp_queue_entry *e;
+  struct uip_udp_conn *c;
+  uip_ipaddr_t curaddr;
+  uint16_t curport;
+
+  while((e = list_pop(udp_queue)) != NULL) {
+    c = e->conn;
+    /* Connections of exited processes have been unbound */
+    if(c->lport != 0) {
+      uip_ipaddr_copy(&curaddr, &c->ripaddr);
+      curport = c->rport;
+      uip_ipaddr_copy(&c->ripaddr, &e->toaddr);
+      c->rport = e->toport;
+
+      uip_udp_packet_output(c, e->data, e->len);
+
+      uip_ipaddr_copy(&c->ripaddr, &curaddr);
+      c->rport = curport;
+    }
+    memb_free(&udp_queue_memb, e);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tcpip_udp_conn_reset(struct uip_udp_conn *conn)
+{
+  struct udp_queue_entry *e;
+  struct udp_queue_entry *next;
+
+  for(e = list_head(udp_queue); e != NULL; e = next) {
+    next = list_item_next(e);
+    if(e->conn == conn) {
+      list_remove(udp_queue, e);
+      memb_free(&udp_queue_memb, e);
+    }
+  }
+  udp_priority[conn - uip_udp_conns] = TCPIP_UDP_PRIO_DATA;
+}
+#endif /* UIP_UDP && TCPIP_UDP_QUEUE_NUM */
+/*---------------------------------------------------------------------------*/
 #if UIP_TCP
 void
 tcpip_poll_tcp(struct uip_conn *conn)
@@ -824,6 +956,11 @@ PROCESS_THREAD(tcpip_process, ev, data)
   }
 #endif
 
+#if UIP_UDP && TCPIP_UDP_QUEUE_NUM
+  memb_init(&udp_queue_memb);
+  list_init(udp_queue);
+#endif /* UIP_UDP && TCPIP_UDP_QUEUE_NUM */
+
   tcpip_event = process_alloc_event();
 #if UIP_CONF_ICMP6
   tcpip_icmp6_event = process_alloc_event();
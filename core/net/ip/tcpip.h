@@ -274,6 +274,82 @@ struct uip_udp_conn *udp_broadcast_new(uint16_t port, void *appstate);
  */
 CCIF void tcpip_poll_udp(struct uip_udp_conn *conn);
 
+/**
+ * Number of UDP datagrams that can wait in the transmit queue. With a
+ * queue, uip_udp_packet_send() and uip_udp_packet_sendto() copy the
+ * datagram to the queue and return; the tcpip process builds and
+ * sends queued datagrams from uip_buf, highest priority first. This
+ * lets processes send while uip_buf holds another packet, for example
+ * from their tcpip_event handler. 0 sends datagrams right away.
+ */
+#ifdef TCPIP_CONF_UDP_QUEUE_NUM
+#define TCPIP_UDP_QUEUE_NUM TCPIP_CONF_UDP_QUEUE_NUM
+#else
+#define TCPIP_UDP_QUEUE_NUM 0
+#endif
+
+/**
+ * Largest payload of a queued UDP datagram. Larger datagrams are sent
+ * right away, after those already in the queue.
+ */
+#ifdef TCPIP_CONF_UDP_QUEUE_DATA_LEN
+#define TCPIP_UDP_QUEUE_DATA_LEN TCPIP_CONF_UDP_QUEUE_DATA_LEN
+#else
+#define TCPIP_UDP_QUEUE_DATA_LEN 128
+#endif
+
+/** Priority of UDP connections by default */
+#define TCPIP_UDP_PRIO_DATA     0
+/** Priority for routing and other control traffic over UDP */
+#define TCPIP_UDP_PRIO_CONTROL  1
+
+#if TCPIP_UDP_QUEUE_NUM
+/**
+ * Set the transmit queue priority of a UDP connection.
+ *
+ * Queued datagrams of connections with a higher priority are sent
+ * before those of connections with a lower one; datagrams of equal
+ * priority are sent in order.
+ *
+ * \param conn A pointer to the UDP connection.
+ * \param priority TCPIP_UDP_PRIO_DATA, TCPIP_UDP_PRIO_CONTROL or higher.
+ */
+void tcpip_udp_set_priority(struct uip_udp_conn *conn, uint8_t priority);
+
+/**
+ * Queue a UDP datagram for the tcpip process to send.
+ *
+ * \param conn The UDP connection.
+ * \param data The payload, copied to the queue.
+ * \param len The length of the payload.
+ * \param toaddr The destination address.
+ * \param toport The destination port in network byte order.
+ *
+ * \return 1 if queued. 0 if the datagram must be sent right away,
+ * which the function makes possible by first sending the queue. A
+ * payload in uip_buf is sent ahead of the queue instead, as sending
+ * the queue would overwrite it.
+ */
+int tcpip_udp_queue(struct uip_udp_conn *conn, const void *data, int len,
+                    const uip_ipaddr_t *toaddr, uint16_t toport);
+
+/**
+ * Send all datagrams in the UDP transmit queue now.
+ */
+void tcpip_udp_queue_flush(void);
+
+/**
+ * Drop the queued datagrams of a UDP connection and reset its
+ * priority, so that a new owner of the connection does not inherit
+ * them. Called by uip_udp_new() and uip_udp_remove().
+ *
+ * \param conn A pointer to the UDP connection.
+ */
+void tcpip_udp_conn_reset(struct uip_udp_conn *conn);
+#else /* TCPIP_UDP_QUEUE_NUM */
+#define tcpip_udp_conn_reset(conn)
+#endif /* TCPIP_UDP_QUEUE_NUM */
+
 /** @} */
  
 /**
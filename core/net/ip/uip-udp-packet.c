@@ -50,6 +50,17 @@ extern uint16_t uip_slen;
 void
 uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len)
 {
+#if UIP_UDP && TCPIP_UDP_QUEUE_NUM
+  if(data != NULL && tcpip_udp_queue(c, data, len, &c->ripaddr, c->rport)) {
+    return;
+  }
+#endif /* UIP_UDP && TCPIP_UDP_QUEUE_NUM */
+  uip_udp_packet_output(c, data, len);
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_packet_output(struct uip_udp_conn *c, const void *data, int len)
+{
 #if UIP_UDP
   if(data != NULL && len <= (UIP_BUFSIZE - (UIP_LLH_LEN + UIP_IPUDPH_LEN))) {
     uip_udp_conn = c;
@@ -45,5 +45,8 @@
 void uip_udp_packet_send(struct uip_udp_conn *c, const void *data, int len);
 void uip_udp_packet_sendto(struct uip_udp_conn *c, const void *data, int len,
 			   const uip_ipaddr_t *toaddr, uint16_t toport);
+/* Build the datagram in uip_buf and send it, bypassing the tcpip
+   transmit queue */
+void uip_udp_packet_output(struct uip_udp_conn *c, const void *data, int len);
 
 #endif /* UIP_UDP_PACKET_H_ */
@@ -874,7 +874,17 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  *
  * \hideinitializer
  */
-#define uip_udp_remove(conn) (conn)->lport = 0
+#if UIP_CONN_HASH_SIZE
+#define uip_udp_remove(conn) do {              \
+    tcpip_udp_conn_reset(conn);                \
+    uip_udp_set_lport(conn, 0);                \
+  } while(0)
+#else
+#define uip_udp_remove(conn) do {              \
+    tcpip_udp_conn_reset(conn);                \
+    (conn)->lport = 0;                         \
+  } while(0)
+#endif
 
 /**
  * Bind a UDP connection to a local port.
@@ -886,7 +896,24 @@ struct uip_udp_conn *uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport);
  *
  * \hideinitializer
  */
+#if UIP_CONN_HASH_SIZE
+#define uip_udp_bind(conn, port) uip_udp_set_lport(conn, port)
+#else
 #define uip_udp_bind(conn, port) (conn)->lport = port
+#endif
+
+#if UIP_CONN_HASH_SIZE
+/**
+ * Set the local port of a UDP connection and update the port hash
+ * table. Used by uip_udp_bind() and uip_udp_remove().
+ *
+ * \param conn A pointer to the uip_udp_conn structure for the
+ * connection.
+ *
+ * \param port The local port number, in network byte order, or 0.
+ */
+void uip_udp_set_lport(struct uip_udp_conn *conn, uint16_t port);
+#endif /* UIP_CONN_HASH_SIZE */
 
 /**
  * Send a UDP datagram of length len on the current connection.
@@ -2230,6 +2257,51 @@ uint16_t uip_udpchksum(void);
  */
 uint16_t uip_icmp6chksum(void);
 
+/**
+ * Add a buffer to a one's complement sum.
+ *
+ * The buffer is summed as 16-bit big endian words, an odd trailing
+ * byte is padded with zero. Architectures can provide a faster
+ * version by defining UIP_ARCH_CHKSUM_ADD.
+ *
+ * \param sum The sum so far, in host byte order.
+ * \param data A pointer to the buffer, no alignment is required.
+ * \param len The length of the buffer.
+ *
+ * \return The one's complement sum in host byte order.
+ */
+uint16_t uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len);
+
+/**
+ * Update a checksum after some of the data it covers was replaced.
+ *
+ * Implements equation 3 of RFC 1624. Replaced fields must start at even
+ * offsets within the checksummed data, and a field may be replaced by
+ * one of a different length (e.g. an IPv6 address in a pseudo-header by
+ * an IPv4 address).
+ *
+ * \param chksum The checksum field as found in the packet.
+ * \param old_sum uip_chksum_add() of the data that was removed.
+ * \param new_sum uip_chksum_add() of the data that was added.
+ *
+ * \return The new checksum field. A UDP checksum of 0 must still be
+ * sent as 0xffff by the caller.
+ */
+uint16_t uip_chksum_update(uint16_t chksum, uint16_t old_sum,
+                           uint16_t new_sum);
+
+/**
+ * Update a checksum after a 16-bit field was rewritten.
+ *
+ * \param chksum The checksum field as found in the packet.
+ * \param old_field The old value of the field, as found in the packet.
+ * \param new_field The new value of the field, as found in the packet.
+ *
+ * \return The new checksum field.
+ */
+uint16_t uip_chksum_update16(uint16_t chksum, uint16_t old_field,
+                             uint16_t new_field);
+
 
 #endif /* UIP_H_ */
 
@@ -365,6 +365,21 @@ void uip_log(char *msg);
 #define UIP_UDP_CONNS    10
 #endif /* UIP_CONF_UDP_CONNS */
 
+/**
+ * The number of buckets, a power of two, of the hash tables that map
+ * local ports to UDP and TCP connections. The tables are used to
+ * demultiplex incoming packets and to pick free ephemeral ports, and
+ * are worth their RAM when UIP_UDP_CONNS or UIP_CONNS is large. 0
+ * scans the connection tables instead. uIPv6 only.
+ *
+ * \hideinitializer
+ */
+#if defined UIP_CONF_CONN_HASH_SIZE && NETSTACK_CONF_WITH_IPV6
+#define UIP_CONN_HASH_SIZE (UIP_CONF_CONN_HASH_SIZE)
+#else
+#define UIP_CONN_HASH_SIZE 0
+#endif
+
 /**
  * The name of the function that should be called when UDP datagrams arrive.
  *
@@ -176,6 +176,36 @@ icmp_output()
   return;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Replace the addresses of the UDP datagram in uip_buf and patch its
+ * checksum for the new pseudo-header instead of clearing it.
+ */
+static void
+rewrite_addrs(const uip_ipaddr_t *src, const uip_ipaddr_t *dst)
+{
+  uint16_t old_sum;
+  uint16_t new_sum;
+  uip_ipaddr_t new_dst;
+
+  uip_ipaddr_copy(&new_dst, dst);
+  old_sum = uip_chksum_add(0, (uint8_t *)&UIP_IP_BUF->srcipaddr,
+                           2 * sizeof(uip_ipaddr_t));
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, src);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &new_dst);
+
+  if(UIP_UDP_BUF->udpchksum == 0) {
+    /* No checksum was computed, nothing to patch */
+    return;
+  }
+  new_sum = uip_chksum_add(0, (uint8_t *)&UIP_IP_BUF->srcipaddr,
+                           2 * sizeof(uip_ipaddr_t));
+  UIP_UDP_BUF->udpchksum = uip_chksum_update(UIP_UDP_BUF->udpchksum,
+                                             old_sum, new_sum);
+  if(UIP_UDP_BUF->udpchksum == 0) {
+    UIP_UDP_BUF->udpchksum = 0xffff;
+  }
+}
+/*---------------------------------------------------------------------------*/
 static void
 icmp_input()
 {
@@ -227,17 +257,14 @@ icmp_input()
   mcast_len = uip_len;
   /* pass the packet to our uip_process to check if it is allowed to 
    * accept this packet or not */
-  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &src_ip);
-  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &des_ip);
-  UIP_UDP_BUF->udpchksum = 0;
-  
+  rewrite_addrs(&src_ip, &des_ip);
+
   uip_process(UIP_DATA);
 
   memcpy(uip_buf, &mcast_buf, mcast_len);
   uip_len = mcast_len;
   /* Return the IP of the original Multicast sender */
-  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &src_ip);
-  UIP_UDP_BUF->udpchksum = 0;
+  rewrite_addrs(&src_ip, &UIP_IP_BUF->destipaddr);
   /* If we have an entry in the multicast routing table, something with
    * a higher RPL rank (somewhere down the tree) is a group member */
   if(uip_mcast6_route_lookup(&UIP_IP_BUF->destipaddr)) {
@@ -69,6 +69,10 @@
 #include "net/rime/rime.h"
 #include "net/ipv6/sicslowpan.h"
 #include "net/netstack.h"
+#if UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h"
+#endif /* UIP_CONF_IPV6_RPL */
 
 #include <stdio.h>
 
@@ -164,6 +168,35 @@ void uip_log(char *msg);
 #define COMPRESSION_THRESHOLD 0
 #endif
 
+/** \brief Priority class of outgoing packets, for the MAC queues
+    (PACKETBUF_CONF_WITH_PRIORITY). By default ICMPv6, i.e. RPL and
+    ND, is control traffic. Define SICSLOWPAN_CONF_PACKET_PRIORITY() to
+    classify from uip_buf, e.g. to mark CoAP ACKs as high priority. */
+#ifdef SICSLOWPAN_CONF_PACKET_PRIORITY
+#define PACKET_PRIORITY() SICSLOWPAN_CONF_PACKET_PRIORITY()
+#else
+#define PACKET_PRIORITY() (UIP_IP_BUF->proto == UIP_PROTO_ICMP6 ? \
+                           PACKETBUF_ATTR_PRIORITY_CONTROL : PACKETBUF_ATTR_PRIORITY_NORMAL)
+#endif
+
+/** \brief Generic Header Compression (RFC 7400) of UDP and ICMPv6
+    payloads that then fit in one frame. All nodes of the network
+    must agree on it. HC06 only. */
+#if defined(SICSLOWPAN_CONF_GHC) && SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+#define SICSLOWPAN_GHC SICSLOWPAN_CONF_GHC
+#else
+#define SICSLOWPAN_GHC 0
+#endif
+
+/** \brief Accept frames that carry several packets, as sent by
+    CSMA_CONF_WITH_AGGREGATION. The neighbors sending aggregates must
+    all be able to parse them. */
+#ifdef SICSLOWPAN_CONF_AGGREGATION
+#define SICSLOWPAN_AGGREGATION SICSLOWPAN_CONF_AGGREGATION
+#else
+#define SICSLOWPAN_AGGREGATION 0
+#endif
+
 /** \brief Fixed size of a frame header. This value is
  * used in case framer returns an error or if SICSLOWPAN_USE_FIXED_HDRLEN
  * is defined.
@@ -241,6 +274,47 @@ static uint16_t my_tag;
 #define SICSLOWPAN_REASS_CONTEXTS 2
 #endif
 
+/* Contexts are looked up by hashing (tag, sender) into this many
+   buckets */
+#ifdef SICSLOWPAN_CONF_REASS_BUCKETS
+#define SICSLOWPAN_REASS_BUCKETS SICSLOWPAN_CONF_REASS_BUCKETS
+#else
+#define SICSLOWPAN_REASS_BUCKETS SICSLOWPAN_REASS_CONTEXTS
+#endif
+
+/* Relay fragments of packets that are only passing through instead of
+   reassembling them, see forward_first_fragment() */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARDING
+#define SICSLOWPAN_FRAG_FORWARDING SICSLOWPAN_CONF_FRAG_FORWARDING
+#else
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+/* Number of packets that can be relayed at the same time */
+#ifdef SICSLOWPAN_CONF_FWD_ENTRIES
+#define SICSLOWPAN_FWD_ENTRIES SICSLOWPAN_CONF_FWD_ENTRIES
+#else
+#define SICSLOWPAN_FWD_ENTRIES 4
+#endif
+
+#ifdef SICSLOWPAN_CONF_FWD_BUCKETS
+#define SICSLOWPAN_FWD_BUCKETS SICSLOWPAN_CONF_FWD_BUCKETS
+#else
+#define SICSLOWPAN_FWD_BUCKETS SICSLOWPAN_FWD_ENTRIES
+#endif
+
+/* Contexts, buffers and forwarding entries are chained by int8_t index,
+   and hash buckets are picked with a uint8_t */
+#if SICSLOWPAN_REASS_CONTEXTS > 127 || SICSLOWPAN_FRAGMENT_BUFFERS > 127
+#error "SICSLOWPAN_CONF_REASS_CONTEXTS and SICSLOWPAN_CONF_FRAGMENT_BUFFERS must be at most 127"
+#endif
+#if SICSLOWPAN_FWD_ENTRIES > 127
+#error "SICSLOWPAN_CONF_FWD_ENTRIES must be at most 127"
+#endif
+#if SICSLOWPAN_REASS_BUCKETS > 256 || SICSLOWPAN_FWD_BUCKETS > 256
+#error "SICSLOWPAN_CONF_REASS_BUCKETS and SICSLOWPAN_CONF_FWD_BUCKETS must be at most 256"
+#endif
+
 /* The size of each fragment (IP payload) for the 6lowpan fragmentation */
 #ifdef SICSLOWPAN_CONF_FRAGMENT_SIZE
 #define SICSLOWPAN_FRAGMENT_SIZE SICSLOWPAN_CONF_FRAGMENT_SIZE
@@ -251,22 +325,38 @@ static uint16_t my_tag;
 /* Assuming that the worst growth for uncompression is 38 bytes */
 #define SICSLOWPAN_FIRST_FRAGMENT_SIZE (SICSLOWPAN_FRAGMENT_SIZE + 38)
 
+/* Fragment offsets are in units of 8 bytes. One bit per unit records
+   what has been received, for the largest datagram uip_buf can hold. */
+#define REASS_MAX_LEN    (UIP_BUFSIZE - UIP_LLH_LEN)
+#define REASS_UNITS(len) (((len) + 7) >> 3)
+#define REASS_BITMAP_LEN ((REASS_UNITS(REASS_MAX_LEN) + 7) >> 3)
+
+#define REASS_NONE       -1
+
 /* all information needed for reassembly */
 struct sicslowpan_frag_info {
   /** When reassembling, the source address of the fragments being merged */
   linkaddr_t sender;
-  /** The destination address of the fragments being merged */
-  linkaddr_t receiver;
   /** When reassembling, the tag in the fragments being merged. */
   uint16_t tag;
-  /** Total length of the fragmented packet */
+  /** Total length of the fragmented packet, zero if the context is free */
   uint16_t len;
-  /** Current length of reassembled fragments */
-  uint16_t reassembled_len;
+  /** Number of 8-byte units received so far */
+  uint16_t received_units;
+  /** One bit per 8-byte unit of the packet that has been received */
+  uint8_t received[REASS_BITMAP_LEN];
+  /** Next context in the same hash bucket */
+  int8_t next;
+  /** First buffer holding a fragment of this packet */
+  int8_t bufs;
+  /** Set when the packet was delivered or cannot complete. Later
+      fragments are dropped until the context times out or is needed
+      for another packet. */
+  uint8_t closed;
   /** Reassembly %process %timer. */
   struct timer reass_timer;
 
-  /** Fragment size of first fragment */
+  /** Fragment size of first fragment, zero until it has arrived */
   uint16_t first_frag_len;
   /** First fragment - needs a larger buffer since the size is uncompressed size
    and we need to know total size to know when we have received last fragment. */
@@ -274,34 +364,106 @@ struct sicslowpan_frag_info {
 };
 
 static struct sicslowpan_frag_info frag_info[SICSLOWPAN_REASS_CONTEXTS];
+static int8_t frag_bucket[SICSLOWPAN_REASS_BUCKETS];
 
 struct sicslowpan_frag_buf {
-  /* the index of the frag_info */
-  uint8_t index;
+  /* Next buffer of the same packet, or in the free list */
+  int8_t next;
   /* Fragment offset */
   uint8_t offset;
-  /* Length of this fragment (if zero this buffer is not allocated) */
+  /* Length of this fragment */
   uint8_t len;
   uint8_t data[SICSLOWPAN_FRAGMENT_SIZE];
 };
 
 static struct sicslowpan_frag_buf frag_buf[SICSLOWPAN_FRAGMENT_BUFFERS];
+static int8_t free_bufs;
+
+static struct sicslowpan_reass_stats reass_stats;
 
+/*---------------------------------------------------------------------------*/
+static void
+init_fragments(void)
+{
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_REASS_BUCKETS; i++) {
+    frag_bucket[i] = REASS_NONE;
+  }
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    frag_info[i].len = 0;
+  }
+  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
+    frag_buf[i].next = i + 1 < SICSLOWPAN_FRAGMENT_BUFFERS ? i + 1 : REASS_NONE;
+  }
+  free_bufs = 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+frag_hash(uint16_t tag, const linkaddr_t *sender)
+{
+  uint16_t h;
+  int i;
+
+  h = tag;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h = ((h << 5) | (h >> 11)) ^ sender->u8[i];
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+/* Give the fragment buffers of a context back to the free list */
+static int
+release_buffers(uint8_t context)
+{
+  int8_t i;
+  int count;
+
+  count = 0;
+  while(frag_info[context].bufs != REASS_NONE) {
+    i = frag_info[context].bufs;
+    frag_info[context].bufs = frag_buf[i].next;
+    frag_buf[i].next = free_bufs;
+    free_bufs = i;
+    count++;
+  }
+  return count;
+}
 /*---------------------------------------------------------------------------*/
 static int
 clear_fragments(uint8_t frag_info_index)
 {
-  int i, clear_count;
-  clear_count = 0;
-  frag_info[frag_info_index].len = 0;
-  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
-    if(frag_buf[i].len > 0 && frag_buf[i].index == frag_info_index) {
-      /* deallocate the buffer */
-      frag_buf[i].len = 0;
-      clear_count++;
+  int8_t *p;
+
+  for(p = &frag_bucket[frag_hash(frag_info[frag_info_index].tag,
+                                 &frag_info[frag_info_index].sender)
+                       % SICSLOWPAN_REASS_BUCKETS];
+      *p != REASS_NONE; p = &frag_info[*p].next) {
+    if(*p == frag_info_index) {
+      *p = frag_info[frag_info_index].next;
+      break;
     }
   }
-  return clear_count;
+  frag_info[frag_info_index].len = 0;
+  return release_buffers(frag_info_index);
+}
+/*---------------------------------------------------------------------------*/
+/* The buffers of a delivered or hopeless packet are freed at once, but
+   the context stays until it times out so that late fragments are
+   dropped instead of starting a new reassembly. */
+static void
+close_fragments(uint8_t context)
+{
+  release_buffers(context);
+  frag_info[context].closed = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+abort_fragments(uint8_t context)
+{
+  PRINTF("*** Discarding packet - tag: %d\n", frag_info[context].tag);
+  close_fragments(context);
+  reass_stats.discarded++;
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -313,104 +475,282 @@ timeout_fragments(int not_context)
     if(frag_info[i].len > 0 && i != not_context &&
        timer_expired(&frag_info[i].reass_timer)) {
       /* This context can be freed */
+      if(!frag_info[i].closed) {
+        reass_stats.timed_out++;
+      }
       count += clear_fragments(i);
     }
   }
   return count;
 }
 /*---------------------------------------------------------------------------*/
-static int
-store_fragment(uint8_t index, uint8_t offset)
+static int8_t
+find_fragments(uint16_t tag, const linkaddr_t *sender)
 {
-  int i;
-  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
-    if(frag_buf[i].len == 0) {
-      /* copy over the data from packetbuf into the fragment buffer and store offset and len */
-      frag_buf[i].offset = offset; /* frag offset */
-      frag_buf[i].len = packetbuf_datalen() - packetbuf_hdr_len;
-      frag_buf[i].index = index;
-      memcpy(frag_buf[i].data, packetbuf_ptr + packetbuf_hdr_len,
-             packetbuf_datalen() - packetbuf_hdr_len);
-
-      PRINTF("Fragsize: %d\n", frag_buf[i].len);
-      /* return the length of the stored fragment */
-      return frag_buf[i].len;
+  int8_t i;
+
+  for(i = frag_bucket[frag_hash(tag, sender) % SICSLOWPAN_REASS_BUCKETS];
+      i != REASS_NONE; i = frag_info[i].next) {
+    if(frag_info[i].tag == tag && linkaddr_cmp(&frag_info[i].sender, sender)) {
+      return i;
     }
   }
-  /* failed */
-  return -1;
+  return REASS_NONE;
 }
 /*---------------------------------------------------------------------------*/
-/* add a new fragment to the buffer */
+#if SICSLOWPAN_FRAG_FORWARDING
+static int fwd_from_sender(const linkaddr_t *sender);
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+/*---------------------------------------------------------------------------*/
 static int8_t
-add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
+new_fragments(uint16_t tag, uint16_t frag_size, const linkaddr_t *sender)
 {
   int i;
-  int len;
-  int8_t found = -1;
+  int j;
+  int8_t found = REASS_NONE;
+  uint8_t bucket;
 
-  if(offset == 0) {
-    /* This is a first fragment - check if we can add this */
+  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
+    /* clear all fragment info with expired timer to free all fragment buffers */
+    if(frag_info[i].len > 0 && timer_expired(&frag_info[i].reass_timer)) {
+      if(!frag_info[i].closed) {
+        reass_stats.timed_out++;
+      }
+      clear_fragments(i);
+    }
+
+    /* We use len as indication on used or not used */
+    if(found < 0 && frag_info[i].len == 0) {
+      /* We remember the first free fragment info but must continue
+         the loop to free any other expired fragment buffers. */
+      found = i;
+    }
+  }
+
+  if(found < 0) {
+    /* Closed contexts are only kept to filter late fragments, the
+       oldest is the least likely to still see one */
     for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
-      /* clear all fragment info with expired timer to free all fragment buffers */
-      if(frag_info[i].len > 0 && timer_expired(&frag_info[i].reass_timer)) {
-	clear_fragments(i);
+      if(frag_info[i].closed &&
+         (found < 0 || timer_remaining(&frag_info[i].reass_timer) <
+          timer_remaining(&frag_info[found].reass_timer))) {
+        found = i;
       }
+    }
+    if(found >= 0) {
+      clear_fragments(found);
+    }
+  }
 
-      /* We use len as indication on used or not used */
-      if(found < 0 && frag_info[i].len == 0) {
-        /* We remember the first free fragment info but must continue
-           the loop to free any other expired fragment buffers. */
+  if(found < 0) {
+    /* A sender fragments one packet at a time, so once it has moved on
+       to a new tag its unfinished packet has lost a fragment. A sender
+       whose packets are relayed here is a router that relays several
+       packets at once, so its packets are left alone. */
+    for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS && found < 0; i++) {
+#if SICSLOWPAN_FRAG_FORWARDING
+      if(fwd_from_sender(&frag_info[i].sender)) {
+        continue;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+      if(linkaddr_cmp(&frag_info[i].sender, sender)) {
         found = i;
       }
+      for(j = 0; j < SICSLOWPAN_REASS_CONTEXTS && found < 0; j++) {
+        if(j != i && linkaddr_cmp(&frag_info[i].sender, &frag_info[j].sender) &&
+           timer_remaining(&frag_info[i].reass_timer) <
+           timer_remaining(&frag_info[j].reass_timer)) {
+          found = i;
+        }
+      }
+    }
+    if(found >= 0) {
+      PRINTF("*** Sender moved on - tag: %d\n", frag_info[found].tag);
+      reass_stats.discarded++;
+      clear_fragments(found);
+    }
+  }
+
+  if(found < 0) {
+    PRINTF("*** Failed to store new fragment session - tag: %d\n", tag);
+    reass_stats.no_context++;
+    return REASS_NONE;
+  }
+
+  /* Found a free fragment info to store data in */
+  frag_info[found].len = frag_size;
+  frag_info[found].tag = tag;
+  linkaddr_copy(&frag_info[found].sender, sender);
+  frag_info[found].received_units = 0;
+  memset(frag_info[found].received, 0, sizeof(frag_info[found].received));
+  frag_info[found].bufs = REASS_NONE;
+  frag_info[found].closed = 0;
+  frag_info[found].first_frag_len = 0;
+  timer_set(&frag_info[found].reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+
+  bucket = frag_hash(tag, sender) % SICSLOWPAN_REASS_BUCKETS;
+  frag_info[found].next = frag_bucket[bucket];
+  frag_bucket[bucket] = found;
+
+  reass_stats.started++;
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+/* Mark the 8-byte units covered by a fragment of a packet of total_len
+   bytes in a bitmap, or with set == 0 only count them. The last fragment
+   may run past the end of the packet and also covers the trailing
+   partial unit. Returns the number of units not seen before. */
+static uint16_t
+mark_units(uint8_t *bitmap, uint16_t total_len, uint16_t start, uint16_t len,
+           uint8_t set)
+{
+  uint16_t unit;
+  uint16_t end;
+  uint16_t count;
+
+  if(start + len >= total_len) {
+    end = REASS_UNITS(total_len);
+  } else {
+    end = (start + len) >> 3;
+  }
+
+  count = 0;
+  for(unit = start >> 3; unit < end; unit++) {
+    if((bitmap[unit >> 3] & (1 << (unit & 7))) == 0) {
+      count++;
+      if(set) {
+        bitmap[unit >> 3] |= 1 << (unit & 7);
+      }
+    }
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+mark_fragment(uint8_t context, uint16_t start, uint16_t len, uint8_t set)
+{
+  struct sicslowpan_frag_info *info;
+  uint16_t count;
+
+  info = &frag_info[context];
+  count = mark_units(info->received, info->len, start, len, set);
+  if(set) {
+    info->received_units += count;
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+static int
+fragments_complete(uint8_t context)
+{
+  return frag_info[context].received_units == REASS_UNITS(frag_info[context].len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+store_fragment(uint8_t index, uint8_t offset)
+{
+  int8_t i;
+
+  i = free_bufs;
+  if(i == REASS_NONE) {
+    /* failed */
+    return -1;
+  }
+
+  /* copy over the data from packetbuf into the fragment buffer and store offset and len */
+  free_bufs = frag_buf[i].next;
+  frag_buf[i].offset = offset; /* frag offset */
+  frag_buf[i].len = packetbuf_datalen() - packetbuf_hdr_len;
+  memcpy(frag_buf[i].data, packetbuf_ptr + packetbuf_hdr_len,
+         packetbuf_datalen() - packetbuf_hdr_len);
+  frag_buf[i].next = frag_info[index].bufs;
+  frag_info[index].bufs = i;
+
+  PRINTF("Fragsize: %d\n", frag_buf[i].len);
+  /* return the length of the stored fragment */
+  return frag_buf[i].len;
+}
+/*---------------------------------------------------------------------------*/
+/* Find or create the context of a fragment and, unless it is the first
+   fragment, store its payload. Fragments may arrive in any order. */
+static int8_t
+add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
+{
+  int8_t i;
+  int len;
+  const linkaddr_t *sender;
+
+  sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+
+  if(frag_size > REASS_MAX_LEN) {
+    /* Would not fit in uip_buf once reassembled */
+    PRINTF("*** Packet too large - tag: %d size: %d\n", tag, frag_size);
+    if(offset == 0) {
+      reass_stats.discarded++;
     }
+    return -1;
+  }
 
-    if(found < 0) {
-      PRINTF("*** Failed to store new fragment session - tag: %d\n", tag);
+  i = find_fragments(tag, sender);
+  if(i != REASS_NONE && timer_expired(&frag_info[i].reass_timer)) {
+    /* A stale packet that reused the tag */
+    if(!frag_info[i].closed) {
+      reass_stats.timed_out++;
+    }
+    clear_fragments(i);
+    i = REASS_NONE;
+  }
+  if(i == REASS_NONE) {
+    i = new_fragments(tag, frag_size, sender);
+    if(i == REASS_NONE) {
       return -1;
     }
+  }
 
-    /* Found a free fragment info to store data in */
-    frag_info[found].len = frag_size;
-    frag_info[found].tag = tag;
-    linkaddr_copy(&frag_info[found].sender,
-                  packetbuf_addr(PACKETBUF_ADDR_SENDER));
-    timer_set(&frag_info[found].reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
-    /* first fragment can not be stored immediately but is moved into
-       the buffer while uncompressing */
-    return found;
+  if(frag_info[i].closed) {
+    return -1;
+  }
+  if(frag_info[i].len != frag_size) {
+    PRINTF("*** Fragment size mismatch - tag: %d\n", tag);
+    abort_fragments(i);
+    return -1;
   }
 
-  /* This is a N-fragment - should find the info */
-  for(i = 0; i < SICSLOWPAN_REASS_CONTEXTS; i++) {
-    if(frag_info[i].tag == tag && frag_info[i].len > 0 &&
-       linkaddr_cmp(&frag_info[i].sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-      /* Tag and Sender match - this must be the correct info to store in */
-      found = i;
-      break;
+  len = packetbuf_datalen() - packetbuf_hdr_len;
+
+  if(offset == 0) {
+    /* This is a first fragment. It can not be stored immediately but is
+       moved into the buffer while uncompressing */
+    if(frag_info[i].first_frag_len > 0) {
+      reass_stats.duplicates++;
+      return -1;
     }
+    return i;
   }
 
-  if(found < 0) {
-    /* no entry found for storing the new fragment */
-    PRINTF("*** Failed to store N-fragment - could not find session - tag: %d offset: %d\n", tag, offset);
+  /* This is a N-fragment */
+  if(len > SICSLOWPAN_FRAGMENT_SIZE || ((uint16_t)offset << 3) >= frag_size) {
+    PRINTF("*** Bad N-fragment - tag: %d offset: %d len: %d\n", tag, offset, len);
+    abort_fragments(i);
+    return -1;
+  }
+  if(mark_fragment(i, (uint16_t)offset << 3, len, 0) == 0) {
+    reass_stats.duplicates++;
     return -1;
   }
 
-  /* i is the index of the reassembly context */
   len = store_fragment(i, offset);
   if(len < 0 && timeout_fragments(i) > 0) {
     len = store_fragment(i, offset);
   }
-  if(len > 0) {
-    frag_info[i].reassembled_len += len;
-    return i;
-  } else {
-    /* should we also clear all fragments since we failed to store
-       this fragment? */
+  if(len < 0) {
+    /* Without this fragment the packet cannot complete */
     PRINTF("*** Failed to store fragment - packet reassembly will fail tag:%d l\n", frag_info[i].tag);
+    abort_fragments(i);
     return -1;
   }
+  mark_fragment(i, (uint16_t)offset << 3, len, 1);
+  return i;
 }
 /*---------------------------------------------------------------------------*/
 /* Copy all the fragments that are associated with a specific context
@@ -418,20 +758,27 @@ add_fragment(uint16_t tag, uint16_t frag_size, uint8_t offset)
 static void
 copy_frags2uip(int context)
 {
-  int i;
+  int8_t i;
 
   /* Copy from the fragment context info buffer first */
   memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)frag_info[context].first_frag,
 	 frag_info[context].first_frag_len);
-  for(i = 0; i < SICSLOWPAN_FRAGMENT_BUFFERS; i++) {
-    /* And also copy all matching fragments */
-    if(frag_buf[i].len > 0 && frag_buf[i].index == context) {
-      memcpy((uint8_t *)UIP_IP_BUF + (uint16_t)(frag_buf[i].offset << 3),
-	     (uint8_t *)frag_buf[i].data, frag_buf[i].len);
-    }
+  for(i = frag_info[context].bufs; i != REASS_NONE; i = frag_buf[i].next) {
+    /* And also copy all matching fragments, cut at the end of the packet */
+    memcpy((uint8_t *)UIP_IP_BUF + (uint16_t)(frag_buf[i].offset << 3),
+	   (uint8_t *)frag_buf[i].data,
+	   MIN(frag_buf[i].len,
+	       frag_info[context].len - (uint16_t)(frag_buf[i].offset << 3)));
   }
   /* deallocate all the fragments for this context */
-  clear_fragments(context);
+  close_fragments(context);
+  reass_stats.completed++;
+}
+/*---------------------------------------------------------------------------*/
+const struct sicslowpan_reass_stats *
+sicslowpan_get_reass_stats(void)
+{
+  return &reass_stats;
 }
 #endif /* SICSLOWPAN_CONF_FRAG */
 
@@ -532,6 +879,73 @@ const uint8_t llprefix[] = {0xfe, 0x80};
 /* TTL uncompression values */
 static const uint8_t ttl_values[] = {0, 1, 64, 255};
 
+/* Number of compressed headers remembered by compress_hdr_iphc(). A
+   node mostly sends to its parent, with the same addresses and ports,
+   so a hit turns compression into a copy and a checksum patch. This
+   pays off with many address contexts; with the default two it costs
+   about as much as it saves, and more when flows outnumber entries. */
+#ifdef SICSLOWPAN_CONF_IPHC_CACHE_SIZE
+#define SICSLOWPAN_IPHC_CACHE_SIZE SICSLOWPAN_CONF_IPHC_CACHE_SIZE
+#else
+#define SICSLOWPAN_IPHC_CACHE_SIZE 0
+#endif
+
+#if SICSLOWPAN_IPHC_CACHE_SIZE > 0
+/* IPHC with CID, 4 bytes TF, NH, HLIM, two full addresses and
+   LOWPAN_UDP with full ports and checksum */
+#define IPHC_MAX_HDR_LEN (3 + 4 + 1 + 1 + 16 + 16 + 7)
+
+/* Everything compress_hdr_iphc() looks at except the UDP checksum */
+struct iphc_template {
+  uip_ipaddr_t srcipaddr;
+  uip_ipaddr_t destipaddr;
+  linkaddr_t link_destaddr;
+  /** Version, traffic class and flow label */
+  uint8_t vtcflow[4];
+  uint8_t proto;
+  uint8_t ttl;
+  uint16_t srcport;
+  uint16_t destport;
+  /** Length of the compressed header, zero if the entry is free */
+  uint8_t len;
+  /** Last use, for replacement */
+  uint8_t used;
+  uint8_t hdr[IPHC_MAX_HDR_LEN];
+};
+
+static struct iphc_template iphc_cache[SICSLOWPAN_IPHC_CACHE_SIZE];
+/* The entry that matched last, tried first */
+static uint8_t iphc_cache_last;
+static uint8_t iphc_cache_clock;
+/* Source addresses are compressed against our link-layer address */
+static uip_lladdr_t iphc_cache_lladdr;
+#endif /* SICSLOWPAN_IPHC_CACHE_SIZE > 0 */
+
+#if SICSLOWPAN_GHC
+/* How far back the GHC encoder looks for a match, in bytes of
+   dictionary and payload. Decoding does not depend on it. */
+#ifdef SICSLOWPAN_CONF_GHC_WINDOW
+#define SICSLOWPAN_GHC_WINDOW SICSLOWPAN_CONF_GHC_WINDOW
+#else
+#define SICSLOWPAN_GHC_WINDOW 128
+#endif
+
+/* The dictionary is the source and destination address followed by
+   the static dictionary (RFC 7400, section 2) */
+#define GHC_DICT_LEN (2 * sizeof(uip_ipaddr_t) + sizeof(ghc_static_dict))
+
+static const uint8_t ghc_static_dict[] = {
+  0x16, 0xfe, 0xfd, 0x17, 0xfe, 0xfd, 0x00, 0x01,
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00
+};
+
+/* compress_hdr_iphc() writes the GHC next header instead of LOWPAN_UDP
+   or an inline ICMPv6 next header */
+static uint8_t ghc_output;
+/* uncompress_hdr_iphc() found a GHC next header */
+static uint8_t ghc_input;
+#endif /* SICSLOWPAN_GHC */
+
 /*--------------------------------------------------------------------*/
 /** \name IPHC related functions
  * @{                                                                 */
@@ -630,6 +1044,296 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
   PRINTF("\n");
 }
 
+#if SICSLOWPAN_IPHC_CACHE_SIZE > 0
+/*--------------------------------------------------------------------*/
+/* Forget all compressed headers, needed when the contexts change */
+static void
+iphc_cache_flush(void)
+{
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_IPHC_CACHE_SIZE; i++) {
+    iphc_cache[i].len = 0;
+  }
+  memcpy(&iphc_cache_lladdr, &uip_lladdr, sizeof(uip_lladdr));
+}
+/*--------------------------------------------------------------------*/
+static int
+iphc_cache_match(const struct iphc_template *t, const linkaddr_t *link_destaddr)
+{
+  if(t->len == 0 || t->ttl != UIP_IP_BUF->ttl || t->proto != UIP_IP_BUF->proto ||
+     memcmp(t->vtcflow, &UIP_IP_BUF->vtc, sizeof(t->vtcflow)) != 0 ||
+     !uip_ipaddr_cmp(&t->destipaddr, &UIP_IP_BUF->destipaddr) ||
+     !uip_ipaddr_cmp(&t->srcipaddr, &UIP_IP_BUF->srcipaddr) ||
+     !linkaddr_cmp(&t->link_destaddr, link_destaddr)) {
+    return 0;
+  }
+  return t->proto != UIP_PROTO_UDP ||
+    (t->srcport == UIP_UDP_BUF->srcport && t->destport == UIP_UDP_BUF->destport);
+}
+/*--------------------------------------------------------------------*/
+/* Copy the compressed header of a packet like the one in uip_buf to
+   packetbuf, if there is one. Returns 0 otherwise. */
+static int
+iphc_cache_lookup(const linkaddr_t *link_destaddr)
+{
+  struct iphc_template *t;
+  int i;
+
+  if(memcmp(&iphc_cache_lladdr, &uip_lladdr, sizeof(uip_lladdr)) != 0) {
+    iphc_cache_flush();
+    return 0;
+  }
+
+  i = iphc_cache_last;
+  if(!iphc_cache_match(&iphc_cache[i], link_destaddr)) {
+    for(i = 0; i < SICSLOWPAN_IPHC_CACHE_SIZE; i++) {
+      if(i != iphc_cache_last && iphc_cache_match(&iphc_cache[i], link_destaddr)) {
+        break;
+      }
+    }
+    if(i == SICSLOWPAN_IPHC_CACHE_SIZE) {
+      return 0;
+    }
+    iphc_cache_last = i;
+  }
+
+  t = &iphc_cache[i];
+  t->used = ++iphc_cache_clock;
+  memcpy(packetbuf_ptr, t->hdr, t->len);
+  packetbuf_hdr_len = t->len;
+  uncomp_hdr_len = UIP_IPH_LEN;
+  if(t->proto == UIP_PROTO_UDP) {
+    /* The checksum is the last inline field */
+    memcpy(packetbuf_ptr + t->len - 2, &UIP_UDP_BUF->udpchksum, 2);
+    uncomp_hdr_len += UIP_UDPH_LEN;
+  }
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/* Remember the header compress_hdr_iphc() just made, in place of the
+   least recently used one */
+static void
+iphc_cache_store(const linkaddr_t *link_destaddr)
+{
+  struct iphc_template *t;
+  int i;
+
+  if(packetbuf_hdr_len > IPHC_MAX_HDR_LEN) {
+    return;
+  }
+
+  t = &iphc_cache[0];
+  for(i = 1; i < SICSLOWPAN_IPHC_CACHE_SIZE && t->len > 0; i++) {
+    if(iphc_cache[i].len == 0 ||
+       (uint8_t)(iphc_cache_clock - iphc_cache[i].used) >
+       (uint8_t)(iphc_cache_clock - t->used)) {
+      t = &iphc_cache[i];
+    }
+  }
+
+  uip_ipaddr_copy(&t->srcipaddr, &UIP_IP_BUF->srcipaddr);
+  uip_ipaddr_copy(&t->destipaddr, &UIP_IP_BUF->destipaddr);
+  linkaddr_copy(&t->link_destaddr, link_destaddr);
+  memcpy(t->vtcflow, &UIP_IP_BUF->vtc, sizeof(t->vtcflow));
+  t->proto = UIP_IP_BUF->proto;
+  t->ttl = UIP_IP_BUF->ttl;
+  if(t->proto == UIP_PROTO_UDP) {
+    t->srcport = UIP_UDP_BUF->srcport;
+    t->destport = UIP_UDP_BUF->destport;
+  }
+  t->len = packetbuf_hdr_len;
+  t->used = ++iphc_cache_clock;
+  memcpy(t->hdr, packetbuf_ptr, packetbuf_hdr_len);
+  iphc_cache_last = t - iphc_cache;
+}
+#endif /* SICSLOWPAN_IPHC_CACHE_SIZE > 0 */
+
+#if SICSLOWPAN_GHC
+/*--------------------------------------------------------------------*/
+/* Byte pos of the dictionary followed by the data; ip is the IPv6
+   header, whose addresses start the dictionary */
+static uint8_t
+ghc_byte(const uint8_t *ip, const uint8_t *data, int pos)
+{
+  if(pos < 2 * sizeof(uip_ipaddr_t)) {
+    return ((const struct uip_ip_hdr *)ip)->srcipaddr.u8[pos];
+  }
+  pos -= 2 * sizeof(uip_ipaddr_t);
+  if(pos < sizeof(ghc_static_dict)) {
+    return ghc_static_dict[pos];
+  }
+  return data[pos - sizeof(ghc_static_dict)];
+}
+/*--------------------------------------------------------------------*/
+/* Bytes needed for a backreference of n bytes, gap bytes between the
+   end of the referenced data and the current position */
+static int
+ghc_backref_len(int n, int gap)
+{
+  int na = (n - 2) >> 3;
+  int sa = ((gap >> 3) + 14) / 15;
+
+  return 1 + (na > sa ? na : sa);
+}
+/*--------------------------------------------------------------------*/
+static int
+ghc_literals(uint8_t *out, int out_len, int limit, const uint8_t *data, int len)
+{
+  int k;
+
+  while(len > 0) {
+    k = len < 0x60 ? len : 0x5f;
+    if(out_len + 1 + k > limit) {
+      return -1;
+    }
+    out[out_len++] = k;
+    memcpy(out + out_len, data, k);
+    out_len += k;
+    data += k;
+    len -= k;
+  }
+  return out_len;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief GHC-compress the payload after the uncomp_hdr_len bytes of
+ * headers in uip_buf.
+ *
+ * A greedy LZ77 over SICSLOWPAN_GHC_WINDOW bytes: at each position the
+ * longest earlier match, or run of zeros, is taken if it saves two
+ * bytes over appending it to the current literal.
+ *
+ * \return The compressed length, or 0 if it is not smaller than the
+ * payload or larger than limit
+ */
+static int
+ghc_compress(uint8_t *out, int limit)
+{
+  const uint8_t *ip = (const uint8_t *)UIP_IP_BUF;
+  const uint8_t *data = ip + uncomp_hdr_len;
+  int len = uip_len - uncomp_hdr_len;
+  int out_len = 0;
+  int lit = 0;
+  int pos = 0;
+  int here, c, n, best_c, best_n, best_gain, gap, sa, na, step;
+
+  while(pos < len) {
+    here = GHC_DICT_LEN + pos;
+    best_gain = 1;
+    best_n = 0;
+    best_c = -1;
+
+    for(n = 0; pos + n < len && n < 17 && data[pos + n] == 0; n++);
+    if(n - 1 > best_gain) {
+      best_gain = n - 1;
+      best_n = n;
+    }
+
+    for(c = here > SICSLOWPAN_GHC_WINDOW ? here - SICSLOWPAN_GHC_WINDOW : 0;
+        c < here - 2; c++) {
+      for(n = 0; pos + n < len && c + n < here &&
+            ghc_byte(ip, data, c + n) == data[pos + n]; n++);
+      if(n > 2 && n - ghc_backref_len(n, here - c - n) > best_gain) {
+        best_gain = n - ghc_backref_len(n, here - c - n);
+        best_n = n;
+        best_c = c;
+      }
+    }
+
+    if(best_n == 0) {
+      pos++;
+      continue;
+    }
+
+    out_len = ghc_literals(out, out_len, limit, data + lit, pos - lit);
+    if(out_len < 0 || out_len + best_n - best_gain > limit) {
+      return 0;
+    }
+    if(best_c < 0) {
+      out[out_len++] = 0x80 | (best_n - 2);
+    } else {
+      /* 101nssss extensions, then 11nnnkkk */
+      gap = here - best_c - best_n;
+      sa = gap >> 3;
+      na = (best_n - 2) >> 3;
+      while(sa > 0 || na > 0) {
+        step = sa < 15 ? sa : 15;
+        out[out_len++] = 0xa0 | (na > 0 ? 0x10 : 0) | step;
+        sa -= step;
+        if(na > 0) {
+          na--;
+        }
+      }
+      out[out_len++] = 0xc0 | (((best_n - 2) & 0x07) << 3) | (gap & 0x07);
+    }
+    pos += best_n;
+    lit = pos;
+  }
+
+  out_len = ghc_literals(out, out_len, limit, data + lit, pos - lit);
+  return out_len > 0 && out_len < len ? out_len : 0;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Decompress a GHC payload behind the uncompressed headers in buf
+ * \return The payload length, or -1 if the data is malformed or does
+ * not fit in max_len bytes
+ */
+static int
+ghc_decompress(uint8_t *buf, const uint8_t *in, int in_len, int max_len)
+{
+  uint8_t *out = buf + uncomp_hdr_len;
+  const uint8_t *end = in + in_len;
+  int out_len = 0;
+  int sa = 0;
+  int na = 0;
+  int n, pos;
+  uint8_t b;
+
+  while(in < end) {
+    b = *in++;
+    if(b < 0x60) {
+      /* 0kkkkkkk: k literal bytes */
+      if(b > end - in || out_len + b > max_len) {
+        return -1;
+      }
+      memcpy(out + out_len, in, b);
+      in += b;
+      out_len += b;
+    } else if((b & 0xf0) == 0x80) {
+      /* 1000nnnn: n + 2 zeros */
+      n = (b & 0x0f) + 2;
+      if(out_len + n > max_len) {
+        return -1;
+      }
+      memset(out + out_len, 0, n);
+      out_len += n;
+    } else if(b == 0x90) {
+      /* stop code */
+      break;
+    } else if((b & 0xe0) == 0xa0) {
+      /* 101nssss: extend the next backreference */
+      sa += (b & 0x0f) << 3;
+      na += (b & 0x10) >> 1;
+    } else if((b & 0xc0) == 0xc0) {
+      /* 11nnnkkk: copy n bytes from s bytes back */
+      n = na + ((b >> 3) & 0x07) + 2;
+      pos = GHC_DICT_LEN + out_len - ((b & 0x07) + sa + n);
+      if(pos < 0 || out_len + n > max_len) {
+        return -1;
+      }
+      while(n-- > 0) {
+        out[out_len++] = ghc_byte(buf, out, pos++);
+      }
+      sa = na = 0;
+    } else {
+      return -1;
+    }
+  }
+  return out_len;
+}
+#endif /* SICSLOWPAN_GHC */
 /*--------------------------------------------------------------------*/
 /**
  * \brief Compress IP/UDP header
@@ -669,6 +1373,9 @@ static void
 compress_hdr_iphc(linkaddr_t *link_destaddr)
 {
   uint8_t tmp, iphc0, iphc1;
+#if SICSLOWPAN_GHC
+  uint8_t *udp_nhc;
+#endif /* SICSLOWPAN_GHC */
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d): ", UIP_IP_BUF->len[1]);
@@ -680,6 +1387,18 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
   }
 #endif
 
+#if SICSLOWPAN_IPHC_CACHE_SIZE > 0
+#if SICSLOWPAN_GHC
+  if(!ghc_output && iphc_cache_lookup(link_destaddr)) {
+    return;
+  }
+#else /* SICSLOWPAN_GHC */
+  if(iphc_cache_lookup(link_destaddr)) {
+    return;
+  }
+#endif /* SICSLOWPAN_GHC */
+#endif /* SICSLOWPAN_IPHC_CACHE_SIZE > 0 */
+
   hc06_ptr = packetbuf_ptr + 2;
   /*
    * As we copy some bit-length fields, in the IPHC encoding bytes,
@@ -762,6 +1481,12 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
     iphc0 |= SICSLOWPAN_IPHC_NH_C;
   }
 #endif /*UIP_CONF_UDP*/
+#if SICSLOWPAN_GHC
+  if(ghc_output) {
+    /* GHC for UDP or ICMPv6 */
+    iphc0 |= SICSLOWPAN_IPHC_NH_C;
+  }
+#endif /* SICSLOWPAN_GHC */
 
   if ((iphc0 & SICSLOWPAN_IPHC_NH_C) == 0) {
     *hc06_ptr = UIP_IP_BUF->proto;
@@ -881,6 +1606,9 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
   if(UIP_IP_BUF->proto == UIP_PROTO_UDP) {
     PRINTF("IPHC: Uncompressed UDP ports on send side: %x, %x\n",
            UIP_HTONS(UIP_UDP_BUF->srcport), UIP_HTONS(UIP_UDP_BUF->destport));
+#if SICSLOWPAN_GHC
+    udp_nhc = hc06_ptr;
+#endif /* SICSLOWPAN_GHC */
     /* Mask out the last 4 bits can be used as a mask */
     if(((UIP_HTONS(UIP_UDP_BUF->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
        ((UIP_HTONS(UIP_UDP_BUF->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
@@ -923,15 +1651,37 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
       memcpy(hc06_ptr, &UIP_UDP_BUF->udpchksum, 2);
       hc06_ptr += 2;
     }
+#if SICSLOWPAN_GHC
+    if(ghc_output) {
+      /* same ports and checksum, GHC payload */
+      *udp_nhc = SICSLOWPAN_NHC_GHC_UDP_ID | (*udp_nhc & ~SICSLOWPAN_NHC_GHC_UDP_MASK);
+    }
+#endif /* SICSLOWPAN_GHC */
     uncomp_hdr_len += UIP_UDPH_LEN;
   }
 #endif /*UIP_CONF_UDP*/
 
+#if SICSLOWPAN_GHC
+  if(ghc_output && UIP_IP_BUF->proto == UIP_PROTO_ICMP6) {
+    *hc06_ptr = SICSLOWPAN_NHC_GHC_ICMP6;
+    hc06_ptr += 1;
+  }
+#endif /* SICSLOWPAN_GHC */
+
   /* before the packetbuf_hdr_len operation */
   PACKETBUF_IPHC_BUF[0] = iphc0;
   PACKETBUF_IPHC_BUF[1] = iphc1;
 
   packetbuf_hdr_len = hc06_ptr - packetbuf_ptr;
+
+#if SICSLOWPAN_IPHC_CACHE_SIZE > 0
+#if SICSLOWPAN_GHC
+  if(ghc_output) {
+    return;
+  }
+#endif /* SICSLOWPAN_GHC */
+  iphc_cache_store(link_destaddr);
+#endif /* SICSLOWPAN_IPHC_CACHE_SIZE > 0 */
   return;
 }
 
@@ -1101,12 +1851,24 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
   /* Next header processing - continued */
   if((iphc0 & SICSLOWPAN_IPHC_NH_C)) {
     /* The next header is compressed, NHC is following */
-    if((*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
+    uint8_t nhc = *hc06_ptr;
+#if SICSLOWPAN_GHC
+    if(nhc == SICSLOWPAN_NHC_GHC_ICMP6) {
+      SICSLOWPAN_IP_BUF(buf)->proto = UIP_PROTO_ICMP6;
+      ghc_input = 1;
+      hc06_ptr += 1;
+    } else if((nhc & SICSLOWPAN_NHC_GHC_UDP_MASK) == SICSLOWPAN_NHC_GHC_UDP_ID) {
+      /* decoded as LOWPAN_UDP, the payload by input() */
+      ghc_input = 1;
+      nhc = SICSLOWPAN_NHC_UDP_ID | (nhc & ~SICSLOWPAN_NHC_GHC_UDP_MASK);
+    }
+#endif /* SICSLOWPAN_GHC */
+    if((nhc & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
       uint8_t checksum_compressed;
       SICSLOWPAN_IP_BUF(buf)->proto = UIP_PROTO_UDP;
-      checksum_compressed = *hc06_ptr & SICSLOWPAN_NHC_UDP_CHECKSUMC;
-      PRINTF("IPHC: Incoming header value: %i\n", *hc06_ptr);
-      switch(*hc06_ptr & SICSLOWPAN_NHC_UDP_CS_P_11) {
+      checksum_compressed = nhc & SICSLOWPAN_NHC_UDP_CHECKSUMC;
+      PRINTF("IPHC: Incoming header value: %i\n", nhc);
+      switch(nhc & SICSLOWPAN_NHC_UDP_CS_P_11) {
       case SICSLOWPAN_NHC_UDP_CS_P_00:
 	/* 1 byte for NHC, 4 byte for ports, 2 bytes chksum */
 	memcpy(&SICSLOWPAN_UDP_BUF(buf)->srcport, hc06_ptr + 1, 2);
@@ -1178,122 +1940,493 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
     SICSLOWPAN_IP_BUF(buf)->len[1] = (ip_len - UIP_IPH_LEN) & 0x00FF;
   }
 
-  /* length field in UDP header */
-  if(SICSLOWPAN_IP_BUF(buf)->proto == UIP_PROTO_UDP) {
-    memcpy(&SICSLOWPAN_UDP_BUF(buf)->udplen, &SICSLOWPAN_IP_BUF(buf)->len[0], 2);
+  /* length field in UDP header */
+  if(SICSLOWPAN_IP_BUF(buf)->proto == UIP_PROTO_UDP) {
+    memcpy(&SICSLOWPAN_UDP_BUF(buf)->udplen, &SICSLOWPAN_IP_BUF(buf)->len[0], 2);
+  }
+
+  return;
+}
+/** @} */
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+
+/*--------------------------------------------------------------------*/
+/** \name IPv6 dispatch "compression" function
+ * @{                                                                 */
+/*--------------------------------------------------------------------*/
+/* \brief Packets "Compression" when only IPv6 dispatch is used
+ *
+ * There is no compression in this case, all fields are sent
+ * inline. We just add the IPv6 dispatch byte before the packet.
+ * \verbatim
+ * 0               1                   2                   3
+ * 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * | IPv6 Dsp      | IPv6 header and payload ...
+ * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ * \endverbatim
+ */
+static void
+compress_hdr_ipv6(linkaddr_t *link_destaddr)
+{
+  *packetbuf_ptr = SICSLOWPAN_DISPATCH_IPV6;
+  packetbuf_hdr_len += SICSLOWPAN_IPV6_HDR_LEN;
+  memcpy(packetbuf_ptr + packetbuf_hdr_len, UIP_IP_BUF, UIP_IPH_LEN);
+  packetbuf_hdr_len += UIP_IPH_LEN;
+  uncomp_hdr_len += UIP_IPH_LEN;
+  return;
+}
+/** @} */
+
+/*--------------------------------------------------------------------*/
+/** \name Input/output functions common to all compression schemes
+ * @{                                                                 */
+/*--------------------------------------------------------------------*/
+/**
+ * Callback function for the MAC packet sent callback
+ */
+static void
+packet_sent(void *ptr, int status, int transmissions)
+{
+  uip_ds6_link_neighbor_callback(status, transmissions);
+
+  if(callback != NULL) {
+    callback->output_callback(status);
+  }
+  last_tx_status = status;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief This function is called by the 6lowpan code to send out a
+ * packet.
+ * \param dest the link layer destination address of the packet
+ */
+static void
+send_packet(linkaddr_t *dest)
+{
+  /* Set the link layer destination address for the packet as a
+   * packetbuf attribute. The MAC layer can access the destination
+   * address with the function packetbuf_addr(PACKETBUF_ADDR_RECEIVER).
+   */
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, dest);
+
+#if NETSTACK_CONF_BRIDGE_MODE
+  /* This needs to be explicitly set here for bridge mode to work */
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER,(void*)&uip_lladdr);
+#endif
+
+  /* Provide a callback function to receive the result of
+     a packet transmission. */
+  NETSTACK_LLSEC.send(&packet_sent, NULL);
+
+  /* If we are sending multiple packets in a row, we need to let the
+     watchdog know that we are still alive. */
+  watchdog_periodic();
+}
+/*--------------------------------------------------------------------*/
+/* Room for 6LoWPAN headers and payload in a frame to dest */
+static int
+max_mac_payload(linkaddr_t *dest)
+{
+  int framer_hdrlen;
+
+  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
+   * We calculate it here only to make a better decision of whether the outgoing packet
+   * needs to be fragmented or not. */
+#ifndef SICSLOWPAN_USE_FIXED_HDRLEN
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, dest);
+  framer_hdrlen = NETSTACK_FRAMER.length();
+  if(framer_hdrlen < 0) {
+    /* Framing failed, we assume the maximum header length */
+    framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+  }
+#else /* USE_FRAMER_HDRLEN */
+  framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+#endif /* USE_FRAMER_HDRLEN */
+
+  return MAC_MAX_PAYLOAD - framer_hdrlen;
+}
+#if SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/** \name Fragment forwarding
+ *
+ * A router that is not the destination of a fragmented packet relays
+ * each fragment as soon as it arrives instead of reassembling the
+ * packet first. The first fragment is decompressed to route the packet
+ * and compressed again for the next hop, the others only get the tag
+ * used towards the next hop. Packets that need more than the hop limit
+ * and RPL option updated on the way, such as those with a source
+ * routing header, are reassembled and handed to uIP as before.
+ * @{
+ */
+/*--------------------------------------------------------------------*/
+struct sicslowpan_fwd_entry {
+  /** The previous hop and its tag */
+  linkaddr_t sender;
+  uint16_t tag;
+  /** The next hop and the tag used towards it */
+  linkaddr_t next_hop;
+  uint16_t out_tag;
+  /** Total length of the packet, zero if the entry is free */
+  uint16_t len;
+  /** Number of 8-byte units relayed so far */
+  uint16_t relayed_units;
+  /** One bit per 8-byte unit of the packet that has been relayed */
+  uint8_t relayed[REASS_BITMAP_LEN];
+  /** Next entry in the same hash bucket */
+  int8_t next;
+  struct timer timer;
+};
+
+static struct sicslowpan_fwd_entry fwd_table[SICSLOWPAN_FWD_ENTRIES];
+static int8_t fwd_bucket[SICSLOWPAN_FWD_BUCKETS];
+/*--------------------------------------------------------------------*/
+static void
+init_forwarding(void)
+{
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_FWD_BUCKETS; i++) {
+    fwd_bucket[i] = REASS_NONE;
+  }
+  for(i = 0; i < SICSLOWPAN_FWD_ENTRIES; i++) {
+    fwd_table[i].len = 0;
+  }
+}
+/*--------------------------------------------------------------------*/
+static void
+fwd_remove(int8_t entry)
+{
+  int8_t *p;
+
+  for(p = &fwd_bucket[frag_hash(fwd_table[entry].tag, &fwd_table[entry].sender)
+                      % SICSLOWPAN_FWD_BUCKETS];
+      *p != REASS_NONE; p = &fwd_table[*p].next) {
+    if(*p == entry) {
+      *p = fwd_table[entry].next;
+      break;
+    }
+  }
+  fwd_table[entry].len = 0;
+}
+/*--------------------------------------------------------------------*/
+static int8_t
+fwd_lookup(uint16_t tag, const linkaddr_t *sender)
+{
+  int8_t i;
+
+  for(i = fwd_bucket[frag_hash(tag, sender) % SICSLOWPAN_FWD_BUCKETS];
+      i != REASS_NONE; i = fwd_table[i].next) {
+    if(fwd_table[i].tag == tag && linkaddr_cmp(&fwd_table[i].sender, sender)) {
+      if(timer_expired(&fwd_table[i].timer)) {
+        fwd_remove(i);
+        return REASS_NONE;
+      }
+      return i;
+    }
+  }
+  return REASS_NONE;
+}
+/*--------------------------------------------------------------------*/
+/* Is a packet from this previous hop being relayed? */
+static int
+fwd_from_sender(const linkaddr_t *sender)
+{
+  int8_t i;
+
+  for(i = 0; i < SICSLOWPAN_FWD_ENTRIES; i++) {
+    if(fwd_table[i].len > 0 && !timer_expired(&fwd_table[i].timer) &&
+       linkaddr_cmp(&fwd_table[i].sender, sender)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*--------------------------------------------------------------------*/
+static int8_t
+fwd_add(uint16_t tag, const linkaddr_t *sender, uint16_t len,
+        const linkaddr_t *next_hop)
+{
+  int8_t i;
+  uint8_t bucket;
+
+  for(i = 0; i < SICSLOWPAN_FWD_ENTRIES; i++) {
+    if(fwd_table[i].len > 0 && timer_expired(&fwd_table[i].timer)) {
+      fwd_remove(i);
+    }
+    if(fwd_table[i].len == 0) {
+      break;
+    }
+  }
+  if(i == SICSLOWPAN_FWD_ENTRIES) {
+    return REASS_NONE;
   }
 
-  return;
+  linkaddr_copy(&fwd_table[i].sender, sender);
+  fwd_table[i].tag = tag;
+  linkaddr_copy(&fwd_table[i].next_hop, next_hop);
+  fwd_table[i].out_tag = my_tag++;
+  fwd_table[i].len = len;
+  fwd_table[i].relayed_units = 0;
+  memset(fwd_table[i].relayed, 0, sizeof(fwd_table[i].relayed));
+  timer_set(&fwd_table[i].timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+
+  bucket = frag_hash(tag, sender) % SICSLOWPAN_FWD_BUCKETS;
+  fwd_table[i].next = fwd_bucket[bucket];
+  fwd_bucket[bucket] = i;
+  return i;
 }
-/** @} */
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
-
-/*--------------------------------------------------------------------*/
-/** \name IPv6 dispatch "compression" function
- * @{                                                                 */
 /*--------------------------------------------------------------------*/
-/* \brief Packets "Compression" when only IPv6 dispatch is used
- *
- * There is no compression in this case, all fields are sent
- * inline. We just add the IPv6 dispatch byte before the packet.
- * \verbatim
- * 0               1                   2                   3
- * 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * | IPv6 Dsp      | IPv6 header and payload ...
- * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
- * \endverbatim
- */
-static void
-compress_hdr_ipv6(linkaddr_t *link_destaddr)
+/* Record that a fragment is relayed. Returns the number of its 8-byte
+   units that were not relayed before, zero for a copy. */
+static uint16_t
+fwd_mark(struct sicslowpan_fwd_entry *e, uint16_t offset, uint16_t len)
 {
-  *packetbuf_ptr = SICSLOWPAN_DISPATCH_IPV6;
-  packetbuf_hdr_len += SICSLOWPAN_IPV6_HDR_LEN;
-  memcpy(packetbuf_ptr + packetbuf_hdr_len, UIP_IP_BUF, UIP_IPH_LEN);
-  packetbuf_hdr_len += UIP_IPH_LEN;
-  uncomp_hdr_len += UIP_IPH_LEN;
-  return;
-}
-/** @} */
+  uint16_t count;
 
+  count = mark_units(e->relayed, e->len, offset, len, 1);
+  e->relayed_units += count;
+  return count;
+}
 /*--------------------------------------------------------------------*/
-/** \name Input/output functions common to all compression schemes
- * @{                                                                 */
+static int
+fwd_complete(struct sicslowpan_fwd_entry *e)
+{
+  return e->relayed_units == REASS_UNITS(e->len);
+}
 /*--------------------------------------------------------------------*/
-/**
- * Callback function for the MAC packet sent callback
- */
 static void
-packet_sent(void *ptr, int status, int transmissions)
+send_fragn(struct sicslowpan_fwd_entry *e, uint16_t offset,
+           const uint8_t *data, uint16_t len)
 {
-  uip_ds6_link_neighbor_callback(status, transmissions);
-
-  if(callback != NULL) {
-    callback->output_callback(status);
-  }
-  last_tx_status = status;
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAGN << 8) | e->len));
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, e->out_tag);
+  PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] = offset >> 3;
+  memcpy(packetbuf_ptr + SICSLOWPAN_FRAGN_HDR_LEN, data, len);
+  packetbuf_set_datalen(SICSLOWPAN_FRAGN_HDR_LEN + len);
+  fwd_mark(e, offset, len);
+  send_packet(&e->next_hop);
 }
 /*--------------------------------------------------------------------*/
-/**
- * \brief This function is called by the 6lowpan code to send out a
- * packet.
- * \param dest the link layer destination address of the packet
- */
-static void
-send_packet(linkaddr_t *dest)
+/* Relay a FRAGN that belongs to a packet being forwarded. The fragment
+   is sent on as it is, with the tag of the next hop. */
+static int
+forward_fragment(uint16_t tag)
 {
-  /* Set the link layer destination address for the packet as a
-   * packetbuf attribute. The MAC layer can access the destination
-   * address with the function packetbuf_addr(PACKETBUF_ADDR_RECEIVER).
-   */
-  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, dest);
+  int8_t i;
+  linkaddr_t next_hop;
 
-#if NETSTACK_CONF_BRIDGE_MODE
-  /* This needs to be explicitly set here for bridge mode to work */
-  packetbuf_set_addr(PACKETBUF_ADDR_SENDER,(void*)&uip_lladdr);
-#endif
+  i = fwd_lookup(tag, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  if(i == REASS_NONE) {
+    return 0;
+  }
 
-  /* Provide a callback function to receive the result of
-     a packet transmission. */
-  NETSTACK_LLSEC.send(&packet_sent, NULL);
+  /* Link-layer duplicates and retransmissions of a fragment that was
+     already relayed are dropped, and do not count towards the packet */
+  if(fwd_mark(&fwd_table[i],
+              (uint16_t)PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] << 3,
+              packetbuf_datalen() - packetbuf_hdr_len) == 0) {
+    PRINTFI("sicslowpan input: fragment already relayed, tag %d\n", tag);
+    return 1;
+  }
 
-  /* If we are sending multiple packets in a row, we need to let the
-     watchdog know that we are still alive. */
-  watchdog_periodic();
+  PRINTFI("sicslowpan input: relaying fragment, tag %d -> %d\n",
+          tag, fwd_table[i].out_tag);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, fwd_table[i].out_tag);
+  linkaddr_copy(&next_hop, &fwd_table[i].next_hop);
+  if(fwd_complete(&fwd_table[i])) {
+    fwd_remove(i);
+  }
+
+  packetbuf_compact();
+  packetbuf_attr_clear();
+  send_packet(&next_hop);
+  return 1;
 }
 /*--------------------------------------------------------------------*/
-/** \brief Take an IP packet and format it to be sent on an 802.15.4
- *  network using 6lowpan.
- *  \param localdest The MAC address of the destination
- *
- *  The IP packet is initially in uip_buf. Its header is compressed
- *  and if necessary it is fragmented. The resulting
- *  packet/fragments are put in packetbuf and delivered to the 802.15.4
- *  MAC.
- */
-static uint8_t
-output(const uip_lladdr_t *localdest)
+/* Decide whether a packet is passing through from its first fragment,
+   and if so relay that and any fragments that arrived before it.
+   Returns 0 if the packet is to be reassembled. */
+static int
+forward_first_fragment(uint8_t context)
 {
-  int framer_hdrlen;
-  int max_payload;
+  struct sicslowpan_frag_info *info;
+  struct sicslowpan_fwd_entry *e;
+  uip_ipaddr_t *nexthop;
+  uip_ds6_route_t *route;
+  uip_ds6_nbr_t *nbr;
+  const uip_lladdr_t *lladdr;
+  int8_t entry;
+  int8_t i;
+  int avail;
+  uint16_t sent;
+
+  info = &frag_info[context];
+  memcpy(UIP_IP_BUF, info->first_frag, info->first_frag_len);
+  uip_ext_len = 0;
+
+  /* The same packets uip_process() would forward */
+  if(uip_ds6_is_my_addr(&UIP_IP_BUF->destipaddr) ||
+     uip_ds6_is_my_maddr(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_linklocal(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_linklocal(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->srcipaddr) ||
+     info->len > UIP_LINK_MTU || UIP_IP_BUF->ttl <= 1) {
+    return 0;
+  }
 
-  /* The MAC address of the destination of the packet */
-  linkaddr_t dest;
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+#if UIP_CONF_IPV6_RPL
+    /* Only a lone RPL option, and not at the root, which replaces it */
+    rpl_dag_t *dag = rpl_get_any_dag();
+    if(info->first_frag_len < UIP_IPH_LEN + RPL_HOP_BY_HOP_LEN ||
+       uip_buf[UIP_LLIPH_LEN + 2] != UIP_EXT_HDR_OPT_RPL ||
+       dag == NULL || uip_ds6_is_my_addr(&dag->dag_id)) {
+      return 0;
+    }
+#else /* UIP_CONF_IPV6_RPL */
+    return 0;
+#endif /* UIP_CONF_IPV6_RPL */
+  } else if(UIP_IP_BUF->proto != UIP_PROTO_UDP &&
+            UIP_IP_BUF->proto != UIP_PROTO_TCP &&
+            UIP_IP_BUF->proto != UIP_PROTO_ICMP6) {
+    return 0;
+  }
+
+  /* Next hop determination, as in tcpip_ipv6_output() */
+  if(uip_ds6_is_addr_onlink(&UIP_IP_BUF->destipaddr)) {
+    nexthop = &UIP_IP_BUF->destipaddr;
+  } else {
+    route = uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr);
+    if(route != NULL) {
+      nexthop = uip_ds6_route_nexthop(route);
+    } else {
+      nexthop = uip_ds6_defrt_choose();
+    }
+  }
+  if(nexthop == NULL) {
+    return 0;
+  }
+  nbr = uip_ds6_nbr_lookup(nexthop);
+  if(nbr == NULL || nbr->state == NBR_INCOMPLETE) {
+    return 0;
+  }
+  lladdr = uip_ds6_nbr_get_ll(nbr);
+  if(lladdr == NULL) {
+    return 0;
+  }
+
+  entry = fwd_add(info->tag, &info->sender, info->len,
+                  (const linkaddr_t *)lladdr);
+  if(entry == REASS_NONE) {
+    return 0;
+  }
+  e = &fwd_table[entry];
+
+#if UIP_CONF_IPV6_RPL
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO && !rpl_verify_hbh_header(2)) {
+    PRINTF("sicslowpan: RPL option check failed, dropping packet\n");
+    goto drop;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+#if UIP_CONF_IPV6_RPL
+  uip_len = info->len;
+  if(!rpl_update_header() || uip_len != info->len) {
+    PRINTF("sicslowpan: RPL header update failed, dropping packet\n");
+    goto drop;
+  }
+#endif /* UIP_CONF_IPV6_RPL */
+  UIP_STAT(++uip_stat.ip.forwarded);
+
+  PRINTFI("sicslowpan input: forwarding fragments, tag %d -> %d\n",
+          info->tag, e->out_tag);
 
-  /* init */
   uncomp_hdr_len = 0;
   packetbuf_hdr_len = 0;
-
-  /* reset packetbuf buffer */
   packetbuf_clear();
   packetbuf_ptr = packetbuf_dataptr();
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+  if(info->len >= COMPRESSION_THRESHOLD) {
+    compress_hdr_iphc(&e->next_hop);
+  } else
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+  {
+    compress_hdr_ipv6(&e->next_hop);
+  }
+
+  memmove(packetbuf_ptr + SICSLOWPAN_FRAG1_HDR_LEN, packetbuf_ptr, packetbuf_hdr_len);
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | info->len));
+  SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, e->out_tag);
+  packetbuf_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+
+  /* The headers may compress worse for the next hop (a hop limit of
+     63 is carried inline where 64 was not), so the first fragment may
+     have to be split. Fragments other than the last end on 8 bytes. */
+  avail = max_mac_payload(&e->next_hop) - packetbuf_hdr_len;
+  sent = info->first_frag_len;
+  if(sent - uncomp_hdr_len > avail) {
+    sent = (uncomp_hdr_len + avail) & 0xfff8;
+    if(sent <= uncomp_hdr_len) {
+      PRINTF("sicslowpan: first fragment headers do not fit, dropping packet\n");
+      goto drop;
+    }
+  }
+  memcpy(packetbuf_ptr + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, sent - uncomp_hdr_len);
+  packetbuf_set_datalen(sent - uncomp_hdr_len + packetbuf_hdr_len);
+  fwd_mark(e, 0, sent);
+  send_packet(&e->next_hop);
+
+  if(sent < info->first_frag_len) {
+    send_fragn(e, sent, (uint8_t *)UIP_IP_BUF + sent,
+               info->first_frag_len - sent);
+  }
+
+  /* Fragments that overtook the first one */
+  for(i = info->bufs; i != REASS_NONE; i = frag_buf[i].next) {
+    send_fragn(e, (uint16_t)frag_buf[i].offset << 3,
+               frag_buf[i].data, frag_buf[i].len);
+  }
+  if(fwd_complete(e)) {
+    fwd_remove(entry);
+  }
 
+  /* Keep the context to drop copies of fragments already relayed */
+  close_fragments(context);
+  reass_stats.forwarded++;
+  uip_clear_buf();
+  return 1;
+
+ drop:
+  fwd_remove(entry);
+  abort_fragments(context);
+  uip_clear_buf();
+  return 1;
+}
+/** @} */
+#endif /* SICSLOWPAN_CONF_FRAG && SICSLOWPAN_FRAG_FORWARDING */
+/*--------------------------------------------------------------------*/
+/* Attributes of every frame of the packet in uip_buf */
+static void
+set_output_attrs(void)
+{
   if(callback) {
     /* call the attribution when the callback comes, but set attributes
        here ! */
     set_packet_attrs();
   }
 
+#if PACKETBUF_WITH_PRIORITY
+  packetbuf_set_attr(PACKETBUF_ATTR_PRIORITY, PACKET_PRIORITY());
+#endif /* PACKETBUF_WITH_PRIORITY */
+
 #if PACKETBUF_WITH_PACKET_TYPE
 #define TCP_FIN 0x01
 #define TCP_ACK 0x10
@@ -1310,6 +2443,33 @@ output(const uip_lladdr_t *localdest)
                        PACKETBUF_ATTR_PACKET_TYPE_STREAM_END);
   }
 #endif
+}
+/*--------------------------------------------------------------------*/
+/** \brief Take an IP packet and format it to be sent on an 802.15.4
+ *  network using 6lowpan.
+ *  \param localdest The MAC address of the destination
+ *
+ *  The IP packet is initially in uip_buf. Its header is compressed
+ *  and if necessary it is fragmented. The resulting
+ *  packet/fragments are put in packetbuf and delivered to the 802.15.4
+ *  MAC.
+ */
+static uint8_t
+output(const uip_lladdr_t *localdest)
+{
+  int max_payload;
+
+  /* The MAC address of the destination of the packet */
+  linkaddr_t dest;
+
+  /* init */
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+
+  /* reset packetbuf buffer */
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  set_output_attrs();
 
   /*
    * The destination address will be tagged to each outbound
@@ -1337,27 +2497,33 @@ output(const uip_lladdr_t *localdest)
   }
   PRINTFO("sicslowpan output: header of len %d\n", packetbuf_hdr_len);
 
-  /* Calculate NETSTACK_FRAMER's header length, that will be added in the NETSTACK_RDC.
-   * We calculate it here only to make a better decision of whether the outgoing packet
-   * needs to be fragmented or not. */
-#ifndef SICSLOWPAN_USE_FIXED_HDRLEN
-  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
-  framer_hdrlen = NETSTACK_FRAMER.length();
-  if(framer_hdrlen < 0) {
-    /* Framing failed, we assume the maximum header length */
-    framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
+  max_payload = max_mac_payload(&dest);
+#if SICSLOWPAN_GHC
+  if((packetbuf_ptr[0] & 0xe0) == SICSLOWPAN_DISPATCH_IPHC &&
+     (UIP_IP_BUF->proto == UIP_PROTO_ICMP6 ||
+      (UIP_IP_BUF->proto == UIP_PROTO_UDP && uncomp_hdr_len == UIP_IPUDPH_LEN))) {
+    /* The GHC header has the length of the one just made, so the
+       payload is compressed in place behind it */
+    int ghc_len = ghc_compress(packetbuf_ptr + packetbuf_hdr_len,
+                               max_payload - packetbuf_hdr_len);
+    if(ghc_len > 0) {
+      packetbuf_hdr_len = 0;
+      uncomp_hdr_len = 0;
+      ghc_output = 1;
+      compress_hdr_iphc(&dest);
+      ghc_output = 0;
+      PRINTFO("sicslowpan output: GHC payload of len %d\n", ghc_len);
+      packetbuf_set_datalen(ghc_len + packetbuf_hdr_len);
+      send_packet(&dest);
+      return 1;
+    }
   }
-#else /* USE_FRAMER_HDRLEN */
-  framer_hdrlen = SICSLOWPAN_FIXED_HDRLEN;
-#endif /* USE_FRAMER_HDRLEN */
-
-  max_payload = MAC_MAX_PAYLOAD - framer_hdrlen;
+#endif /* SICSLOWPAN_GHC */
   if((int)uip_len - (int)uncomp_hdr_len > max_payload - (int)packetbuf_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
     /* Number of bytes processed. */
     uint16_t processed_ip_out_len;
 
-    struct queuebuf *q;
     uint16_t frag_tag;
 
     /*
@@ -1366,9 +2532,12 @@ output(const uip_lladdr_t *localdest)
      * The first fragment contains frag1 dispatch, then
      * IPv6/IPHC/HC_UDP dispatchs/headers.
      * The following fragments contain only the fragn dispatch.
+     * Each fragment is built directly in packetbuf and handed to the
+     * MAC, which keeps its own queuebuf copy; packetbuf is not saved
+     * and restored around the MAC.
      */
     int estimated_fragments = ((int)uip_len) / (max_payload - SICSLOWPAN_FRAGN_HDR_LEN) + 1;
-    int freebuf = queuebuf_numfree() - 1;
+    int freebuf = queuebuf_numfree();
     PRINTFO("uip_len: %d, fragments: %d, free bufs: %d\n", uip_len, estimated_fragments, freebuf);
     if(freebuf < estimated_fragments) {
       PRINTFO("Dropping packet, not enough free bufs\n");
@@ -1404,15 +2573,7 @@ output(const uip_lladdr_t *localdest)
     memcpy(packetbuf_ptr + packetbuf_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, packetbuf_payload_len);
     packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-    q = queuebuf_new_from_packetbuf();
-    if(q == NULL) {
-      PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
-      return 0;
-    }
     send_packet(&dest);
-    queuebuf_to_packetbuf(q);
-    queuebuf_free(q);
-    q = NULL;
 
     /* Check tx result. */
     if((last_tx_status == MAC_TX_COLLISION) ||
@@ -1427,17 +2588,20 @@ output(const uip_lladdr_t *localdest)
 
     /*
      * Create following fragments
-     * Datagram tag is already in the buffer, we need to set the
-     * FRAGN dispatch and for each fragment, the offset
+     * The MAC may have added its header in packetbuf, so each fragment
+     * starts from a cleared packetbuf with the FRAGN dispatch, the
+     * datagram tag and its offset
      */
     packetbuf_hdr_len = SICSLOWPAN_FRAGN_HDR_LEN;
-/*     PACKETBUF_FRAG_BUF->dispatch_size = */
-/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
-    SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
-          ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
     packetbuf_payload_len = (max_payload - packetbuf_hdr_len) & 0xfffffff8;
     while(processed_ip_out_len < uip_len) {
       PRINTFO("sicslowpan output: fragment ");
+      packetbuf_clear();
+      packetbuf_ptr = packetbuf_dataptr();
+      set_output_attrs();
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_DISPATCH_SIZE,
+            ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
+      SET16(PACKETBUF_FRAG_PTR, PACKETBUF_FRAG_TAG, frag_tag);
       PACKETBUF_FRAG_PTR[PACKETBUF_FRAG_OFFSET] = processed_ip_out_len >> 3;
 
       /* Copy payload and send */
@@ -1450,15 +2614,7 @@ output(const uip_lladdr_t *localdest)
       memcpy(packetbuf_ptr + packetbuf_hdr_len,
              (uint8_t *)UIP_IP_BUF + processed_ip_out_len, packetbuf_payload_len);
       packetbuf_set_datalen(packetbuf_payload_len + packetbuf_hdr_len);
-      q = queuebuf_new_from_packetbuf();
-      if(q == NULL) {
-        PRINTFO("could not allocate queuebuf, dropping fragment\n");
-        return 0;
-      }
       send_packet(&dest);
-      queuebuf_to_packetbuf(q);
-      queuebuf_free(q);
-      q = NULL;
       processed_ip_out_len += packetbuf_payload_len;
 
       /* Check tx result. */
@@ -1500,7 +2656,7 @@ output(const uip_lladdr_t *localdest)
  * (it is a SHALL in the RFC 4944 and should never happen)
  */
 static void
-input(void)
+input_payload(void)
 {
   /* size of the IP packet (read from fragment) */
   uint16_t frag_size = 0;
@@ -1517,12 +2673,12 @@ input(void)
   uint8_t first_fragment = 0, last_fragment = 0;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
-  /* Update link statistics */
-  link_stats_input_callback(packetbuf_addr(PACKETBUF_ADDR_SENDER));
-
   /* init */
   uncomp_hdr_len = 0;
   packetbuf_hdr_len = 0;
+#if SICSLOWPAN_GHC
+  ghc_input = 0;
+#endif /* SICSLOWPAN_GHC */
 
   /* The MAC puts the 15.4 payload inside the packetbuf data buffer */
   packetbuf_ptr = packetbuf_dataptr();
@@ -1555,6 +2711,13 @@ input(void)
       first_fragment = 1;
       is_fragment = 1;
 
+#if SICSLOWPAN_FRAG_FORWARDING
+      if(fwd_lookup(frag_tag, packetbuf_addr(PACKETBUF_ADDR_SENDER)) != REASS_NONE) {
+        /* Already relayed */
+        return;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+
       /* Add the fragment to the fragmentation context */
       frag_context = add_fragment(frag_tag, frag_size, frag_offset);
 
@@ -1578,10 +2741,16 @@ input(void)
              frag_size, frag_tag, frag_offset);
       packetbuf_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
 
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: packetbuf_payload_len %d frag_size %d\n",
-              packetbuf_datalen() - packetbuf_hdr_len, frag_size);
+      if(frag_offset == 0) {
+        /* Only FRAG1 may start the packet */
+        return;
+      }
+
+#if SICSLOWPAN_FRAG_FORWARDING
+      if(forward_fragment(frag_tag)) {
+        return;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
 
       /* Add the fragment to the fragmentation context (this will also
          copy the payload) */
@@ -1595,9 +2764,9 @@ input(void)
          we should not store more */
       buffer = NULL;
 
-      if(frag_info[frag_context].reassembled_len >= frag_size) {
-        last_fragment = 1;
-      }
+      /* Fragments may arrive in any order, so whichever one completes
+         the packet is the last fragment. */
+      last_fragment = fragments_complete(frag_context);
       is_fragment = 1;
       break;
     default:
@@ -1615,6 +2784,16 @@ input(void)
   if((PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH] & 0xe0) == SICSLOWPAN_DISPATCH_IPHC) {
     PRINTFI("sicslowpan input: IPHC\n");
     uncompress_hdr_iphc(buffer, frag_size);
+#if SICSLOWPAN_GHC
+    if(ghc_input && frag_size > 0) {
+      /* output() only uses GHC for packets that fit in a frame */
+      PRINTFI("sicslowpan input: fragmented GHC packet dropped\n");
+#if SICSLOWPAN_CONF_FRAG
+      abort_fragments(frag_context);
+#endif /* SICSLOWPAN_CONF_FRAG */
+      return;
+    }
+#endif /* SICSLOWPAN_GHC */
   } else
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
     switch(PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH]) {
@@ -1633,6 +2812,11 @@ input(void)
       /* unknown header */
       PRINTFI("sicslowpan input: unknown dispatch: %u\n",
              PACKETBUF_HC1_PTR[PACKETBUF_HC1_DISPATCH]);
+#if SICSLOWPAN_CONF_FRAG
+      if(first_fragment) {
+        abort_fragments(frag_context);
+      }
+#endif /* SICSLOWPAN_CONF_FRAG */
       return;
   }
 
@@ -1666,9 +2850,36 @@ input(void)
     }
   }
 
+#if SICSLOWPAN_CONF_FRAG
+  if(first_fragment &&
+     uncomp_hdr_len + packetbuf_payload_len > SICSLOWPAN_FIRST_FRAGMENT_SIZE) {
+    PRINTF("SICSLOWPAN: first fragment too large (%d)\n",
+           uncomp_hdr_len + packetbuf_payload_len);
+    abort_fragments(frag_context);
+    return;
+  }
+#endif /* SICSLOWPAN_CONF_FRAG */
+
   /* copy the payload if buffer is non-null - which is only the case with first fragment
      or packets that are non fragmented */
   if(buffer != NULL) {
+#if SICSLOWPAN_GHC
+    if(ghc_input) {
+      packetbuf_payload_len = ghc_decompress(buffer, packetbuf_ptr + packetbuf_hdr_len,
+                                             packetbuf_payload_len,
+                                             UIP_BUFSIZE - UIP_LLH_LEN - uncomp_hdr_len);
+      if(packetbuf_payload_len < 0) {
+        PRINTFI("sicslowpan input: malformed GHC payload\n");
+        return;
+      }
+      /* uncompress_hdr_iphc() took the lengths from the frame */
+      SICSLOWPAN_IP_BUF(buffer)->len[0] = (uncomp_hdr_len - UIP_IPH_LEN + packetbuf_payload_len) >> 8;
+      SICSLOWPAN_IP_BUF(buffer)->len[1] = (uncomp_hdr_len - UIP_IPH_LEN + packetbuf_payload_len) & 0xff;
+      if(SICSLOWPAN_IP_BUF(buffer)->proto == UIP_PROTO_UDP) {
+        memcpy(&SICSLOWPAN_UDP_BUF(buffer)->udplen, &SICSLOWPAN_IP_BUF(buffer)->len[0], 2);
+      }
+    } else
+#endif /* SICSLOWPAN_GHC */
     memcpy((uint8_t *)buffer + uncomp_hdr_len, packetbuf_ptr + packetbuf_hdr_len, packetbuf_payload_len);
   }
 
@@ -1678,13 +2889,18 @@ input(void)
   if(frag_size > 0) {
     /* Add the size of the header only for the first fragment. */
     if(first_fragment != 0) {
-      frag_info[frag_context].reassembled_len = uncomp_hdr_len + packetbuf_payload_len;
       frag_info[frag_context].first_frag_len = uncomp_hdr_len + packetbuf_payload_len;
+      mark_fragment(frag_context, 0, frag_info[frag_context].first_frag_len, 1);
+      last_fragment = fragments_complete(frag_context);
+#if SICSLOWPAN_FRAG_FORWARDING
+      if(!last_fragment && forward_first_fragment(frag_context)) {
+        return;
+      }
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
     }
     /* For the last fragment, we are OK if there is extrenous bytes at
        the end of the packet. */
     if(last_fragment != 0) {
-      frag_info[frag_context].reassembled_len = frag_size;
       /* copy to uip */
       copy_frags2uip(frag_context);
     }
@@ -1730,6 +2946,56 @@ input(void)
   }
 #endif /* SICSLOWPAN_CONF_FRAG */
 }
+#if SICSLOWPAN_AGGREGATION
+/*--------------------------------------------------------------------*/
+/** \brief Process a frame that carries several 6lowpan packets.
+ *
+ *  The packets follow the aggregate dispatch, each preceded by its
+ *  length. They are put in packetbuf one by one, with the addresses and
+ *  attributes of the frame, and processed as if received on their own.
+ *  Processing stops at the first malformed length.
+ */
+static void
+input_aggregate(void)
+{
+  static uint8_t frame[PACKETBUF_SIZE];
+  static struct packetbuf_attr attrs[PACKETBUF_NUM_ATTRS];
+  static struct packetbuf_addr addrs[PACKETBUF_NUM_ADDRS];
+  uint16_t len;
+  uint16_t pos;
+
+  len = packetbuf_datalen();
+  memcpy(frame, packetbuf_dataptr(), len);
+  packetbuf_attr_copyto(attrs, addrs);
+
+  for(pos = 1; pos < len; pos += 1 + frame[pos]) {
+    if(frame[pos] == 0 || pos + 1 + frame[pos] > len) {
+      PRINTFI("sicslowpan input: malformed aggregate at %u\n", pos);
+      break;
+    }
+    packetbuf_copyfrom(&frame[pos + 1], frame[pos]);
+    packetbuf_attr_copyfrom(attrs, addrs);
+    input_payload();
+  }
+}
+#endif /* SICSLOWPAN_AGGREGATION */
+/*--------------------------------------------------------------------*/
+static void
+input(void)
+{
+  /* Update link statistics */
+  link_stats_input_callback(packetbuf_addr(PACKETBUF_ADDR_SENDER));
+
+#if SICSLOWPAN_AGGREGATION
+  if(packetbuf_datalen() > 0 &&
+     *(uint8_t *)packetbuf_dataptr() == SICSLOWPAN_DISPATCH_AGGREGATE) {
+    input_aggregate();
+    return;
+  }
+#endif /* SICSLOWPAN_AGGREGATION */
+
+  input_payload();
+}
 /** @} */
 
 /*--------------------------------------------------------------------*/
@@ -1745,6 +3011,13 @@ sicslowpan_init(void)
 
   tcpip_set_outputfunc(output);
 
+#if SICSLOWPAN_CONF_FRAG
+  init_fragments();
+#if SICSLOWPAN_FRAG_FORWARDING
+  init_forwarding();
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+#endif /* SICSLOWPAN_CONF_FRAG */
+
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
 /* Preinitialize any address contexts for better header compression
  * (Saves up to 13 bytes per 6lowpan packet)
@@ -1787,6 +3060,10 @@ sicslowpan_init(void)
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
 
+#if SICSLOWPAN_IPHC_CACHE_SIZE > 0
+  iphc_cache_flush();
+#endif /* SICSLOWPAN_IPHC_CACHE_SIZE > 0 */
+
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
 }
 /*--------------------------------------------------------------------*/
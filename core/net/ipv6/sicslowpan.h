@@ -82,6 +82,9 @@
 #define SICSLOWPAN_DISPATCH_IPHC                    0x60 /* 011xxxxx = ... */
 #define SICSLOWPAN_DISPATCH_FRAG1                   0xc0 /* 11000xxx */
 #define SICSLOWPAN_DISPATCH_FRAGN                   0xe0 /* 11100xxx */
+/* Not in RFC 4944: several packets for the same neighbor in one frame,
+   each preceded by its length (SICSLOWPAN_CONF_AGGREGATION) */
+#define SICSLOWPAN_DISPATCH_AGGREGATE               0x4f /* 01001111 = 79 */
 /** @} */
 
 /** \name HC1 encoding
@@ -164,6 +167,17 @@
 #define SICSLOWPAN_NHC_UDP_CS_P_11  0xF3 /* source & dest = 0xF0B + 4bit inline */
 /** @} */
 
+/**
+ * \name LOWPAN_GHC encoding (RFC 7400)
+ * @{
+ */
+/* UDP as LOWPAN_UDP, with the low bits of 0xF0-0xF7, and a GHC payload */
+#define SICSLOWPAN_NHC_GHC_UDP_MASK                 0xF8
+#define SICSLOWPAN_NHC_GHC_UDP_ID                   0xD0
+/* ICMPv6 header and payload GHC-compressed */
+#define SICSLOWPAN_NHC_GHC_ICMP6                    0xDF
+/** @} */
+
 
 /**
  * \name The 6lowpan "headers" length
@@ -321,6 +335,26 @@ struct sicslowpan_nh_compressor {
 
 int sicslowpan_get_last_rssi(void);
 
+/**
+ * \brief Fragment reassembly counters, in packets
+ */
+struct sicslowpan_reass_stats {
+  uint16_t started;    /**< Reassembly contexts opened */
+  uint16_t completed;  /**< Packets reassembled and passed to uIP */
+  uint16_t timed_out;  /**< Packets still incomplete at SICSLOWPAN_REASS_MAXAGE */
+  uint16_t discarded;  /**< Packets dropped early because they cannot complete */
+  uint16_t duplicates; /**< Fragments dropped because they carried nothing new */
+  uint16_t no_context; /**< Packets dropped because all contexts were busy */
+  uint16_t forwarded;  /**< Packets relayed fragment by fragment, see
+                            SICSLOWPAN_CONF_FRAG_FORWARDING */
+};
+
+/**
+ * \brief Get the reassembly counters. Only available when
+ * SICSLOWPAN_CONF_FRAG is enabled.
+ */
+const struct sicslowpan_reass_stats *sicslowpan_get_reass_stats(void);
+
 extern const struct network_driver sicslowpan_driver;
 
 #endif /* SICSLOWPAN_H_ */
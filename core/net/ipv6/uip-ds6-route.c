@@ -69,12 +69,34 @@ MEMB(neighborroutememb, struct uip_ds6_route_neighbor_route, UIP_DS6_ROUTE_NB);
 /* Each route is repressented by a uip_ds6_route_t structure and
    memory for each route is allocated from the routememb memory
    block. These routes are maintained on the routelist. */
+#if !UIP_DS6_ROUTE_TRIE
 LIST(routelist);
+#endif /* !UIP_DS6_ROUTE_TRIE */
 MEMB(routememb, uip_ds6_route_t, UIP_DS6_ROUTE_NB);
 
 static int num_routes = 0;
 static void rm_routelist_callback(nbr_table_item_t *ptr);
 
+#if UIP_DS6_ROUTE_TRIE
+/* A node of the path-compressed binary trie that indexes the routes
+   by prefix. Nodes with a route have the prefix of the route, the
+   others are where the prefixes below them first differ. */
+struct uip_ds6_route_trie_node {
+  struct uip_ds6_route_trie_node *parent;
+  struct uip_ds6_route_trie_node *child[2];
+  uip_ds6_route_t *route;
+  uip_ipaddr_t prefix;
+  uint8_t length;
+};
+
+MEMB(trienodememb, struct uip_ds6_route_trie_node, 2 * UIP_DS6_ROUTE_NB);
+static struct uip_ds6_route_trie_node *trie_root;
+/* The routelist is doubly linked in this mode, so that a route is
+   moved to the front or removed without a walk */
+static uip_ds6_route_t *routelist_head;
+static uip_ds6_route_t *routelist_tail;
+#endif /* UIP_DS6_ROUTE_TRIE */
+
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
 
 /* Default routes are held on the defaultrouterlist and their
@@ -155,13 +177,264 @@ uip_ds6_notification_rm(struct uip_ds6_notification *n)
   list_remove(notificationlist, n);
 }
 #endif
+#if (UIP_CONF_MAX_ROUTES != 0)
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+routelist_first(void)
+{
+#if UIP_DS6_ROUTE_TRIE
+  return routelist_head;
+#else /* UIP_DS6_ROUTE_TRIE */
+  return list_head(routelist);
+#endif /* UIP_DS6_ROUTE_TRIE */
+}
+/*---------------------------------------------------------------------------*/
+/* The route list is ordered by use, most recently used first */
+static void
+routelist_push(uip_ds6_route_t *r)
+{
+#if UIP_DS6_ROUTE_TRIE
+  r->prev = NULL;
+  r->next = routelist_head;
+  if(r->next != NULL) {
+    r->next->prev = r;
+  } else {
+    routelist_tail = r;
+  }
+  routelist_head = r;
+#else /* UIP_DS6_ROUTE_TRIE */
+  list_push(routelist, r);
+#endif /* UIP_DS6_ROUTE_TRIE */
+}
+/*---------------------------------------------------------------------------*/
+static void
+routelist_remove(uip_ds6_route_t *r)
+{
+#if UIP_DS6_ROUTE_TRIE
+  if(r->prev != NULL) {
+    r->prev->next = r->next;
+  } else {
+    routelist_head = r->next;
+  }
+  if(r->next != NULL) {
+    r->next->prev = r->prev;
+  } else {
+    routelist_tail = r->prev;
+  }
+#else /* UIP_DS6_ROUTE_TRIE */
+  list_remove(routelist, r);
+#endif /* UIP_DS6_ROUTE_TRIE */
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
+static uip_ds6_route_t *
+routelist_least_recently_used(void)
+{
+#if UIP_DS6_ROUTE_TRIE
+  return routelist_tail;
+#else /* UIP_DS6_ROUTE_TRIE */
+  return list_tail(routelist);
+#endif /* UIP_DS6_ROUTE_TRIE */
+}
+#endif /* UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED */
+#endif /* (UIP_CONF_MAX_ROUTES != 0) */
+#if UIP_DS6_ROUTE_TRIE
+/*---------------------------------------------------------------------------*/
+static uint8_t
+addr_bit(const uip_ipaddr_t *addr, uint8_t bit)
+{
+  return (addr->u8[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The first bit in [from, to) where a and b differ, or to */
+static uint8_t
+first_diff(const uip_ipaddr_t *a, const uip_ipaddr_t *b,
+           uint8_t from, uint8_t to)
+{
+  uint8_t i;
+  uint8_t x;
+  uint8_t bit;
+
+  for(i = from >> 3; (i << 3) < to; i++) {
+    x = a->u8[i] ^ b->u8[i];
+    if(i == from >> 3) {
+      x &= 0xff >> (from & 7);
+    }
+    if(x != 0) {
+      for(bit = i << 3; (x & 0x80) == 0; x <<= 1) {
+        bit++;
+      }
+      return MIN(bit, to);
+    }
+  }
+  return to;
+}
+/*---------------------------------------------------------------------------*/
+static struct uip_ds6_route_trie_node *
+trie_node_new(const uip_ipaddr_t *prefix, uint8_t length,
+              struct uip_ds6_route_trie_node *parent)
+{
+  struct uip_ds6_route_trie_node *n;
+  uint8_t i;
+
+  n = memb_alloc(&trienodememb);
+  if(n != NULL) {
+    memset(n, 0, sizeof(*n));
+    n->parent = parent;
+    n->length = length;
+    for(i = 0; (i << 3) < length; i++) {
+      n->prefix.u8[i] = prefix->u8[i];
+    }
+    if(length & 7) {
+      n->prefix.u8[length >> 3] &= 0xff << (8 - (length & 7));
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static uip_ds6_route_t *
+trie_lookup(const uip_ipaddr_t *addr)
+{
+  struct uip_ds6_route_trie_node *n;
+  uip_ds6_route_t *found_route;
+  uint8_t from;
+
+  found_route = NULL;
+  from = 0;
+  for(n = trie_root; n != NULL; n = n->child[addr_bit(addr, n->length)]) {
+    /* The bits above from matched the ancestors of n */
+    if(first_diff(addr, &n->prefix, from, n->length) < n->length) {
+      break;
+    }
+    if(n->route != NULL) {
+      found_route = n->route;
+    }
+    if(n->length == 128) {
+      break;
+    }
+    from = n->length;
+  }
+  return found_route;
+}
+/*---------------------------------------------------------------------------*/
+static int
+trie_insert(uip_ds6_route_t *r)
+{
+  struct uip_ds6_route_trie_node **link;
+  struct uip_ds6_route_trie_node *parent;
+  struct uip_ds6_route_trie_node *n;
+  struct uip_ds6_route_trie_node *node;
+  struct uip_ds6_route_trie_node *split;
+  uint8_t from;
+  uint8_t len;
+  uint8_t d;
+
+  link = &trie_root;
+  parent = NULL;
+  node = NULL;
+  from = 0;
+  while((n = *link) != NULL) {
+    len = MIN(r->length, n->length);
+    d = first_diff(&r->ipaddr, &n->prefix, from, len);
+    if(d < len) {
+      /* The prefixes part at d, where a new node takes the place of n */
+      split = trie_node_new(&r->ipaddr, d, parent);
+      node = trie_node_new(&r->ipaddr, r->length, split);
+      if(split == NULL || node == NULL) {
+        memb_free(&trienodememb, split);
+        memb_free(&trienodememb, node);
+        return 0;
+      }
+      split->child[addr_bit(&n->prefix, d)] = n;
+      split->child[addr_bit(&r->ipaddr, d)] = node;
+      n->parent = split;
+      *link = split;
+      break;
+    }
+    if(n->length == r->length) {
+      if(n->route != NULL) {
+        return 0;
+      }
+      node = n;
+      break;
+    }
+    if(n->length > r->length) {
+      /* The new prefix covers n */
+      node = trie_node_new(&r->ipaddr, r->length, parent);
+      if(node == NULL) {
+        return 0;
+      }
+      node->child[addr_bit(&n->prefix, r->length)] = n;
+      n->parent = node;
+      *link = node;
+      break;
+    }
+    from = n->length;
+    parent = n;
+    link = &n->child[addr_bit(&r->ipaddr, n->length)];
+  }
+
+  if(node == NULL) {
+    node = trie_node_new(&r->ipaddr, r->length, parent);
+    if(node == NULL) {
+      return 0;
+    }
+    *link = node;
+  }
+  node->route = r;
+  r->trie_node = node;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+trie_remove(uip_ds6_route_t *r)
+{
+  struct uip_ds6_route_trie_node *n;
+  struct uip_ds6_route_trie_node *parent;
+  struct uip_ds6_route_trie_node *child;
+
+  n = r->trie_node;
+  if(n == NULL) {
+    return;
+  }
+  n->route = NULL;
+  r->trie_node = NULL;
+
+  /* Drop the nodes that neither hold a route nor part two subtries */
+  while(n != NULL && n->route == NULL &&
+        (n->child[0] == NULL || n->child[1] == NULL)) {
+    child = n->child[0] != NULL ? n->child[0] : n->child[1];
+    parent = n->parent;
+    if(parent == NULL) {
+      trie_root = child;
+    } else {
+      parent->child[parent->child[1] == n] = child;
+    }
+    memb_free(&trienodememb, n);
+    if(child != NULL) {
+      /* The parent keeps as many children as before */
+      child->parent = parent;
+      n = NULL;
+    } else {
+      n = parent;
+    }
+  }
+}
+#endif /* UIP_DS6_ROUTE_TRIE */
 /*---------------------------------------------------------------------------*/
 void
 uip_ds6_route_init(void)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
   memb_init(&routememb);
+#if UIP_DS6_ROUTE_TRIE
+  memb_init(&trienodememb);
+  trie_root = NULL;
+  routelist_head = NULL;
+  routelist_tail = NULL;
+#else /* UIP_DS6_ROUTE_TRIE */
   list_init(routelist);
+#endif /* UIP_DS6_ROUTE_TRIE */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -205,7 +478,7 @@ uip_ds6_route_t *
 uip_ds6_route_head(void)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
-  return list_head(routelist);
+  return routelist_first();
 #else /* (UIP_CONF_MAX_ROUTES != 0) */
   return NULL;
 #endif /* (UIP_CONF_MAX_ROUTES != 0) */
@@ -254,15 +527,20 @@ uip_ds6_route_t *
 uip_ds6_route_lookup(uip_ipaddr_t *addr)
 {
 #if (UIP_CONF_MAX_ROUTES != 0)
-  uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
+#if !UIP_DS6_ROUTE_TRIE
+  uip_ds6_route_t *r;
   uint8_t longestmatch;
+#endif /* !UIP_DS6_ROUTE_TRIE */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
   PRINTF("\n");
 
 
+#if UIP_DS6_ROUTE_TRIE
+  found_route = trie_lookup(addr);
+#else /* UIP_DS6_ROUTE_TRIE */
   found_route = NULL;
   longestmatch = 0;
   for(r = uip_ds6_route_head();
@@ -278,6 +556,7 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
       }
     }
   }
+#endif /* UIP_DS6_ROUTE_TRIE */
 
   if(found_route != NULL) {
     PRINTF("uip-ds6-route: Found route: ");
@@ -289,14 +568,14 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
     PRINTF("uip-ds6-route: No route found\n");
   }
 
-  if(found_route != NULL && found_route != list_head(routelist)) {
+  if(found_route != NULL && found_route != routelist_first()) {
     /* If we found a route, we put it at the start of the routeslist
        list. The list is ordered by how recently we looked them up:
        the least recently used route will be at the end of the
        list - for fast lookups (assuming multiple packets to the same node). */
 
-    list_remove(routelist, found_route);
-    list_push(routelist, found_route);
+    routelist_remove(found_route);
+    routelist_push(found_route);
   }
 
   return found_route;
@@ -355,7 +634,7 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 #if UIP_DS6_ROUTE_REMOVE_LEAST_RECENTLY_USED
       /* Removing the oldest route entry from the route table. The
          least recently used route is the first route on the list. */
-      oldest = list_tail(routelist);
+      oldest = routelist_least_recently_used();
 #endif
       if(oldest == NULL) {
         return NULL;
@@ -411,7 +690,7 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
     /* add new routes first - assuming that there is a reason to add this
        and that there is a packet coming soon. */
-    list_push(routelist, r);
+    routelist_push(r);
 
     nbrr = memb_alloc(&neighborroutememb);
     if(nbrr == NULL) {
@@ -424,7 +703,13 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
     nbrr->route = r;
     /* Add the route to this neighbor */
+#if UIP_DS6_ROUTE_TRIE
+    /* The order of a next hop's routes does not matter, and a push
+       does not walk the list a second time to find its tail */
+    list_push(routes->route_list, nbrr);
+#else /* UIP_DS6_ROUTE_TRIE */
     list_add(routes->route_list, nbrr);
+#endif /* UIP_DS6_ROUTE_TRIE */
     r->neighbor_routes = routes;
     num_routes++;
 
@@ -436,6 +721,13 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
   r->length = length;
+#if UIP_DS6_ROUTE_TRIE
+  if(!trie_insert(r)) {
+    PRINTF("uip_ds6_route_add: could not index route\n");
+    uip_ds6_route_rm(r);
+    return NULL;
+  }
+#endif /* UIP_DS6_ROUTE_TRIE */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -478,7 +770,10 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
     PRINTF("\n");
 
     /* Remove the route from the route list */
-    list_remove(routelist, route);
+    routelist_remove(route);
+#if UIP_DS6_ROUTE_TRIE
+    trie_remove(route);
+#endif /* UIP_DS6_ROUTE_TRIE */
 
     /* Find the corresponding neighbor_route and remove it. */
     for(neighbor_route = list_head(route->neighbor_routes->route_list);
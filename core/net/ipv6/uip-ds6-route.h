@@ -88,6 +88,16 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB 4
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/* Index the routing table with a prefix trie, for longest prefix
+   matches in time bound by the address length rather than the number
+   of routes. Worth its RAM (two trie nodes and two pointers per route)
+   on routers with large routing tables. */
+#ifdef UIP_CONF_DS6_ROUTE_TRIE
+#define UIP_DS6_ROUTE_TRIE UIP_CONF_DS6_ROUTE_TRIE
+#else /* UIP_CONF_DS6_ROUTE_TRIE */
+#define UIP_DS6_ROUTE_TRIE 0
+#endif /* UIP_CONF_DS6_ROUTE_TRIE */
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -157,6 +167,12 @@ typedef struct uip_ds6_route {
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
+#if UIP_DS6_ROUTE_TRIE
+  /* The route list is doubly linked so that routes can be moved and
+     removed without a search */
+  struct uip_ds6_route *prev;
+  struct uip_ds6_route_trie_node *trie_node;
+#endif /* UIP_DS6_ROUTE_TRIE */
   uint8_t length;
 } uip_ds6_route_t;
 
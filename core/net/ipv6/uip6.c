@@ -268,6 +268,55 @@ struct uip_udp_conn uip_udp_conns[UIP_UDP_CONNS];
 #endif /* UIP_UDP */
 /** @} */
 
+/*---------------------------------------------------------------------------*/
+/**
+ * \name Port hash tables
+ * @{
+ */
+/*---------------------------------------------------------------------------*/
+#if UIP_CONN_HASH_SIZE
+#if UIP_CONN_HASH_SIZE < 0 || (UIP_CONN_HASH_SIZE & (UIP_CONN_HASH_SIZE - 1))
+#error "UIP_CONF_CONN_HASH_SIZE must be a power of two"
+#endif
+#if UIP_CONNS < 0xff && UIP_UDP_CONNS < 0xff
+typedef uint8_t conn_index_t;
+#else
+typedef uint16_t conn_index_t;
+#endif
+#define CONN_NONE ((conn_index_t)~0)
+#define PORT_HASH(port) (uip_ntohs(port) & (UIP_CONN_HASH_SIZE - 1))
+
+/* Each bucket chains the connections of its local ports in table
+   order, so that a lookup finds the connection a scan of the table
+   would find first */
+#if UIP_TCP
+static conn_index_t tcp_bucket[UIP_CONN_HASH_SIZE];
+static conn_index_t tcp_next[UIP_CONNS];
+#endif /* UIP_TCP */
+#if UIP_UDP
+static conn_index_t udp_bucket[UIP_CONN_HASH_SIZE];
+static conn_index_t udp_next[UIP_UDP_CONNS];
+#endif /* UIP_UDP */
+
+/* Iterate over the connections that may have a given local port */
+#define TCP_CONN_FIRST(port) tcp_conn_at(tcp_bucket[PORT_HASH(port)])
+#define TCP_CONN_NEXT(conn)  tcp_conn_at(tcp_next[(conn) - uip_conns])
+#define TCP_CONN_END         NULL
+#define UDP_CONN_FIRST(port) udp_conn_at(udp_bucket[PORT_HASH(port)])
+#define UDP_CONN_NEXT(conn)  udp_conn_at(udp_next[(conn) - uip_udp_conns])
+#define UDP_CONN_END         NULL
+#define TCP_SET_LPORT(conn, port) tcp_set_lport(conn, port)
+#else /* UIP_CONN_HASH_SIZE */
+#define TCP_CONN_FIRST(port) (&uip_conns[0])
+#define TCP_CONN_NEXT(conn)  ((conn) + 1)
+#define TCP_CONN_END         (&uip_conns[UIP_CONNS])
+#define UDP_CONN_FIRST(port) (&uip_udp_conns[0])
+#define UDP_CONN_NEXT(conn)  ((conn) + 1)
+#define UDP_CONN_END         (&uip_udp_conns[UIP_UDP_CONNS])
+#define TCP_SET_LPORT(conn, port) (conn)->lport = (port)
+#endif /* UIP_CONN_HASH_SIZE */
+/** @} */
+
 /*---------------------------------------------------------------------------*/
 /**
  * \name ICMPv6 variables
@@ -316,43 +365,66 @@ uip_add32(uint8_t *op32, uint16_t op16)
 #endif /* UIP_ARCH_ADD32 */
 #endif /* UIP_TCP */
 
-#if ! UIP_ARCH_CHKSUM
+#if ! UIP_ARCH_CHKSUM_ADD
 /*---------------------------------------------------------------------------*/
-static uint16_t
-chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+uint16_t
+uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len)
 {
-  uint16_t t;
-  const uint8_t *dataptr;
-  const uint8_t *last_byte;
-
-  dataptr = data;
-  last_byte = data + len - 1;
-
-  while(dataptr < last_byte) {   /* At least two more bytes */
-    t = (dataptr[0] << 8) + dataptr[1];
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
-    dataptr += 2;
+  /* Carries are collected in the upper half and folded back once at the
+     end. This cannot overflow: at most 32767 words are added. */
+  uint32_t acc = sum;
+
+  while(len >= 8) {
+    acc += ((uint16_t)data[0] << 8) | data[1];
+    acc += ((uint16_t)data[2] << 8) | data[3];
+    acc += ((uint16_t)data[4] << 8) | data[5];
+    acc += ((uint16_t)data[6] << 8) | data[7];
+    data += 8;
+    len -= 8;
   }
-
-  if(dataptr == last_byte) {
-    t = (dataptr[0] << 8) + 0;
-    sum += t;
-    if(sum < t) {
-      sum++;      /* carry */
-    }
+  while(len >= 2) {
+    acc += ((uint16_t)data[0] << 8) | data[1];
+    data += 2;
+    len -= 2;
   }
+  if(len > 0) {
+    acc += (uint16_t)data[0] << 8;
+  }
+
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
 
   /* Return sum in host byte order. */
-  return sum;
+  return (uint16_t)acc;
+}
+#endif /* UIP_ARCH_CHKSUM_ADD */
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_update(uint16_t chksum, uint16_t old_sum, uint16_t new_sum)
+{
+  uint32_t acc;
+
+  /* HC' = ~(~HC + ~m + m') */
+  acc = (uint16_t)~uip_ntohs(chksum);
+  acc += (uint16_t)~old_sum;
+  acc += new_sum;
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+
+  return uip_htons((uint16_t)~acc);
 }
 /*---------------------------------------------------------------------------*/
 uint16_t
+uip_chksum_update16(uint16_t chksum, uint16_t old_field, uint16_t new_field)
+{
+  return uip_chksum_update(chksum, uip_ntohs(old_field), uip_ntohs(new_field));
+}
+/*---------------------------------------------------------------------------*/
+#if ! UIP_ARCH_CHKSUM
+uint16_t
 uip_chksum(uint16_t *data, uint16_t len)
 {
-  return uip_htons(chksum(0, (uint8_t *)data, len));
+  return uip_htons(uip_chksum_add(0, (uint8_t *)data, len));
 }
 /*---------------------------------------------------------------------------*/
 #ifndef UIP_ARCH_IPCHKSUM
@@ -361,7 +433,7 @@ uip_ipchksum(void)
 {
   uint16_t sum;
 
-  sum = chksum(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
+  sum = uip_chksum_add(0, &uip_buf[UIP_LLH_LEN], UIP_IPH_LEN);
   PRINTF("uip_ipchksum: sum 0x%04x\n", sum);
   return (sum == 0) ? 0xffff : uip_htons(sum);
 }
@@ -391,10 +463,10 @@ upper_layer_chksum(uint8_t proto)
   /* IP protocol and length fields. This addition cannot carry. */
   sum = upper_layer_len + proto;
   /* Sum IP source and destination addresses. */
-  sum = chksum(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
+  sum = uip_chksum_add(sum, (uint8_t *)&UIP_IP_BUF->srcipaddr, 2 * sizeof(uip_ipaddr_t));
 
   /* Sum TCP header and data. */
-  sum = chksum(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
+  sum = uip_chksum_add(sum, &uip_buf[UIP_IPH_LEN + UIP_LLH_LEN + uip_ext_len],
                upper_layer_len);
 
   return (sum == 0) ? 0xffff : uip_htons(sum);
@@ -424,6 +496,76 @@ uip_udpchksum(void)
 #endif /* UIP_UDP && UIP_UDP_CHECKSUMS */
 #endif /* UIP_ARCH_CHKSUM */
 /*---------------------------------------------------------------------------*/
+#if UIP_CONN_HASH_SIZE
+static void
+port_hash_remove(conn_index_t *bucket, conn_index_t *next,
+                 conn_index_t i, uint16_t port)
+{
+  conn_index_t *p;
+
+  for(p = &bucket[PORT_HASH(port)]; *p != CONN_NONE; p = &next[*p]) {
+    if(*p == i) {
+      *p = next[i];
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+port_hash_insert(conn_index_t *bucket, conn_index_t *next,
+                 conn_index_t i, uint16_t port)
+{
+  conn_index_t *p;
+
+  for(p = &bucket[PORT_HASH(port)]; *p != CONN_NONE && *p < i;
+      p = &next[*p]);
+  next[i] = *p;
+  *p = i;
+}
+/*---------------------------------------------------------------------------*/
+#if UIP_TCP
+static struct uip_conn *
+tcp_conn_at(conn_index_t i)
+{
+  return i == CONN_NONE ? NULL : &uip_conns[i];
+}
+/*---------------------------------------------------------------------------*/
+/* Closed connections stay in the table of their last local port until
+   they get another one */
+static void
+tcp_set_lport(struct uip_conn *conn, uint16_t port)
+{
+  if(conn->lport != 0) {
+    port_hash_remove(tcp_bucket, tcp_next, conn - uip_conns, conn->lport);
+  }
+  conn->lport = port;
+  if(port != 0) {
+    port_hash_insert(tcp_bucket, tcp_next, conn - uip_conns, port);
+  }
+}
+#endif /* UIP_TCP */
+/*---------------------------------------------------------------------------*/
+#if UIP_UDP
+static struct uip_udp_conn *
+udp_conn_at(conn_index_t i)
+{
+  return i == CONN_NONE ? NULL : &uip_udp_conns[i];
+}
+/*---------------------------------------------------------------------------*/
+void
+uip_udp_set_lport(struct uip_udp_conn *conn, uint16_t port)
+{
+  if(conn->lport != 0) {
+    port_hash_remove(udp_bucket, udp_next, conn - uip_udp_conns, conn->lport);
+  }
+  conn->lport = port;
+  if(port != 0) {
+    port_hash_insert(udp_bucket, udp_next, conn - uip_udp_conns, port);
+  }
+}
+#endif /* UIP_UDP */
+#endif /* UIP_CONN_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
 void
 uip_init(void)
 {
@@ -440,6 +582,12 @@ uip_init(void)
   for(c = 0; c < UIP_CONNS; ++c) {
     uip_conns[c].tcpstateflags = UIP_CLOSED;
   }
+#if UIP_CONN_HASH_SIZE
+  for(c = 0; c < UIP_CONNS; ++c) {
+    uip_conns[c].lport = 0;
+  }
+  memset(tcp_bucket, CONN_NONE, sizeof(tcp_bucket));
+#endif /* UIP_CONN_HASH_SIZE */
 #endif /* UIP_TCP */
 
 #if UIP_ACTIVE_OPEN || UIP_UDP
@@ -450,6 +598,9 @@ uip_init(void)
   for(c = 0; c < UIP_UDP_CONNS; ++c) {
     uip_udp_conns[c].lport = 0;
   }
+#if UIP_CONN_HASH_SIZE
+  memset(udp_bucket, CONN_NONE, sizeof(udp_bucket));
+#endif /* UIP_CONN_HASH_SIZE */
 #endif /* UIP_UDP */
 
 #if UIP_IPV6_MULTICAST
@@ -474,8 +625,8 @@ uip_connect(const uip_ipaddr_t *ripaddr, uint16_t rport)
 
   /* Check if this port is already in use, and if so try to find
      another one. */
-  for(c = 0; c < UIP_CONNS; ++c) {
-    conn = &uip_conns[c];
+  for(conn = TCP_CONN_FIRST(uip_htons(lastport)); conn != TCP_CONN_END;
+      conn = TCP_CONN_NEXT(conn)) {
     if(conn->tcpstateflags != UIP_CLOSED &&
        conn->lport == uip_htons(lastport)) {
       goto again;
@@ -521,7 +672,7 @@ uip_connect(const uip_ipaddr_t *ripaddr, uint16_t rport)
   conn->rto = UIP_RTO;
   conn->sa = 0;
   conn->sv = 16;   /* Initial value of the RTT variance. */
-  conn->lport = uip_htons(lastport);
+  TCP_SET_LPORT(conn, uip_htons(lastport));
   conn->rport = rport;
   uip_ipaddr_copy(&conn->ripaddr, ripaddr);
 
@@ -568,8 +719,9 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     lastport = 4096;
   }
 
-  for(c = 0; c < UIP_UDP_CONNS; ++c) {
-    if(uip_udp_conns[c].lport == uip_htons(lastport)) {
+  for(conn = UDP_CONN_FIRST(uip_htons(lastport)); conn != UDP_CONN_END;
+      conn = UDP_CONN_NEXT(conn)) {
+    if(conn->lport == uip_htons(lastport)) {
       goto again;
     }
   }
@@ -586,7 +738,8 @@ uip_udp_new(const uip_ipaddr_t *ripaddr, uint16_t rport)
     return 0;
   }
 
-  conn->lport = UIP_HTONS(lastport);
+  tcpip_udp_conn_reset(conn);
+  uip_udp_bind(conn, UIP_HTONS(lastport));
   conn->rport = rport;
   if(ripaddr == NULL) {
     memset(&conn->ripaddr, 0, sizeof(uip_ipaddr_t));
@@ -1503,9 +1656,9 @@ uip_process(uint8_t flag)
   }
 
   /* Demultiplex this UDP packet between the UDP "connections". */
-  for(uip_udp_conn = &uip_udp_conns[0];
-      uip_udp_conn < &uip_udp_conns[UIP_UDP_CONNS];
-      ++uip_udp_conn) {
+  for(uip_udp_conn = UDP_CONN_FIRST(UIP_UDP_BUF->destport);
+      uip_udp_conn != UDP_CONN_END;
+      uip_udp_conn = UDP_CONN_NEXT(uip_udp_conn)) {
     /* If the local UDP port is non-zero, the connection is considered
        to be used. If so, the local port number is checked against the
        destination port number in the received packet. If the two port
@@ -1607,8 +1760,9 @@ uip_process(uint8_t flag)
 
   /* Demultiplex this segment. */
   /* First check any active connections. */
-  for(uip_connr = &uip_conns[0]; uip_connr <= &uip_conns[UIP_CONNS - 1];
-      ++uip_connr) {
+  for(uip_connr = TCP_CONN_FIRST(UIP_TCP_BUF->destport);
+      uip_connr != TCP_CONN_END;
+      uip_connr = TCP_CONN_NEXT(uip_connr)) {
     if(uip_connr->tcpstateflags != UIP_CLOSED &&
        UIP_TCP_BUF->destport == uip_connr->lport &&
        UIP_TCP_BUF->srcport == uip_connr->rport &&
@@ -1728,7 +1882,7 @@ uip_process(uint8_t flag)
   uip_connr->sa = 0;
   uip_connr->sv = 4;
   uip_connr->nrtx = 0;
-  uip_connr->lport = UIP_TCP_BUF->destport;
+  TCP_SET_LPORT(uip_connr, UIP_TCP_BUF->destport);
   uip_connr->rport = UIP_TCP_BUF->srcport;
   uip_ipaddr_copy(&uip_connr->ripaddr, &UIP_IP_BUF->srcipaddr);
   uip_connr->tcpstateflags = UIP_SYN_RCVD;
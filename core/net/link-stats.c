@@ -155,6 +155,13 @@ link_stats_packet_sent(const linkaddr_t *lladdr, int status, int numtx)
   stats->last_tx_time = clock_time();
   stats->freshness = MIN(stats->freshness + numtx, FRESHNESS_MAX);
 
+#if LINK_STATS_PACKET_COUNTERS
+  stats->cnt_total.num_packets_tx += numtx;
+  if(status == MAC_TX_OK) {
+    stats->cnt_total.num_packets_acked++;
+  }
+#endif /* LINK_STATS_PACKET_COUNTERS */
+
   /* ETX used for this update */
   packet_etx = ((status == MAC_TX_NOACK) ? ETX_NOACK_PENALTY : numtx) * ETX_DIVISOR;
   /* ETX alpha used for this update */
@@ -180,10 +187,17 @@ link_stats_input_callback(const linkaddr_t *lladdr)
       /* Initialize */
       stats->rssi = packet_rssi;
       stats->etx = LINK_STATS_INIT_ETX(stats);
+#if LINK_STATS_PACKET_COUNTERS
+      stats->cnt_total.num_packets_rx = 1;
+#endif /* LINK_STATS_PACKET_COUNTERS */
     }
     return;
   }
 
+#if LINK_STATS_PACKET_COUNTERS
+  stats->cnt_total.num_packets_rx++;
+#endif /* LINK_STATS_PACKET_COUNTERS */
+
   /* Update RSSI EWMA */
   stats->rssi = ((int32_t)stats->rssi * (EWMA_SCALE - EWMA_ALPHA) +
       (int32_t)packet_rssi * EWMA_ALPHA) / EWMA_SCALE;
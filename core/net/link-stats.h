@@ -42,12 +42,32 @@
 #define LINK_STATS_ETX_DIVISOR              128
 #endif /* LINK_STATS_CONF_ETX_DIVISOR */
 
+/* Maintain per-link packet counters, e.g. for traffic-adaptive scheduling */
+#ifdef LINK_STATS_CONF_PACKET_COUNTERS
+#define LINK_STATS_PACKET_COUNTERS          LINK_STATS_CONF_PACKET_COUNTERS
+#else /* LINK_STATS_CONF_PACKET_COUNTERS */
+#define LINK_STATS_PACKET_COUNTERS          0
+#endif /* LINK_STATS_CONF_PACKET_COUNTERS */
+
+#if LINK_STATS_PACKET_COUNTERS
+/* Free-running frame counters of a link. They wrap around: users compute
+ * differences between two snapshots */
+struct link_packet_counter {
+  uint16_t num_packets_tx;    /* Transmissions, including retransmissions */
+  uint16_t num_packets_acked; /* Frames acknowledged by the neighbor */
+  uint16_t num_packets_rx;    /* Frames received from the neighbor */
+};
+#endif /* LINK_STATS_PACKET_COUNTERS */
+
 /* All statistics of a given link */
 struct link_stats {
   uint16_t etx;               /* ETX using ETX_DIVISOR as fixed point divisor */
   int16_t rssi;               /* RSSI (received signal strength) */
   uint8_t freshness;          /* Freshness of the statistics */
   clock_time_t last_tx_time;  /* Last Tx timestamp */
+#if LINK_STATS_PACKET_COUNTERS
+  struct link_packet_counter cnt_total; /* Frame counters since the link was added */
+#endif /* LINK_STATS_PACKET_COUNTERS */
 };
 
 /* Returns the neighbor's link statistics */
@@ -200,6 +200,14 @@ static int we_are_receiving_burst = 0;
 #define GUARD_TIME                         10 * CHECK_TIME + CHECK_TIME_TX
 #endif
 
+/* MIN_GUARD_TIME is what GUARD_TIME shrinks to for neighbors whose
+   phase is predicted accurately (PHASE_CONF_DRIFT_CORRECT). */
+#ifdef CONTIKIMAC_CONF_MIN_GUARD_TIME
+#define MIN_GUARD_TIME                     CONTIKIMAC_CONF_MIN_GUARD_TIME
+#else
+#define MIN_GUARD_TIME                     2 * CHECK_TIME + CHECK_TIME_TX
+#endif
+
 /* INTER_PACKET_INTERVAL is the interval between two successive packet transmissions */
 #ifdef CONTIKIMAC_CONF_INTER_PACKET_INTERVAL
 #define INTER_PACKET_INTERVAL              CONTIKIMAC_CONF_INTER_PACKET_INTERVAL
@@ -616,7 +624,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   if(!is_broadcast && !is_receiver_awake) {
 #if WITH_PHASE_OPTIMIZATION
     ret = phase_wait(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
-                     CYCLE_TIME, GUARD_TIME,
+                     CYCLE_TIME, GUARD_TIME, MIN_GUARD_TIME,
                      mac_callback, mac_callback_ptr, buf_list);
     if(ret == PHASE_DEFERRED) {
       return MAC_TX_DEFERRED;
@@ -825,7 +833,7 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   if(!is_broadcast) {
     if(collisions == 0 && is_receiver_awake == 0) {
       phase_update(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
-		   encounter_time, ret);
+		   encounter_time, CYCLE_TIME, ret);
     }
   }
 #endif /* WITH_PHASE_OPTIMIZATION */
@@ -842,6 +850,28 @@ qsend_packet(mac_callback_t sent, void *ptr)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Turns frames of a burst that were created in advance, but not sent,
+   back into packets. They are created again when they are next sent,
+   with frame pending bits that account for the packets queued in the
+   meantime, so that the burst still covers the whole queue. Secured
+   frames are left as they are. */
+static void
+uncreate_frames(struct rdc_buf_list *buf_list)
+{
+  for(; buf_list != NULL; buf_list = list_item_next(buf_list)) {
+    queuebuf_to_packetbuf(buf_list->buf);
+    if(packetbuf_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED)
+#if LLSEC802154_USES_AUX_HEADER
+       && packetbuf_attr(PACKETBUF_ATTR_SECURITY_LEVEL) == 0
+#endif /* LLSEC802154_USES_AUX_HEADER */
+       && NETSTACK_FRAMER.parse() >= 0) {
+      packetbuf_set_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED, 0);
+      packetbuf_set_attr(PACKETBUF_ATTR_PENDING, 0);
+      queuebuf_update_from_packetbuf(buf_list->buf);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
 static void
 qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 {
@@ -899,6 +929,11 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 
     /* Send the current packet */
     ret = send_packet(sent, ptr, curr, is_receiver_awake);
+    if(ret != MAC_TX_OK) {
+      /* The burst ends, or is deferred to the receiver's phase */
+      uncreate_frames(curr);
+      queuebuf_to_packetbuf(curr->buf);
+    }
     if(ret != MAC_TX_DEFERRED) {
       mac_call_sent_callback(sent, ptr, ret, 1);
     }
@@ -51,6 +51,10 @@
 #include "lib/list.h"
 #include "lib/memb.h"
 
+#if CSMA_CONF_WITH_AGGREGATION
+#include "net/ipv6/sicslowpan.h"
+#endif /* CSMA_CONF_WITH_AGGREGATION */
+
 #include <string.h>
 
 #include <stdio.h>
@@ -93,20 +97,90 @@
 #define CSMA_MAX_MAX_FRAME_RETRIES 7
 #endif
 
+/* Packets carry a priority class: each neighbor queue is kept sorted by
+   class, FIFO within a class */
+#define CSMA_WITH_PRIORITY (CSMA_NUM_PRIORITIES > 1)
+
+/* Number of buckets of the neighbor queue hash table, a power of two.
+   0 looks neighbor queues up by scanning the list */
+#ifdef CSMA_CONF_NEIGHBOR_HASH_SIZE
+#define CSMA_NEIGHBOR_HASH_SIZE CSMA_CONF_NEIGHBOR_HASH_SIZE
+#else /* CSMA_CONF_NEIGHBOR_HASH_SIZE */
+#define CSMA_NEIGHBOR_HASH_SIZE 0
+#endif /* CSMA_CONF_NEIGHBOR_HASH_SIZE */
+
+/* Share the packet buffers fairly among neighbors: a neighbor may only
+   queue a packet while its queue is shorter than CSMA_FAIR_SHARE_ALPHA
+   times the number of free buffers. Packets of the highest class are
+   only limited by the buffers left. */
+#ifdef CSMA_CONF_WITH_FAIR_SHARE
+#define CSMA_WITH_FAIR_SHARE CSMA_CONF_WITH_FAIR_SHARE
+#else /* CSMA_CONF_WITH_FAIR_SHARE */
+#define CSMA_WITH_FAIR_SHARE 0
+#endif /* CSMA_CONF_WITH_FAIR_SHARE */
+
+#ifdef CSMA_CONF_FAIR_SHARE_ALPHA
+#define CSMA_FAIR_SHARE_ALPHA CSMA_CONF_FAIR_SHARE_ALPHA
+#else /* CSMA_CONF_FAIR_SHARE_ALPHA */
+#define CSMA_FAIR_SHARE_ALPHA 2
+#endif /* CSMA_CONF_FAIR_SHARE_ALPHA */
+
+/* Aggregate the packets queued for a neighbor into one frame, as a
+   6LoWPAN container of length-prefixed packets. The receivers must
+   enable SICSLOWPAN_CONF_AGGREGATION. A packet that finds its queue
+   empty is held back for up to CSMA_AGGREGATION_HOLD_TIME to let others
+   join it, unless the frame is already full. Held back queues live
+   longer, and may need a larger CSMA_CONF_MAX_NEIGHBOR_QUEUES. */
+#ifdef CSMA_CONF_WITH_AGGREGATION
+#define CSMA_WITH_AGGREGATION CSMA_CONF_WITH_AGGREGATION
+#else /* CSMA_CONF_WITH_AGGREGATION */
+#define CSMA_WITH_AGGREGATION 0
+#endif /* CSMA_CONF_WITH_AGGREGATION */
+
+#ifdef CSMA_CONF_AGGREGATION_HOLD_TIME
+#define CSMA_AGGREGATION_HOLD_TIME CSMA_CONF_AGGREGATION_HOLD_TIME
+#else /* CSMA_CONF_AGGREGATION_HOLD_TIME */
+#define CSMA_AGGREGATION_HOLD_TIME (CLOCK_SECOND / 32)
+#endif /* CSMA_CONF_AGGREGATION_HOLD_TIME */
+
+/* Room for the frame header and payload, without the FCS */
+#ifdef CSMA_CONF_AGGREGATION_MAX_FRAME
+#define CSMA_AGGREGATION_MAX_FRAME CSMA_CONF_AGGREGATION_MAX_FRAME
+#else /* CSMA_CONF_AGGREGATION_MAX_FRAME */
+#define CSMA_AGGREGATION_MAX_FRAME (127 - 2)
+#endif /* CSMA_CONF_AGGREGATION_MAX_FRAME */
+
 /* Packet metadata */
 struct qbuf_metadata {
   mac_callback_t sent;
   void *cptr;
   uint8_t max_transmissions;
+#if CSMA_WITH_PRIORITY
+  uint8_t priority;
+#endif /* CSMA_WITH_PRIORITY */
+#if CSMA_WITH_QUEUE_STATS
+  uint8_t dequeued;
+  clock_time_t enqueue_time;
+#endif /* CSMA_WITH_QUEUE_STATS */
+#if CSMA_WITH_AGGREGATION
+  /* The packets carried in this packet's frame */
+  struct rdc_buf_list *aggregated;
+#endif /* CSMA_WITH_AGGREGATION */
 };
 
 /* Every neighbor has its own packet queue */
 struct neighbor_queue {
   struct neighbor_queue *next;
+#if CSMA_NEIGHBOR_HASH_SIZE
+  struct neighbor_queue *hash_next;
+#endif /* CSMA_NEIGHBOR_HASH_SIZE */
   linkaddr_t addr;
   struct ctimer transmit_timer;
   uint8_t transmissions;
   uint8_t collisions;
+#if CSMA_WITH_AGGREGATION
+  uint8_t held;
+#endif /* CSMA_WITH_AGGREGATION */
   LIST_STRUCT(queued_packet_list);
 };
 
@@ -124,18 +198,49 @@ struct neighbor_queue {
 #define CSMA_MAX_PACKET_PER_NEIGHBOR MAX_QUEUED_PACKETS
 #endif /* CSMA_CONF_MAX_PACKET_PER_NEIGHBOR */
 
+/* The total number of packets queued for all neighbors */
+#ifdef CSMA_CONF_MAX_QUEUED_PACKETS
+#define MAX_QUEUED_PACKETS CSMA_CONF_MAX_QUEUED_PACKETS
+#else /* CSMA_CONF_MAX_QUEUED_PACKETS */
 #define MAX_QUEUED_PACKETS QUEUEBUF_NUM
+#endif /* CSMA_CONF_MAX_QUEUED_PACKETS */
+
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
 LIST(neighbor_list);
 
+#if CSMA_NEIGHBOR_HASH_SIZE
+static struct neighbor_queue *neighbor_hash[CSMA_NEIGHBOR_HASH_SIZE];
+#define NEIGHBOR_HASH(addr) (((addr)->u8[LINKADDR_SIZE - 1] ^ \
+                              (addr)->u8[LINKADDR_SIZE - 2]) & (CSMA_NEIGHBOR_HASH_SIZE - 1))
+#endif /* CSMA_NEIGHBOR_HASH_SIZE */
+
+#if CSMA_WITH_QUEUE_STATS
+static struct csma_queue_stats queue_stats[CSMA_NUM_PRIORITIES];
+#endif /* CSMA_WITH_QUEUE_STATS */
+
+#if CSMA_WITH_PRIORITY
+#define PACKET_PRIORITY(q) (((struct qbuf_metadata *)(q)->ptr)->priority)
+#else /* CSMA_WITH_PRIORITY */
+#define PACKET_PRIORITY(q) 0
+#endif /* CSMA_WITH_PRIORITY */
+
 static void packet_sent(void *ptr, int status, int num_transmissions);
 static void transmit_packet_list(void *ptr);
 /*---------------------------------------------------------------------------*/
 static struct neighbor_queue *
 neighbor_queue_from_addr(const linkaddr_t *addr)
 {
+#if CSMA_NEIGHBOR_HASH_SIZE
+  struct neighbor_queue *n = neighbor_hash[NEIGHBOR_HASH(addr)];
+  while(n != NULL) {
+    if(linkaddr_cmp(&n->addr, addr)) {
+      return n;
+    }
+    n = n->hash_next;
+  }
+#else /* CSMA_NEIGHBOR_HASH_SIZE */
   struct neighbor_queue *n = list_head(neighbor_list);
   while(n != NULL) {
     if(linkaddr_cmp(&n->addr, addr)) {
@@ -143,9 +248,180 @@ neighbor_queue_from_addr(const linkaddr_t *addr)
     }
     n = list_item_next(n);
   }
+#endif /* CSMA_NEIGHBOR_HASH_SIZE */
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+static void
+neighbor_queue_add(struct neighbor_queue *n)
+{
+  list_add(neighbor_list, n);
+#if CSMA_NEIGHBOR_HASH_SIZE
+  n->hash_next = neighbor_hash[NEIGHBOR_HASH(&n->addr)];
+  neighbor_hash[NEIGHBOR_HASH(&n->addr)] = n;
+#endif /* CSMA_NEIGHBOR_HASH_SIZE */
+}
+/*---------------------------------------------------------------------------*/
+static void
+neighbor_queue_free(struct neighbor_queue *n)
+{
+#if CSMA_NEIGHBOR_HASH_SIZE
+  struct neighbor_queue **np = &neighbor_hash[NEIGHBOR_HASH(&n->addr)];
+  while(*np != NULL) {
+    if(*np == n) {
+      *np = n->hash_next;
+      break;
+    }
+    np = &(*np)->hash_next;
+  }
+#endif /* CSMA_NEIGHBOR_HASH_SIZE */
+  list_remove(neighbor_list, n);
+  memb_free(&neighbor_memb, n);
+}
+/*---------------------------------------------------------------------------*/
+#if CSMA_WITH_QUEUE_STATS
+/* Accounts for the time a packet waited before its first transmission */
+static void
+queue_stats_dequeued(struct rdc_buf_list *q)
+{
+  struct qbuf_metadata *metadata = (struct qbuf_metadata *)q->ptr;
+  if(!metadata->dequeued) {
+    struct csma_queue_stats *stats = &queue_stats[PACKET_PRIORITY(q)];
+    clock_time_t delay = clock_time() - metadata->enqueue_time;
+    metadata->dequeued = 1;
+    stats->packets++;
+    stats->delay_sum += delay;
+    if(delay > stats->delay_max) {
+      stats->delay_max = delay;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct csma_queue_stats *
+csma_get_queue_stats(uint8_t priority)
+{
+  return priority < CSMA_NUM_PRIORITIES ? &queue_stats[priority] : NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+csma_reset_queue_stats(void)
+{
+  memset(queue_stats, 0, sizeof(queue_stats));
+}
+#endif /* CSMA_WITH_QUEUE_STATS */
+/*---------------------------------------------------------------------------*/
+#if CSMA_WITH_AGGREGATION
+/* Room for an aggregate in a frame to the receiver in packetbuf */
+static int
+aggregation_budget(void)
+{
+  int hdrlen = NETSTACK_FRAMER.length();
+  return hdrlen < 0 ? 0 : CSMA_AGGREGATION_MAX_FRAME - hdrlen;
+}
+/*---------------------------------------------------------------------------*/
+/* Length of an aggregate of all packets queued for a neighbor */
+static int
+aggregate_len(struct neighbor_queue *n)
+{
+  struct rdc_buf_list *q;
+  int len = 1;
+  for(q = list_head(n->queued_packet_list); q != NULL; q = list_item_next(q)) {
+    len += 1 + queuebuf_datalen(q->buf);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+/* Packs the packets that follow the head of a neighbor's queue into the
+   head's frame, in order and as far as they fit. They leave the queue,
+   and are kept on the head until its frame is done. Frames that the
+   RDC layer has already created are left as they are. */
+static void
+aggregate(struct neighbor_queue *n, struct rdc_buf_list *head)
+{
+  struct qbuf_metadata *metadata = (struct qbuf_metadata *)head->ptr;
+  struct rdc_buf_list *q;
+  struct rdc_buf_list *last;
+  uint8_t *p;
+  int len;
+  int budget;
+  int packed;
+
+  if(list_item_next(head) == NULL) {
+    return;
+  }
+
+  queuebuf_to_packetbuf(head->buf);
+  if(packetbuf_attr(PACKETBUF_ATTR_IS_CREATED_AND_SECURED)) {
+    /* The RDC layer created, and maybe secured, the frame on a
+       previous attempt: it is sent as it is */
+    return;
+  }
+  budget = aggregation_budget();
+  len = packetbuf_datalen();
+  p = packetbuf_dataptr();
+  packed = 0;
+
+  /* The head may already carry packets, from a previous attempt */
+  for(last = metadata->aggregated; last != NULL && last->next != NULL;
+      last = last->next);
+
+  while((q = list_item_next(head)) != NULL) {
+    int qlen = queuebuf_datalen(q->buf);
+    if(queuebuf_attr(q->buf, PACKETBUF_ATTR_IS_CREATED_AND_SECURED) ||
+       len + (metadata->aggregated == NULL ? 2 : 0) + 1 + qlen > budget) {
+      break;
+    }
+    if(metadata->aggregated == NULL) {
+      memmove(p + 2, p, len);
+      p[0] = SICSLOWPAN_DISPATCH_AGGREGATE;
+      p[1] = len;
+      len += 2;
+    }
+    p[len] = qlen;
+    memcpy(p + len + 1, queuebuf_dataptr(q->buf), qlen);
+    len += 1 + qlen;
+
+    list_remove(n->queued_packet_list, q);
+    queuebuf_free(q->buf);
+    q->buf = NULL;
+    q->next = NULL;
+#if CSMA_WITH_QUEUE_STATS
+    queue_stats_dequeued(q);
+#endif /* CSMA_WITH_QUEUE_STATS */
+    if(last == NULL) {
+      metadata->aggregated = q;
+    } else {
+      last->next = q;
+    }
+    last = q;
+    packed++;
+  }
+
+  if(packed > 0) {
+    PRINTF("csma: aggregated %d packets, %d bytes\n", packed, len);
+    packetbuf_set_datalen(len);
+    queuebuf_update_from_packetbuf(head->buf);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Reports the outcome of a frame to the packets it carried */
+static void
+aggregated_done(struct rdc_buf_list *q, int status, int num_tx)
+{
+  while(q != NULL) {
+    struct rdc_buf_list *next = q->next;
+    struct qbuf_metadata *metadata = (struct qbuf_metadata *)q->ptr;
+    mac_callback_t sent = metadata->sent;
+    void *cptr = metadata->cptr;
+
+    memb_free(&metadata_memb, metadata);
+    memb_free(&packet_memb, q);
+    mac_call_sent_callback(sent, cptr, status, num_tx);
+    q = next;
+  }
+}
+#endif /* CSMA_WITH_AGGREGATION */
+/*---------------------------------------------------------------------------*/
 static clock_time_t
 backoff_period(void)
 {
@@ -172,6 +448,13 @@ transmit_packet_list(void *ptr)
     if(q != NULL) {
       PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
           list_length(n->queued_packet_list));
+#if CSMA_WITH_QUEUE_STATS
+      queue_stats_dequeued(q);
+#endif /* CSMA_WITH_QUEUE_STATS */
+#if CSMA_WITH_AGGREGATION
+      n->held = 0;
+      aggregate(n, q);
+#endif /* CSMA_WITH_AGGREGATION */
       /* Send packets in the neighbor's list */
       NETSTACK_RDC.send_list(packet_sent, n, q);
     }
@@ -197,6 +480,31 @@ schedule_transmission(struct neighbor_queue *n)
       (unsigned)delay, n->collisions, backoff_exponent);
   ctimer_set(&n->transmit_timer, delay, transmit_packet_list, n);
 }
+#if CSMA_WITH_AGGREGATION
+/*---------------------------------------------------------------------------*/
+/* Holds a packet that found its queue empty back, for others to join it
+   in the same frame, and releases the queue once it fills a frame */
+static void
+hold_transmission(struct neighbor_queue *n, struct rdc_buf_list *q)
+{
+  /* Could one more packet, of a single byte, join? */
+  int full = aggregate_len(n) + 2 > aggregation_budget();
+
+  if(list_head(n->queued_packet_list) == q) {
+    if(full) {
+      n->held = 0;
+      schedule_transmission(n);
+    } else {
+      n->held = 1;
+      ctimer_set(&n->transmit_timer, CSMA_AGGREGATION_HOLD_TIME,
+                 transmit_packet_list, n);
+    }
+  } else if(n->held && full) {
+    n->held = 0;
+    ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
+  }
+}
+#endif /* CSMA_WITH_AGGREGATION */
 /*---------------------------------------------------------------------------*/
 static void
 free_packet(struct neighbor_queue *n, struct rdc_buf_list *p, int status)
@@ -219,8 +527,7 @@ free_packet(struct neighbor_queue *n, struct rdc_buf_list *p, int status)
     } else {
       /* This was the last packet in the queue, we free the neighbor */
       ctimer_stop(&n->transmit_timer);
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
+      neighbor_queue_free(n);
     }
   }
 }
@@ -231,10 +538,22 @@ tx_done(int status, struct rdc_buf_list *q, struct neighbor_queue *n)
   mac_callback_t sent;
   struct qbuf_metadata *metadata;
   void *cptr;
+#if CSMA_WITH_AGGREGATION
+  struct rdc_buf_list *aggregated;
+  int num_tx;
+#endif /* CSMA_WITH_AGGREGATION */
 
   metadata = (struct qbuf_metadata *)q->ptr;
   sent = metadata->sent;
   cptr = metadata->cptr;
+#if CSMA_WITH_AGGREGATION
+  aggregated = metadata->aggregated;
+  num_tx = n->transmissions;
+#endif /* CSMA_WITH_AGGREGATION */
+#if CSMA_WITH_QUEUE_STATS
+  /* The RDC layer may have sent it in a burst, behind the head */
+  queue_stats_dequeued(q);
+#endif /* CSMA_WITH_QUEUE_STATS */
 
   switch(status) {
   case MAC_TX_OK:
@@ -252,6 +571,9 @@ tx_done(int status, struct rdc_buf_list *q, struct neighbor_queue *n)
 
   free_packet(n, q, status);
   mac_call_sent_callback(sent, cptr, status, n->transmissions);
+#if CSMA_WITH_AGGREGATION
+  aggregated_done(aggregated, status, num_tx);
+#endif /* CSMA_WITH_AGGREGATION */
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -360,6 +682,50 @@ packet_sent(void *ptr, int status, int num_transmissions)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* May the neighbor queue one more packet of a given class? */
+static int
+has_room(struct neighbor_queue *n, uint8_t priority)
+{
+  int len = list_length(n->queued_packet_list);
+  if(len >= CSMA_MAX_PACKET_PER_NEIGHBOR) {
+    return 0;
+  }
+#if CSMA_WITH_FAIR_SHARE
+  if(CSMA_WITH_PRIORITY && priority == CSMA_NUM_PRIORITIES - 1) {
+    return memb_numfree(&packet_memb) > 0;
+  }
+  return len < CSMA_FAIR_SHARE_ALPHA * memb_numfree(&packet_memb);
+#else /* CSMA_WITH_FAIR_SHARE */
+  return 1;
+#endif /* CSMA_WITH_FAIR_SHARE */
+}
+/*---------------------------------------------------------------------------*/
+static void
+enqueue_packet(struct neighbor_queue *n, struct rdc_buf_list *q)
+{
+#if CSMA_WITH_PRIORITY
+  /* Insert behind the packets of the same or a higher class, but never
+     ahead of the head, which may be under transmission */
+  struct rdc_buf_list *prev = list_head(n->queued_packet_list);
+  if(prev != NULL) {
+    struct rdc_buf_list *next;
+    while((next = list_item_next(prev)) != NULL
+          && PACKET_PRIORITY(next) >= PACKET_PRIORITY(q)) {
+      prev = next;
+    }
+    list_insert(n->queued_packet_list, prev, q);
+    return;
+  }
+#elif PACKETBUF_WITH_PACKET_TYPE
+  if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
+     PACKETBUF_ATTR_PACKET_TYPE_ACK) {
+    list_push(n->queued_packet_list, q);
+    return;
+  }
+#endif
+  list_add(n->queued_packet_list, q);
+}
+/*---------------------------------------------------------------------------*/
 static void
 send_packet(mac_callback_t sent, void *ptr)
 {
@@ -368,6 +734,11 @@ send_packet(mac_callback_t sent, void *ptr)
   static uint8_t initialized = 0;
   static uint16_t seqno;
   const linkaddr_t *addr = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+  uint8_t priority = 0;
+
+#if CSMA_WITH_PRIORITY
+  priority = MIN(packetbuf_attr(PACKETBUF_ATTR_PRIORITY), CSMA_NUM_PRIORITIES - 1);
+#endif /* CSMA_WITH_PRIORITY */
 
   if(!initialized) {
     initialized = 1;
@@ -392,16 +763,19 @@ send_packet(mac_callback_t sent, void *ptr)
       linkaddr_copy(&n->addr, addr);
       n->transmissions = 0;
       n->collisions = CSMA_MIN_BE;
+#if CSMA_WITH_AGGREGATION
+      n->held = 0;
+#endif /* CSMA_WITH_AGGREGATION */
       /* Init packet list for this neighbor */
       LIST_STRUCT_INIT(n, queued_packet_list);
       /* Add neighbor to the list */
-      list_add(neighbor_list, n);
+      neighbor_queue_add(n);
     }
   }
 
   if(n != NULL) {
     /* Add packet to the neighbor's queue */
-    if(list_length(n->queued_packet_list) < CSMA_MAX_PACKET_PER_NEIGHBOR) {
+    if(has_room(n, priority)) {
       q = memb_alloc(&packet_memb);
       if(q != NULL) {
         q->ptr = memb_alloc(&metadata_memb);
@@ -419,22 +793,28 @@ send_packet(mac_callback_t sent, void *ptr)
             }
             metadata->sent = sent;
             metadata->cptr = ptr;
-#if PACKETBUF_WITH_PACKET_TYPE
-            if(packetbuf_attr(PACKETBUF_ATTR_PACKET_TYPE) ==
-               PACKETBUF_ATTR_PACKET_TYPE_ACK) {
-              list_push(n->queued_packet_list, q);
-            } else
-#endif
-            {
-              list_add(n->queued_packet_list, q);
-            }
+#if CSMA_WITH_PRIORITY
+            metadata->priority = priority;
+#endif /* CSMA_WITH_PRIORITY */
+#if CSMA_WITH_QUEUE_STATS
+            metadata->dequeued = 0;
+            metadata->enqueue_time = clock_time();
+#endif /* CSMA_WITH_QUEUE_STATS */
+#if CSMA_WITH_AGGREGATION
+            metadata->aggregated = NULL;
+#endif /* CSMA_WITH_AGGREGATION */
+            enqueue_packet(n, q);
 
             PRINTF("csma: send_packet, queue length %d, free packets %d\n",
                    list_length(n->queued_packet_list), memb_numfree(&packet_memb));
+#if CSMA_WITH_AGGREGATION
+            hold_transmission(n, q);
+#else /* CSMA_WITH_AGGREGATION */
             /* If q is the first packet in the neighbor's queue, send asap */
             if(list_head(n->queued_packet_list) == q) {
               schedule_transmission(n);
             }
+#endif /* CSMA_WITH_AGGREGATION */
             return;
           }
           memb_free(&metadata_memb, q->ptr);
@@ -445,8 +825,7 @@ send_packet(mac_callback_t sent, void *ptr)
       }
       /* The packet allocation failed. Remove and free neighbor entry if empty. */
       if(list_length(n->queued_packet_list) == 0) {
-        list_remove(neighbor_list, n);
-        memb_free(&neighbor_memb, n);
+        neighbor_queue_free(n);
       }
     } else {
       PRINTF("csma: Neighbor queue full\n");
@@ -455,6 +834,9 @@ send_packet(mac_callback_t sent, void *ptr)
   } else {
     PRINTF("csma: could not allocate neighbor, dropping packet\n");
   }
+#if CSMA_WITH_QUEUE_STATS
+  queue_stats[priority].drops++;
+#endif /* CSMA_WITH_QUEUE_STATS */
   mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 1);
 }
 /*---------------------------------------------------------------------------*/
@@ -491,6 +873,9 @@ init(void)
   memb_init(&packet_memb);
   memb_init(&metadata_memb);
   memb_init(&neighbor_memb);
+#if CSMA_NEIGHBOR_HASH_SIZE
+  memset(neighbor_hash, 0, sizeof(neighbor_hash));
+#endif /* CSMA_NEIGHBOR_HASH_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 const struct mac_driver csma_driver = {
@@ -42,7 +42,38 @@
 #define CSMA_H_
 
 #include "net/mac/mac.h"
+#include "net/packetbuf.h"
 #include "dev/radio.h"
+#include "sys/clock.h"
+
+/* Collect per-class statistics of the time packets wait in the queues */
+#ifdef CSMA_CONF_WITH_QUEUE_STATS
+#define CSMA_WITH_QUEUE_STATS CSMA_CONF_WITH_QUEUE_STATS
+#else /* CSMA_CONF_WITH_QUEUE_STATS */
+#define CSMA_WITH_QUEUE_STATS 0
+#endif /* CSMA_CONF_WITH_QUEUE_STATS */
+
+/* Number of priority classes, served in strict priority order. Taken from
+ * PACKETBUF_ATTR_PRIORITY when packets carry a priority. */
+#if PACKETBUF_WITH_PRIORITY
+#define CSMA_NUM_PRIORITIES PACKETBUF_ATTR_PRIORITY_NUM
+#else /* PACKETBUF_WITH_PRIORITY */
+#define CSMA_NUM_PRIORITIES 1
+#endif /* PACKETBUF_WITH_PRIORITY */
+
+#if CSMA_WITH_QUEUE_STATS
+struct csma_queue_stats {
+  uint32_t packets;         /* Packets that reached the head of their queue */
+  uint32_t drops;           /* Packets refused for lack of room */
+  uint32_t delay_sum;       /* Total time spent waiting, in clock ticks */
+  clock_time_t delay_max;   /* Longest wait, in clock ticks */
+};
+
+/* Returns the queue statistics of a priority class */
+const struct csma_queue_stats *csma_get_queue_stats(uint8_t priority);
+/* Clears the queue statistics of all classes */
+void csma_reset_queue_stats(void);
+#endif /* CSMA_WITH_QUEUE_STATS */
 
 extern const struct mac_driver csma_driver;
 
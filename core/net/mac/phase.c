@@ -44,17 +44,8 @@
 #include "net/queuebuf.h"
 #include "net/nbr-table.h"
 
-#if PHASE_CONF_DRIFT_CORRECT
-#define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
-#else
-#define PHASE_DRIFT_CORRECT 0
-#endif
-
 struct phase {
-  rtimer_clock_t time;
-#if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
-#endif
+  struct phase_lock lock;
   uint8_t noacks;
   struct timer noacks_timer;
 };
@@ -74,6 +65,16 @@ struct phase_queueitem {
 
 #define MAX_NOACKS_TIME       CLOCK_SECOND * 30
 
+#if PHASE_DRIFT_CORRECT
+/* Older phases are not corrected for drift: they are not trusted, and
+   the clock may have wrapped */
+#define MAX_DRIFT_AGE         MIN(CLOCK_SECOND * 3600UL, (clock_time_t)~0 / 2)
+/* Shorter intervals are too noisy to estimate the drift from */
+#define MIN_DRIFT_CYCLES      16
+/* The drift is estimated over about this many cycles */
+#define DRIFT_WINDOW          4096
+#endif /* PHASE_DRIFT_CORRECT */
+
 MEMB(queued_packets_memb, struct phase_queueitem, PHASE_QUEUESIZE);
 NBR_TABLE(struct phase, nbr_phase);
 
@@ -87,9 +88,132 @@ NBR_TABLE(struct phase, nbr_phase);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+/* Number of cycles in an interval of clock ticks, rounded */
+static uint32_t
+elapsed_cycles(clock_time_t elapsed, rtimer_clock_t cycle_time)
+{
+  uint32_t ticks;
+
+  ticks = (uint32_t)(elapsed / CLOCK_SECOND) * RTIMER_ARCH_SECOND +
+    (uint32_t)(elapsed % CLOCK_SECOND) * RTIMER_ARCH_SECOND / CLOCK_SECOND;
+  return (ticks + cycle_time / 2) / cycle_time;
+}
+/*---------------------------------------------------------------------------*/
+/* Phase shift expected after a number of cycles */
+static int32_t
+drift_shift(const struct phase_lock *l, uint32_t cycles)
+{
+  return (int32_t)((int64_t)l->drift * cycles / 65536);
+}
+/*---------------------------------------------------------------------------*/
+/* An interval modulo the cycle time, between -cycle_time / 2 and
+   cycle_time / 2 */
+static int32_t
+phase_offset(rtimer_clock_t interval, rtimer_clock_t cycle_time)
+{
+  int32_t offset = interval % cycle_time;
+  return offset >= cycle_time / 2 ? offset - cycle_time : offset;
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
+void
+phase_lock_init(struct phase_lock *l, rtimer_clock_t time, clock_time_t now)
+{
+  l->time = time;
+#if PHASE_DRIFT_CORRECT
+  l->seen = now;
+  l->drift = 0;
+  l->weight = 0;
+  l->error = 0;
+  l->locked = 0;
+#endif /* PHASE_DRIFT_CORRECT */
+}
+/*---------------------------------------------------------------------------*/
+void
+phase_lock_update(struct phase_lock *l, rtimer_clock_t time,
+                  clock_time_t now, rtimer_clock_t cycle_time)
+{
+#if PHASE_DRIFT_CORRECT
+  clock_time_t elapsed = now - l->seen;
+
+  if(elapsed <= MAX_DRIFT_AGE) {
+    uint32_t cycles = elapsed_cycles(elapsed, cycle_time);
+    int32_t shift = drift_shift(l, cycles);
+    int32_t error = phase_offset(time - l->time - shift, cycle_time);
+    rtimer_clock_t abs_error = error < 0 ? -error : error;
+
+    /* How far off the prediction was, on average */
+    l->error = l->locked ? (3 * (uint32_t)l->error + abs_error) / 4 : abs_error;
+    l->locked = 1;
+
+    /* The drift is the phase shift per cycle, averaged over the last
+       DRIFT_WINDOW cycles or so */
+    if(cycles >= MIN_DRIFT_CYCLES) {
+      l->drift = ((int64_t)l->drift * l->weight + (int64_t)(shift + error) * 65536)
+        / (int32_t)(l->weight + cycles);
+      l->weight = MIN(l->weight + cycles, DRIFT_WINDOW);
+    }
+  } else {
+    l->locked = 0;
+  }
+  l->seen = now;
+#endif /* PHASE_DRIFT_CORRECT */
+  l->time = time;
+}
+/*---------------------------------------------------------------------------*/
+void
+phase_lock_miss(struct phase_lock *l)
+{
+#if PHASE_DRIFT_CORRECT
+  l->locked = 0;
+#endif /* PHASE_DRIFT_CORRECT */
+}
+/*---------------------------------------------------------------------------*/
+rtimer_clock_t
+phase_lock_wait(const struct phase_lock *l,
+                rtimer_clock_t now, clock_time_t clock_now,
+                rtimer_clock_t cycle_time,
+                rtimer_clock_t wait_before, rtimer_clock_t min_wait_before)
+{
+  rtimer_clock_t sync;
+  rtimer_clock_t wait;
+
+  sync = l->time;
+
+#if PHASE_DRIFT_CORRECT
+  if(clock_now - l->seen <= MAX_DRIFT_AGE) {
+    /* Add the drift since the last wake-up in */
+    sync += drift_shift(l, elapsed_cycles(clock_now - l->seen, cycle_time));
+    if(l->locked && min_wait_before + 2 * l->error < wait_before) {
+      wait_before = min_wait_before + 2 * l->error;
+    }
+  }
+#endif /* PHASE_DRIFT_CORRECT */
+
+  /* We expect phases to happen every CYCLE_TIME time units. The next
+     expected phase is at time sync + CYCLE_TIME. Because we are only
+     interested in turning on the radio within the CYCLE_TIME period,
+     we compute the waiting time with modulo CYCLE_TIME. */
+
+  /* Check if cycle_time is a power of two */
+  if(!(cycle_time & (cycle_time - 1))) {
+    /* Faster if cycle_time is a power of two */
+    wait = (rtimer_clock_t)((sync - now) & (cycle_time - 1));
+  } else {
+    /* Works generally */
+    wait = cycle_time - (rtimer_clock_t)((now - sync) % cycle_time);
+  }
+
+  if(wait < wait_before) {
+    wait += cycle_time;
+  }
+  return wait - wait_before;
+}
+/*---------------------------------------------------------------------------*/
 void
 phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
-             int mac_status)
+             rtimer_clock_t cycle_time, int mac_status)
 {
   struct phase *e;
 
@@ -97,16 +221,14 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
-#if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
-#endif
-      e->time = time;
+      phase_lock_update(&e->lock, time, clock_time(), cycle_time);
     }
     /* If the neighbor didn't reply to us, it may have switched
        phase (rebooted). We try a number of transmissions to it
        before we drop it from the phase list. */
     if(mac_status == MAC_TX_NOACK) {
       PRINTF("phase noacks %d to %d.%d\n", e->noacks, neighbor->u8[0], neighbor->u8[1]);
+      phase_lock_miss(&e->lock);
       e->noacks++;
       if(e->noacks == 1) {
         timer_set(&e->noacks_timer, MAX_NOACKS_TIME);
@@ -124,11 +246,8 @@ phase_update(const linkaddr_t *neighbor, rtimer_clock_t time,
     if(mac_status == MAC_TX_OK && e == NULL) {
       e = nbr_table_add_lladdr(nbr_phase, neighbor, NBR_TABLE_REASON_MAC, NULL);
       if(e) {
-        e->time = time;
-#if PHASE_DRIFT_CORRECT
-      e->drift = 0;
-#endif
-      e->noacks = 0;
+        phase_lock_init(&e->lock, time, clock_time());
+        e->noacks = 0;
       }
     }
   }
@@ -152,7 +271,7 @@ send_packet(void *ptr)
 /*---------------------------------------------------------------------------*/
 phase_status_t
 phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
-           rtimer_clock_t guard_time,
+           rtimer_clock_t guard_time, rtimer_clock_t min_guard_time,
            mac_callback_t mac_callback, void *mac_callback_ptr,
            struct rdc_buf_list *buf_list)
 {
@@ -164,52 +283,14 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
      the radio just before the phase. */
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
   if(e != NULL) {
-    rtimer_clock_t wait, now, expected, sync;
+    rtimer_clock_t wait, now, expected;
     clock_time_t ctimewait;
-    
-    /* We expect phases to happen every CYCLE_TIME time
-       units. The next expected phase is at time e->time +
-       CYCLE_TIME. To compute a relative offset, we subtract
-       with clock_time(). Because we are only interested in turning
-       on the radio within the CYCLE_TIME period, we compute the
-       waiting time with modulo CYCLE_TIME. */
-    
-    /*      printf("neighbor phase 0x%02x (cycle 0x%02x)\n", e->time & (cycle_time - 1),
-            cycle_time);*/
-
-    /*      if(e->noacks > 0) {
-            printf("additional wait %d\n", additional_wait);
-            }*/
-    
-    now = RTIMER_NOW();
 
-    sync = (e == NULL) ? now : e->time;
-
-#if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
-#endif
-
-    /* Check if cycle_time is a power of two */
-    if(!(cycle_time & (cycle_time - 1))) {
-      /* Faster if cycle_time is a power of two */
-      wait = (rtimer_clock_t)((sync - now) & (cycle_time - 1));
-    } else {
-      /* Works generally */
-      wait = cycle_time - (rtimer_clock_t)((now - sync) % cycle_time);
-    }
-
-    if(wait < guard_time) {
-      wait += cycle_time;
-    }
+    now = RTIMER_NOW();
+    wait = phase_lock_wait(&e->lock, now, clock_time(), cycle_time,
+                           guard_time, min_guard_time);
 
-    ctimewait = (CLOCK_SECOND * (wait - guard_time)) / RTIMER_ARCH_SECOND;
+    ctimewait = (CLOCK_SECOND * wait) / RTIMER_ARCH_SECOND;
 
     if(ctimewait > PHASE_DEFER_THRESHOLD) {
       struct phase_queueitem *p;
@@ -233,7 +314,7 @@ phase_wait(const linkaddr_t *neighbor, rtimer_clock_t cycle_time,
       }
     }
 
-    expected = now + wait - guard_time;
+    expected = now + wait;
     if(!RTIMER_CLOCK_LT(expected, now)) {
       /* Wait until the receiver is expected to be awake */
       while(RTIMER_CLOCK_LT(RTIMER_NOW(), expected));
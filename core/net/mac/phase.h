@@ -47,20 +47,59 @@
 #include "lib/memb.h"
 #include "net/netstack.h"
 
+#ifdef PHASE_CONF_DRIFT_CORRECT
+#define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
+#else
+#define PHASE_DRIFT_CORRECT 0
+#endif
+
 typedef enum {
   PHASE_UNKNOWN,
   PHASE_SEND_NOW,
   PHASE_DEFERRED,
 } phase_status_t;
 
+/* The phase of a neighbor: when it last woke up and, with
+   PHASE_CONF_DRIFT_CORRECT, how fast its phase drifts from ours and
+   how well it has been predicted so far */
+struct phase_lock {
+  rtimer_clock_t time;
+#if PHASE_DRIFT_CORRECT
+  clock_time_t seen;       /* clock_time() at the last wake-up */
+  int32_t drift;           /* Phase shift per cycle, in 1/65536 rtimer ticks */
+  uint16_t weight;         /* Cycles the drift was estimated over */
+  rtimer_clock_t error;    /* Mean prediction error, in rtimer ticks */
+  uint8_t locked;          /* The prediction error is known */
+#endif
+};
 
 void phase_init(void);
 phase_status_t phase_wait(const linkaddr_t *neighbor,
                           rtimer_clock_t cycle_time, rtimer_clock_t wait_before,
+                          rtimer_clock_t min_wait_before,
                           mac_callback_t mac_callback, void *mac_callback_ptr,
                           struct rdc_buf_list *buf_list);
 void phase_update(const linkaddr_t *neighbor,
-                  rtimer_clock_t time, int mac_status);
+                  rtimer_clock_t time, rtimer_clock_t cycle_time,
+                  int mac_status);
 void phase_remove(const linkaddr_t *neighbor);
 
+/* Starts a phase lock on a wake-up seen at rtimer time `time`, that is
+   at `now` on the clock */
+void phase_lock_init(struct phase_lock *l, rtimer_clock_t time, clock_time_t now);
+/* Renews a phase lock with a new wake-up */
+void phase_lock_update(struct phase_lock *l, rtimer_clock_t time,
+                       clock_time_t now, rtimer_clock_t cycle_time);
+/* Forgets how good the predictions were, after a missed wake-up */
+void phase_lock_miss(struct phase_lock *l);
+/* Time from `now` until transmissions to the neighbor should start,
+   wait_before ahead of its next expected wake-up. With drift
+   correction, that margin shrinks down to min_wait_before as the
+   predictions prove accurate. */
+rtimer_clock_t phase_lock_wait(const struct phase_lock *l,
+                               rtimer_clock_t now, clock_time_t clock_now,
+                               rtimer_clock_t cycle_time,
+                               rtimer_clock_t wait_before,
+                               rtimer_clock_t min_wait_before);
+
 #endif /* PHASE_H */
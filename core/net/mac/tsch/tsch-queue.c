@@ -77,6 +77,32 @@ LIST(neighbor_list);
 struct tsch_neighbor *n_broadcast;
 struct tsch_neighbor *n_eb;
 
+#if TSCH_QUEUE_NBR_HASH_SIZE
+#if (TSCH_QUEUE_NBR_HASH_SIZE & (TSCH_QUEUE_NBR_HASH_SIZE - 1)) != 0
+#error TSCH_QUEUE_NBR_HASH_SIZE must be power of two
+#endif
+
+/* Neighbors, chained by the hash of their address */
+static struct tsch_neighbor *nbr_hash[TSCH_QUEUE_NBR_HASH_SIZE];
+#define NBR_HASH(addr) (((addr)->u8[LINKADDR_SIZE - 1] ^ (addr)->u8[LINKADDR_SIZE - 2]) \
+                        & (TSCH_QUEUE_NBR_HASH_SIZE - 1))
+#endif /* TSCH_QUEUE_NBR_HASH_SIZE */
+
+#if TSCH_QUEUE_WITH_READY_LIST
+/* Neighbors that may send in shared broadcast slots, oldest first.
+ * Entries that are no longer ready are removed when they are met. */
+static struct tsch_neighbor *ready_head;
+static struct tsch_neighbor *ready_tail;
+/* Neighbors with a non-zero backoff window */
+static struct tsch_neighbor *backoff_head;
+/* Neighbors that got a packet in an empty queue, passed to the slot
+ * operation. Lockfree, as the neighbor queues. */
+static struct tsch_neighbor *pending_array[TSCH_QUEUE_NUM_PER_NEIGHBOR];
+static struct ringbufindex pending_ringbuf;
+/* Set when the lists are to be rebuilt from all neighbors */
+static volatile uint8_t ready_list_rebuild;
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
+
 /*---------------------------------------------------------------------------*/
 /* Add a TSCH neighbor */
 struct tsch_neighbor *
@@ -99,6 +125,10 @@ tsch_queue_add_nbr(const linkaddr_t *addr)
         tsch_queue_backoff_reset(n);
         /* Add neighbor to the list */
         list_add(neighbor_list, n);
+#if TSCH_QUEUE_NBR_HASH_SIZE
+        n->hash_next = nbr_hash[NBR_HASH(addr)];
+        nbr_hash[NBR_HASH(addr)] = n;
+#endif /* TSCH_QUEUE_NBR_HASH_SIZE */
       }
       tsch_release_lock();
     }
@@ -111,6 +141,15 @@ struct tsch_neighbor *
 tsch_queue_get_nbr(const linkaddr_t *addr)
 {
   if(!tsch_is_locked()) {
+#if TSCH_QUEUE_NBR_HASH_SIZE
+    struct tsch_neighbor *n = nbr_hash[NBR_HASH(addr)];
+    while(n != NULL) {
+      if(linkaddr_cmp(&n->addr, addr)) {
+        return n;
+      }
+      n = n->hash_next;
+    }
+#else /* TSCH_QUEUE_NBR_HASH_SIZE */
     struct tsch_neighbor *n = list_head(neighbor_list);
     while(n != NULL) {
       if(linkaddr_cmp(&n->addr, addr)) {
@@ -118,6 +157,7 @@ tsch_queue_get_nbr(const linkaddr_t *addr)
       }
       n = list_item_next(n);
     }
+#endif /* TSCH_QUEUE_NBR_HASH_SIZE */
   }
   return NULL;
 }
@@ -198,6 +238,148 @@ tsch_queue_flush_nbr_queue(struct tsch_neighbor *n)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if TSCH_QUEUE_NBR_HASH_SIZE
+/* Remove a neighbor from its hash chain */
+static void
+nbr_hash_remove(struct tsch_neighbor *n)
+{
+  struct tsch_neighbor **prev = &nbr_hash[NBR_HASH(&n->addr)];
+  while(*prev != NULL) {
+    if(*prev == n) {
+      *prev = n->hash_next;
+      return;
+    }
+    prev = &(*prev)->hash_next;
+  }
+}
+#endif /* TSCH_QUEUE_NBR_HASH_SIZE */
+/*---------------------------------------------------------------------------*/
+#if TSCH_QUEUE_WITH_READY_LIST
+/* May the neighbor send in a shared broadcast slot? */
+static int
+nbr_is_ready(const struct tsch_neighbor *n)
+{
+  return !n->is_broadcast && n->tx_links_count == 0
+    && n->backoff_window == 0 && !ringbufindex_empty(&n->tx_ringbuf);
+}
+/*---------------------------------------------------------------------------*/
+static void
+ready_list_add(struct tsch_neighbor *n)
+{
+  if(!n->in_ready_list && nbr_is_ready(n)) {
+    n->in_ready_list = 1;
+    n->ready_next = NULL;
+    if(ready_tail != NULL) {
+      ready_tail->ready_next = n;
+    } else {
+      ready_head = n;
+    }
+    ready_tail = n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Unlink a neighbor from the ready list, given the one before it */
+static void
+ready_list_unlink(struct tsch_neighbor *prev, struct tsch_neighbor *n)
+{
+  if(prev != NULL) {
+    prev->ready_next = n->ready_next;
+  } else {
+    ready_head = n->ready_next;
+  }
+  if(ready_tail == n) {
+    ready_tail = prev;
+  }
+  n->in_ready_list = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+backoff_list_add(struct tsch_neighbor *n)
+{
+  if(!n->in_backoff_list && n->backoff_window != 0) {
+    n->in_backoff_list = 1;
+    n->backoff_next = backoff_head;
+    backoff_head = n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Unlink a neighbor from the backoff list, given the one before it */
+static void
+backoff_list_unlink(struct tsch_neighbor *prev, struct tsch_neighbor *n)
+{
+  if(prev != NULL) {
+    prev->backoff_next = n->backoff_next;
+  } else {
+    backoff_head = n->backoff_next;
+  }
+  n->in_backoff_list = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Bring the lists up to date with the packets added since the last call.
+ * Runs in the slot operation, or with the lock taken. */
+static void
+ready_list_update(void)
+{
+  int16_t get_index;
+  if(ready_list_rebuild) {
+    struct tsch_neighbor *n;
+    ready_list_rebuild = 0;
+    /* All neighbors are looked at, pending ones included */
+    while(ringbufindex_get(&pending_ringbuf) != -1);
+    ready_head = NULL;
+    ready_tail = NULL;
+    backoff_head = NULL;
+    for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+      n->in_ready_list = 0;
+      n->in_backoff_list = 0;
+      ready_list_add(n);
+      backoff_list_add(n);
+    }
+  } else {
+    while((get_index = ringbufindex_peek_get(&pending_ringbuf)) != -1) {
+      ready_list_add(pending_array[get_index]);
+      ringbufindex_get(&pending_ringbuf);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Remove a neighbor from both lists. Called with the lock taken. */
+static void
+ready_list_remove(struct tsch_neighbor *n)
+{
+  struct tsch_neighbor *prev;
+  struct tsch_neighbor *curr;
+
+  ready_list_update();
+  for(prev = NULL, curr = ready_head; curr != NULL; prev = curr, curr = curr->ready_next) {
+    if(curr == n) {
+      ready_list_unlink(prev, n);
+      break;
+    }
+  }
+  for(prev = NULL, curr = backoff_head; curr != NULL; prev = curr, curr = curr->backoff_next) {
+    if(curr == n) {
+      backoff_list_unlink(prev, n);
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Tell the slot operation that a neighbor may now send in shared broadcast slots */
+void
+tsch_queue_check_ready(struct tsch_neighbor *n)
+{
+  int16_t put_index = ringbufindex_peek_put(&pending_ringbuf);
+  if(put_index != -1) {
+    pending_array[put_index] = n;
+    ringbufindex_put(&pending_ringbuf);
+  } else {
+    /* Too many changes since the last slot operation */
+    ready_list_rebuild = 1;
+  }
+}
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
+/*---------------------------------------------------------------------------*/
 /* Remove TSCH neighbor queue */
 static void
 tsch_queue_remove_nbr(struct tsch_neighbor *n)
@@ -207,6 +389,12 @@ tsch_queue_remove_nbr(struct tsch_neighbor *n)
 
       /* Remove neighbor from list */
       list_remove(neighbor_list, n);
+#if TSCH_QUEUE_NBR_HASH_SIZE
+      nbr_hash_remove(n);
+#endif /* TSCH_QUEUE_NBR_HASH_SIZE */
+#if TSCH_QUEUE_WITH_READY_LIST
+      ready_list_remove(n);
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
 
       tsch_release_lock();
 
@@ -246,6 +434,13 @@ tsch_queue_add_packet(const linkaddr_t *addr, mac_callback_t sent, void *ptr)
             /* Add to ringbuf (actual add committed through atomic operation) */
             n->tx_array[put_index] = p;
             ringbufindex_put(&n->tx_ringbuf);
+#if TSCH_QUEUE_WITH_READY_LIST
+            /* The queue was empty, unless the slot operation has just
+             * emptied it: the neighbor may have become ready */
+            if(!n->is_broadcast && ringbufindex_elements(&n->tx_ringbuf) == 1) {
+              tsch_queue_check_ready(n);
+            }
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
             return p;
           } else {
             memb_free(&packet_memb, p);
@@ -315,6 +510,9 @@ tsch_queue_reset(void)
       tsch_queue_backoff_reset(n);
       n = next_n;
     }
+#if TSCH_QUEUE_WITH_READY_LIST
+    ready_list_rebuild = 1;
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -345,6 +543,18 @@ tsch_queue_is_empty(const struct tsch_neighbor *n)
   return !tsch_is_locked() && n != NULL && ringbufindex_empty(&n->tx_ringbuf);
 }
 /*---------------------------------------------------------------------------*/
+/* Returns the packet at a given position in a neighbor queue */
+struct tsch_packet *
+tsch_queue_get_packet_at(const struct tsch_neighbor *n, int position)
+{
+  if(!tsch_is_locked() && n != NULL && position >= 0
+     && position < ringbufindex_elements(&n->tx_ringbuf)) {
+    int16_t index = ringbufindex_peek_get(&n->tx_ringbuf);
+    return n->tx_array[(index + position) & (TSCH_QUEUE_NUM_PER_NEIGHBOR - 1)];
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 /* Returns the first packet from a neighbor queue */
 struct tsch_packet *
 tsch_queue_get_packet_for_nbr(const struct tsch_neighbor *n, struct tsch_link *link)
@@ -389,8 +599,35 @@ struct tsch_packet *
 tsch_queue_get_unicast_packet_for_any(struct tsch_neighbor **n, struct tsch_link *link)
 {
   if(!tsch_is_locked()) {
-    struct tsch_neighbor *curr_nbr = list_head(neighbor_list);
+    struct tsch_neighbor *curr_nbr;
     struct tsch_packet *p = NULL;
+#if TSCH_QUEUE_WITH_READY_LIST
+    if(link != NULL && link->link_options & LINK_OPTION_SHARED) {
+      /* Only neighbors with an expired backoff may send: look at the ready list */
+      struct tsch_neighbor *prev_nbr = NULL;
+      ready_list_update();
+      curr_nbr = ready_head;
+      while(curr_nbr != NULL) {
+        struct tsch_neighbor *next_nbr = curr_nbr->ready_next;
+        if(!nbr_is_ready(curr_nbr)) {
+          /* Emptied, in backoff or given a tx link since it was added */
+          ready_list_unlink(prev_nbr, curr_nbr);
+        } else {
+          p = tsch_queue_get_packet_for_nbr(curr_nbr, link);
+          if(p != NULL) {
+            if(n != NULL) {
+              *n = curr_nbr;
+            }
+            return p;
+          }
+          prev_nbr = curr_nbr;
+        }
+        curr_nbr = next_nbr;
+      }
+      return NULL;
+    }
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
+    curr_nbr = list_head(neighbor_list);
     while(curr_nbr != NULL) {
       if(!curr_nbr->is_broadcast && curr_nbr->tx_links_count == 0) {
         /* Only look up for non-broadcast neighbors we do not have a tx link to */
@@ -436,6 +673,9 @@ tsch_queue_backoff_inc(struct tsch_neighbor *n)
   /* Add one to the window as we will decrement it at the end of the current slot
    * through tsch_queue_update_all_backoff_windows */
   n->backoff_window++;
+#if TSCH_QUEUE_WITH_READY_LIST
+  backoff_list_add(n);
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
 }
 /*---------------------------------------------------------------------------*/
 /* Decrement backoff window for all queues directed at dest_addr */
@@ -444,6 +684,28 @@ tsch_queue_update_all_backoff_windows(const linkaddr_t *dest_addr)
 {
   if(!tsch_is_locked()) {
     int is_broadcast = linkaddr_cmp(dest_addr, &tsch_broadcast_address);
+#if TSCH_QUEUE_WITH_READY_LIST
+    struct tsch_neighbor *prev = NULL;
+    struct tsch_neighbor *n;
+    ready_list_update();
+    n = backoff_head;
+    while(n != NULL) {
+      struct tsch_neighbor *next_n = n->backoff_next;
+      if(n->backoff_window != 0
+         && ((n->tx_links_count == 0 && is_broadcast)
+             || (n->tx_links_count > 0 && linkaddr_cmp(dest_addr, &n->addr)))) {
+        n->backoff_window--;
+      }
+      if(n->backoff_window == 0) {
+        /* Out of backoff (or reset): the neighbor may send again */
+        backoff_list_unlink(prev, n);
+        ready_list_add(n);
+      } else {
+        prev = n;
+      }
+      n = next_n;
+    }
+#else /* TSCH_QUEUE_WITH_READY_LIST */
     struct tsch_neighbor *n = list_head(neighbor_list);
     while(n != NULL) {
       if(n->backoff_window != 0 /* Is the queue in backoff state? */
@@ -453,6 +715,7 @@ tsch_queue_update_all_backoff_windows(const linkaddr_t *dest_addr)
       }
       n = list_item_next(n);
     }
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -463,6 +726,16 @@ tsch_queue_init(void)
   list_init(neighbor_list);
   memb_init(&neighbor_memb);
   memb_init(&packet_memb);
+#if TSCH_QUEUE_NBR_HASH_SIZE
+  memset(nbr_hash, 0, sizeof(nbr_hash));
+#endif /* TSCH_QUEUE_NBR_HASH_SIZE */
+#if TSCH_QUEUE_WITH_READY_LIST
+  ringbufindex_init(&pending_ringbuf, TSCH_QUEUE_NUM_PER_NEIGHBOR);
+  ready_head = NULL;
+  ready_tail = NULL;
+  backoff_head = NULL;
+  ready_list_rebuild = 0;
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
   /* Add virtual EB and the broadcast neighbors */
   n_eb = tsch_queue_add_nbr(&tsch_eb_address);
   n_broadcast = tsch_queue_add_nbr(&tsch_broadcast_address);
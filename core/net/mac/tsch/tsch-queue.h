@@ -77,6 +77,24 @@
 #define TSCH_QUEUE_MAX_NEIGHBOR_QUEUES ((NBR_TABLE_CONF_MAX_NEIGHBORS) + 2)
 #endif
 
+/* Number of buckets of the hash that finds neighbor queues from their
+ * address, a power of two. When 0, all neighbors are compared. */
+#ifdef TSCH_QUEUE_CONF_NBR_HASH_SIZE
+#define TSCH_QUEUE_NBR_HASH_SIZE TSCH_QUEUE_CONF_NBR_HASH_SIZE
+#else
+#define TSCH_QUEUE_NBR_HASH_SIZE 0
+#endif
+
+/* Keep a list of the unicast neighbors that may send in shared broadcast
+ * slots (queued packets, expired backoff, no Tx link of their own) and a
+ * list of the neighbors in backoff, so that the slot operation does not
+ * look at every neighbor */
+#ifdef TSCH_QUEUE_CONF_WITH_READY_LIST
+#define TSCH_QUEUE_WITH_READY_LIST TSCH_QUEUE_CONF_WITH_READY_LIST
+#else
+#define TSCH_QUEUE_WITH_READY_LIST 0
+#endif
+
 /* TSCH CSMA-CA parameters, see IEEE 802.15.4e-2012 */
 /* Min backoff exponent */
 #ifdef TSCH_CONF_MAC_MIN_BE
@@ -140,6 +158,17 @@ struct tsch_neighbor {
   struct tsch_packet *tx_array[TSCH_QUEUE_NUM_PER_NEIGHBOR];
   /* Circular buffer of pointers to packet. */
   struct ringbufindex tx_ringbuf;
+#if TSCH_QUEUE_NBR_HASH_SIZE
+  struct tsch_neighbor *hash_next; /* Next neighbor in the same hash bucket */
+#endif /* TSCH_QUEUE_NBR_HASH_SIZE */
+#if TSCH_QUEUE_WITH_READY_LIST
+  /* Ready and backoff lists, only updated from the slot operation
+   * or with the TSCH lock taken */
+  struct tsch_neighbor *ready_next;
+  struct tsch_neighbor *backoff_next;
+  uint8_t in_ready_list;
+  uint8_t in_backoff_list;
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
 };
 
 /***** External Variables *****/
@@ -173,6 +202,9 @@ void tsch_queue_reset(void);
 void tsch_queue_free_unused_neighbors(void);
 /* Is the neighbor queue empty? */
 int tsch_queue_is_empty(const struct tsch_neighbor *n);
+/* Returns the packet at a given position in a neighbor queue (0 being the head),
+ * or NULL if the queue holds fewer packets */
+struct tsch_packet *tsch_queue_get_packet_at(const struct tsch_neighbor *n, int position);
 /* Returns the first packet from a neighbor queue */
 struct tsch_packet *tsch_queue_get_packet_for_nbr(const struct tsch_neighbor *n, struct tsch_link *link);
 /* Returns the head packet from a neighbor queue (from neighbor address) */
@@ -188,6 +220,10 @@ void tsch_queue_backoff_reset(struct tsch_neighbor *n);
 void tsch_queue_backoff_inc(struct tsch_neighbor *n);
 /* Decrement backoff window for all queues directed at dest_addr */
 void tsch_queue_update_all_backoff_windows(const linkaddr_t *dest_addr);
+#if TSCH_QUEUE_WITH_READY_LIST
+/* Tell the slot operation that a neighbor may now send in shared broadcast slots */
+void tsch_queue_check_ready(struct tsch_neighbor *n);
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
 /* Initialize TSCH queue module */
 void tsch_queue_init(void);
 
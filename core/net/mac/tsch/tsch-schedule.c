@@ -69,6 +69,85 @@ MEMB(slotframe_memb, struct tsch_slotframe, TSCH_SCHEDULE_MAX_SLOTFRAMES);
 /* List of slotframes (each slotframe holds its own list of links) */
 LIST(slotframe_list);
 
+#if TSCH_SCHEDULE_WITH_INDEX
+/* All links, sorted by slotframe handle and timeslot */
+static struct tsch_link *link_index[TSCH_SCHEDULE_MAX_LINKS];
+static uint16_t link_index_count;
+
+/* Returns the position in the index of the first link at or after
+ * the given timeslot of a slotframe */
+static uint16_t
+link_index_find(uint16_t slotframe_handle, uint16_t timeslot)
+{
+  uint16_t low = 0;
+  uint16_t high = link_index_count;
+  while(low < high) {
+    uint16_t mid = (low + high) / 2;
+    struct tsch_link *l = link_index[mid];
+    if(l->slotframe_handle < slotframe_handle
+       || (l->slotframe_handle == slotframe_handle && l->timeslot < timeslot)) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the link of a slotframe at the given position of the index, if any */
+static struct tsch_link *
+link_index_get(uint16_t slotframe_handle, uint16_t pos)
+{
+  if(pos < link_index_count && link_index[pos]->slotframe_handle == slotframe_handle) {
+    return link_index[pos];
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+link_index_add(struct tsch_link *l)
+{
+  uint16_t pos = link_index_find(l->slotframe_handle, l->timeslot);
+  memmove(&link_index[pos + 1], &link_index[pos],
+          (link_index_count - pos) * sizeof(link_index[0]));
+  link_index[pos] = l;
+  link_index_count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+link_index_remove(struct tsch_link *l)
+{
+  uint16_t pos = link_index_find(l->slotframe_handle, l->timeslot);
+  /* Skip other links at the same timeslot, if any */
+  while(pos < link_index_count && link_index[pos] != l) {
+    pos++;
+  }
+  if(pos < link_index_count) {
+    link_index_count--;
+    memmove(&link_index[pos], &link_index[pos + 1],
+            (link_index_count - pos) * sizeof(link_index[0]));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the link of a slotframe that comes first after a timeslot:
+ * the first one with a higher timeslot, or the first one of the next
+ * slotframe iteration, whichever is closer */
+static struct tsch_link *
+link_index_next(struct tsch_slotframe *sf, uint16_t timeslot)
+{
+  struct tsch_link *after = link_index_get(sf->handle,
+                                           link_index_find(sf->handle, timeslot + 1));
+  struct tsch_link *first = link_index_get(sf->handle,
+                                           link_index_find(sf->handle, 0));
+  if(after == NULL
+     || (first != NULL && first->timeslot <= timeslot
+         && sf->size.val + first->timeslot - timeslot < after->timeslot - timeslot)) {
+    return first;
+  }
+  return after;
+}
+#endif /* TSCH_SCHEDULE_WITH_INDEX */
+
 /* Adds and returns a slotframe (NULL if failure) */
 struct tsch_slotframe *
 tsch_schedule_add_slotframe(uint16_t handle, uint16_t size)
@@ -209,6 +288,9 @@ tsch_schedule_add_link(struct tsch_slotframe *slotframe,
           address = &linkaddr_null;
         }
         linkaddr_copy(&l->addr, address);
+#if TSCH_SCHEDULE_WITH_INDEX
+        link_index_add(l);
+#endif /* TSCH_SCHEDULE_WITH_INDEX */
 
         PRINTF("TSCH-schedule: add_link %u %u %u %u %u %u\n",
                slotframe->handle, link_options, link_type, timeslot, channel_offset, TSCH_LOG_ID_FROM_LINKADDR(address));
@@ -256,6 +338,9 @@ tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l)
              TSCH_LOG_ID_FROM_LINKADDR(&l->addr));
 
       list_remove(slotframe->links_list, l);
+#if TSCH_SCHEDULE_WITH_INDEX
+      link_index_remove(l);
+#endif /* TSCH_SCHEDULE_WITH_INDEX */
       memb_free(&link_memb, l);
 
       /* Release the lock before we update the neighbor (will take the lock) */
@@ -269,6 +354,12 @@ tsch_schedule_remove_link(struct tsch_slotframe *slotframe, struct tsch_link *l)
           if(!(link_options & LINK_OPTION_SHARED)) {
             n->dedicated_tx_links_count--;
           }
+#if TSCH_QUEUE_WITH_READY_LIST
+          if(n->tx_links_count == 0) {
+            /* Its packets may now go in shared broadcast slots */
+            tsch_queue_check_ready(n);
+          }
+#endif /* TSCH_QUEUE_WITH_READY_LIST */
         }
       }
 
@@ -294,6 +385,14 @@ tsch_schedule_get_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t ti
 {
   if(!tsch_is_locked()) {
     if(slotframe != NULL) {
+#if TSCH_SCHEDULE_WITH_INDEX
+      struct tsch_link *l = link_index_get(slotframe->handle,
+                                           link_index_find(slotframe->handle, timeslot));
+      if(l != NULL && l->timeslot == timeslot) {
+        return l;
+      }
+      return NULL;
+#else /* TSCH_SCHEDULE_WITH_INDEX */
       struct tsch_link *l = list_head(slotframe->links_list);
       /* Loop over all items. Assume there is max one link per timeslot */
       while(l != NULL) {
@@ -303,6 +402,7 @@ tsch_schedule_get_link_by_timeslot(struct tsch_slotframe *slotframe, uint16_t ti
         l = list_item_next(l);
       }
       return l;
+#endif /* TSCH_SCHEDULE_WITH_INDEX */
     }
   }
   return NULL;
@@ -325,7 +425,13 @@ tsch_schedule_get_next_active_link(struct asn_t *asn, uint16_t *time_offset,
     while(sf != NULL) {
       /* Get timeslot from ASN, given the slotframe length */
       uint16_t timeslot = ASN_MOD(*asn, sf->size);
+#if TSCH_SCHEDULE_WITH_INDEX
+      /* With one link per timeslot, only the first link after the
+       * current timeslot can be the earliest of this slotframe */
+      struct tsch_link *l = link_index_next(sf, timeslot);
+#else /* TSCH_SCHEDULE_WITH_INDEX */
       struct tsch_link *l = list_head(sf->links_list);
+#endif /* TSCH_SCHEDULE_WITH_INDEX */
       while(l != NULL) {
         uint16_t time_to_timeslot =
           l->timeslot > timeslot ?
@@ -369,7 +475,11 @@ tsch_schedule_get_next_active_link(struct asn_t *asn, uint16_t *time_offset,
           }
         }
 
+#if TSCH_SCHEDULE_WITH_INDEX
+        l = NULL;
+#else /* TSCH_SCHEDULE_WITH_INDEX */
         l = list_item_next(l);
+#endif /* TSCH_SCHEDULE_WITH_INDEX */
       }
       sf = list_item_next(sf);
     }
@@ -391,6 +501,9 @@ tsch_schedule_init(void)
     memb_init(&link_memb);
     memb_init(&slotframe_memb);
     list_init(slotframe_list);
+#if TSCH_SCHEDULE_WITH_INDEX
+    link_index_count = 0;
+#endif /* TSCH_SCHEDULE_WITH_INDEX */
     tsch_release_lock();
     return 1;
   } else {
@@ -54,6 +54,7 @@
 #include "net/mac/tsch/tsch-packet.h"
 #include "net/mac/tsch/tsch-security.h"
 #include "net/mac/tsch/tsch-adaptive-timesync.h"
+#include "net/mac/tsch/tsch-slot-timing.h"
 
 #if TSCH_LOG_LEVEL >= 1
 #define DEBUG DEBUG_PRINT
@@ -154,6 +155,13 @@ static rtimer_clock_t volatile current_slot_start;
 /* Are we currently inside a slot? */
 static volatile int tsch_in_slot_operation = 0;
 
+#if TSCH_SLOT_TIMING_ENABLED
+/* Start of the slot phase being timed */
+static rtimer_clock_t phase_start;
+/* End of the last reception, for timing the ACK turnaround */
+static rtimer_clock_t rx_end_time;
+#endif /* TSCH_SLOT_TIMING_ENABLED */
+
 /* If we are inside a slot, this tells the current channel */
 static uint8_t current_channel;
 
@@ -296,11 +304,30 @@ tsch_schedule_slot_operation(struct rtimer *tm, rtimer_clock_t ref_time, rtimer_
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+#if TSCH_SLOT_TIMING_ENABLED
+/* Record the time left before a deadline within the slot */
+static void
+record_slack(rtimer_clock_t ref_time, rtimer_clock_t offset)
+{
+  rtimer_clock_t now = RTIMER_NOW();
+
+  if(check_timer_miss(ref_time, offset, now)) {
+    tsch_slot_timing_slack(0);
+  } else {
+    tsch_slot_timing_slack(ref_time + offset - now);
+  }
+}
+#define TSCH_SLOT_TIMING_SLACK(ref_time, offset) record_slack(ref_time, offset)
+#else /* TSCH_SLOT_TIMING_ENABLED */
+#define TSCH_SLOT_TIMING_SLACK(ref_time, offset)
+#endif /* TSCH_SLOT_TIMING_ENABLED */
+/*---------------------------------------------------------------------------*/
 /* Schedule slot operation conditionally, and YIELD if success only.
  * Always attempt to schedule RTIMER_GUARD before the target to make sure to wake up
  * ahead of time and then busy wait to exactly hit the target. */
 #define TSCH_SCHEDULE_AND_YIELD(pt, tm, ref_time, offset, str) \
   do { \
+    TSCH_SLOT_TIMING_SLACK(ref_time, offset); \
     if(tsch_schedule_slot_operation(tm, ref_time, offset - RTIMER_GUARD, str)) { \
       PT_YIELD(pt); \
     } \
@@ -517,8 +544,10 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
         /* If we are going to encrypt, we need to generate the output in a separate buffer and keep
          * the original untouched. This is to allow for future retransmissions. */
         int with_encryption = queuebuf_attr(current_packet->qb, PACKETBUF_ATTR_SECURITY_LEVEL) & 0x4;
+        TSCH_SLOT_TIMING_BEGIN(phase_start);
         packet_len += tsch_security_secure_frame(packet, with_encryption ? encrypted_packet : packet, current_packet->header_len,
             packet_len - current_packet->header_len, &current_asn);
+        TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_SECURITY, phase_start);
         if(with_encryption) {
           packet = encrypted_packet;
         }
@@ -526,9 +555,12 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
 #endif /* LLSEC802154_ENABLED */
 
       /* prepare packet to send: copy to radio buffer */
+      TSCH_SLOT_TIMING_BEGIN(phase_start);
       if(packet_ready && NETSTACK_RADIO.prepare(packet, packet_len) == 0) { /* 0 means success */
         static rtimer_clock_t tx_duration;
 
+        TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_PREPARE, phase_start);
+
 #if CCA_ENABLED
         cca_status = 1;
         /* delay before CCA */
@@ -614,8 +646,13 @@ PT_THREAD(tsch_tx_slot(struct pt *pt, struct rtimer *t))
 
 #if LLSEC802154_ENABLED
                 if(ack_len != 0) {
-                  if(!tsch_security_parse_frame(ackbuf, ack_hdrlen, ack_len - ack_hdrlen - tsch_security_mic_len(&frame),
-                      &frame, &current_neighbor->addr, &current_asn)) {
+                  int ack_authentic;
+
+                  TSCH_SLOT_TIMING_BEGIN(phase_start);
+                  ack_authentic = tsch_security_parse_frame(ackbuf, ack_hdrlen, ack_len - ack_hdrlen - tsch_security_mic_len(&frame),
+                      &frame, &current_neighbor->addr, &current_asn);
+                  TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_SECURITY, phase_start);
+                  if(!ack_authentic) {
                     TSCH_LOG_ADD(tsch_log_message,
                         snprintf(log->message, sizeof(log->message),
                         "!failed to authenticate ACK"));
@@ -770,6 +807,7 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
       BUSYWAIT_UNTIL_ABS(!NETSTACK_RADIO.receiving_packet(),
           current_slot_start, tsch_timing[tsch_ts_rx_offset] + tsch_timing[tsch_ts_rx_wait] + tsch_timing[tsch_ts_max_tx]);
       TSCH_DEBUG_RX_EVENT();
+      TSCH_SLOT_TIMING_BEGIN(rx_end_time);
       tsch_radio_off(TSCH_RADIO_CMD_OFF_WITHIN_TIMESLOT);
 
       if(NETSTACK_RADIO.pending_packet()) {
@@ -799,9 +837,14 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
 #if LLSEC802154_ENABLED
         /* Decrypt and verify incoming frame */
         if(frame_valid) {
-          if(tsch_security_parse_frame(
+          int frame_authentic;
+
+          TSCH_SLOT_TIMING_BEGIN(phase_start);
+          frame_authentic = tsch_security_parse_frame(
                current_input->payload, header_len, current_input->len - header_len - tsch_security_mic_len(&frame),
-               &frame, &source_address, &current_asn)) {
+               &frame, &source_address, &current_asn);
+          TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_SECURITY, phase_start);
+          if(frame_authentic) {
             current_input->len -= tsch_security_mic_len(&frame);
           } else {
             TSCH_LOG_ADD(tsch_log_message,
@@ -852,12 +895,17 @@ PT_THREAD(tsch_rx_slot(struct pt *pt, struct rtimer *t))
 #if LLSEC802154_ENABLED
               if(tsch_is_pan_secured) {
                 /* Secure ACK frame. There is only header and header IEs, therefore data len == 0. */
+                TSCH_SLOT_TIMING_BEGIN(phase_start);
                 ack_len += tsch_security_secure_frame(ack_buf, ack_buf, ack_len, 0, &current_asn);
+                TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_SECURITY, phase_start);
               }
 #endif /* LLSEC802154_ENABLED */
 
               /* Copy to radio buffer */
+              TSCH_SLOT_TIMING_BEGIN(phase_start);
               NETSTACK_RADIO.prepare((const void *)ack_buf, ack_len);
+              TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_PREPARE, phase_start);
+              TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_RX_TO_ACK, rx_end_time);
 
               /* Wait for time to ACK and transmit ACK */
               TSCH_SCHEDULE_AND_YIELD(pt, t, rx_start_time,
@@ -944,10 +992,17 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
       int is_active_slot;
       TSCH_DEBUG_SLOT_START();
       tsch_in_slot_operation = 1;
+#if TSCH_SLOT_TIMING_ENABLED
+      /* Leave the timings alone while they are being read under the lock */
+      if(!tsch_locked) {
+        tsch_slot_timing_slot_start(&current_asn);
+      }
+#endif /* TSCH_SLOT_TIMING_ENABLED */
       /* Reset drift correction */
       drift_correction = 0;
       is_drift_correction_used = 0;
       /* Get a packet ready to be sent */
+      TSCH_SLOT_TIMING_BEGIN(phase_start);
       current_packet = get_packet_and_neighbor_for_link(current_link, &current_neighbor);
       /* There is no packet to send, and this link does not have Rx flag. Instead of doing
        * nothing, switch to the backup link (has Rx flag) if any. */
@@ -955,6 +1010,7 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
         current_link = backup_link;
         current_packet = get_packet_and_neighbor_for_link(current_link, &current_neighbor);
       }
+      TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_QUEUE, phase_start);
       is_active_slot = current_packet != NULL || (current_link->link_options & LINK_OPTION_RX);
       if(is_active_slot) {
         /* Hop channel */
@@ -1011,7 +1067,9 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
         }
 
         /* Get next active link */
+        TSCH_SLOT_TIMING_BEGIN(phase_start);
         current_link = tsch_schedule_get_next_active_link(&current_asn, &timeslot_diff, &backup_link);
+        TSCH_SLOT_TIMING_END(TSCH_SLOT_PHASE_SCHEDULE, phase_start);
         if(current_link == NULL) {
           /* There is no next link. Fall back to default
            * behavior: wake up at the next slot. */
@@ -1030,6 +1088,7 @@ PT_THREAD(tsch_slot_operation(struct rtimer *t, void *ptr))
       } while(!tsch_schedule_slot_operation(t, prev_slot_start, time_to_next_active_slot, "main"));
     }
 
+    tsch_slot_timing_slot_end();
     tsch_in_slot_operation = 0;
     PT_YIELD(&slot_operation_pt);
   }
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Timing of the phases of TSCH slot operation, recorded from the
+ *         slot operation interrupt. New maxima are reported through
+ *         tsch-log; the rest is read out on request.
+ *
+ */
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-slot-timing.h"
+#include "net/mac/tsch/tsch-log.h"
+#include <stdio.h>
+#include <string.h>
+
+#if TSCH_SLOT_TIMING_ENABLED
+
+static struct tsch_slot_timing_stats stats[TSCH_SLOT_PHASE_COUNT];
+/* The last slots. The slot being recorded is history[history_next] */
+static struct tsch_slot_timing history[TSCH_SLOT_TIMING_HISTORY_LEN];
+static uint8_t history_next;
+static uint8_t history_count;
+static uint8_t recording;
+
+static const char *const phase_names[TSCH_SLOT_PHASE_COUNT] = {
+  "queue", "security", "prepare", "rx-to-ack", "schedule", "slack"
+};
+
+/*---------------------------------------------------------------------------*/
+/* Histogram bin of a duration */
+static uint8_t
+bin_of(rtimer_clock_t duration)
+{
+  uint8_t bin = 0;
+
+  while(duration > 0 && bin < TSCH_SLOT_TIMING_BINS - 1) {
+    duration >>= 1;
+    bin++;
+  }
+  return bin;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_init(void)
+{
+  tsch_slot_timing_reset();
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_slot_start(const struct asn_t *asn)
+{
+  struct tsch_slot_timing *slot = &history[history_next];
+
+  slot->asn = *asn;
+  slot->phases = 0;
+  recording = 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_add(enum tsch_slot_phase phase, rtimer_clock_t duration)
+{
+  struct tsch_slot_timing *slot = &history[history_next];
+
+  if(!recording) {
+    return;
+  }
+  /* A phase can run more than once in a slot, e.g. securing a frame
+   * then authenticating its ACK */
+  if(slot->phases & (1 << phase)) {
+    slot->time[phase] += duration;
+  } else {
+    slot->time[phase] = duration;
+    slot->phases |= 1 << phase;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_slack(rtimer_clock_t slack)
+{
+  struct tsch_slot_timing *slot = &history[history_next];
+
+  if(!recording) {
+    return;
+  }
+  if(!(slot->phases & (1 << TSCH_SLOT_PHASE_SLACK))
+     || slack < slot->time[TSCH_SLOT_PHASE_SLACK]) {
+    slot->time[TSCH_SLOT_PHASE_SLACK] = slack;
+    slot->phases |= 1 << TSCH_SLOT_PHASE_SLACK;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_slot_end(void)
+{
+  struct tsch_slot_timing *slot = &history[history_next];
+  struct tsch_slot_timing_stats *s;
+  rtimer_clock_t t;
+  int i;
+
+  if(!recording) {
+    return;
+  }
+  recording = 0;
+
+  for(i = 0; i < TSCH_SLOT_PHASE_COUNT; i++) {
+    if(!(slot->phases & (1 << i))) {
+      continue;
+    }
+    s = &stats[i];
+    t = slot->time[i];
+    if(s->count == 0) {
+      s->min = t;
+      s->max = t;
+    } else if(t > s->max) {
+      s->max = t;
+      if(i != TSCH_SLOT_PHASE_SLACK) {
+        TSCH_LOG_ADD(tsch_log_message,
+            snprintf(log->message, sizeof(log->message),
+                "!slot %s max %u", phase_names[i], (unsigned)t);
+        );
+      }
+    } else if(t < s->min) {
+      s->min = t;
+      if(i == TSCH_SLOT_PHASE_SLACK) {
+        TSCH_LOG_ADD(tsch_log_message,
+            snprintf(log->message, sizeof(log->message),
+                "!slot slack min %u", (unsigned)t);
+        );
+      }
+    }
+    s->count++;
+    s->bins[bin_of(t)]++;
+  }
+
+  history_next = (history_next + 1) % TSCH_SLOT_TIMING_HISTORY_LEN;
+  if(history_count < TSCH_SLOT_TIMING_HISTORY_LEN) {
+    history_count++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct tsch_slot_timing_stats *
+tsch_slot_timing_stats(enum tsch_slot_phase phase)
+{
+  return &stats[phase];
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_slot_timing_get_slot(int index, struct tsch_slot_timing *slot)
+{
+  if(index < 0 || index >= history_count) {
+    return 0;
+  }
+  *slot = history[(history_next + TSCH_SLOT_TIMING_HISTORY_LEN - 1 - index)
+                  % TSCH_SLOT_TIMING_HISTORY_LEN];
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_reset(void)
+{
+  memset(stats, 0, sizeof(stats));
+  history_next = 0;
+  history_count = 0;
+  recording = 0;
+}
+/*---------------------------------------------------------------------------*/
+const char *
+tsch_slot_timing_phase_name(enum tsch_slot_phase phase)
+{
+  return phase < TSCH_SLOT_PHASE_COUNT ? phase_names[phase] : "?";
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_slot_timing_print(void)
+{
+  const struct tsch_slot_timing_stats *s;
+  int i;
+  int j;
+
+  for(i = 0; i < TSCH_SLOT_PHASE_COUNT; i++) {
+    s = &stats[i];
+    printf("TSCH: timing %s n %lu min %u max %u bins",
+           phase_names[i], (unsigned long)s->count,
+           (unsigned)s->min, (unsigned)s->max);
+    for(j = 0; j < TSCH_SLOT_TIMING_BINS; j++) {
+      printf(" %lu", (unsigned long)s->bins[j]);
+    }
+    printf("\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+
+#endif /* TSCH_SLOT_TIMING_ENABLED */
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Timing of the phases of TSCH slot operation. Each slot records
+ *         how long its phases took; the last slots are kept in a ring,
+ *         and every phase has its min, max and a histogram over all slots.
+ *
+ */
+
+#ifndef __TSCH_SLOT_TIMING_H__
+#define __TSCH_SLOT_TIMING_H__
+
+/********** Includes **********/
+
+#include "contiki.h"
+#include "sys/rtimer.h"
+#include "net/mac/tsch/tsch-asn.h"
+
+/******** Configuration *******/
+
+/* Time the phases of slot operation. Costs two RTIMER_NOW() per phase
+ * and a few comparisons per slot */
+#ifdef TSCH_SLOT_TIMING_CONF_ENABLED
+#define TSCH_SLOT_TIMING_ENABLED TSCH_SLOT_TIMING_CONF_ENABLED
+#else /* TSCH_SLOT_TIMING_CONF_ENABLED */
+#define TSCH_SLOT_TIMING_ENABLED 0
+#endif /* TSCH_SLOT_TIMING_CONF_ENABLED */
+
+/* The number of last slots whose timings are kept */
+#ifdef TSCH_SLOT_TIMING_CONF_HISTORY_LEN
+#define TSCH_SLOT_TIMING_HISTORY_LEN TSCH_SLOT_TIMING_CONF_HISTORY_LEN
+#else /* TSCH_SLOT_TIMING_CONF_HISTORY_LEN */
+#define TSCH_SLOT_TIMING_HISTORY_LEN 8
+#endif /* TSCH_SLOT_TIMING_CONF_HISTORY_LEN */
+
+/* Histogram bins. Bin 0 counts durations of 0 ticks, bin i durations
+ * from 2^(i-1) to 2^i - 1 ticks, the last bin all longer ones */
+#ifdef TSCH_SLOT_TIMING_CONF_BINS
+#define TSCH_SLOT_TIMING_BINS TSCH_SLOT_TIMING_CONF_BINS
+#else /* TSCH_SLOT_TIMING_CONF_BINS */
+#define TSCH_SLOT_TIMING_BINS 10
+#endif /* TSCH_SLOT_TIMING_CONF_BINS */
+
+/************ Types ***********/
+
+enum tsch_slot_phase {
+  /* Pick the packet and neighbor for the link */
+  TSCH_SLOT_PHASE_QUEUE,
+  /* Secure or authenticate frames and ACKs (CCM*) */
+  TSCH_SLOT_PHASE_SECURITY,
+  /* Copy a frame or ACK to the radio */
+  TSCH_SLOT_PHASE_PREPARE,
+  /* From the end of a reception to the ACK being ready to send */
+  TSCH_SLOT_PHASE_RX_TO_ACK,
+  /* Find the next active link */
+  TSCH_SLOT_PHASE_SCHEDULE,
+  /* Time left before the tightest deadline of the slot */
+  TSCH_SLOT_PHASE_SLACK,
+  TSCH_SLOT_PHASE_COUNT
+};
+
+/* Durations of a phase over all slots, in rtimer ticks. Bins are as
+ * wide as the count, so that they keep adding up to it */
+struct tsch_slot_timing_stats {
+  uint32_t count;
+  rtimer_clock_t min;
+  rtimer_clock_t max;
+  uint32_t bins[TSCH_SLOT_TIMING_BINS];
+};
+
+/* Durations of the phases of one slot */
+struct tsch_slot_timing {
+  struct asn_t asn;
+  /* Bit i is set if phase i ran */
+  uint8_t phases;
+  rtimer_clock_t time[TSCH_SLOT_PHASE_COUNT];
+};
+
+/********** Functions *********/
+
+#if TSCH_SLOT_TIMING_ENABLED
+
+/* Initialize the timing module */
+void tsch_slot_timing_init(void);
+/* Start recording a slot */
+void tsch_slot_timing_slot_start(const struct asn_t *asn);
+/* Add the duration of a phase to the current slot */
+void tsch_slot_timing_add(enum tsch_slot_phase phase, rtimer_clock_t duration);
+/* Record the time left before a deadline of the current slot */
+void tsch_slot_timing_slack(rtimer_clock_t slack);
+/* Fold the current slot into the stats and keep it in the ring */
+void tsch_slot_timing_slot_end(void);
+/* Stats of a phase. Slots are not recorded while TSCH is locked:
+ * call with TSCH locked for a consistent copy */
+const struct tsch_slot_timing_stats *tsch_slot_timing_stats(enum tsch_slot_phase phase);
+/* Copy the timings of the index-th last slot, 0 being the last one.
+ * Returns 0 if no such slot is kept. Call with TSCH locked */
+int tsch_slot_timing_get_slot(int index, struct tsch_slot_timing *slot);
+/* Clear the stats and kept slots. Call with TSCH locked */
+void tsch_slot_timing_reset(void);
+/* Name of a phase, for printing */
+const char *tsch_slot_timing_phase_name(enum tsch_slot_phase phase);
+/* Print the stats of all phases */
+void tsch_slot_timing_print(void);
+
+/************ Macros **********/
+
+/* Time a phase: start is a rtimer_clock_t holding its start time */
+#define TSCH_SLOT_TIMING_BEGIN(start) ((start) = RTIMER_NOW())
+#define TSCH_SLOT_TIMING_END(phase, start) \
+  tsch_slot_timing_add((phase), RTIMER_NOW() - (start))
+
+#else /* TSCH_SLOT_TIMING_ENABLED */
+
+#define tsch_slot_timing_init()
+#define tsch_slot_timing_slot_start(asn)
+#define tsch_slot_timing_slack(slack)
+#define tsch_slot_timing_slot_end()
+#define TSCH_SLOT_TIMING_BEGIN(start)
+#define TSCH_SLOT_TIMING_END(phase, start)
+
+#endif /* TSCH_SLOT_TIMING_ENABLED */
+
+#endif /* __TSCH_SLOT_TIMING_H__ */
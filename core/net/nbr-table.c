@@ -83,6 +83,22 @@ static unsigned num_tables;
 MEMB(neighbor_addr_mem, nbr_table_key_t, NBR_TABLE_MAX_NEIGHBORS);
 LIST(nbr_table_keys);
 
+#if NBR_TABLE_HASH_SIZE
+#if NBR_TABLE_HASH_SIZE <= NBR_TABLE_MAX_NEIGHBORS || \
+  (NBR_TABLE_HASH_SIZE & (NBR_TABLE_HASH_SIZE - 1)) != 0
+#error NBR_TABLE_CONF_HASH_SIZE must be a power of two larger than NBR_TABLE_CONF_MAX_NEIGHBORS
+#endif
+/* Open addressing with linear probing over the keys in use. A slot
+ * holds the neighbor index plus one, so that 0 is a free slot. */
+#if NBR_TABLE_MAX_NEIGHBORS < 255
+typedef uint8_t key_slot_t;
+#else
+typedef uint16_t key_slot_t;
+#endif
+static key_slot_t key_hash[NBR_TABLE_HASH_SIZE];
+#define NEXT_SLOT(slot) (((slot) + 1) & (NBR_TABLE_HASH_SIZE - 1))
+#endif /* NBR_TABLE_HASH_SIZE */
+
 /*---------------------------------------------------------------------------*/
 /* Get a key from a neighbor index */
 static nbr_table_key_t *
@@ -125,17 +141,86 @@ key_from_item(nbr_table_t *table, const nbr_table_item_t *item)
 {
   return key_from_index(index_from_item(table, item));
 }
+#if NBR_TABLE_HASH_SIZE
+/*---------------------------------------------------------------------------*/
+/* The first slot to probe for a link-layer address */
+static unsigned
+hash_slot(const linkaddr_t *lladdr)
+{
+  uint32_t hash;
+  int i;
+
+  hash = 0;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    hash = hash * 33 + lladdr->u8[i];
+  }
+  /* Spread out consecutive addresses, which would otherwise fill
+   * consecutive slots and make long runs for misses to probe */
+  hash *= 0x9e3779b1;
+  return (hash ^ (hash >> 16)) & (NBR_TABLE_HASH_SIZE - 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_insert(nbr_table_key_t *key)
+{
+  unsigned slot;
+
+  for(slot = hash_slot(&key->lladdr); key_hash[slot] != 0;
+      slot = NEXT_SLOT(slot));
+  key_hash[slot] = index_from_key(key) + 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(nbr_table_key_t *key)
+{
+  unsigned slot;
+  unsigned next;
+  unsigned home;
+
+  for(slot = hash_slot(&key->lladdr); key_hash[slot] != 0;
+      slot = NEXT_SLOT(slot)) {
+    if(key_hash[slot] == index_from_key(key) + 1) {
+      break;
+    }
+  }
+  if(key_hash[slot] == 0) {
+    return;
+  }
+  /* Move back the keys of the run that would no longer be reached
+   * through the freed slot */
+  for(next = NEXT_SLOT(slot); key_hash[next] != 0; next = NEXT_SLOT(next)) {
+    home = hash_slot(&key_from_index(key_hash[next] - 1)->lladdr);
+    if(((next - home) & (NBR_TABLE_HASH_SIZE - 1)) >=
+       ((next - slot) & (NBR_TABLE_HASH_SIZE - 1))) {
+      key_hash[slot] = key_hash[next];
+      slot = next;
+    }
+  }
+  key_hash[slot] = 0;
+}
+#endif /* NBR_TABLE_HASH_SIZE */
 /*---------------------------------------------------------------------------*/
 /* Get the index of a neighbor from its link-layer address */
 static int
 index_from_lladdr(const linkaddr_t *lladdr)
 {
   nbr_table_key_t *key;
+#if NBR_TABLE_HASH_SIZE
+  unsigned slot;
+#endif /* NBR_TABLE_HASH_SIZE */
   /* Allow lladdr-free insertion, useful e.g. for IPv6 ND.
    * Only one such entry is possible at a time, indexed by linkaddr_null. */
   if(lladdr == NULL) {
     lladdr = &linkaddr_null;
   }
+#if NBR_TABLE_HASH_SIZE
+  for(slot = hash_slot(lladdr); key_hash[slot] != 0; slot = NEXT_SLOT(slot)) {
+    key = key_from_index(key_hash[slot] - 1);
+    if(linkaddr_cmp(lladdr, &key->lladdr)) {
+      return index_from_key(key);
+    }
+  }
+#else /* NBR_TABLE_HASH_SIZE */
   key = list_head(nbr_table_keys);
   while(key != NULL) {
     if(lladdr && linkaddr_cmp(lladdr, &key->lladdr)) {
@@ -143,6 +228,7 @@ index_from_lladdr(const linkaddr_t *lladdr)
     }
     key = list_item_next(key);
   }
+#endif /* NBR_TABLE_HASH_SIZE */
   return -1;
 }
 /*---------------------------------------------------------------------------*/
@@ -195,6 +281,9 @@ remove_key(nbr_table_key_t *least_used_key)
   used_map[index_from_key(least_used_key)] = 0;
   /* Remove neighbor from list */
   list_remove(nbr_table_keys, least_used_key);
+#if NBR_TABLE_HASH_SIZE
+  hash_remove(least_used_key);
+#endif /* NBR_TABLE_HASH_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 static nbr_table_key_t *
@@ -359,6 +448,9 @@ nbr_table_add_lladdr(nbr_table_t *table, const linkaddr_t *lladdr, nbr_table_rea
 
     /* Set link-layer address */
     linkaddr_copy(&key->lladdr, lladdr);
+#if NBR_TABLE_HASH_SIZE
+    hash_insert(key);
+#endif /* NBR_TABLE_HASH_SIZE */
   }
 
   /* Get item in the current table */
@@ -446,11 +538,17 @@ nbr_table_update_lladdr(const linkaddr_t *old_addr, const linkaddr_t *new_addr,
     return 0;
   }
   key = key_from_index(index);
+#if NBR_TABLE_HASH_SIZE
+  hash_remove(key);
+#endif /* NBR_TABLE_HASH_SIZE */
   /**
    * Copy the new lladdr into the key - since we know that there is no
    * conflicting entry.
    */
   memcpy(&key->lladdr, new_addr, sizeof(linkaddr_t));
+#if NBR_TABLE_HASH_SIZE
+  hash_insert(key);
+#endif /* NBR_TABLE_HASH_SIZE */
   return 1;
 }
 /*---------------------------------------------------------------------------*/
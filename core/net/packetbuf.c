@@ -51,6 +51,8 @@
 
 struct packetbuf_attr packetbuf_attrs[PACKETBUF_NUM_ATTRS];
 struct packetbuf_addr packetbuf_addrs[PACKETBUF_NUM_ADDRS];
+/* The queuebuf that holds a copy of the packetbuf, if any */
+const void *packetbuf_mirror_buf;
 
 
 static uint16_t buflen, bufptr;
@@ -81,6 +83,18 @@ packetbuf_clear(void)
   packetbuf_attr_clear();
 }
 /*---------------------------------------------------------------------------*/
+void
+packetbuf_set_mirror(const void *q)
+{
+  packetbuf_mirror_buf = q;
+}
+/*---------------------------------------------------------------------------*/
+const void *
+packetbuf_mirror(void)
+{
+  return packetbuf_mirror_buf;
+}
+/*---------------------------------------------------------------------------*/
 int
 packetbuf_copyfrom(const void *from, uint16_t len)
 {
@@ -99,6 +113,7 @@ packetbuf_compact(void)
   int16_t i;
 
   if(bufptr) {
+    packetbuf_mirror_buf = NULL;
     /* shift data to the left */
     for(i = 0; i < buflen; i++) {
       packetbuf[hdrlen + i] = packetbuf[packetbuf_hdrlen() + i];
@@ -132,6 +147,7 @@ packetbuf_hdralloc(int size)
     packetbuf[i + size] = packetbuf[i];
   }
   hdrlen += size;
+  packetbuf_mirror_buf = NULL;
   return 1;
 }
 /*---------------------------------------------------------------------------*/
@@ -144,6 +160,7 @@ packetbuf_hdrreduce(int size)
 
   bufptr += size;
   buflen -= size;
+  packetbuf_mirror_buf = NULL;
   return 1;
 }
 /*---------------------------------------------------------------------------*/
@@ -152,6 +169,7 @@ packetbuf_set_datalen(uint16_t len)
 {
   PRINTF("packetbuf_set_len: len %d\n", len);
   buflen = len;
+  packetbuf_mirror_buf = NULL;
 }
 /*---------------------------------------------------------------------------*/
 void *
@@ -188,6 +206,7 @@ void
 packetbuf_attr_clear(void)
 {
   int i;
+  packetbuf_mirror_buf = NULL;
   memset(packetbuf_attrs, 0, sizeof(packetbuf_attrs));
   for(i = 0; i < PACKETBUF_NUM_ADDRS; ++i) {
     linkaddr_copy(&packetbuf_addrs[i].addr, &linkaddr_null);
@@ -208,6 +227,7 @@ packetbuf_attr_copyfrom(struct packetbuf_attr *attrs,
 {
   memcpy(packetbuf_attrs, attrs, sizeof(packetbuf_attrs));
   memcpy(packetbuf_addrs, addrs, sizeof(packetbuf_addrs));
+  packetbuf_mirror_buf = NULL;
 }
 /*---------------------------------------------------------------------------*/
 #if !PACKETBUF_CONF_ATTRS_INLINE
@@ -215,6 +235,7 @@ int
 packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
 {
   packetbuf_attrs[type].val = val;
+  packetbuf_mirror_buf = NULL;
   return 1;
 }
 /*---------------------------------------------------------------------------*/
@@ -228,6 +249,7 @@ int
 packetbuf_set_addr(uint8_t type, const linkaddr_t *addr)
 {
   linkaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
+  packetbuf_mirror_buf = NULL;
   return 1;
 }
 /*---------------------------------------------------------------------------*/
@@ -72,6 +72,13 @@
 #define PACKETBUF_WITH_PACKET_TYPE NETSTACK_CONF_WITH_RIME
 #endif
 
+/* Carry a priority class with every packet, for the MAC queues */
+#ifdef PACKETBUF_CONF_WITH_PRIORITY
+#define PACKETBUF_WITH_PRIORITY PACKETBUF_CONF_WITH_PRIORITY
+#else
+#define PACKETBUF_WITH_PRIORITY 0
+#endif
+
 /**
  * \brief      Clear and reset the packetbuf
  *
@@ -204,6 +211,26 @@ int packetbuf_hdralloc(int size);
  */
 int packetbuf_hdrreduce(int size);
 
+/**
+ * \brief      Remember that a queuebuf holds a copy of the packetbuf
+ * \param q    The queuebuf, or NULL
+ *
+ *             queuebuf.c sets this when it copies a packet to or from
+ *             the packetbuf, and the functions that change the
+ *             packetbuf clear it. queuebuf_to_packetbuf() then does
+ *             not copy back a packet that is still there, as when the
+ *             MAC sends the packet it has just queued. Code that
+ *             changes the packetbuf only through packetbuf_dataptr()
+ *             or packetbuf_hdrptr() must clear it.
+ */
+void packetbuf_set_mirror(const void *q);
+
+/**
+ * \brief      The queuebuf that holds a copy of the packetbuf
+ * \return     The queuebuf, or NULL if the packetbuf changed since
+ */
+const void *packetbuf_mirror(void);
+
 /* Packet attributes stuff below: */
 
 typedef uint16_t packetbuf_attr_t;
@@ -221,6 +248,13 @@ struct packetbuf_addr {
 #define PACKETBUF_ATTR_PACKET_TYPE_STREAM_END 3
 #define PACKETBUF_ATTR_PACKET_TYPE_TIMESTAMP 4
 
+/* Priority classes, from lowest to highest. Packets are normal unless
+ * marked otherwise. */
+#define PACKETBUF_ATTR_PRIORITY_NORMAL       0
+#define PACKETBUF_ATTR_PRIORITY_HIGH         1
+#define PACKETBUF_ATTR_PRIORITY_CONTROL      2
+#define PACKETBUF_ATTR_PRIORITY_NUM          3
+
 enum {
   PACKETBUF_ATTR_NONE,
 
@@ -237,6 +271,9 @@ enum {
   PACKETBUF_ATTR_MAC_SEQNO,
   PACKETBUF_ATTR_MAC_ACK,
   PACKETBUF_ATTR_IS_CREATED_AND_SECURED,
+#if PACKETBUF_WITH_PRIORITY
+  PACKETBUF_ATTR_PRIORITY,
+#endif /* PACKETBUF_WITH_PRIORITY */
 #if TSCH_WITH_LINK_SELECTOR
   PACKETBUF_ATTR_TSCH_SLOTFRAME,
   PACKETBUF_ATTR_TSCH_TIMESLOT,
@@ -302,11 +339,13 @@ enum {
 
 extern struct packetbuf_attr packetbuf_attrs[];
 extern struct packetbuf_addr packetbuf_addrs[];
+extern const void *packetbuf_mirror_buf;
 
 static inline int
 packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
 {
   packetbuf_attrs[type].val = val;
+  packetbuf_mirror_buf = NULL;
   return 1;
 }
 static inline packetbuf_attr_t
@@ -319,6 +358,7 @@ static inline int
 packetbuf_set_addr(uint8_t type, const linkaddr_t *addr)
 {
   linkaddr_copy(&packetbuf_addrs[type - PACKETBUF_ADDR_FIRST].addr, addr);
+  packetbuf_mirror_buf = NULL;
   return 1;
 }
 
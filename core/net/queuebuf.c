@@ -276,6 +276,15 @@ queuebuf_load_to_ram(struct queuebuf *b)
 }
 #endif /* WITH_SWAP */
 /*---------------------------------------------------------------------------*/
+/* b now holds what the packetbuf holds. queuebuf_to_packetbuf() puts
+   the header back as data, so only a packetbuf without a header is the
+   same as a reloaded one. */
+static void
+queuebuf_mirror(struct queuebuf *b)
+{
+  packetbuf_set_mirror(packetbuf_hdrlen() == 0 ? b : NULL);
+}
+/*---------------------------------------------------------------------------*/
 void
 queuebuf_init(void)
 {
@@ -341,6 +350,7 @@ queuebuf_new_from_packetbuf(void)
 
     buframptr->len = packetbuf_copyto(buframptr->data);
     packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
+    queuebuf_mirror(buf);
 
 #if WITH_SWAP
     if(buf->location == IN_CFS) {
@@ -384,6 +394,7 @@ queuebuf_update_from_packetbuf(struct queuebuf *buf)
   struct queuebuf_data *buframptr = queuebuf_load_to_ram(buf);
   packetbuf_attr_copyto(buframptr->attrs, buframptr->addrs);
   buframptr->len = packetbuf_copyto(buframptr->data);
+  queuebuf_mirror(buf);
 #if WITH_SWAP
   if(buf->location == IN_CFS) {
     queuebuf_flush_tmpdata();
@@ -395,6 +406,9 @@ void
 queuebuf_free(struct queuebuf *buf)
 {
   if(memb_inmemb(&bufmem, buf)) {
+    if(packetbuf_mirror() == buf) {
+      packetbuf_set_mirror(NULL);
+    }
 #if WITH_SWAP
     if(buf->location == IN_RAM) {
       memb_free(&buframmem, buf->ram_ptr);
@@ -419,9 +433,15 @@ void
 queuebuf_to_packetbuf(struct queuebuf *b)
 {
   if(memb_inmemb(&bufmem, b)) {
-    struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+    struct queuebuf_data *buframptr;
+    if(packetbuf_mirror() == b) {
+      /* Still there since it was queued or last loaded */
+      return;
+    }
+    buframptr = queuebuf_load_to_ram(b);
     packetbuf_copyfrom(buframptr->data, buframptr->len);
     packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
+    packetbuf_set_mirror(b);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -430,6 +450,10 @@ queuebuf_dataptr(struct queuebuf *b)
 {
   if(memb_inmemb(&bufmem, b)) {
     struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+    /* The caller may change the data */
+    if(packetbuf_mirror() == b) {
+      packetbuf_set_mirror(NULL);
+    }
     return buframptr->data;
   }
   return NULL;
@@ -310,6 +310,67 @@ rpl_process_srh_header(void)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_NS_SRH_CACHE_SIZE
+/* A source routing header built for a destination: its path length,
+ * compression and addresses, and the hop the packet is sent to */
+struct srh_cache_entry {
+  const rpl_ns_node_t *dest;
+  const rpl_ns_node_t *root;
+  rpl_ns_node_t *first_hop;
+  uint8_t path_len;
+  uint8_t cmpr; /* ComprI, equal to ComprE */
+  uint8_t addresses[RPL_NS_SRH_CACHE_ADDR_LEN];
+};
+
+static struct srh_cache_entry srh_cache[RPL_NS_SRH_CACHE_SIZE];
+/*---------------------------------------------------------------------------*/
+static struct srh_cache_entry *
+srh_cache_entry(const rpl_ns_node_t *dest)
+{
+  return &srh_cache[((dest->link_identifier[6] << 8) |
+                     dest->link_identifier[7]) % RPL_NS_SRH_CACHE_SIZE];
+}
+/*---------------------------------------------------------------------------*/
+/* Does the path of the entry go through the node? The compressed
+ * addresses end with the last bytes of the link identifiers of the
+ * hops. A node with the same last bytes as a hop invalidates the
+ * entry too, which only costs rebuilding it. */
+static int
+srh_cache_has_hop(const struct srh_cache_entry *e, const rpl_ns_node_t *node)
+{
+  uint8_t addr_len;
+  uint8_t i;
+
+  if(node == e->dest || node == e->first_hop || node == e->root) {
+    return 1;
+  }
+  if(e->cmpr < 8) {
+    return 1;
+  }
+  addr_len = 16 - e->cmpr;
+  for(i = 0; i < e->path_len; i++) {
+    if(memcmp(&e->addresses[i * addr_len],
+              &node->link_identifier[8 - addr_len], addr_len) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Drop the headers whose path goes through the node, or all of them */
+void
+rpl_srh_cache_invalidate(const rpl_ns_node_t *node)
+{
+  struct srh_cache_entry *e;
+
+  for(e = srh_cache; e < &srh_cache[RPL_NS_SRH_CACHE_SIZE]; e++) {
+    if(e->dest != NULL && (node == NULL || srh_cache_has_hop(e, node))) {
+      e->dest = NULL;
+    }
+  }
+}
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+/*---------------------------------------------------------------------------*/
 static int
 count_matching_bytes(const void *p1, const void *p2, size_t n)
 {
@@ -337,6 +398,9 @@ insert_srh_header(void)
   rpl_ns_node_t *node;
   rpl_dag_t *dag;
   uip_ipaddr_t node_addr;
+#if RPL_NS_SRH_CACHE_SIZE
+  struct srh_cache_entry *e;
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
   PRINTF("RPL: SRH creating source routing header with destination ");
   PRINT6ADDR(&UIP_IP_BUF->destipaddr);
@@ -364,36 +428,51 @@ insert_srh_header(void)
     return 0;
   }
 
-  if(!rpl_ns_is_node_reachable(dag, &UIP_IP_BUF->destipaddr)) {
-    PRINTF("RPL: SRH no path found to destination\n");
-    return 0;
-  }
+#if RPL_NS_SRH_CACHE_SIZE
+  /* A cached header still has a path to the root, as its entry is
+   * dropped when a node on the path changes */
+  e = srh_cache_entry(dest_node);
+  if(e->dest == dest_node && e->root == root_node) {
+    path_len = e->path_len;
+    cmpri = e->cmpr;
+    cmpre = e->cmpr;
+  } else {
+    e->dest = NULL;
+#else /* RPL_NS_SRH_CACHE_SIZE */
+  {
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
-  /* Compute path length and compression factors (we use cmpri == cmpre) */
-  path_len = 0;
-  node = dest_node->parent;
-  /* For simplicity, we use cmpri = cmpre */
-  cmpri = 15;
-  cmpre = 15;
+    if(!rpl_ns_is_node_reachable(dag, &UIP_IP_BUF->destipaddr)) {
+      PRINTF("RPL: SRH no path found to destination\n");
+      return 0;
+    }
 
-  if(node == root_node) {
-    PRINTF("RPL: SRH no need to insert SRH\n");
-    return 1;
-  }
+    /* Compute path length and compression factors (we use cmpri == cmpre) */
+    path_len = 0;
+    node = dest_node->parent;
+    /* For simplicity, we use cmpri = cmpre */
+    cmpri = 15;
+    cmpre = 15;
 
-  while(node != NULL && node != root_node) {
+    if(node == root_node) {
+      PRINTF("RPL: SRH no need to insert SRH\n");
+      return 1;
+    }
 
-    rpl_ns_get_node_global_addr(&node_addr, node);
+    while(node != NULL && node != root_node) {
 
-    /* How many bytes in common between all nodes in the path? */
-    cmpri = MIN(cmpri, count_matching_bytes(&node_addr, &UIP_IP_BUF->destipaddr, 16));
-    cmpre = cmpri;
+      rpl_ns_get_node_global_addr(&node_addr, node);
 
-    PRINTF("RPL: SRH Hop ");
-    PRINT6ADDR(&node_addr);
-    PRINTF("\n");
-    node = node->parent;
-    path_len++;
+      /* How many bytes in common between all nodes in the path? */
+      cmpri = MIN(cmpri, count_matching_bytes(&node_addr, &UIP_IP_BUF->destipaddr, 16));
+      cmpre = cmpri;
+
+      PRINTF("RPL: SRH Hop ");
+      PRINT6ADDR(&node_addr);
+      PRINTF("\n");
+      node = node->parent;
+      path_len++;
+    }
   }
 
   /* Extension header length: fixed headers + (n-1) * (16-ComprI) + (16-ComprE)*/
@@ -436,13 +515,33 @@ insert_srh_header(void)
   node = dest_node;
   hop_ptr = ((uint8_t *)UIP_RH_BUF) + ext_len - padding; /* Pointer where to write the next hop compressed address */
 
-  while(node != NULL && node->parent != root_node) {
-    rpl_ns_get_node_global_addr(&node_addr, node);
+#if RPL_NS_SRH_CACHE_SIZE
+  if(e->dest != NULL) {
+    memcpy((uint8_t *)UIP_RPL_SRH_BUF + RPL_SRH_LEN, e->addresses,
+           path_len * (16 - cmpri));
+    node = e->first_hop;
+  } else {
+#else /* RPL_NS_SRH_CACHE_SIZE */
+  {
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+    while(node != NULL && node->parent != root_node) {
+      rpl_ns_get_node_global_addr(&node_addr, node);
 
-    hop_ptr -= (16 - cmpri);
-    memcpy(hop_ptr, ((uint8_t*)&node_addr) + cmpri, 16 - cmpri);
+      hop_ptr -= (16 - cmpri);
+      memcpy(hop_ptr, ((uint8_t*)&node_addr) + cmpri, 16 - cmpri);
 
-    node = node->parent;
+      node = node->parent;
+    }
+#if RPL_NS_SRH_CACHE_SIZE
+    if(node != NULL && path_len * (16 - cmpri) <= RPL_NS_SRH_CACHE_ADDR_LEN) {
+      memcpy(e->addresses, hop_ptr, path_len * (16 - cmpri));
+      e->path_len = path_len;
+      e->cmpr = cmpri;
+      e->first_hop = node;
+      e->root = root_node;
+      e->dest = dest_node;
+    }
+#endif /* RPL_NS_SRH_CACHE_SIZE */
   }
 
   /* The next hop (i.e. node whose parent is the root) is placed as the current IPv6 destination */
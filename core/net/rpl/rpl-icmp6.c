@@ -55,6 +55,7 @@
 #include "net/packetbuf.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
 #include "random.h"
+#include "lib/assert.h"
 
 #include <limits.h>
 #include <string.h>
@@ -95,6 +96,41 @@ static uint8_t dao_sequence = RPL_LOLLIPOP_INIT;
 #if RPL_WITH_MULTICAST
 static uip_mcast6_route_t *mcast_group;
 #endif
+
+#if RPL_WITH_STORING && RPL_DAO_AGGREGATION_DELAY
+#define RPL_DAO_AGGREGATION 1
+
+#define DAO_TARGET_OWN  0x01
+#define DAO_TARGET_SENT 0x02
+
+/* A DAO target held back for aggregation */
+struct dao_target {
+  uip_ipaddr_t prefix;
+  uint8_t prefixlen;
+  uint8_t lifetime;
+  uint8_t flags;
+};
+
+static struct dao_target dao_targets[RPL_DAO_AGGREGATION_TARGETS];
+static uint8_t dao_target_count;
+static rpl_instance_t *dao_target_instance;
+static uip_ipaddr_t dao_target_parent;
+static struct ctimer dao_aggregation_timer;
+
+#if RPL_WITH_DAO_ACK
+/* Our own target is sent in an aggregated DAO before the first
+   retransmission of our DAO is due */
+CTASSERT(RPL_DAO_AGGREGATION_DELAY < RPL_DAO_RETRANSMISSION_TIMEOUT);
+
+/* The targets of the last aggregated DAO that carried our own target,
+   sent again as they were when the DAO is retransmitted */
+static struct dao_target dao_own_targets[RPL_DAO_AGGREGATION_TARGETS];
+static uint8_t dao_own_count;
+static uint8_t dao_own_seqno;
+#endif /* RPL_WITH_DAO_ACK */
+#else /* RPL_WITH_STORING && RPL_DAO_AGGREGATION_DELAY */
+#define RPL_DAO_AGGREGATION 0
+#endif /* RPL_WITH_STORING && RPL_DAO_AGGREGATION_DELAY */
 /*---------------------------------------------------------------------------*/
 /* Initialise RPL ICMPv6 message handlers */
 UIP_ICMP6_HANDLER(dis_handler, ICMP6_RPL, RPL_CODE_DIS, dis_input);
@@ -103,38 +139,45 @@ UIP_ICMP6_HANDLER(dao_handler, ICMP6_RPL, RPL_CODE_DAO, dao_input);
 UIP_ICMP6_HANDLER(dao_ack_handler, ICMP6_RPL, RPL_CODE_DAO_ACK, dao_ack_input);
 /*---------------------------------------------------------------------------*/
 
-#if RPL_WITH_DAO_ACK
-static uip_ds6_route_t *
-find_route_entry_by_dao_ack(uint8_t seq)
+#if RPL_WITH_DAO_ACK && RPL_WITH_STORING
+/* Check whether a DAO ACK with sequence number seq has already been
+   forwarded for a route registered by the same DAO as re. */
+static int
+dao_ack_forwarded(uip_ds6_route_t *re, uint8_t seq)
 {
-  uip_ds6_route_t *re;
-  re = uip_ds6_route_head();
-  while(re != NULL) {
-    if(re->state.dao_seqno_out == seq && RPL_ROUTE_IS_DAO_PENDING(re)) {
-      /* found it! */
-      return re;
+  uip_ds6_route_t *r;
+
+  for(r = uip_ds6_route_head(); r != re; r = uip_ds6_route_next(r)) {
+    if(r->state.dao_seqno_out == seq && !RPL_ROUTE_IS_DAO_PENDING(r) &&
+       r->state.dao_seqno_in == re->state.dao_seqno_in &&
+       uip_ds6_route_nexthop(r) != NULL &&
+       uip_ipaddr_cmp(uip_ds6_route_nexthop(r), uip_ds6_route_nexthop(re))) {
+      return 1;
     }
-    re = uip_ds6_route_next(re);
   }
-  return NULL;
+  return 0;
 }
-#endif /* RPL_WITH_DAO_ACK */
+#endif /* RPL_WITH_DAO_ACK && RPL_WITH_STORING */
 
-#if RPL_WITH_STORING
-/* prepare for forwarding of DAO */
-static uint8_t
-prepare_for_dao_fwd(uint8_t sequence, uip_ds6_route_t *rep)
+/* Returns the offset of the first Transit option at or after offset i,
+   which applies to the Target options before it, or 0 if there is none */
+static int
+dao_find_transit(const unsigned char *buffer, int i, int buffer_length)
 {
-  /* not pending - or pending but not a retransmission */
-  RPL_LOLLIPOP_INCREMENT(dao_sequence);
+  int len;
 
-  /* set DAO pending and sequence numbers */
-  rep->state.dao_seqno_in = sequence;
-  rep->state.dao_seqno_out = dao_sequence;
-  RPL_ROUTE_SET_DAO_PENDING(rep);
-  return dao_sequence;
+  for(; i < buffer_length; i += len) {
+    if(buffer[i] == RPL_OPTION_PAD1) {
+      len = 1;
+      continue;
+    }
+    if(buffer[i] == RPL_OPTION_TRANSIT) {
+      return i;
+    }
+    len = 2 + buffer[i + 1];
+  }
+  return 0;
 }
-#endif /* RPL_WITH_STORING */
 /*---------------------------------------------------------------------------*/
 static int
 get_global_addr(uip_ipaddr_t *addr)
@@ -630,6 +673,263 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
 #endif /* RPL_LEAF_ONLY */
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_DAO_AGGREGATION
+/* Write a DAO with the targets not sent yet that fit, grouped by
+   lifetime, each group followed by the Transit option that carries
+   it. The written targets are marked sent and their indices stored in
+   written. Returns the length of the DAO. */
+static int
+dao_aggregation_write(rpl_instance_t *instance, rpl_parent_t *parent,
+                      struct dao_target *targets, int count, uint8_t seq_no,
+                      uint8_t *written, int *written_count)
+{
+  uip_ds6_route_t *rep;
+  struct dao_target *t;
+  unsigned char *buffer;
+  uint8_t lifetime;
+  int pos;
+  int i;
+  int j;
+  int len;
+  int group;
+  int full;
+
+  uip_clear_buf();
+  buffer = UIP_ICMP_PAYLOAD;
+
+  pos = 0;
+  buffer[pos++] = instance->instance_id;
+  buffer[pos] = 0;
+#if RPL_DAO_SPECIFY_DAG
+  buffer[pos] |= RPL_DAO_D_FLAG;
+#endif /* RPL_DAO_SPECIFY_DAG */
+  ++pos;
+  buffer[pos++] = 0; /* reserved */
+  buffer[pos++] = seq_no;
+#if RPL_DAO_SPECIFY_DAG
+  memcpy(buffer + pos, &parent->dag->dag_id, sizeof(parent->dag->dag_id));
+  pos += sizeof(parent->dag->dag_id);
+#endif /* RPL_DAO_SPECIFY_DAG */
+
+  *written_count = 0;
+  full = 0;
+  for(i = 0; i < count && !full; i++) {
+    if(targets[i].flags & DAO_TARGET_SENT) {
+      continue;
+    }
+    lifetime = targets[i].lifetime;
+    group = 0;
+    for(j = i; j < count; j++) {
+      t = &targets[j];
+      if((t->flags & DAO_TARGET_SENT) || t->lifetime != lifetime) {
+        continue;
+      }
+      len = (t->prefixlen + 7) / CHAR_BIT;
+      if(pos + 4 + len + 6 > RPL_DAO_AGGREGATION_MAX_LEN) {
+        full = 1;
+        break;
+      }
+      buffer[pos++] = RPL_OPTION_TARGET;
+      buffer[pos++] = 2 + len;
+      buffer[pos++] = 0; /* reserved */
+      buffer[pos++] = t->prefixlen;
+      memcpy(buffer + pos, &t->prefix, len);
+      pos += len;
+
+      t->flags |= DAO_TARGET_SENT;
+      written[(*written_count)++] = j;
+      group++;
+
+      if(t->flags & DAO_TARGET_OWN) {
+#if RPL_WITH_DAO_ACK
+        if(t->lifetime != RPL_ZERO_LIFETIME) {
+          instance->my_dao_seqno = seq_no;
+        }
+#endif /* RPL_WITH_DAO_ACK */
+      } else {
+        rep = uip_ds6_route_lookup(&t->prefix);
+        if(rep != NULL && rep->length == t->prefixlen) {
+          rep->state.dao_seqno_out = seq_no;
+        }
+      }
+    }
+    if(group > 0) {
+      buffer[pos++] = RPL_OPTION_TRANSIT;
+      buffer[pos++] = 4;
+      buffer[pos++] = 0; /* flags - ignored */
+      buffer[pos++] = 0; /* path control - ignored */
+      buffer[pos++] = 0; /* path seq - ignored */
+      buffer[pos++] = lifetime;
+#if RPL_WITH_DAO_ACK
+      if(lifetime != RPL_ZERO_LIFETIME) {
+        buffer[1] |= RPL_DAO_K_FLAG;
+      }
+#endif /* RPL_WITH_DAO_ACK */
+    }
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_aggregation_flush(void *ptr)
+{
+  rpl_instance_t *instance;
+  rpl_parent_t *parent;
+  uint8_t written[RPL_DAO_AGGREGATION_TARGETS];
+  uint8_t count;
+  uint8_t remaining;
+  uint8_t seq_no;
+  int pos;
+  int targets;
+#if RPL_WITH_DAO_ACK
+  int i;
+#endif /* RPL_WITH_DAO_ACK */
+
+  ctimer_stop(&dao_aggregation_timer);
+  count = dao_target_count;
+  instance = dao_target_instance;
+  dao_target_count = 0;
+  if(count == 0) {
+    return;
+  }
+
+  parent = rpl_find_parent_any_dag(instance, &dao_target_parent);
+  if(parent == NULL || parent->dag == NULL ||
+     rpl_get_mode() == RPL_MODE_FEATHER) {
+    PRINTF("RPL: Dropping %u aggregated DAO targets\n", count);
+    return;
+  }
+
+  remaining = count;
+  while(remaining > 0) {
+    RPL_LOLLIPOP_INCREMENT(dao_sequence);
+    seq_no = dao_sequence;
+    pos = dao_aggregation_write(instance, parent, dao_targets, count, seq_no,
+                                written, &targets);
+    if(targets == 0) {
+      PRINTF("RPL: Aggregated DAO target does not fit\n");
+      break;
+    }
+    remaining -= targets;
+
+#if RPL_WITH_DAO_ACK
+    for(i = 0; i < targets; i++) {
+      if((dao_targets[written[i]].flags & DAO_TARGET_OWN) &&
+         dao_targets[written[i]].lifetime != RPL_ZERO_LIFETIME) {
+        break;
+      }
+    }
+    if(i < targets) {
+      for(i = 0; i < targets; i++) {
+        dao_own_targets[i] = dao_targets[written[i]];
+      }
+      dao_own_count = targets;
+      dao_own_seqno = seq_no;
+    }
+#endif /* RPL_WITH_DAO_ACK */
+
+    PRINTF("RPL: Sending an aggregated DAO with sequence number %u and %d targets to ",
+           seq_no, targets);
+    PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+    PRINTF("\n");
+
+    RPL_STAT(rpl_stats.daos_sent++);
+    uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_DAO_ACK
+/* Send the aggregated DAO with our own target again. Returns 0 if
+   our last DAO was not aggregated. */
+static int
+dao_aggregation_retransmit(rpl_parent_t *parent)
+{
+  rpl_instance_t *instance;
+  uint8_t written[RPL_DAO_AGGREGATION_TARGETS];
+  int targets;
+  int pos;
+  int i;
+
+  instance = parent->dag->instance;
+  if(dao_own_count == 0 || dao_own_seqno != instance->my_dao_seqno ||
+     rpl_get_parent_ipaddr(parent) == NULL ||
+     rpl_get_mode() == RPL_MODE_FEATHER) {
+    return 0;
+  }
+
+  for(i = 0; i < dao_own_count; i++) {
+    dao_own_targets[i].flags &= ~DAO_TARGET_SENT;
+  }
+  /* The targets fitted in one DAO before and do so again */
+  pos = dao_aggregation_write(instance, parent, dao_own_targets,
+                              dao_own_count, dao_own_seqno,
+                              written, &targets);
+
+  PRINTF("RPL: Retransmitting an aggregated DAO with sequence number %u and %d targets\n",
+         dao_own_seqno, targets);
+
+  RPL_STAT(rpl_stats.daos_sent++);
+  uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
+  return 1;
+}
+#endif /* RPL_WITH_DAO_ACK */
+/*---------------------------------------------------------------------------*/
+/* Number of targets that can still be held for a DAO to parent */
+static int
+dao_aggregation_room(rpl_parent_t *parent)
+{
+  if(dao_target_count > 0 &&
+     (dao_target_instance != parent->dag->instance ||
+      !uip_ipaddr_cmp(&dao_target_parent, rpl_get_parent_ipaddr(parent)))) {
+    return 0;
+  }
+  return RPL_DAO_AGGREGATION_TARGETS - dao_target_count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+dao_aggregation_add(rpl_parent_t *parent, uip_ipaddr_t *prefix,
+                    uint8_t prefixlen, uint8_t lifetime, uint8_t flags)
+{
+  struct dao_target *t;
+  uip_ipaddr_t *parent_ipaddr;
+  int i;
+
+  parent_ipaddr = rpl_get_parent_ipaddr(parent);
+  if(parent_ipaddr == NULL || parent->dag == NULL ||
+     prefixlen > sizeof(t->prefix) * CHAR_BIT) {
+    return;
+  }
+
+  if(dao_aggregation_room(parent) == 0) {
+    dao_aggregation_flush(NULL);
+  }
+
+  /* A newer DAO for a held target replaces it */
+  for(i = 0; i < dao_target_count; i++) {
+    t = &dao_targets[i];
+    if(t->prefixlen == prefixlen && uip_ipaddr_cmp(&t->prefix, prefix)) {
+      t->lifetime = lifetime;
+      t->flags |= flags;
+      return;
+    }
+  }
+
+  if(dao_target_count == 0) {
+    dao_target_instance = parent->dag->instance;
+    uip_ipaddr_copy(&dao_target_parent, parent_ipaddr);
+    ctimer_set(&dao_aggregation_timer, RPL_DAO_AGGREGATION_DELAY,
+               dao_aggregation_flush, NULL);
+  }
+
+  t = &dao_targets[dao_target_count++];
+  memset(&t->prefix, 0, sizeof(t->prefix));
+  memcpy(&t->prefix, prefix, (prefixlen + 7) / CHAR_BIT);
+  t->prefixlen = prefixlen;
+  t->lifetime = lifetime;
+  t->flags = flags;
+}
+#endif /* RPL_DAO_AGGREGATION */
+/*---------------------------------------------------------------------------*/
 static void
 dao_input_storing(void)
 {
@@ -651,13 +951,23 @@ dao_input_storing(void)
   uip_ipaddr_t prefix;
   uip_ds6_route_t *rep;
   uint8_t buffer_length;
+  uint8_t status;
+  uint8_t out_seq;
   int pos;
   int len;
   int i;
+  int transit;
   int learned_from;
+  int forward;
+  int has_out_seq;
+  int wait_for_parent;
   rpl_parent_t *parent;
   uip_ds6_nbr_t *nbr;
   int is_root;
+#if RPL_DAO_AGGREGATION
+  int aggregate;
+  int targets;
+#endif /* RPL_DAO_AGGREGATION */
 
   prefixlen = 0;
   parent = NULL;
@@ -723,7 +1033,29 @@ dao_input_storing(void)
     }
   }
 
-  /* Check if there are any RPL options present. */
+  forward = dag->preferred_parent != NULL &&
+            rpl_get_parent_ipaddr(dag->preferred_parent) != NULL;
+#if RPL_DAO_AGGREGATION
+  /* Hold the targets back only if all of them fit; otherwise the DAO
+     is forwarded as it is. */
+  targets = 0;
+  for(i = pos; i < buffer_length; i += len) {
+    if(buffer[i] == RPL_OPTION_PAD1) {
+      len = 1;
+    } else {
+      len = 2 + buffer[i + 1];
+      targets += buffer[i] == RPL_OPTION_TARGET;
+    }
+  }
+  aggregate = forward && targets <= dao_aggregation_room(dag->preferred_parent);
+#endif /* RPL_DAO_AGGREGATION */
+
+  status = RPL_DAO_ACK_UNCONDITIONAL_ACCEPT;
+  out_seq = 0;
+  has_out_seq = 0;
+  wait_for_parent = 0;
+
+  /* Handle each target option with the transit option that follows it. */
   for(i = pos; i < buffer_length; i += len) {
     subopt_type = buffer[i];
     if(subopt_type == RPL_OPTION_PAD1) {
@@ -732,50 +1064,62 @@ dao_input_storing(void)
       /* The option consists of a two-byte header and a payload. */
       len = 2 + buffer[i + 1];
     }
+    if(subopt_type != RPL_OPTION_TARGET) {
+      continue;
+    }
 
-    switch(subopt_type) {
-    case RPL_OPTION_TARGET:
-      /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
-      break;
-    case RPL_OPTION_TRANSIT:
+    prefixlen = buffer[i + 3];
+    if(prefixlen > sizeof(prefix) * CHAR_BIT) {
+      PRINTF("RPL: Ignoring a DAO target with prefix length %u\n",
+             (unsigned)prefixlen);
+      continue;
+    }
+    memset(&prefix, 0, sizeof(prefix));
+    memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
+
+    transit = dao_find_transit(buffer, i + len, buffer_length);
+    if(transit > 0) {
       /* The path sequence and control are ignored. */
-      /*      pathcontrol = buffer[i + 3];
-              pathsequence = buffer[i + 4];*/
-      lifetime = buffer[i + 5];
+      /*      pathcontrol = buffer[transit + 3];
+              pathsequence = buffer[transit + 4];*/
+      lifetime = buffer[transit + 5];
       /* The parent address is also ignored. */
-      break;
     }
-  }
 
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-          (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF("\n");
+    PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+           (unsigned)lifetime, (unsigned)prefixlen);
+    PRINT6ADDR(&prefix);
+    PRINTF("\n");
+
+    rep = NULL;
 
 #if RPL_WITH_MULTICAST
-  if(uip_is_addr_mcast_global(&prefix)) {
-    mcast_group = uip_mcast6_route_add(&prefix);
-    if(mcast_group) {
-      mcast_group->dag = dag;
-      mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+    if(uip_is_addr_mcast_global(&prefix)) {
+      mcast_group = uip_mcast6_route_add(&prefix);
+      if(mcast_group) {
+        mcast_group->dag = dag;
+        mcast_group->lifetime = RPL_LIFETIME(instance, lifetime);
+      }
+      wait_for_parent = 1;
+      if(learned_from != RPL_ROUTE_FROM_UNICAST_DAO) {
+        continue;
+      }
+      goto fwd_target;
     }
-    goto fwd_dao;
-  }
 #endif
 
-  rep = uip_ds6_route_lookup(&prefix);
-
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n");
-    /* No-Path DAO received; invoke the route purging routine. */
-    if(rep != NULL &&
-       !RPL_ROUTE_IS_NOPATH_RECEIVED(rep) &&
-       rep->length == prefixlen &&
-       uip_ds6_route_nexthop(rep) != NULL &&
-       uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &dao_sender_addr)) {
+    rep = uip_ds6_route_lookup(&prefix);
+
+    if(lifetime == RPL_ZERO_LIFETIME) {
+      PRINTF("RPL: No-Path DAO received\n");
+      /* No-Path DAO received; invoke the route purging routine. */
+      if(rep == NULL ||
+         RPL_ROUTE_IS_NOPATH_RECEIVED(rep) ||
+         rep->length != prefixlen ||
+         uip_ds6_route_nexthop(rep) == NULL ||
+         !uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &dao_sender_addr)) {
+        continue;
+      }
       PRINTF("RPL: Setting expiration timer for prefix ");
       PRINT6ADDR(&prefix);
       PRINTF("\n");
@@ -783,117 +1127,122 @@ dao_input_storing(void)
       rep->state.lifetime = RPL_NOPATH_REMOVAL_DELAY;
 
       /* We forward the incoming No-Path DAO to our parent, if we have
-         one. */
-      if(dag->preferred_parent != NULL &&
-         rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-        uint8_t out_seq;
-        out_seq = prepare_for_dao_fwd(sequence, rep);
-
-        PRINTF("RPL: Forwarding No-path DAO to parent - out_seq:%d",
-	       out_seq);
-        PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
+         one, and ACK it independent of whether we removed the route. */
+    } else {
+      PRINTF("RPL: Adding DAO route\n");
+
+      /* Update and add neighbor - if no room - fail. */
+      if((nbr = rpl_icmp6_update_nbr_table(&dao_sender_addr, NBR_TABLE_REASON_RPL_DAO, instance)) == NULL) {
+        PRINTF("RPL: Out of Memory, dropping DAO from ");
+        PRINT6ADDR(&dao_sender_addr);
+        PRINTF(", ");
+        PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
         PRINTF("\n");
-
-        buffer = UIP_ICMP_PAYLOAD;
-        buffer[3] = out_seq; /* add an outgoing seq no before fwd */
-        uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                       ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+        /* signal the failure to add the node */
+        status = is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
+                           RPL_DAO_ACK_UNABLE_TO_ACCEPT;
+        continue;
       }
-    }
-    /* independent if we remove or not - ACK the request */
-    if(flags & RPL_DAO_K_FLAG) {
-      /* indicate that we accepted the no-path DAO */
-      uip_clear_buf();
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-                     RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
-    }
-    return;
-  }
-
-  PRINTF("RPL: Adding DAO route\n");
-
-  /* Update and add neighbor - if no room - fail. */
-  if((nbr = rpl_icmp6_update_nbr_table(&dao_sender_addr, NBR_TABLE_REASON_RPL_DAO, instance)) == NULL) {
-    PRINTF("RPL: Out of Memory, dropping DAO from ");
-    PRINT6ADDR(&dao_sender_addr);
-    PRINTF(", ");
-    PRINTLLADDR((uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
-    PRINTF("\n");
-    if(flags & RPL_DAO_K_FLAG) {
-      /* signal the failure to add the node */
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-		     is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
-		     RPL_DAO_ACK_UNABLE_TO_ACCEPT);
-    }
-    return;
-  }
-
-  rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
-  if(rep == NULL) {
-    RPL_STAT(rpl_stats.mem_overflows++);
-    PRINTF("RPL: Could not add a route after receiving a DAO\n");
-    if(flags & RPL_DAO_K_FLAG) {
-      /* signal the failure to add the node */
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-		     is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
-		     RPL_DAO_ACK_UNABLE_TO_ACCEPT);
-    }
-    return;
-  }
 
-  /* set lifetime and clear NOPATH bit */
-  rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
-  RPL_ROUTE_CLEAR_NOPATH_RECEIVED(rep);
+      rep = rpl_add_route(dag, &prefix, prefixlen, &dao_sender_addr);
+      if(rep == NULL) {
+        RPL_STAT(rpl_stats.mem_overflows++);
+        PRINTF("RPL: Could not add a route after receiving a DAO\n");
+        /* signal the failure to add the node */
+        status = is_root ? RPL_DAO_ACK_UNABLE_TO_ADD_ROUTE_AT_ROOT :
+                           RPL_DAO_ACK_UNABLE_TO_ACCEPT;
+        continue;
+      }
 
-#if RPL_WITH_MULTICAST
-fwd_dao:
-#endif
+      /* set lifetime and clear NOPATH bit */
+      rep->state.lifetime = RPL_LIFETIME(instance, lifetime);
+      RPL_ROUTE_CLEAR_NOPATH_RECEIVED(rep);
 
-  if(learned_from == RPL_ROUTE_FROM_UNICAST_DAO) {
-    int should_ack = 0;
+      if(learned_from != RPL_ROUTE_FROM_UNICAST_DAO) {
+        wait_for_parent = 1;
+        continue;
+      }
 
-    if(flags & RPL_DAO_K_FLAG) {
       /*
        * check if this route is already installed and we can ack now!
        * not pending - and same seq-no means that we can ack.
        * (e.g. the route is installed already so it will not take any
        * more room that it already takes - so should be ok!)
        */
-      if((!RPL_ROUTE_IS_DAO_PENDING(rep) &&
-          rep->state.dao_seqno_in == sequence) ||
-          dag->rank == ROOT_RANK(instance)) {
-        should_ack = 1;
+      if(RPL_ROUTE_IS_DAO_PENDING(rep) ||
+         rep->state.dao_seqno_in != sequence) {
+        wait_for_parent = 1;
       }
     }
 
-    if(dag->preferred_parent != NULL &&
-       rpl_get_parent_ipaddr(dag->preferred_parent) != NULL) {
-      uint8_t out_seq = 0;
+#if RPL_WITH_MULTICAST
+fwd_target:
+#endif
+    if(!forward) {
+      continue;
+    }
+
+#if RPL_DAO_AGGREGATION
+    if(aggregate) {
+      /* The outgoing seq no is set when the aggregated DAO is sent */
+      if(rep != NULL) {
+        rep->state.dao_seqno_in = sequence;
+        RPL_ROUTE_SET_DAO_PENDING(rep);
+      }
+      dao_aggregation_add(dag->preferred_parent, &prefix, prefixlen,
+                          lifetime, 0);
+      continue;
+    }
+#endif /* RPL_DAO_AGGREGATION */
+
+    if(!has_out_seq) {
       /* if this is pending and we get the same seq no it is a retrans */
-      if(RPL_ROUTE_IS_DAO_PENDING(rep) &&
+      if(rep != NULL && RPL_ROUTE_IS_DAO_PENDING(rep) &&
          rep->state.dao_seqno_in == sequence) {
         /* keep the same seq-no as before for parent also */
         out_seq = rep->state.dao_seqno_out;
       } else {
-        out_seq = prepare_for_dao_fwd(sequence, rep);
+        RPL_LOLLIPOP_INCREMENT(dao_sequence);
+        out_seq = dao_sequence;
       }
-
-      PRINTF("RPL: Forwarding DAO to parent ");
-      PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
-      PRINTF(" in seq: %d out seq: %d\n", sequence, out_seq);
-
-      buffer = UIP_ICMP_PAYLOAD;
-      buffer[3] = out_seq; /* add an outgoing seq no before fwd */
-      uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
-                     ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+      has_out_seq = 1;
     }
-    if(should_ack) {
-      PRINTF("RPL: Sending DAO ACK\n");
-      uip_clear_buf();
-      dao_ack_output(instance, &dao_sender_addr, sequence,
-                     RPL_DAO_ACK_UNCONDITIONAL_ACCEPT);
+
+    if(rep != NULL) {
+      /* set DAO pending and sequence numbers */
+      rep->state.dao_seqno_in = sequence;
+      rep->state.dao_seqno_out = out_seq;
+      RPL_ROUTE_SET_DAO_PENDING(rep);
     }
   }
+
+  if(has_out_seq) {
+    PRINTF("RPL: Forwarding DAO to parent ");
+    PRINT6ADDR(rpl_get_parent_ipaddr(dag->preferred_parent));
+    PRINTF(" in seq: %d out seq: %d\n", sequence, out_seq);
+
+    buffer = UIP_ICMP_PAYLOAD;
+    buffer[3] = out_seq; /* add an outgoing seq no before fwd */
+    RPL_STAT(rpl_stats.daos_sent++);
+    uip_icmp6_send(rpl_get_parent_ipaddr(dag->preferred_parent),
+                   ICMP6_RPL, RPL_CODE_DAO, buffer_length);
+  }
+
+  if((flags & RPL_DAO_K_FLAG) &&
+     (status != RPL_DAO_ACK_UNCONDITIONAL_ACCEPT || !wait_for_parent ||
+      (is_root && learned_from == RPL_ROUTE_FROM_UNICAST_DAO))) {
+    PRINTF("RPL: Sending DAO ACK\n");
+    uip_clear_buf();
+    dao_ack_output(instance, &dao_sender_addr, sequence, status);
+  }
+
+#if RPL_DAO_AGGREGATION
+  if(aggregate && dao_aggregation_room(dag->preferred_parent) == 0) {
+    /* Send a full batch now rather than forward the next DAOs as they
+       are */
+    dao_aggregation_flush(NULL);
+  }
+#endif /* RPL_DAO_AGGREGATION */
 #endif /* RPL_WITH_STORING */
 }
 /*---------------------------------------------------------------------------*/
@@ -917,6 +1266,7 @@ dao_input_nonstoring(void)
   int pos;
   int len;
   int i;
+  int transit;
 
   prefixlen = 0;
 
@@ -946,7 +1296,7 @@ dao_input_nonstoring(void)
     pos += 16;
   }
 
-  /* Check if there are any RPL options present. */
+  /* Handle each target option with the transit option that follows it. */
   for(i = pos; i < buffer_length; i += len) {
     subopt_type = buffer[i];
     if(subopt_type == RPL_OPTION_PAD1) {
@@ -955,40 +1305,45 @@ dao_input_nonstoring(void)
       /* The option consists of a two-byte header and a payload. */
       len = 2 + buffer[i + 1];
     }
+    if(subopt_type != RPL_OPTION_TARGET) {
+      continue;
+    }
 
-    switch(subopt_type) {
-    case RPL_OPTION_TARGET:
-      /* Handle the target option. */
-      prefixlen = buffer[i + 3];
-      memset(&prefix, 0, sizeof(prefix));
-      memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
-      break;
-    case RPL_OPTION_TRANSIT:
+    prefixlen = buffer[i + 3];
+    if(prefixlen > sizeof(prefix) * CHAR_BIT) {
+      PRINTF("RPL: Ignoring a DAO target with prefix length %u\n",
+             (unsigned)prefixlen);
+      continue;
+    }
+    memset(&prefix, 0, sizeof(prefix));
+    memcpy(&prefix, buffer + i + 4, (prefixlen + 7) / CHAR_BIT);
+
+    transit = dao_find_transit(buffer, i + len, buffer_length);
+    if(transit > 0) {
       /* The path sequence and control are ignored. */
-      /*      pathcontrol = buffer[i + 3];
-              pathsequence = buffer[i + 4];*/
-      lifetime = buffer[i + 5];
-      if(len >= 20) {
-        memcpy(&dao_parent_addr, buffer + i + 6, 16);
+      /*      pathcontrol = buffer[transit + 3];
+              pathsequence = buffer[transit + 4];*/
+      lifetime = buffer[transit + 5];
+      if(2 + buffer[transit + 1] >= 20) {
+        memcpy(&dao_parent_addr, buffer + transit + 6, 16);
       }
-      break;
     }
-  }
 
-  PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
-          (unsigned)lifetime, (unsigned)prefixlen);
-  PRINT6ADDR(&prefix);
-  PRINTF(", parent: ");
-  PRINT6ADDR(&dao_parent_addr);
-  PRINTF(" \n");
+    PRINTF("RPL: DAO lifetime: %u, prefix length: %u prefix: ",
+            (unsigned)lifetime, (unsigned)prefixlen);
+    PRINT6ADDR(&prefix);
+    PRINTF(", parent: ");
+    PRINT6ADDR(&dao_parent_addr);
+    PRINTF(" \n");
 
-  if(lifetime == RPL_ZERO_LIFETIME) {
-    PRINTF("RPL: No-Path DAO received\n");
-    rpl_ns_expire_parent(dag, &prefix, &dao_parent_addr);
-  } else {
-    if(rpl_ns_update_node(dag, &prefix, &dao_parent_addr, RPL_LIFETIME(instance, lifetime)) == NULL) {
-      PRINTF("RPL: failed to add link\n");
-      return;
+    if(lifetime == RPL_ZERO_LIFETIME) {
+      PRINTF("RPL: No-Path DAO received\n");
+      rpl_ns_expire_parent(dag, &prefix, &dao_parent_addr);
+    } else {
+      if(rpl_ns_update_node(dag, &prefix, &dao_parent_addr, RPL_LIFETIME(instance, lifetime)) == NULL) {
+        PRINTF("RPL: failed to add link\n");
+        return;
+      }
     }
   }
 
@@ -1080,6 +1435,11 @@ handle_dao_retransmission(void *ptr)
 	     handle_dao_retransmission, parent);
 
   instance->my_dao_transmissions++;
+#if RPL_DAO_AGGREGATION
+  if(RPL_IS_STORING(instance) && dao_aggregation_retransmit(parent)) {
+    return;
+  }
+#endif /* RPL_DAO_AGGREGATION */
   dao_output_target_seq(parent, &prefix,
 			instance->default_lifetime, instance->my_dao_seqno);
 }
@@ -1100,6 +1460,16 @@ dao_output(rpl_parent_t *parent, uint8_t lifetime)
     return;
   }
 
+#if RPL_DAO_AGGREGATION
+  /* A No-Path DAO goes out right away, as the parent may be removed
+     before a hold timer fires. What is held for that parent goes
+     first. */
+  if(lifetime == RPL_ZERO_LIFETIME && dao_target_count > 0 &&
+     dao_aggregation_room(parent) > 0) {
+    dao_aggregation_flush(NULL);
+  }
+#endif /* RPL_DAO_AGGREGATION */
+
   RPL_LOLLIPOP_INCREMENT(dao_sequence);
 #if RPL_WITH_DAO_ACK
   /* set up the state since this will be the first transmission of DAO */
@@ -1120,6 +1490,19 @@ dao_output(rpl_parent_t *parent, uint8_t lifetime)
   parent->dag->instance->has_downward_route = lifetime != RPL_ZERO_LIFETIME;
 #endif /* RPL_WITH_DAO_ACK */
 
+#if RPL_DAO_AGGREGATION
+  if(RPL_IS_STORING(parent->dag->instance)) {
+    if(lifetime == RPL_ZERO_LIFETIME) {
+      dao_output_target_seq(parent, &prefix, lifetime, dao_sequence);
+    } else {
+      /* Send our own target together with the ones we forward */
+      dao_aggregation_add(parent, &prefix, sizeof(prefix) * CHAR_BIT,
+                          lifetime, DAO_TARGET_OWN);
+    }
+    return;
+  }
+#endif /* RPL_DAO_AGGREGATION */
+
   /* Sending a DAO with own prefix as target */
   dao_output_target(parent, &prefix, lifetime);
 }
@@ -1127,6 +1510,14 @@ dao_output(rpl_parent_t *parent, uint8_t lifetime)
 void
 dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
 {
+#if RPL_DAO_AGGREGATION
+  if(parent != NULL && parent->dag != NULL &&
+     RPL_IS_STORING(parent->dag->instance) && prefix != NULL) {
+    dao_aggregation_add(parent, prefix, sizeof(*prefix) * CHAR_BIT,
+                        lifetime, 0);
+    return;
+  }
+#endif /* RPL_DAO_AGGREGATION */
   dao_output_target_seq(parent, prefix, lifetime, dao_sequence);
 }
 /*---------------------------------------------------------------------------*/
@@ -1242,6 +1633,7 @@ dao_output_target_seq(rpl_parent_t *parent, uip_ipaddr_t *prefix,
   PRINTF("\n");
 
   if(dest_ipaddr != NULL) {
+    RPL_STAT(rpl_stats.daos_sent++);
     uip_icmp6_send(dest_ipaddr, ICMP6_RPL, RPL_CODE_DAO, pos);
   }
 }
@@ -1308,11 +1700,26 @@ dao_ack_input(void)
     }
 #endif
 
-  } else if(RPL_IS_STORING(instance)) {
-    /* this DAO ACK should be forwarded to another recently registered route */
+  }
+
+#if RPL_WITH_STORING
+  if(RPL_IS_STORING(instance)) {
+    /* this DAO ACK should be forwarded to other recently registered
+       routes. A DAO may have carried several of them, so the DAO ACK
+       is forwarded once per next hop and incoming seq no. */
     uip_ds6_route_t *re;
+    uip_ds6_route_t *next;
     uip_ipaddr_t *nexthop;
-    if((re = find_route_entry_by_dao_ack(sequence)) != NULL) {
+    int found;
+
+    found = 0;
+    for(re = uip_ds6_route_head(); re != NULL; re = next) {
+      next = uip_ds6_route_next(re);
+      if(re->state.dao_seqno_out != sequence || !RPL_ROUTE_IS_DAO_PENDING(re)) {
+        continue;
+      }
+      found = 1;
+
       /* pick the recorded seq no from that node and forward DAO ACK - and
          clear the pending flag*/
       RPL_ROUTE_CLEAR_DAO_PENDING(re);
@@ -1320,22 +1727,24 @@ dao_ack_input(void)
       nexthop = uip_ds6_route_nexthop(re);
       if(nexthop == NULL) {
         PRINTF("RPL: No next hop to fwd DAO ACK to\n");
-      } else {
+      } else if(!dao_ack_forwarded(re, sequence)) {
         PRINTF("RPL: Fwd DAO ACK to:");
         PRINT6ADDR(nexthop);
         PRINTF("\n");
-        buffer[2] = re->state.dao_seqno_in;
-        uip_icmp6_send(nexthop, ICMP6_RPL, RPL_CODE_DAO_ACK, 4);
+        uip_clear_buf();
+        dao_ack_output(instance, nexthop, re->state.dao_seqno_in, status);
       }
 
       if(status >= RPL_DAO_ACK_UNABLE_TO_ACCEPT) {
         /* this node did not get in to the routing tables above... - remove */
         uip_ds6_route_rm(re);
       }
-    } else {
+    }
+    if(!found && sequence != instance->my_dao_seqno) {
       PRINTF("RPL: No route entry found to forward DAO ACK (seqno %u)\n", sequence);
     }
   }
+#endif /* RPL_WITH_STORING */
 #endif /* RPL_WITH_DAO_ACK */
   uip_clear_buf();
 }
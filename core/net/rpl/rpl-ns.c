@@ -63,6 +63,14 @@ static int num_nodes;
 LIST(nodelist);
 MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
 
+#if RPL_NS_HASH_SIZE
+#if (RPL_NS_HASH_SIZE & (RPL_NS_HASH_SIZE - 1)) != 0
+#error RPL_NS_CONF_HASH_SIZE must be a power of two
+#endif
+/* The nodes, chained by hash of their link identifier */
+static rpl_ns_node_t *node_hash[RPL_NS_HASH_SIZE];
+#endif /* RPL_NS_HASH_SIZE */
+
 /*---------------------------------------------------------------------------*/
 int
 rpl_ns_num_nodes(void)
@@ -80,17 +88,61 @@ node_matches_address(const rpl_dag_t *dag, const rpl_ns_node_t *node, const uip_
       && !memcmp(addr, &node->dag->dag_id, 8)
       && !memcmp(((const unsigned char *)addr) + 8, node->link_identifier, 8);
 }
+#if RPL_NS_HASH_SIZE
+/*---------------------------------------------------------------------------*/
+/* The bucket of a link identifier. Identifiers often differ only in
+ * their last bytes, which the multiplication spreads over the bucket
+ * bits. */
+static rpl_ns_node_t **
+hash_bucket(const unsigned char *link_identifier)
+{
+  uint32_t hash;
+  int i;
+
+  hash = 0;
+  for(i = 0; i < 8; i++) {
+    hash = hash * 33 + link_identifier[i];
+  }
+  hash *= 0x9e3779b1;
+  return &node_hash[(hash ^ (hash >> 16)) & (RPL_NS_HASH_SIZE - 1)];
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(rpl_ns_node_t *node)
+{
+  rpl_ns_node_t **l;
+
+  for(l = hash_bucket(node->link_identifier); *l != NULL; l = &(*l)->hash_next) {
+    if(*l == node) {
+      *l = node->hash_next;
+      return;
+    }
+  }
+}
+#endif /* RPL_NS_HASH_SIZE */
 /*---------------------------------------------------------------------------*/
 rpl_ns_node_t *
 rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
 {
   rpl_ns_node_t *l;
+#if RPL_NS_HASH_SIZE
+  if(addr == NULL) {
+    return NULL;
+  }
+  for(l = *hash_bucket(((const unsigned char *)addr) + 8); l != NULL;
+      l = l->hash_next) {
+    if(node_matches_address(dag, l, addr)) {
+      return l;
+    }
+  }
+#else /* RPL_NS_HASH_SIZE */
   for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
     /* Compare prefix and node identifier */
     if(node_matches_address(dag, l, addr)) {
       return l;
     }
   }
+#endif /* RPL_NS_HASH_SIZE */
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
@@ -123,6 +175,10 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
   rpl_ns_node_t *child_node = rpl_ns_get_node(dag, child);
   rpl_ns_node_t *parent_node = rpl_ns_get_node(dag, parent);
   rpl_ns_node_t *old_parent_node;
+#if RPL_NS_SRH_CACHE_SIZE
+  rpl_ns_node_t *prev_parent_node;
+  rpl_dag_t *prev_dag;
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 
   if(parent != NULL) {
     /* No node for the parent, add one with infinite lifetime */
@@ -142,10 +198,21 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
       return NULL;
     }
     child_node->parent = NULL;
+    child_node->dag = NULL;
+    memcpy(child_node->link_identifier, ((const unsigned char *)child) + 8, 8);
     list_add(nodelist, child_node);
+#if RPL_NS_HASH_SIZE
+    child_node->hash_next = *hash_bucket(child_node->link_identifier);
+    *hash_bucket(child_node->link_identifier) = child_node;
+#endif /* RPL_NS_HASH_SIZE */
     num_nodes++;
   }
 
+#if RPL_NS_SRH_CACHE_SIZE
+  prev_parent_node = child_node->parent;
+  prev_dag = child_node->dag;
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+
   /* Initialize node */
   child_node->dag = dag;
   child_node->lifetime = lifetime;
@@ -167,6 +234,13 @@ rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child, const uip_ipaddr_t
     child_node->parent = parent_node;
   }
 
+#if RPL_NS_SRH_CACHE_SIZE
+  /* Source routes through the node have changed */
+  if(child_node->parent != prev_parent_node || child_node->dag != prev_dag) {
+    rpl_srh_cache_invalidate(child_node);
+  }
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+
   return child_node;
 }
 /*---------------------------------------------------------------------------*/
@@ -176,6 +250,12 @@ rpl_ns_init(void)
   num_nodes = 0;
   memb_init(&nodememb);
   list_init(nodelist);
+#if RPL_NS_HASH_SIZE
+  memset(node_hash, 0, sizeof(node_hash));
+#endif /* RPL_NS_HASH_SIZE */
+#if RPL_NS_SRH_CACHE_SIZE
+  rpl_srh_cache_invalidate(NULL);
+#endif /* RPL_NS_SRH_CACHE_SIZE */
 }
 /*---------------------------------------------------------------------------*/
 rpl_ns_node_t *
@@ -203,6 +283,7 @@ void
 rpl_ns_periodic(void)
 {
   rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
   /* First pass, decrement lifetime for all nodes with non-infinite lifetime */
   for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
     /* Don't touch infinite lifetime nodes */
@@ -211,7 +292,8 @@ rpl_ns_periodic(void)
     }
   }
   /* Second pass, for all expire nodes, deallocate them iff no child points to them */
-  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+  for(l = list_head(nodelist); l != NULL; l = next) {
+    next = list_item_next(l);
     if(l->lifetime == 0) {
       rpl_ns_node_t *l2;
       for(l2 = list_head(nodelist); l2 != NULL; l2 = list_item_next(l2)) {
@@ -219,10 +301,18 @@ rpl_ns_periodic(void)
           break;
         }
       }
-      /* No child found, deallocate node */
-      list_remove(nodelist, l);
-      memb_free(&nodememb, l);
-      num_nodes--;
+      if(l2 == NULL) {
+        /* No child found, deallocate node */
+#if RPL_NS_SRH_CACHE_SIZE
+        rpl_srh_cache_invalidate(l);
+#endif /* RPL_NS_SRH_CACHE_SIZE */
+#if RPL_NS_HASH_SIZE
+        hash_remove(l);
+#endif /* RPL_NS_HASH_SIZE */
+        list_remove(nodelist, l);
+        memb_free(&nodememb, l);
+        num_nodes--;
+      }
     }
   }
 }
@@ -49,8 +49,36 @@
 #define RPL_NS_LINK_NUM 32
 #endif /* RPL_NS_CONF_LINK_NUM */
 
+/* Number of buckets, a power of two, of the hash table that finds
+ * nodes by address. When 0, lookups walk the list of all nodes. */
+#ifdef RPL_NS_CONF_HASH_SIZE
+#define RPL_NS_HASH_SIZE RPL_NS_CONF_HASH_SIZE
+#else /* RPL_NS_CONF_HASH_SIZE */
+#define RPL_NS_HASH_SIZE 0
+#endif /* RPL_NS_CONF_HASH_SIZE */
+
+/* Number of source routing headers the root keeps for reuse, indexed
+ * by destination. A header is dropped when a node on its path changes
+ * parent or is removed. */
+#ifdef RPL_NS_CONF_SRH_CACHE_SIZE
+#define RPL_NS_SRH_CACHE_SIZE RPL_NS_CONF_SRH_CACHE_SIZE
+#else /* RPL_NS_CONF_SRH_CACHE_SIZE */
+#define RPL_NS_SRH_CACHE_SIZE 0
+#endif /* RPL_NS_CONF_SRH_CACHE_SIZE */
+
+/* Space for the compressed addresses of a cached header. Longer
+ * source routes are built for every packet. */
+#ifdef RPL_NS_CONF_SRH_CACHE_ADDR_LEN
+#define RPL_NS_SRH_CACHE_ADDR_LEN RPL_NS_CONF_SRH_CACHE_ADDR_LEN
+#else /* RPL_NS_CONF_SRH_CACHE_ADDR_LEN */
+#define RPL_NS_SRH_CACHE_ADDR_LEN 32
+#endif /* RPL_NS_CONF_SRH_CACHE_ADDR_LEN */
+
 typedef struct rpl_ns_node {
   struct rpl_ns_node *next;
+#if RPL_NS_HASH_SIZE
+  struct rpl_ns_node *hash_next;
+#endif /* RPL_NS_HASH_SIZE */
   uint32_t lifetime;
   rpl_dag_t *dag;
   /* Store only IPv6 link identifiers as all nodes in the DAG share the same prefix */
@@ -123,6 +123,33 @@
 #define RPL_DAO_DELAY                 (CLOCK_SECOND * 4)
 #endif /* RPL_CONF_DAO_DELAY */
 
+/* Storing-mode routers hold the DAO targets they send upwards, their
+   own and the ones forwarded for their sub-DODAG, for up to
+   RPL_DAO_AGGREGATION_DELAY and send them to the parent as one DAO
+   with several Target options. 0 sends every DAO on its own. */
+#ifdef RPL_CONF_DAO_AGGREGATION_DELAY
+#define RPL_DAO_AGGREGATION_DELAY     RPL_CONF_DAO_AGGREGATION_DELAY
+#else /* RPL_CONF_DAO_AGGREGATION_DELAY */
+#define RPL_DAO_AGGREGATION_DELAY     0
+#endif /* RPL_CONF_DAO_AGGREGATION_DELAY */
+
+/* Number of targets that can be held for aggregation */
+#ifdef RPL_CONF_DAO_AGGREGATION_TARGETS
+#define RPL_DAO_AGGREGATION_TARGETS   RPL_CONF_DAO_AGGREGATION_TARGETS
+#else /* RPL_CONF_DAO_AGGREGATION_TARGETS */
+#define RPL_DAO_AGGREGATION_TARGETS   8
+#endif /* RPL_CONF_DAO_AGGREGATION_TARGETS */
+
+/* Largest DAO payload an aggregated DAO may use. Defaults to what
+   fits in uip_buf together with the RPL hop-by-hop option; lower it
+   to keep aggregated DAOs within one link-layer frame. */
+#ifdef RPL_CONF_DAO_AGGREGATION_MAX_LEN
+#define RPL_DAO_AGGREGATION_MAX_LEN   RPL_CONF_DAO_AGGREGATION_MAX_LEN
+#else /* RPL_CONF_DAO_AGGREGATION_MAX_LEN */
+#define RPL_DAO_AGGREGATION_MAX_LEN   (UIP_BUFSIZE - UIP_LLH_LEN - \
+                                       UIP_IPICMPH_LEN - RPL_HOP_BY_HOP_LEN)
+#endif /* RPL_CONF_DAO_AGGREGATION_MAX_LEN */
+
 /* Delay between reception of a no-path DAO and actual route removal */
 #ifdef RPL_CONF_NOPATH_REMOVAL_DELAY
 #define RPL_NOPATH_REMOVAL_DELAY          RPL_CONF_NOPATH_REMOVAL_DELAY
@@ -318,6 +345,7 @@ struct rpl_stats {
   uint16_t loop_errors;
   uint16_t loop_warnings;
   uint16_t root_repairs;
+  uint16_t daos_sent;
 };
 typedef struct rpl_stats rpl_stats_t;
 
@@ -396,6 +424,9 @@ void rpl_reset_periodic_timer(void);
 /* Route poisoning. */
 void rpl_poison_routes(rpl_dag_t *, rpl_parent_t *);
 
+/* Source routing header cache. */
+void rpl_srh_cache_invalidate(const rpl_ns_node_t *node);
+
 
 rpl_instance_t *rpl_get_default_instance(void);
 
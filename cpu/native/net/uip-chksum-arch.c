@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Internet checksum for native targets, summed in host byte
+ *         order a 32-bit word at a time (RFC 1071, section 2), with
+ *         SSE2 for long buffers on x86.
+ */
+
+#include "net/ip/uip.h"
+
+#include <string.h>
+
+#if UIP_ARCH_CHKSUM_ADD
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+/* Shorter buffers are not worth setting up the vector registers */
+#define SSE2_MIN_LEN 64
+
+/*---------------------------------------------------------------------------*/
+uint16_t
+uip_chksum_add(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint64_t acc = 0;
+  uint32_t word;
+  uint16_t half;
+
+#if defined(__SSE2__)
+  if(len >= SSE2_MIN_LEN) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = zero;
+    __m128i hi = zero;
+    uint32_t lanes[4];
+
+    /* Each 32-bit lane gets one 16-bit word per 16 bytes, it cannot
+       overflow within 64 kB */
+    while(len >= 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)data);
+      lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v, zero));
+      hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v, zero));
+      data += 16;
+      len -= 16;
+    }
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi32(lo, hi));
+    acc = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+#endif /* __SSE2__ */
+
+  while(len >= 4) {
+    memcpy(&word, data, sizeof(word));
+    acc += word;
+    data += 4;
+    len -= 4;
+  }
+  if(len >= 2) {
+    memcpy(&half, data, sizeof(half));
+    acc += half;
+    data += 2;
+    len -= 2;
+  }
+  if(len > 0) {
+    /* the trailing byte is the high byte of a big endian word */
+#if UIP_BYTE_ORDER == UIP_LITTLE_ENDIAN
+    acc += data[0];
+#else
+    acc += (uint16_t)data[0] << 8;
+#endif
+  }
+
+  while(acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+#if UIP_BYTE_ORDER == UIP_LITTLE_ENDIAN
+  /* the one's complement sum is byte order independent up to a swap */
+  acc = ((acc & 0xff) << 8) | (acc >> 8);
+#endif
+
+  acc += sum;
+  acc = (acc & 0xffff) + (acc >> 16);
+
+  /* Return sum in host byte order. */
+  return (uint16_t)acc;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* UIP_ARCH_CHKSUM_ADD */
@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Correctness and throughput of uip_chksum_add() and the
+ *         incremental checksum update. Results are compared against the
+ *         byte pair checksum uIP used before, at every alignment and
+ *         length up to MAX_LEN. Build once with the architecture version
+ *         and once with the generic one to compare them:
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=UIP_ARCH_CHKSUM_ADD=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_LEN      300
+#define BENCH_LEN    1280
+#define BENCH_BYTES  (64UL * 1024 * 1024)
+#define UPDATE_RUNS  10000
+
+static uint8_t buf[BENCH_LEN + 8];
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(chksum_benchmark_process, "Checksum benchmark");
+AUTOSTART_PROCESSES(&chksum_benchmark_process);
+/*---------------------------------------------------------------------------*/
+/* The checksum loop of uip6.c before uip_chksum_add() */
+static uint16_t
+reference_chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+  uint16_t t;
+  const uint8_t *dataptr;
+  const uint8_t *last_byte;
+
+  dataptr = data;
+  last_byte = data + len - 1;
+
+  while(dataptr < last_byte) {
+    t = (dataptr[0] << 8) + dataptr[1];
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+    dataptr += 2;
+  }
+
+  if(dataptr == last_byte) {
+    t = (dataptr[0] << 8) + 0;
+    sum += t;
+    if(sum < t) {
+      sum++;
+    }
+  }
+
+  return sum;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int ok)
+{
+  if(!ok) {
+    failures++;
+  }
+  printf("chksum: %s %s\n", name, ok ? "OK" : "FAILED");
+}
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(uint8_t *data, uint16_t len, int pattern)
+{
+  uint16_t i;
+
+  for(i = 0; i < len; i++) {
+    switch(pattern) {
+    case 0:
+      data[i] = rand();
+      break;
+    case 1:
+      data[i] = 0xff;
+      break;
+    default:
+      data[i] = 0;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_add(void)
+{
+  int pattern;
+  int offset;
+  uint16_t len;
+  uint16_t sum;
+  int ok = 1;
+
+  for(pattern = 0; pattern < 3; pattern++) {
+    for(offset = 0; offset < 8; offset++) {
+      fill(buf, sizeof(buf), pattern);
+      for(len = 0; len <= MAX_LEN; len++) {
+        sum = pattern == 0 ? rand() : 0xffff;
+        if(uip_chksum_add(sum, buf + offset, len) !=
+           reference_chksum(sum, buf + offset, len)) {
+          printf("chksum: mismatch pattern %d offset %d len %u\n",
+                 pattern, offset, len);
+          ok = 0;
+        }
+      }
+    }
+  }
+  check("sum matches byte pair reference", ok);
+
+  /* Sums split at even offsets must equal the sum of the whole buffer */
+  fill(buf, sizeof(buf), 0);
+  sum = uip_chksum_add(0, buf, 100);
+  sum = uip_chksum_add(sum, buf + 100, 201);
+  check("split sum", sum == uip_chksum_add(0, buf, 301));
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_update(void)
+{
+  uint8_t old_field[16];
+  uint16_t chksum;
+  uint16_t expected;
+  uint16_t old_sum;
+  uint16_t new_sum;
+  uint16_t old16;
+  uint16_t new16;
+  int offset;
+  int i;
+  int ok = 1;
+
+  for(i = 0; i < UPDATE_RUNS; i++) {
+    fill(buf, 200, i & 0xff ? 0 : 1);
+    chksum = uip_htons(~uip_chksum_add(0, buf, 200));
+
+    /* Replace a 16-byte address at an even offset */
+    offset = (rand() % 92) * 2;
+    memcpy(old_field, buf + offset, sizeof(old_field));
+    old_sum = uip_chksum_add(0, old_field, sizeof(old_field));
+    fill(buf + offset, sizeof(old_field), i & 1 ? 0 : 2);
+    new_sum = uip_chksum_add(0, buf + offset, sizeof(old_field));
+    chksum = uip_chksum_update(chksum, old_sum, new_sum);
+    expected = uip_htons(~uip_chksum_add(0, buf, 200));
+    /* 0x0000 and 0xffff are both a valid one's complement zero */
+    if(chksum != expected && (uint16_t)(chksum + expected) != 0xffff) {
+      ok = 0;
+    }
+
+    /* Rewrite a port */
+    offset = (rand() % 100) * 2;
+    memcpy(&old16, buf + offset, 2);
+    new16 = rand();
+    memcpy(buf + offset, &new16, 2);
+    chksum = uip_chksum_update16(chksum, old16, new16);
+    expected = uip_htons(~uip_chksum_add(0, buf, 200));
+    if(chksum != expected && (uint16_t)(chksum + expected) != 0xffff) {
+      ok = 0;
+    }
+  }
+  check("incremental update matches recompute", ok);
+
+  /* Verification over the whole buffer must still succeed */
+  memcpy(buf + 200, &chksum, 2);
+  check("updated checksum verifies",
+        uip_chksum_add(0, buf, 202) == 0xffff);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(const char *name, uint16_t len, int offset,
+      uint16_t (*f)(uint16_t, const uint8_t *, uint16_t))
+{
+  static volatile uint16_t sink;
+  unsigned long runs;
+  unsigned long i;
+  double start;
+  double elapsed;
+
+  runs = BENCH_BYTES / len;
+  start = now();
+  for(i = 0; i < runs; i++) {
+    sink = f(sink, buf + offset, len);
+  }
+  elapsed = now() - start;
+  printf("chksum: %-9s len %4u offset %d: %7.1f MB/s\n",
+         name, len, offset, runs * len / elapsed / 1e6);
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench_all(void)
+{
+  static const uint16_t lens[] = { 8, 40, 127, 1280 };
+  int i;
+
+  fill(buf, sizeof(buf), 0);
+  printf("chksum: UIP_ARCH_CHKSUM_ADD %d\n", UIP_ARCH_CHKSUM_ADD);
+  for(i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+    bench("reference", lens[i], 0, reference_chksum);
+    bench("add", lens[i], 0, uip_chksum_add);
+    bench("add", lens[i], 1, uip_chksum_add);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chksum_benchmark_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  srand(1);
+  test_add();
+  test_update();
+  bench_all();
+  printf("chksum: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
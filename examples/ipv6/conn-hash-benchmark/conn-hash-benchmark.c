@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Cost of demultiplexing incoming UDP datagrams and TCP
+ *         segments as connections are opened. Packets are passed to
+ *         uIP for the connection opened last, which a scan of the
+ *         connection table finds last. Datagrams for every connection
+ *         and for connections sharing a port check that the hash
+ *         tables pick the connection the scan picks.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=UIP_CONF_CONN_HASH_SIZE=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS        20000
+#define PEER_PORT     4000
+#define SHARED_PORT   5000
+#define PAYLOAD_LEN   16
+
+#define UIP_IP_BUF    ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF   ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define UIP_TCP_BUF   ((struct uip_tcp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+static const uint16_t steps[] = { 1, 10, 50, 100, 200 };
+static uip_ipaddr_t peer_addr;
+static uip_ipaddr_t other_addr;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(conn_hash_benchmark_process, "Connection hash benchmark");
+AUTOSTART_PROCESSES(&conn_hash_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+ip_header(const uip_ipaddr_t *from, uint8_t proto, uint16_t len)
+{
+  memset(UIP_IP_BUF, 0, UIP_IPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[0] = (len - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (len - UIP_IPH_LEN) & 0xff;
+  UIP_IP_BUF->proto = proto;
+  UIP_IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, from);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr,
+                  &uip_ds6_get_link_local(-1)->ipaddr);
+  uip_len = len;
+  uip_ext_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* A datagram from a peer to a local port; zero checksums are not
+   checked */
+static void
+input_udp(const uip_ipaddr_t *from, uint16_t port)
+{
+  ip_header(from, UIP_PROTO_UDP, UIP_IPUDPH_LEN + PAYLOAD_LEN);
+  UIP_UDP_BUF->srcport = UIP_HTONS(PEER_PORT);
+  UIP_UDP_BUF->destport = port;
+  UIP_UDP_BUF->udplen = UIP_HTONS(UIP_UDPH_LEN + PAYLOAD_LEN);
+  UIP_UDP_BUF->udpchksum = 0;
+  memset(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], 'u', PAYLOAD_LEN);
+  uip_udp_conn = NULL;
+  uip_input();
+}
+/*---------------------------------------------------------------------------*/
+/* An out of window segment, which the connection acknowledges */
+static void
+input_tcp(const uip_ipaddr_t *from, uint16_t port)
+{
+  ip_header(from, UIP_PROTO_TCP, UIP_IPTCPH_LEN + PAYLOAD_LEN);
+  memset(UIP_TCP_BUF, 0, UIP_TCPH_LEN);
+  UIP_TCP_BUF->srcport = UIP_HTONS(PEER_PORT);
+  UIP_TCP_BUF->destport = port;
+  UIP_TCP_BUF->seqno[2] = 0x10;
+  UIP_TCP_BUF->tcpoffset = 5 << 4;
+  UIP_TCP_BUF->flags = 0x10;
+  UIP_TCP_BUF->wnd[0] = 1;
+  memset(&uip_buf[UIP_LLH_LEN + UIP_IPTCPH_LEN], 't', PAYLOAD_LEN);
+  UIP_TCP_BUF->tcpchksum = ~(uip_tcpchksum());
+  uip_conn = NULL;
+  uip_input();
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int ok)
+{
+  if(ok) {
+    printf("hash: %s OK\n", name);
+  } else {
+    printf("hash: %s FAILED\n", name);
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_udp(void)
+{
+  struct uip_udp_conn *conns[UIP_UDP_CONNS];
+  struct uip_udp_conn *bound;
+  struct uip_udp_conn *any;
+  double start;
+  int count;
+  int ok;
+  int i;
+  int j;
+
+  count = 0;
+  for(i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    start = now();
+    while(count < steps[i]) {
+      conns[count] = uip_udp_new(&peer_addr, UIP_HTONS(PEER_PORT));
+      if(conns[count] == NULL) {
+        printf("hash: udp FAILED, no connection %d\n", count);
+        failures++;
+        return;
+      }
+      count++;
+    }
+    printf("hash: udp %3d connections, %6.2f us per connection opened,",
+           count, (now() - start) * 1e6 / (count - (i ? steps[i - 1] : 0)));
+    start = now();
+    for(j = 0; j < ROUNDS; j++) {
+      input_udp(&peer_addr, conns[count - 1]->lport);
+    }
+    printf(" %5.3f us per datagram\n", (now() - start) * 1e6 / ROUNDS);
+  }
+
+  ok = 1;
+  for(i = 0; i < count; i++) {
+    for(j = 0; j < i; j++) {
+      ok = ok && conns[i]->lport != conns[j]->lport;
+    }
+  }
+  check("udp ports", ok);
+
+  ok = 1;
+  for(i = 0; i < count; i++) {
+    input_udp(&peer_addr, conns[i]->lport);
+    ok = ok && uip_udp_conn == conns[i];
+  }
+  check("udp demultiplexing", ok);
+
+  /* Two connections on a port, the first bound to another peer */
+  uip_udp_remove(conns[10]);
+  uip_udp_remove(conns[20]);
+  bound = conns[10];
+  any = conns[20];
+  uip_ipaddr_copy(&bound->ripaddr, &other_addr);
+  uip_udp_bind(bound, UIP_HTONS(SHARED_PORT));
+  memset(&any->ripaddr, 0, sizeof(any->ripaddr));
+  uip_udp_bind(any, UIP_HTONS(SHARED_PORT));
+  input_udp(&other_addr, UIP_HTONS(SHARED_PORT));
+  ok = uip_udp_conn == bound;
+  input_udp(&peer_addr, UIP_HTONS(SHARED_PORT));
+  ok = ok && uip_udp_conn == any;
+  uip_udp_remove(bound);
+  input_udp(&other_addr, UIP_HTONS(SHARED_PORT));
+  ok = ok && uip_udp_conn == any;
+  check("udp shared port", ok);
+
+  uip_udp_remove(any);
+  input_udp(&peer_addr, UIP_HTONS(SHARED_PORT));
+  check("udp closed port",
+        uip_len > 0 && UIP_IP_BUF->proto == UIP_PROTO_ICMP6);
+
+  for(i = 0; i < count; i++) {
+    uip_udp_remove(conns[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_tcp(void)
+{
+  struct uip_conn *conns[UIP_CONNS];
+  double start;
+  int count;
+  int ok;
+  int i;
+  int j;
+
+  count = 0;
+  for(i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    start = now();
+    while(count < steps[i]) {
+      conns[count] = uip_connect(&peer_addr, UIP_HTONS(PEER_PORT));
+      if(conns[count] == NULL) {
+        printf("hash: tcp FAILED, no connection %d\n", count);
+        failures++;
+        return;
+      }
+      conns[count]->tcpstateflags = UIP_ESTABLISHED;
+      count++;
+    }
+    printf("hash: tcp %3d connections, %6.2f us per connection opened,",
+           count, (now() - start) * 1e6 / (count - (i ? steps[i - 1] : 0)));
+    start = now();
+    for(j = 0; j < ROUNDS; j++) {
+      input_tcp(&peer_addr, conns[count - 1]->lport);
+    }
+    printf(" %5.3f us per segment\n", (now() - start) * 1e6 / ROUNDS);
+  }
+
+  ok = 1;
+  for(i = 0; i < count; i++) {
+    input_tcp(&peer_addr, conns[i]->lport);
+    ok = ok && uip_conn == conns[i];
+  }
+  check("tcp demultiplexing", ok);
+
+  for(i = 0; i < count; i++) {
+    conns[i]->tcpstateflags = UIP_CLOSED;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(conn_hash_benchmark_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  uip_ip6addr(&peer_addr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  uip_ip6addr(&other_addr, 0xfe80, 0, 0, 0, 0, 0, 0, 3);
+  printf("hash: %d buckets\n", UIP_CONN_HASH_SIZE);
+
+  test_udp();
+  test_tcp();
+
+  printf("hash: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
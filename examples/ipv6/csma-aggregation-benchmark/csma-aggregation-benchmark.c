@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Frame aggregation in CSMA. Sensors behind the node send small
+ *         notifications to its parent, a neighbor gets occasional
+ *         control-sized packets and the parent an occasional packet
+ *         that needs fragmentation. A stub RDC layer captures the
+ *         frames, which are fed back through 6LoWPAN to check that
+ *         every packet is delivered once and in order. Reports the
+ *         frames sent, the radio-on time of the sender under two
+ *         models and the goodput over the time the channel is busy:
+ *
+ *         - csma: CCA, the frame and its ACK, as with nullrdc
+ *         - contikimac: unicast strobes last half a channel check
+ *           interval on average, without phase lock
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=CSMA_CONF_WITH_AGGREGATION=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "net/mac/rdc.h"
+#include "net/rime/rime.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ROUNDS          400
+#define ROUND_TIME      (CLOCK_SECOND / 100)
+#define SENSORS         4
+#define FLOWS           (SENSORS + 2)
+#define NOTIFY_LEN      16
+#define CONTROL_LEN     40
+#define LARGE_LEN       200
+#define MAX_FRAMES      64
+#define PORT            0xf0b1
+
+/* Radio timings of a 2.4 GHz 802.15.4 radio, in microseconds */
+#define BYTE_US         32
+#define PHY_HDR_LEN     6
+#define CCA_US          128
+#define TURNAROUND_US   192
+#define ACK_US          (TURNAROUND_US + 11 * BYTE_US)
+#define CHECK_RATE      8
+
+#define UIP_IP_BUF      ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+struct frame {
+  linkaddr_t receiver;
+  uint8_t len;
+  uint8_t data[PACKETBUF_SIZE];
+};
+
+static struct frame frames[MAX_FRAMES];
+static int frame_count;
+static linkaddr_t neighbors[2];
+static uip_ipaddr_t src_addr;
+static uip_ipaddr_t dest_addr[2];
+static uint16_t next_seqno[FLOWS];
+static uint16_t last_seqno[FLOWS];
+static uint32_t packets_sent;
+static uint32_t packets_delivered;
+static uint32_t bytes_delivered;
+static uint32_t frames_sent;
+static uint32_t frames_aggregated;
+static uint32_t frames_oversized;
+static uint32_t frames_lost;
+static uint64_t csma_us;
+static uint64_t contikimac_us;
+static int order_failures;
+static int failures;
+static uint32_t seed = 1;
+/*---------------------------------------------------------------------------*/
+PROCESS(csma_aggregation_benchmark_process, "CSMA aggregation benchmark");
+AUTOSTART_PROCESSES(&csma_aggregation_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rand16(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+  int len;
+
+  queuebuf_to_packetbuf(list->buf);
+  if(linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &neighbors[0]) ||
+     linkaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), &neighbors[1])) {
+    len = NETSTACK_FRAMER.length() + packetbuf_datalen() + 2;
+    frames_sent++;
+    if(*(uint8_t *)packetbuf_dataptr() == SICSLOWPAN_DISPATCH_AGGREGATE) {
+      frames_aggregated++;
+    }
+    if(len > 127) {
+      frames_oversized++;
+    }
+    csma_us += CCA_US + TURNAROUND_US + (PHY_HDR_LEN + len) * BYTE_US + ACK_US;
+    contikimac_us += 1000000 / CHECK_RATE / 2 + (PHY_HDR_LEN + len) * BYTE_US + ACK_US;
+
+    if(frame_count < MAX_FRAMES) {
+      linkaddr_copy(&frames[frame_count].receiver,
+                    packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+      frames[frame_count].len = packetbuf_datalen();
+      memcpy(frames[frame_count].data, packetbuf_dataptr(), packetbuf_datalen());
+      frame_count++;
+    } else {
+      frames_lost++;
+    }
+  }
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send(mac_callback_t sent, void *ptr)
+{
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+rdc_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+rdc_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+rdc_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver bench_rdc_driver = {
+  "bench-rdc",
+  rdc_init,
+  rdc_send,
+  rdc_send_list,
+  rdc_input,
+  rdc_on,
+  rdc_off,
+  rdc_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+/* Every packet that 6LoWPAN delivers to IP */
+static void
+sniffer_input(void)
+{
+  uint8_t *payload = &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + UIP_UDPH_LEN];
+  uint8_t flow;
+  uint16_t seqno;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_UDP ||
+     uip_len < UIP_IPH_LEN + UIP_UDPH_LEN + 3) {
+    return;
+  }
+  flow = payload[0];
+  seqno = (payload[1] << 8) | payload[2];
+  if(flow >= FLOWS || seqno != last_seqno[flow] + 1) {
+    order_failures++;
+  } else {
+    last_seqno[flow] = seqno;
+  }
+  packets_delivered++;
+  bytes_delivered += uip_len - UIP_IPH_LEN - UIP_UDPH_LEN;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* A UDP packet of a flow, from the node to a neighbor */
+static void
+send_packet(int flow, int neighbor, uint16_t len)
+{
+  uint8_t *ip = (uint8_t *)UIP_IP_BUF;
+  uint16_t seqno = ++next_seqno[flow];
+  int i;
+
+  memset(ip, 0, UIP_IPH_LEN + UIP_UDPH_LEN);
+  ip[0] = 0x60;
+  ip[4] = (len - UIP_IPH_LEN) >> 8;
+  ip[5] = (len - UIP_IPH_LEN) & 0xff;
+  ip[6] = UIP_PROTO_UDP;
+  ip[7] = 64;
+  memcpy(&ip[8], &src_addr, sizeof(src_addr));
+  memcpy(&ip[24], &dest_addr[neighbor], sizeof(dest_addr[neighbor]));
+  ip[UIP_IPH_LEN] = PORT >> 8;
+  ip[UIP_IPH_LEN + 1] = PORT & 0xff;
+  ip[UIP_IPH_LEN + 2] = PORT >> 8;
+  ip[UIP_IPH_LEN + 3] = PORT & 0xff;
+  ip[UIP_IPH_LEN + 4] = (len - UIP_IPH_LEN) >> 8;
+  ip[UIP_IPH_LEN + 5] = (len - UIP_IPH_LEN) & 0xff;
+  ip[UIP_IPH_LEN + UIP_UDPH_LEN] = flow;
+  ip[UIP_IPH_LEN + UIP_UDPH_LEN + 1] = seqno >> 8;
+  ip[UIP_IPH_LEN + UIP_UDPH_LEN + 2] = seqno & 0xff;
+  for(i = UIP_IPH_LEN + UIP_UDPH_LEN + 3; i < len; i++) {
+    ip[i] = flow ^ (i * 7);
+  }
+
+  uip_len = len;
+  packets_sent++;
+  tcpip_output((uip_lladdr_t *)&neighbors[neighbor]);
+  uip_clear_buf();
+}
+/*---------------------------------------------------------------------------*/
+/* The neighbors receive the captured frames; the node stands in for them */
+static void
+deliver_frames(void)
+{
+  static struct frame copy[MAX_FRAMES];
+  int count;
+  int i;
+
+  count = frame_count;
+  memcpy(copy, frames, count * sizeof(copy[0]));
+  frame_count = 0;
+  for(i = 0; i < count; i++) {
+    packetbuf_clear();
+    packetbuf_copyfrom(copy[i].data, copy[i].len);
+    packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+    packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &copy[i].receiver);
+    NETSTACK_NETWORK.input();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int ok)
+{
+  printf("csma-aggr: %s %s\n", name, ok ? "OK" : "FAILED");
+  if(!ok) {
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(csma_aggregation_benchmark_process, ev, data)
+{
+  static struct etimer et;
+  static int round;
+  int i;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < 2; i++) {
+    memset(&neighbors[i], 0, sizeof(linkaddr_t));
+    neighbors[i].u8[0] = 0x02;
+    neighbors[i].u8[LINKADDR_SIZE - 1] = 0x10 + i;
+    /* Stateless addresses, that IPHC elides with context 0 */
+    uip_ip6addr(&dest_addr[i], UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&dest_addr[i], (uip_lladdr_t *)&neighbors[i]);
+    uip_ds6_addr_add(&dest_addr[i], 0, ADDR_MANUAL);
+  }
+  uip_ip6addr(&src_addr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&src_addr, (uip_lladdr_t *)&linkaddr_node_addr);
+
+  rime_sniffer_add(&sniffer);
+
+  etimer_set(&et, ROUND_TIME);
+  for(round = 0; round < ROUNDS; round++) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+    deliver_frames();
+
+    for(i = 0; i < SENSORS; i++) {
+      if(rand16() % 4 == 0) {
+        send_packet(i, 0, UIP_IPH_LEN + UIP_UDPH_LEN + NOTIFY_LEN);
+      }
+    }
+    if(round % 25 == 0) {
+      send_packet(SENSORS, 1, UIP_IPH_LEN + UIP_UDPH_LEN + CONTROL_LEN);
+    }
+    if(round % 50 == 25) {
+      send_packet(SENSORS + 1, 0, UIP_IPH_LEN + UIP_UDPH_LEN + LARGE_LEN);
+    }
+  }
+
+  /* Wait until CSMA has sent the queued frames */
+  while(queuebuf_numfree() < QUEUEBUF_NUM) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+  }
+  deliver_frames();
+
+  printf("csma-aggr: %lu packets in %lu frames (%lu aggregates)\n",
+         (unsigned long)packets_sent, (unsigned long)frames_sent,
+         (unsigned long)frames_aggregated);
+  printf("csma-aggr: radio on, csma %lu ms (%lu us per packet), contikimac %lu ms (%lu us per packet)\n",
+         (unsigned long)(csma_us / 1000),
+         (unsigned long)(csma_us / MAX(packets_delivered, 1)),
+         (unsigned long)(contikimac_us / 1000),
+         (unsigned long)(contikimac_us / MAX(packets_delivered, 1)));
+  printf("csma-aggr: goodput %lu kbit/s of channel time\n",
+         (unsigned long)(bytes_delivered * 8000ULL / MAX(csma_us, 1)));
+
+  check("delivery", packets_delivered == packets_sent && frames_lost == 0);
+  check("order", order_failures == 0);
+  check("frame size", frames_oversized == 0);
+#if CSMA_CONF_WITH_AGGREGATION
+  check("aggregation", frames_aggregated > 0 && frames_sent < packets_sent);
+#endif /* CSMA_CONF_WITH_AGGREGATION */
+
+  printf("csma-aggr: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
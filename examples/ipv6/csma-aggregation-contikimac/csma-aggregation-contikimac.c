@@ -0,0 +1,399 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Frame aggregation in CSMA over ContikiMAC and link-layer
+ *         security. ContikiMAC creates and secures a frame before it
+ *         first sends it; when the receiver does not answer, CSMA
+ *         retransmits that frame while more packets have joined the
+ *         queue. The frame must go out unchanged, and the new packets
+ *         in frames of their own. A stub radio captures every
+ *         transmission, and the acknowledged frames are parsed and
+ *         authenticated as a receiver would, then fed back through
+ *         6LoWPAN to check that every packet is delivered once and in
+ *         order. Packets queued while no frame has been created
+ *         still share a frame.
+ *
+ *         make TARGET=native
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ip/uip-udp-packet.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "net/mac/frame802154.h"
+#include "net/rime/rime.h"
+#include "dev/radio.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PACKETS         3
+#define NOTIFY_LEN      16
+#define MAX_FRAMES      8
+#define PORT            0xf0b1
+
+#define UIP_IP_BUF      ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+struct frame {
+  uint8_t len;
+  uint8_t data[PACKETBUF_SIZE];
+};
+
+static uint8_t tx_buf[PACKETBUF_SIZE];
+static unsigned short tx_len;
+static int acking;
+static struct frame frames[MAX_FRAMES];
+static int frame_count;
+static uint32_t transmissions;
+static uint32_t frames_malformed;
+static uint32_t frames_lost;
+static uint32_t frames_unauthentic;
+static uint32_t frames_aggregated;
+static linkaddr_t neighbor;
+static uip_ipaddr_t src_addr;
+static uip_ipaddr_t dest_addr;
+static uint16_t next_seqno;
+static uint16_t last_seqno;
+static uint32_t packets_sent;
+static uint32_t packets_delivered;
+static int order_failures;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(csma_aggregation_contikimac_process, "CSMA aggregation over ContikiMAC");
+AUTOSTART_PROCESSES(&csma_aggregation_contikimac_process);
+/*---------------------------------------------------------------------------*/
+static int
+radio_init(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_prepare(const void *payload, unsigned short payload_len)
+{
+  tx_len = MIN(payload_len, sizeof(tx_buf));
+  memcpy(tx_buf, payload, tx_len);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Every strobe must be a secured data frame. The neighbor acknowledges
+   unicast frames once acking is on, and those are kept for delivery. */
+static int
+radio_transmit(unsigned short transmit_len)
+{
+  frame802154_t frame;
+
+  transmissions++;
+  if(frame802154_parse(tx_buf, tx_len, &frame) == 0 ||
+     frame.fcf.frame_type != FRAME802154_DATAFRAME ||
+     !frame.fcf.security_enabled) {
+    frames_malformed++;
+    return RADIO_TX_NOACK;
+  }
+  if(frame802154_is_broadcast_addr(frame.fcf.dest_addr_mode,
+                                   frame.dest_addr)) {
+    return RADIO_TX_OK;
+  }
+  if(!acking) {
+    return RADIO_TX_NOACK;
+  }
+  if(frame_count < MAX_FRAMES) {
+    frames[frame_count].len = tx_len;
+    memcpy(frames[frame_count].data, tx_buf, tx_len);
+    frame_count++;
+  } else {
+    frames_lost++;
+  }
+  return RADIO_TX_OK;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_send(const void *payload, unsigned short payload_len)
+{
+  radio_prepare(payload, payload_len);
+  return radio_transmit(payload_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_read(void *buf, unsigned short buf_len)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+channel_clear(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+receiving_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+pending_packet(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+radio_off(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_value(radio_param_t param, radio_value_t *value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_value(radio_param_t param, radio_value_t value)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+get_object(radio_param_t param, void *dest, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+static radio_result_t
+set_object(radio_param_t param, const void *src, size_t size)
+{
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_driver bench_radio_driver = {
+  radio_init,
+  radio_prepare,
+  radio_transmit,
+  radio_send,
+  radio_read,
+  channel_clear,
+  receiving_packet,
+  pending_packet,
+  radio_on,
+  radio_off,
+  get_value,
+  set_value,
+  get_object,
+  set_object
+};
+/*---------------------------------------------------------------------------*/
+/* Every packet that 6LoWPAN delivers to IP */
+static void
+sniffer_input(void)
+{
+  uint8_t *payload = &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + UIP_UDPH_LEN];
+  uint16_t seqno;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_UDP ||
+     uip_len < UIP_IPH_LEN + UIP_UDPH_LEN + 2) {
+    return;
+  }
+  seqno = (payload[0] << 8) | payload[1];
+  if(seqno != last_seqno + 1) {
+    order_failures++;
+  } else {
+    last_seqno = seqno;
+  }
+  packets_delivered++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* A UDP packet from the node to the neighbor */
+static void
+send_packet(void)
+{
+  uint8_t *ip = (uint8_t *)UIP_IP_BUF;
+  uint16_t len = UIP_IPH_LEN + UIP_UDPH_LEN + NOTIFY_LEN;
+  uint16_t seqno = ++next_seqno;
+  int i;
+
+  memset(ip, 0, UIP_IPH_LEN + UIP_UDPH_LEN);
+  ip[0] = 0x60;
+  ip[4] = (len - UIP_IPH_LEN) >> 8;
+  ip[5] = (len - UIP_IPH_LEN) & 0xff;
+  ip[6] = UIP_PROTO_UDP;
+  ip[7] = 64;
+  memcpy(&ip[8], &src_addr, sizeof(src_addr));
+  memcpy(&ip[24], &dest_addr, sizeof(dest_addr));
+  ip[UIP_IPH_LEN] = PORT >> 8;
+  ip[UIP_IPH_LEN + 1] = PORT & 0xff;
+  ip[UIP_IPH_LEN + 2] = PORT >> 8;
+  ip[UIP_IPH_LEN + 3] = PORT & 0xff;
+  ip[UIP_IPH_LEN + 4] = (len - UIP_IPH_LEN) >> 8;
+  ip[UIP_IPH_LEN + 5] = (len - UIP_IPH_LEN) & 0xff;
+  ip[UIP_IPH_LEN + UIP_UDPH_LEN] = seqno >> 8;
+  ip[UIP_IPH_LEN + UIP_UDPH_LEN + 1] = seqno & 0xff;
+  for(i = UIP_IPH_LEN + UIP_UDPH_LEN + 2; i < len; i++) {
+    ip[i] = i * 7;
+  }
+
+  uip_len = len;
+  packets_sent++;
+  tcpip_output((uip_lladdr_t *)&neighbor);
+  uip_clear_buf();
+}
+/*---------------------------------------------------------------------------*/
+/* The neighbor parses and authenticates the acknowledged frames; the
+   node stands in for it */
+static void
+deliver_frames(void)
+{
+  linkaddr_t node_addr;
+  int i;
+
+  linkaddr_copy(&node_addr, &linkaddr_node_addr);
+  for(i = 0; i < frame_count; i++) {
+    int ok;
+
+    packetbuf_clear();
+    packetbuf_copyfrom(frames[i].data, frames[i].len);
+    linkaddr_set_node_addr(&neighbor);
+    ok = NETSTACK_FRAMER.parse() >= 0;
+    linkaddr_set_node_addr(&node_addr);
+    if(!ok) {
+      frames_unauthentic++;
+      continue;
+    }
+    if(*(uint8_t *)packetbuf_dataptr() == SICSLOWPAN_DISPATCH_AGGREGATE) {
+      frames_aggregated++;
+    }
+    NETSTACK_NETWORK.input();
+  }
+  frame_count = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int ok)
+{
+  printf("csma-aggr-cmac: %s %s\n", name, ok ? "OK" : "FAILED");
+  if(!ok) {
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(csma_aggregation_contikimac_process, ev, data)
+{
+  static struct etimer et;
+  static struct uip_udp_conn *conn;
+  int i;
+
+  PROCESS_BEGIN();
+
+  neighbor.u8[0] = 0x02;
+  neighbor.u8[LINKADDR_SIZE - 1] = 0x10;
+  /* A stateless address, that IPHC elides with context 0 */
+  uip_ip6addr(&dest_addr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&dest_addr, (uip_lladdr_t *)&neighbor);
+  uip_ds6_addr_add(&dest_addr, 0, ADDR_MANUAL);
+  uip_ip6addr(&src_addr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&src_addr, (uip_lladdr_t *)&linkaddr_node_addr);
+
+  /* The delivered packets end here, rather than in ICMP errors */
+  conn = udp_new(NULL, 0, NULL);
+  udp_bind(conn, UIP_HTONS(PORT));
+
+  rime_sniffer_add(&sniffer);
+
+  /* The first packet goes out alone, and is not acknowledged: ContikiMAC
+     keeps it created and secured for the retransmissions */
+  send_packet();
+  etimer_set(&et, CLOCK_SECOND / 100);
+  while(transmissions == 0) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+  }
+
+  /* More packets join the queue before a retransmission */
+  for(i = 1; i < PACKETS; i++) {
+    send_packet();
+  }
+  acking = 1;
+
+  /* Wait until CSMA has sent the queued frames */
+  while(queuebuf_numfree() < QUEUEBUF_NUM) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+  }
+  deliver_frames();
+
+  /* Packets that find no frame created yet share one */
+  for(i = 0; i < PACKETS; i++) {
+    send_packet();
+  }
+  while(queuebuf_numfree() < QUEUEBUF_NUM) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+  }
+  deliver_frames();
+
+  printf("csma-aggr-cmac: %lu packets, %lu transmissions, %lu aggregates\n",
+         (unsigned long)packets_sent, (unsigned long)transmissions,
+         (unsigned long)frames_aggregated);
+
+  check("frames", frames_malformed == 0 && frames_unauthentic == 0 &&
+        frames_lost == 0);
+  check("delivery", packets_delivered == packets_sent);
+  check("order", order_failures == 0);
+  check("aggregation", frames_aggregated == 1);
+
+  printf("csma-aggr-cmac: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
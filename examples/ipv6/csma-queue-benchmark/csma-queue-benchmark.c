@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         CSMA queues under mixed traffic. Two neighbors get a steady
+ *         stream of normal (bulk) packets that is enough to keep the
+ *         channel busy on its own, while high priority packets (e.g.
+ *         CoAP ACKs) and control packets (e.g. RPL) go to random
+ *         neighbors. A stub RDC layer stands for a channel that sends
+ *         one frame per tick. Reports the drops and the queueing delay,
+ *         in ticks, of every class, and checks that every packet gets
+ *         exactly one callback, that each neighbor queue stays in
+ *         priority order and FIFO within a class, and that the CSMA
+ *         queue statistics account for every frame sent.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=PACKETBUF_CONF_WITH_PRIORITY=0,CSMA_CONF_WITH_FAIR_SHARE=0,CSMA_CONF_NEIGHBOR_HASH_SIZE=0
+ */
+
+#include "contiki.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "net/mac/csma.h"
+#include "net/mac/rdc.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NEIGHBORS      6
+#define TICKS          20000
+#define DRAIN_TICKS    200
+#define PAYLOAD_LEN    60
+#define MAGIC          0xbe
+
+#define CLASSES        PACKETBUF_ATTR_PRIORITY_NUM
+
+struct bench_hdr {
+  uint8_t magic;
+  uint8_t neighbor;
+  uint8_t class;
+  uint16_t seqno;
+  uint32_t tick;
+};
+
+struct class_result {
+  uint32_t offered;
+  uint32_t ok;
+  uint32_t dropped;
+  uint32_t delivered;
+  uint32_t delay_sum;
+  uint32_t delay_max;
+};
+
+/* Frames handed to the stub RDC layer, one per neighbor at most */
+struct pending_frame {
+  mac_callback_t sent;
+  void *ptr;
+  struct queuebuf *buf;
+};
+
+static const char *class_names[CLASSES] = { "normal", "high", "control" };
+static struct class_result results[CLASSES];
+static struct pending_frame pending[CSMA_CONF_MAX_NEIGHBOR_QUEUES + 1];
+static int pending_count;
+static linkaddr_t neighbors[NEIGHBORS];
+static uint16_t next_seqno[NEIGHBORS][CLASSES];
+static uint16_t last_seqno[NEIGHBORS][CLASSES];
+static uint32_t frames_sent[CSMA_NUM_PRIORITIES];
+static int order_failures;
+static int priority_failures;
+static int failures;
+static uint32_t seed = 1;
+/*---------------------------------------------------------------------------*/
+PROCESS(csma_queue_benchmark_process, "CSMA queue benchmark");
+AUTOSTART_PROCESSES(&csma_queue_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rand16(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+frame_priority(struct queuebuf *buf)
+{
+#if PACKETBUF_WITH_PRIORITY
+  return queuebuf_attr(buf, PACKETBUF_ATTR_PRIORITY);
+#else /* PACKETBUF_WITH_PRIORITY */
+  return 0;
+#endif /* PACKETBUF_WITH_PRIORITY */
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send(mac_callback_t sent, void *ptr)
+{
+  mac_call_sent_callback(sent, ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *list)
+{
+  struct rdc_buf_list *q;
+
+  /* Behind the head, which may have been queued before packets of a
+     higher class, the queue is in priority order */
+  for(q = list->next; q != NULL && q->next != NULL; q = q->next) {
+    if(frame_priority(q->buf) < frame_priority(q->next->buf)) {
+      priority_failures++;
+    }
+  }
+  /* Only the head is sent, as by RDC layers that do not burst */
+  if(pending_count < sizeof(pending) / sizeof(pending[0])) {
+    pending[pending_count].sent = sent;
+    pending[pending_count].ptr = ptr;
+    pending[pending_count].buf = list->buf;
+    pending_count++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+rdc_on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+rdc_off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+rdc_channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rdc_init(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver bench_rdc_driver = {
+  "bench-rdc",
+  rdc_init,
+  rdc_send,
+  rdc_send_list,
+  rdc_input,
+  rdc_on,
+  rdc_off,
+  rdc_channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+static void
+packet_sent(void *ptr, int status, int num_tx)
+{
+  struct class_result *r = ptr;
+  if(status == MAC_TX_OK) {
+    r->ok++;
+  } else {
+    r->dropped++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+offer(int neighbor, int class, int tick)
+{
+  struct bench_hdr hdr;
+
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = MAGIC;
+  hdr.neighbor = neighbor;
+  hdr.class = class;
+  hdr.seqno = ++next_seqno[neighbor][class];
+  hdr.tick = tick;
+
+  packetbuf_clear();
+  memset(packetbuf_dataptr(), 0, PAYLOAD_LEN);
+  memcpy(packetbuf_dataptr(), &hdr, sizeof(hdr));
+  packetbuf_set_datalen(PAYLOAD_LEN);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &neighbors[neighbor]);
+#if PACKETBUF_WITH_PRIORITY
+  packetbuf_set_attr(PACKETBUF_ATTR_PRIORITY, class);
+#endif /* PACKETBUF_WITH_PRIORITY */
+
+  results[class].offered++;
+  NETSTACK_MAC.send(packet_sent, &results[class]);
+}
+/*---------------------------------------------------------------------------*/
+/* The channel sends the oldest frame handed to the RDC layer */
+static void
+channel_tick(int tick)
+{
+  struct pending_frame frame;
+  struct bench_hdr hdr;
+
+  if(pending_count == 0) {
+    return;
+  }
+  frame = pending[0];
+  pending_count--;
+  memmove(&pending[0], &pending[1], pending_count * sizeof(pending[0]));
+
+  queuebuf_to_packetbuf(frame.buf);
+  frames_sent[MIN(frame_priority(frame.buf), CSMA_NUM_PRIORITIES - 1)]++;
+  memcpy(&hdr, packetbuf_dataptr(), sizeof(hdr));
+  if(packetbuf_datalen() == PAYLOAD_LEN && hdr.magic == MAGIC) {
+    struct class_result *r = &results[hdr.class];
+    uint32_t delay = tick - hdr.tick;
+    r->delivered++;
+    r->delay_sum += delay;
+    if(delay > r->delay_max) {
+      r->delay_max = delay;
+    }
+    if(hdr.seqno <= last_seqno[hdr.neighbor][hdr.class]) {
+      order_failures++;
+    }
+    last_seqno[hdr.neighbor][hdr.class] = hdr.seqno;
+  }
+  mac_call_sent_callback(frame.sent, frame.ptr, MAC_TX_OK, 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int ok)
+{
+  printf("csma-queue: %s %s\n", name, ok ? "OK" : "FAILED");
+  if(!ok) {
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(csma_queue_benchmark_process, ev, data)
+{
+  static int tick;
+  static int i;
+  static double cpu;
+  double start;
+  int c;
+  int ok;
+
+  PROCESS_BEGIN();
+
+  /* Last bytes 1, 2, 3, 5, 6, 9: some neighbors share a hash bucket */
+  for(i = 0; i < NEIGHBORS; i++) {
+    static const uint8_t last_bytes[NEIGHBORS] = { 1, 2, 3, 5, 6, 9 };
+    memset(&neighbors[i], 0, sizeof(linkaddr_t));
+    neighbors[i].u8[0] = 0x02;
+    neighbors[i].u8[LINKADDR_SIZE - 1] = last_bytes[i];
+  }
+  csma_reset_queue_stats();
+  memset(frames_sent, 0, sizeof(frames_sent));
+
+  for(tick = 0; tick < TICKS + DRAIN_TICKS; tick++) {
+    start = now();
+    if(tick < TICKS) {
+      /* Bulk transfers to the first two neighbors */
+      if(rand16() % 2 == 0) {
+        offer(0, PACKETBUF_ATTR_PRIORITY_NORMAL, tick);
+      }
+      if(rand16() % 2 == 0) {
+        offer(1, PACKETBUF_ATTR_PRIORITY_NORMAL, tick);
+      }
+      if(tick % 10 == 0) {
+        offer(rand16() % NEIGHBORS, PACKETBUF_ATTR_PRIORITY_HIGH, tick);
+      }
+      if(tick % 25 == 0) {
+        offer(rand16() % NEIGHBORS, PACKETBUF_ATTR_PRIORITY_CONTROL, tick);
+      }
+    }
+    cpu += now() - start;
+
+    /* Let the CSMA timers hand the queue heads to the RDC layer */
+    for(i = 0; i < 3; i++) {
+      PROCESS_PAUSE();
+    }
+
+    start = now();
+    channel_tick(tick);
+    cpu += now() - start;
+  }
+
+  for(c = 0; c < CLASSES; c++) {
+    struct class_result *r = &results[c];
+    printf("csma-queue: %s: offered %lu dropped %lu delay mean %lu max %lu ticks\n",
+           class_names[c], (unsigned long)r->offered, (unsigned long)r->dropped,
+           (unsigned long)(r->delivered > 0 ? r->delay_sum / r->delivered : 0),
+           (unsigned long)r->delay_max);
+  }
+  printf("csma-queue: %.2f us per packet\n",
+         cpu * 1e6 / (results[0].offered + results[1].offered + results[2].offered));
+
+  ok = 1;
+  for(c = 0; c < CLASSES; c++) {
+    ok &= results[c].ok + results[c].dropped == results[c].offered
+      && results[c].ok == results[c].delivered;
+  }
+  check("callbacks", ok);
+  check("fifo within class", order_failures == 0);
+  check("priority order", priority_failures == 0);
+  ok = 1;
+  for(c = 0; c < CSMA_NUM_PRIORITIES; c++) {
+    ok &= csma_get_queue_stats(c)->packets == frames_sent[c];
+  }
+  check("queue stats", ok);
+
+  printf("csma-queue: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+/* Frames are queued by CSMA and handed to a stub RDC layer that
+   stands for a shared channel */
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC               csma_driver
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC               bench_rdc_driver
+
+#ifndef PACKETBUF_CONF_WITH_PRIORITY
+#define PACKETBUF_CONF_WITH_PRIORITY    1
+#endif /* PACKETBUF_CONF_WITH_PRIORITY */
+
+#ifndef CSMA_CONF_WITH_FAIR_SHARE
+#define CSMA_CONF_WITH_FAIR_SHARE       1
+#endif /* CSMA_CONF_WITH_FAIR_SHARE */
+
+#ifndef CSMA_CONF_NEIGHBOR_HASH_SIZE
+#define CSMA_CONF_NEIGHBOR_HASH_SIZE    4
+#endif /* CSMA_CONF_NEIGHBOR_HASH_SIZE */
+
+#define CSMA_CONF_WITH_QUEUE_STATS      1
+#define CSMA_CONF_MAX_NEIGHBOR_QUEUES   8
+#undef QUEUEBUF_CONF_NUM
+#define QUEUEBUF_CONF_NUM               16
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Functional test of DAO aggregation at a storing-mode RPL
+ *         router. The node joins a DODAG below a parent, then DAOs
+ *         arrive from CHILDREN children, one for each child and one
+ *         for each of its DESCENDANTS, as after a global repair. The
+ *         DAOs the node sends to its parent are captured and must
+ *         carry every target, and each DAO ACK from the parent must be
+ *         passed down once for every DAO that asked for one. Also
+ *         checks DAOs with several targets and lifetimes, No-Path
+ *         DAOs, targets with a prefix longer than an address, that a
+ *         retransmission of our DAO repeats it target for target, and
+ *         that our No-Path DAO leaves when the parent is removed.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DAO_AGGREGATION_DELAY=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/packetbuf.h"
+#include "net/rpl/rpl-private.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHILDREN         8
+#define DESCENDANTS      3
+#define PARENT           0xff
+#define LIFETIME         20
+#define SHORT_LIFETIME   10
+#define MAX_TARGETS      64
+#define MAX_DAOS         64
+
+#define UIP_IP_BUF       ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_ICMP_BUF     ((struct uip_icmp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define UIP_ICMP_PAYLOAD ((unsigned char *)&uip_buf[UIP_LLIPH_LEN + UIP_ICMPH_LEN])
+
+/* A target in a DAO sent to the parent */
+struct target {
+  uip_ipaddr_t prefix;
+  uint8_t lifetime;
+};
+
+/* A DAO sent by a child, or a DAO ACK sent to one */
+struct dao {
+  uint8_t child;
+  uint8_t seq;
+  uint8_t status;
+};
+
+static struct target targets[MAX_TARGETS];
+static int target_count;
+/* Sequence numbers of the DAOs sent to the parent and their first
+   targets */
+static uint8_t dao_seqs[MAX_DAOS];
+static int dao_first[MAX_DAOS];
+static int dao_count;
+static clock_time_t last_dao_time;
+static struct dao child_daos[MAX_DAOS];
+static int child_dao_count;
+static struct dao acks[MAX_DAOS];
+static int ack_count;
+static uint8_t child_seq[CHILDREN + 1];
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(dao_aggregation_test_process, "DAO aggregation test");
+AUTOSTART_PROCESSES(&dao_aggregation_test_process);
+/*---------------------------------------------------------------------------*/
+static void
+node_addr(uip_ipaddr_t *addr, linkaddr_t *lladdr, int node)
+{
+  memset(lladdr, 0, sizeof(*lladdr));
+  lladdr->u8[1] = 0x12;
+  lladdr->u8[2] = 0x4b;
+  lladdr->u8[LINKADDR_SIZE - 1] = node;
+  uip_ip6addr(addr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(addr, (uip_lladdr_t *)lladdr);
+}
+/*---------------------------------------------------------------------------*/
+/* Descendant 0 is the child itself */
+static void
+target_addr(uip_ipaddr_t *addr, int child, int descendant)
+{
+  uip_ip6addr(addr, 0xfd00, 0, 0, 0, 0x0212, 0x4b00, descendant, child);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+capture_output(const uip_lladdr_t *lladdr)
+{
+  unsigned char *buffer;
+  int buffer_length;
+  int first;
+  int i;
+
+  if(UIP_IP_BUF->proto != UIP_PROTO_ICMP6 ||
+     UIP_ICMP_BUF->type != ICMP6_RPL) {
+    return 0;
+  }
+  buffer = UIP_ICMP_PAYLOAD;
+  buffer_length = uip_len - UIP_IPICMPH_LEN;
+
+  if(UIP_ICMP_BUF->icode == RPL_CODE_DAO && dao_count < MAX_DAOS) {
+    dao_first[dao_count] = target_count;
+    dao_seqs[dao_count++] = buffer[3];
+    last_dao_time = clock_time();
+    /* A Transit option applies to the Target options before it */
+    first = target_count;
+    for(i = (buffer[1] & RPL_DAO_D_FLAG) ? 20 : 4; i < buffer_length;
+        i += 2 + buffer[i + 1]) {
+      if(buffer[i] == RPL_OPTION_TARGET && buffer[i + 3] <= 128 &&
+         target_count < MAX_TARGETS) {
+        memset(&targets[target_count].prefix, 0, sizeof(uip_ipaddr_t));
+        memcpy(&targets[target_count].prefix, buffer + i + 4,
+               (buffer[i + 3] + 7) / 8);
+        target_count++;
+      } else if(buffer[i] == RPL_OPTION_TRANSIT) {
+        for(; first < target_count; first++) {
+          targets[first].lifetime = buffer[i + 5];
+        }
+      }
+    }
+  } else if(UIP_ICMP_BUF->icode == RPL_CODE_DAO_ACK && ack_count < MAX_DAOS) {
+    acks[ack_count].child = UIP_IP_BUF->destipaddr.u8[15];
+    acks[ack_count].seq = buffer[2];
+    acks[ack_count].status = buffer[3];
+    ack_count++;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+deliver(int from, uint8_t code, const uint8_t *payload, int len)
+{
+  uip_ipaddr_t addr;
+  linkaddr_t lladdr;
+
+  node_addr(&addr, &lladdr, from);
+  uip_clear_buf();
+  memset(UIP_IP_BUF, 0, UIP_IPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->proto = UIP_PROTO_ICMP6;
+  UIP_IP_BUF->ttl = 64;
+  UIP_IP_BUF->len[1] = UIP_ICMPH_LEN + len;
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &addr);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr,
+                  &uip_ds6_get_link_local(-1)->ipaddr);
+  UIP_ICMP_BUF->type = ICMP6_RPL;
+  UIP_ICMP_BUF->icode = code;
+  memcpy(UIP_ICMP_PAYLOAD, payload, len);
+  uip_len = UIP_IPICMPH_LEN + len;
+  UIP_ICMP_BUF->icmpchksum = 0;
+  UIP_ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+
+  packetbuf_clear();
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &lladdr);
+  tcpip_input();
+}
+/*---------------------------------------------------------------------------*/
+/* A DAO from child for count of its descendants, each with its
+   lifetime */
+static void
+child_dao(int child, const int *descendants, const uint8_t *lifetimes,
+          int count)
+{
+  uint8_t buffer[128];
+  uip_ipaddr_t prefix;
+  int pos;
+  int i;
+
+  pos = 0;
+  buffer[pos++] = RPL_DEFAULT_INSTANCE;
+  buffer[pos++] = lifetimes[0] != RPL_ZERO_LIFETIME ? RPL_DAO_K_FLAG : 0;
+  buffer[pos++] = 0;
+  buffer[pos++] = ++child_seq[child];
+  for(i = 0; i < count; i++) {
+    target_addr(&prefix, child, descendants[i]);
+    buffer[pos++] = RPL_OPTION_TARGET;
+    buffer[pos++] = 18;
+    buffer[pos++] = 0;
+    buffer[pos++] = 128;
+    memcpy(buffer + pos, &prefix, 16);
+    pos += 16;
+    if(i == count - 1 || lifetimes[i + 1] != lifetimes[i]) {
+      buffer[pos++] = RPL_OPTION_TRANSIT;
+      buffer[pos++] = 4;
+      buffer[pos++] = 0;
+      buffer[pos++] = 0;
+      buffer[pos++] = 0;
+      buffer[pos++] = lifetimes[i];
+    }
+  }
+
+  if(buffer[1] & RPL_DAO_K_FLAG) {
+    child_daos[child_dao_count].child = child;
+    child_daos[child_dao_count].seq = buffer[3];
+    child_dao_count++;
+  }
+  deliver(child, RPL_CODE_DAO, buffer, pos);
+}
+/*---------------------------------------------------------------------------*/
+/* A DAO from child with a target longer than an address, then one for
+   descendant */
+static void
+long_prefix_dao(int child, int descendant)
+{
+  uint8_t buffer[128];
+  uip_ipaddr_t prefix;
+  int pos;
+
+  pos = 0;
+  buffer[pos++] = RPL_DEFAULT_INSTANCE;
+  buffer[pos++] = 0;
+  buffer[pos++] = 0;
+  buffer[pos++] = ++child_seq[child];
+  buffer[pos++] = RPL_OPTION_TARGET;
+  buffer[pos++] = 34;
+  buffer[pos++] = 0;
+  buffer[pos++] = 255;
+  memset(buffer + pos, 0xff, 32);
+  pos += 32;
+  target_addr(&prefix, child, descendant);
+  buffer[pos++] = RPL_OPTION_TARGET;
+  buffer[pos++] = 18;
+  buffer[pos++] = 0;
+  buffer[pos++] = 128;
+  memcpy(buffer + pos, &prefix, 16);
+  pos += 16;
+  buffer[pos++] = RPL_OPTION_TRANSIT;
+  buffer[pos++] = 4;
+  buffer[pos++] = 0;
+  buffer[pos++] = 0;
+  buffer[pos++] = 0;
+  buffer[pos++] = LIFETIME;
+  deliver(child, RPL_CODE_DAO, buffer, pos);
+}
+/*---------------------------------------------------------------------------*/
+/* The parent acknowledges every DAO sent to it */
+static void
+ack_daos(void)
+{
+  uint8_t buffer[4];
+  int i;
+
+  for(i = 0; i < dao_count; i++) {
+    buffer[0] = RPL_DEFAULT_INSTANCE;
+    buffer[1] = 0;
+    buffer[2] = dao_seqs[i];
+    buffer[3] = RPL_DAO_ACK_UNCONDITIONAL_ACCEPT;
+    deliver(PARENT, RPL_CODE_DAO_ACK, buffer, 4);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Every DAO from a child got exactly one DAO ACK */
+static int
+check_acks(void)
+{
+  int found;
+  int i;
+  int j;
+
+  if(ack_count != child_dao_count) {
+    return 0;
+  }
+  for(i = 0; i < child_dao_count; i++) {
+    found = 0;
+    for(j = 0; j < ack_count; j++) {
+      found += acks[j].child == child_daos[i].child &&
+        acks[j].seq == child_daos[i].seq &&
+        acks[j].status == RPL_DAO_ACK_UNCONDITIONAL_ACCEPT;
+    }
+    if(found != 1) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* The last DAO sent to the parent repeats the earlier one with the
+   same sequence number */
+static int
+check_retransmission(void)
+{
+  int first;
+  int last;
+  int count;
+  int i;
+
+  last = dao_count - 1;
+  for(first = 0; first < last; first++) {
+    if(dao_seqs[first] == dao_seqs[last]) {
+      break;
+    }
+  }
+  if(last < 1 || first == last) {
+    return 0;
+  }
+  count = dao_first[first + 1] - dao_first[first];
+  if(count == 0 || target_count - dao_first[last] != count) {
+    return 0;
+  }
+  for(i = 0; i < count; i++) {
+    if(!uip_ipaddr_cmp(&targets[dao_first[first] + i].prefix,
+                       &targets[dao_first[last] + i].prefix)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+sent_upwards(const uip_ipaddr_t *prefix, uint8_t lifetime)
+{
+  int i;
+
+  for(i = 0; i < target_count; i++) {
+    if(uip_ipaddr_cmp(&targets[i].prefix, prefix) &&
+       targets[i].lifetime == lifetime) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* The route is in place, with about the lifetime from the DAO, and
+   the target was sent to the parent */
+static int
+check_route(int child, int descendant, uint8_t lifetime)
+{
+  uip_ipaddr_t prefix;
+  uip_ipaddr_t addr;
+  linkaddr_t lladdr;
+  uip_ds6_route_t *rep;
+
+  target_addr(&prefix, child, descendant);
+  node_addr(&addr, &lladdr, child);
+  rep = uip_ds6_route_lookup(&prefix);
+  return rep != NULL && uip_ds6_route_nexthop(rep) != NULL &&
+    uip_ipaddr_cmp(uip_ds6_route_nexthop(rep), &addr) &&
+    (lifetime == RPL_ZERO_LIFETIME ?
+     RPL_ROUTE_IS_NOPATH_RECEIVED(rep) :
+     (rep->state.lifetime <= RPL_LIFETIME(default_instance, lifetime) &&
+      rep->state.lifetime + 10 > RPL_LIFETIME(default_instance, lifetime))) &&
+    sent_upwards(&prefix, lifetime);
+}
+/*---------------------------------------------------------------------------*/
+static void
+reset(void)
+{
+  target_count = 0;
+  dao_count = 0;
+  child_dao_count = 0;
+  ack_count = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, int ok)
+{
+  if(ok) {
+    printf("dao: %s OK\n", name);
+  } else {
+    printf("dao: %s FAILED\n", name);
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(dao_aggregation_test_process, ev, data)
+{
+  static struct etimer et;
+  static clock_time_t start;
+  static const int several[] = { 4, 5, 6 };
+  static const uint8_t lifetimes[] = { LIFETIME, LIFETIME, SHORT_LIFETIME };
+  static const uint8_t nopath = RPL_ZERO_LIFETIME;
+  static const uint8_t lifetime = LIFETIME;
+  rpl_dio_t dio;
+  uip_ipaddr_t addr;
+  linkaddr_t lladdr;
+  int ok;
+  int i;
+  int j;
+
+  PROCESS_BEGIN();
+
+  tcpip_set_outputfunc(capture_output);
+
+  /* Join the DODAG of the parent */
+  memset(&dio, 0, sizeof(dio));
+  dio.instance_id = RPL_DEFAULT_INSTANCE;
+  dio.version = RPL_LOLLIPOP_INIT;
+  dio.rank = RPL_MIN_HOPRANKINC;
+  dio.grounded = 1;
+  dio.mop = RPL_MOP_DEFAULT;
+  dio.preference = RPL_PREFERENCE;
+  dio.ocp = RPL_OF_OCP;
+  dio.dag_intdoubl = RPL_DIO_INTERVAL_DOUBLINGS;
+  dio.dag_intmin = RPL_DIO_INTERVAL_MIN;
+  dio.dag_redund = RPL_DIO_REDUNDANCY;
+  dio.dag_max_rankinc = RPL_MAX_RANKINC;
+  dio.dag_min_hoprankinc = RPL_MIN_HOPRANKINC;
+  dio.default_lifetime = RPL_DEFAULT_LIFETIME;
+  dio.lifetime_unit = RPL_DEFAULT_LIFETIME_UNIT;
+  dio.mc.type = RPL_DAG_MC;
+  target_addr(&dio.dag_id, PARENT, 0);
+  uip_ip6addr(&dio.prefix_info.prefix, 0xfd00, 0, 0, 0, 0, 0, 0, 0);
+  dio.prefix_info.length = 64;
+  dio.prefix_info.flags = UIP_ND6_RA_FLAG_AUTONOMOUS;
+  dio.prefix_info.lifetime = 0xffffffff;
+
+  node_addr(&addr, &lladdr, PARENT);
+  packetbuf_clear();
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &lladdr);
+  rpl_process_dio(&addr, &dio);
+  report("join", default_instance != NULL &&
+         default_instance->current_dag->preferred_parent != NULL);
+
+  /* Our own DAO */
+  etimer_set(&et, 2 * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  ack_daos();
+  report("own DAO", dao_count == 1 && target_count == 1 &&
+         uip_ipaddr_cmp(&targets[0].prefix, &uip_ds6_get_global(-1)->ipaddr) &&
+         rpl_has_downward_route());
+
+  /* All children and their descendants register again, as after a
+     global repair, and so do we */
+  reset();
+  start = clock_time();
+  dao_output(default_instance->current_dag->preferred_parent,
+             default_instance->default_lifetime);
+  for(i = 1; i <= CHILDREN; i++) {
+    for(j = 0; j <= DESCENDANTS; j++) {
+      child_dao(i, &j, &lifetime, 1);
+    }
+  }
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  printf("dao: %d targets sent to the parent in %d DAOs, the last after %lu ms\n",
+         target_count, dao_count,
+         (unsigned long)((last_dao_time - start) * 1000 / CLOCK_SECOND));
+
+  ok = target_count == CHILDREN * (DESCENDANTS + 1) + 1 &&
+    sent_upwards(&uip_ds6_get_global(-1)->ipaddr,
+                 default_instance->default_lifetime);
+  for(i = 1; i <= CHILDREN; i++) {
+    for(j = 0; j <= DESCENDANTS; j++) {
+      ok = ok && check_route(i, j, LIFETIME);
+    }
+  }
+  report("burst", ok);
+  ack_daos();
+  report("burst DAO ACKs", check_acks());
+
+  /* A DAO with several targets and lifetimes */
+  reset();
+  child_dao(1, several, lifetimes, 3);
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  report("several targets", target_count == 3 &&
+         check_route(1, several[0], lifetimes[0]) &&
+         check_route(1, several[1], lifetimes[1]) &&
+         check_route(1, several[2], lifetimes[2]));
+  ack_daos();
+  report("several targets DAO ACK", check_acks());
+
+  /* A descendant goes away */
+  reset();
+  i = 1;
+  child_dao(2, &i, &nopath, 1);
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  report("No-Path", target_count == 1 && check_route(2, 1, RPL_ZERO_LIFETIME));
+
+  /* Only the target that fits in an address is used */
+  reset();
+  long_prefix_dao(5, DESCENDANTS + 1);
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  report("long prefix", target_count == 1 &&
+         check_route(5, DESCENDANTS + 1, LIFETIME));
+  ack_daos();
+
+  /* Our DAO goes unacknowledged, together with a child's target */
+  reset();
+  dao_output(default_instance->current_dag->preferred_parent,
+             default_instance->default_lifetime);
+  i = 0;
+  child_dao(3, &i, &lifetime, 1);
+  etimer_set(&et, RPL_DAO_RETRANSMISSION_TIMEOUT + CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  report("retransmission", check_retransmission());
+  ack_daos();
+
+  /* The parent is removed while a child's target is held for it: both
+     that target and our No-Path DAO reach it before it goes */
+  reset();
+  i = DESCENDANTS + 2;
+  child_dao(4, &i, &lifetime, 1);
+  rpl_remove_parent(default_instance->current_dag->preferred_parent);
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  target_addr(&addr, 4, DESCENDANTS + 2);
+  report("parent removed", sent_upwards(&addr, LIFETIME) &&
+         sent_upwards(&uip_ds6_get_global(-1)->ipaddr, RPL_ZERO_LIFETIME));
+
+  printf("dao: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Firmware for the dao-grid.csc simulation. Node 1 is the
+ *         RPL root and prints the DAO aggregation delay it was built
+ *         with. REPAIR_TIME after boot it drops its routes and starts
+ *         a global repair, then prints its number of routes whenever
+ *         it changes. Every node prints how many DAOs it has sent. The
+ *         simulation script takes the convergence time and the DAO
+ *         count of the repair from the "repair", "routes" and "daos"
+ *         lines. Run it with DAO_AGGREGATION_DELAY=0 in the
+ *         environment to compare with forwarding every DAO on its own.
+ */
+
+#include "contiki.h"
+#include "sys/node-id.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/rpl/rpl-private.h"
+
+#include <stdio.h>
+
+#define REPAIR_TIME     (300 * CLOCK_SECOND)
+#define POLL_INTERVAL   (CLOCK_SECOND / 8)
+#define PRINT_INTERVAL  (10 * CLOCK_SECOND)
+/*---------------------------------------------------------------------------*/
+PROCESS(dao_node_process, "DAO aggregation grid node");
+AUTOSTART_PROCESSES(&dao_node_process);
+/*---------------------------------------------------------------------------*/
+static void
+create_rpl_dag(void)
+{
+  uip_ipaddr_t ipaddr;
+  rpl_dag_t *dag;
+
+  uip_ip6addr(&ipaddr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+
+  dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &ipaddr);
+  if(dag != NULL) {
+    rpl_set_prefix(dag, &ipaddr, 64);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(dao_node_process, ev, data)
+{
+  static struct etimer print_timer;
+  static struct etimer poll_timer;
+  static struct etimer repair_timer;
+  static int routes;
+  uip_ds6_route_t *r;
+
+  PROCESS_BEGIN();
+
+  if(node_id == 1) {
+    printf("aggregation delay %u\n", (unsigned)RPL_DAO_AGGREGATION_DELAY);
+    create_rpl_dag();
+    etimer_set(&repair_timer, REPAIR_TIME);
+    etimer_set(&poll_timer, POLL_INTERVAL);
+  }
+  etimer_set(&print_timer, PRINT_INTERVAL);
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+
+    if(etimer_expired(&print_timer)) {
+      etimer_reset(&print_timer);
+      printf("daos %u\n", rpl_stats.daos_sent);
+    }
+    if(node_id != 1) {
+      continue;
+    }
+
+    if(data == &repair_timer) {
+      /* Every node has to register again for its route to come back */
+      while((r = uip_ds6_route_head()) != NULL) {
+        uip_ds6_route_rm(r);
+      }
+      rpl_repair_root(RPL_DEFAULT_INSTANCE);
+      printf("repair\n");
+    }
+    if(etimer_expired(&poll_timer)) {
+      etimer_reset(&poll_timer);
+      if(uip_ds6_route_num_routes() != routes) {
+        routes = uip_ds6_route_num_routes();
+        printf("routes %d\n", routes);
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Firmware for the frag-forwarding-chain.csc simulation. Node 1
+ *         is the RPL root and counts what it receives, node CHAIN_LENGTH
+ *         at the other end of the chain sends a PACKET_LEN byte UDP
+ *         packet to it every SEND_INTERVAL, the nodes in between route.
+ *         The simulation script takes the latency from the "send" and
+ *         "recv" lines.
+ */
+
+#include "contiki.h"
+#include "sys/node-id.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/rpl/rpl.h"
+#include "simple-udp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define UDP_PORT       5678
+#define CHAIN_LENGTH   7
+#define PACKET_LEN     1024
+#define SEND_INTERVAL  (10 * CLOCK_SECOND)
+/* Let the DODAG form before the first packet */
+#define START_DELAY    (60 * CLOCK_SECOND)
+
+static struct simple_udp_connection conn;
+static uint8_t buf[PACKET_LEN];
+/*---------------------------------------------------------------------------*/
+PROCESS(chain_node_process, "Fragment forwarding chain node");
+AUTOSTART_PROCESSES(&chain_node_process);
+/*---------------------------------------------------------------------------*/
+static void
+receiver(struct simple_udp_connection *c,
+         const uip_ipaddr_t *sender_addr,
+         uint16_t sender_port,
+         const uip_ipaddr_t *receiver_addr,
+         uint16_t receiver_port,
+         const uint8_t *data,
+         uint16_t datalen)
+{
+  uint32_t seq;
+
+  if(datalen == PACKET_LEN) {
+    memcpy(&seq, data, sizeof(seq));
+    printf("recv %lu\n", (unsigned long)seq);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_rpl_dag(void)
+{
+  uip_ipaddr_t ipaddr;
+  rpl_dag_t *dag;
+
+  uip_ip6addr(&ipaddr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+
+  dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &ipaddr);
+  if(dag != NULL) {
+    rpl_set_prefix(dag, &ipaddr, 64);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(chain_node_process, ev, data)
+{
+  static struct etimer et;
+  static uint32_t seq;
+  static rpl_dag_t *dag;
+  static const struct sicslowpan_reass_stats *stats;
+
+  PROCESS_BEGIN();
+
+  simple_udp_register(&conn, UDP_PORT, NULL, UDP_PORT, receiver);
+  stats = sicslowpan_get_reass_stats();
+
+  if(node_id == 1) {
+    create_rpl_dag();
+  }
+
+  etimer_set(&et, START_DELAY);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_set(&et, SEND_INTERVAL);
+
+    if(node_id != CHAIN_LENGTH) {
+      if(node_id != 1) {
+        printf("router: forwarded %u, reassembled %u\n",
+               stats->forwarded, stats->completed);
+      }
+      continue;
+    }
+
+    dag = rpl_get_any_dag();
+    if(dag == NULL || dag->preferred_parent == NULL) {
+      continue;
+    }
+    memset(buf, seq, sizeof(buf));
+    memcpy(buf, &seq, sizeof(seq));
+    printf("send %lu\n", (unsigned long)seq);
+    simple_udp_sendto(&conn, buf, sizeof(buf), &dag->dag_id);
+    seq++;
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Functional test and latency of 6LoWPAN fragment forwarding.
+ *         The node is a router between a sender and a next hop with a
+ *         route towards fd01::/64. Fragments of a PACKET_LEN byte UDP
+ *         packet are passed to the network driver and the frames it
+ *         sends are captured. Fed back with the destination address
+ *         made local, they must reassemble into the original packet
+ *         with the hop limit decremented. Built with forwarding
+ *         disabled the same program measures reassembly at the hop.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=SICSLOWPAN_CONF_FRAG_FORWARDING=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/packetbuf.h"
+#include "net/netstack.h"
+#include "net/rime/rime.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define PACKET_LEN   600
+/* IP bytes per fragment, a multiple of 8 */
+#define CHUNK        96
+#define FRAGS        ((PACKET_LEN + CHUNK - 1) / CHUNK)
+#define MAX_FRAMES   (2 * FRAGS)
+#define ROUNDS       200
+
+#define UIP_IP_BUF   (&uip_buf[UIP_LLH_LEN])
+
+struct frame {
+  uint8_t len;
+  uint8_t data[127];
+};
+
+static struct frame in[MAX_FRAMES];
+static struct frame out[MAX_FRAMES];
+static int out_count;
+static int in_count;
+/* Fragments passed in when the first frame went out */
+static int first_out_after;
+static double first_out_time;
+static linkaddr_t out_dest;
+static uint8_t packet[PACKET_LEN];
+static struct frame interleaved[MAX_FRAMES];
+static uint8_t interleaved_packet[PACKET_LEN];
+static uint8_t delivered[PACKET_LEN];
+static uint16_t delivered_len;
+static uint16_t tag;
+static linkaddr_t sender_ll;
+static linkaddr_t relay_ll;
+static linkaddr_t next_hop_ll;
+static uip_ipaddr_t dest_addr;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(frag_forward_test_process, "Fragment forwarding test");
+AUTOSTART_PROCESSES(&frag_forward_test_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_input(void)
+{
+  delivered_len = MIN(uip_len, PACKET_LEN);
+  memcpy(delivered, UIP_IP_BUF, delivered_len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+  if(out_count == 0) {
+    first_out_after = in_count;
+    first_out_time = now();
+    linkaddr_copy(&out_dest, packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  }
+  if(out_count < MAX_FRAMES && packetbuf_datalen() <= sizeof(out[0].data)) {
+    out[out_count].len = packetbuf_datalen();
+    memcpy(out[out_count].data, packetbuf_dataptr(), packetbuf_datalen());
+  }
+  out_count++;
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* A UDP packet from fd02::2 to dest_addr */
+static void
+make_packet(void)
+{
+  int i;
+
+  memset(packet, 0, UIP_IPH_LEN + UIP_UDPH_LEN);
+  packet[0] = 0x60;
+  packet[4] = (PACKET_LEN - UIP_IPH_LEN) >> 8;
+  packet[5] = (PACKET_LEN - UIP_IPH_LEN) & 0xff;
+  packet[6] = UIP_PROTO_UDP;
+  packet[7] = 64;
+  packet[8] = 0xfd;
+  packet[9] = 0x02;
+  packet[23] = 0x02;
+  memcpy(&packet[24], &dest_addr, sizeof(dest_addr));
+  packet[UIP_IPH_LEN] = 0x16;
+  packet[UIP_IPH_LEN + 1] = 0x33;
+  packet[UIP_IPH_LEN + 2] = 0x16;
+  packet[UIP_IPH_LEN + 3] = 0x33;
+  packet[UIP_IPH_LEN + 4] = (PACKET_LEN - UIP_IPH_LEN) >> 8;
+  packet[UIP_IPH_LEN + 5] = (PACKET_LEN - UIP_IPH_LEN) & 0xff;
+  for(i = UIP_IPH_LEN + UIP_UDPH_LEN; i < PACKET_LEN; i++) {
+    packet[i] = tag ^ (i * 7);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Fragments with an uncompressed IPv6 header, as the sender would */
+static void
+make_frames(void)
+{
+  int i;
+  int offset;
+  int len;
+
+  for(i = 0; i < FRAGS; i++) {
+    offset = i * CHUNK;
+    len = MIN(CHUNK, PACKET_LEN - offset);
+    in[i].data[0] = (i == 0 ? SICSLOWPAN_DISPATCH_FRAG1 : SICSLOWPAN_DISPATCH_FRAGN)
+      | (PACKET_LEN >> 8);
+    in[i].data[1] = PACKET_LEN & 0xff;
+    in[i].data[2] = tag >> 8;
+    in[i].data[3] = tag & 0xff;
+    if(i == 0) {
+      in[i].data[SICSLOWPAN_FRAG1_HDR_LEN] = SICSLOWPAN_DISPATCH_IPV6;
+      memcpy(&in[i].data[SICSLOWPAN_FRAG1_HDR_LEN + 1], packet, len);
+      in[i].len = SICSLOWPAN_FRAG1_HDR_LEN + 1 + len;
+    } else {
+      in[i].data[4] = offset >> 3;
+      memcpy(&in[i].data[SICSLOWPAN_FRAGN_HDR_LEN], packet + offset, len);
+      in[i].len = SICSLOWPAN_FRAGN_HDR_LEN + len;
+    }
+  }
+  tag++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+input_frame(const struct frame *f, const linkaddr_t *from, const linkaddr_t *to)
+{
+  packetbuf_clear();
+  packetbuf_copyfrom(f->data, f->len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, from);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, to);
+  NETSTACK_NETWORK.input();
+}
+/*---------------------------------------------------------------------------*/
+/* Pass the first count fragments from a neighbor in, in the given
+   order, and capture what is sent */
+static double
+route_packet(const int *order, int count, const linkaddr_t *from)
+{
+  double start;
+  int i;
+
+  out_count = 0;
+  in_count = 0;
+  start = now();
+  for(i = 0; i < count; i++) {
+    in_count++;
+    input_frame(&in[order[i]], from, &linkaddr_node_addr);
+  }
+  return first_out_time - start;
+}
+/*---------------------------------------------------------------------------*/
+/* Reassemble the captured frames as the next hop would */
+static int
+check_output(const char *name)
+{
+  struct frame copy[MAX_FRAMES];
+  int count;
+  int i;
+
+  if(out_count == 0 || out_count > MAX_FRAMES) {
+    printf("fwd: %s FAILED, %d frames sent\n", name, out_count);
+    return 0;
+  }
+  if(!linkaddr_cmp(&out_dest, &next_hop_ll)) {
+    printf("fwd: %s FAILED, sent to the wrong neighbor\n", name);
+    return 0;
+  }
+
+  /* The packet is now for this node */
+  count = out_count;
+  memcpy(copy, out, sizeof(copy));
+  uip_ds6_addr_add(&dest_addr, 0, ADDR_MANUAL);
+  delivered_len = 0;
+  for(i = 0; i < count; i++) {
+    input_frame(&copy[i], &linkaddr_node_addr, &next_hop_ll);
+  }
+  uip_ds6_addr_rm(uip_ds6_addr_lookup(&dest_addr));
+
+  packet[7]--;
+  if(delivered_len != PACKET_LEN || memcmp(delivered, packet, PACKET_LEN) != 0) {
+    printf("fwd: %s FAILED, packet not reassembled at the next hop\n", name);
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_test(const char *name, const int *order)
+{
+  int ok;
+
+  make_packet();
+  make_frames();
+  route_packet(order, FRAGS, &sender_ll);
+  ok = check_output(name);
+  if(ok) {
+    printf("fwd: %s OK, first frame sent after %d/%d fragments, %d frames\n",
+           name, first_out_after, FRAGS, out_count);
+  } else {
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(frag_forward_test_process, ev, data)
+{
+  static int in_order[MAX_FRAMES];
+  static int reverse[FRAGS];
+  static int duplicate[FRAGS + 1];
+  static const struct sicslowpan_reass_stats *stats;
+  static uip_ipaddr_t addr;
+  static uip_ipaddr_t next_hop;
+  static double first_out;
+  static int i;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < MAX_FRAMES; i++) {
+    in_order[i] = i;
+  }
+  for(i = 0; i < FRAGS; i++) {
+    reverse[i] = FRAGS - 1 - i;
+  }
+
+  memset(&sender_ll, 0, sizeof(sender_ll));
+  sender_ll.u8[0] = 0x02;
+  sender_ll.u8[LINKADDR_SIZE - 1] = 0x20;
+  memset(&relay_ll, 0, sizeof(relay_ll));
+  relay_ll.u8[0] = 0x02;
+  relay_ll.u8[LINKADDR_SIZE - 1] = 0x30;
+  memset(&next_hop_ll, 0, sizeof(next_hop_ll));
+  next_hop_ll.u8[0] = 0x02;
+  next_hop_ll.u8[LINKADDR_SIZE - 1] = 0x10;
+
+  uip_ip6addr(&addr, 0xfd00, 0, 0, 0, 0, 0, 0, 1);
+  uip_ds6_addr_add(&addr, 0, ADDR_MANUAL);
+  uip_ip6addr(&next_hop, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&next_hop, (uip_lladdr_t *)&next_hop_ll);
+  uip_ds6_nbr_add(&next_hop, (uip_lladdr_t *)&next_hop_ll, 1, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  uip_ip6addr(&addr, 0xfd01, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_route_add(&addr, 64, &next_hop);
+  uip_ip6addr(&dest_addr, 0xfd01, 0, 0, 0, 0, 0, 0, 5);
+
+  rime_sniffer_add(&sniffer);
+  stats = sicslowpan_get_reass_stats();
+  printf("fwd: %d byte packets, %d fragments, forwarding %s\n",
+         PACKET_LEN, FRAGS, SICSLOWPAN_CONF_FRAG_FORWARDING ? "on" : "off");
+
+  run_test("in order", in_order);
+  run_test("first fragment last", reverse);
+
+  /* Fragments with compressed headers, as relayed by a previous hop.
+     The relayed frames come from another neighbor since their tag is
+     not related to those of sender_ll. */
+  make_packet();
+  make_frames();
+  route_packet(in_order, FRAGS, &sender_ll);
+  packet[7]--;
+  i = out_count;
+  memcpy(in, out, sizeof(out));
+  route_packet(in_order, i, &relay_ll);
+  if(check_output("compressed")) {
+    printf("fwd: compressed OK, %d frames\n", out_count);
+  } else {
+    failures++;
+  }
+
+  /* A copy of the first fragment must not start the packet again */
+  make_packet();
+  make_frames();
+  route_packet(in_order, FRAGS, &sender_ll);
+  i = out_count;
+  input_frame(&in[0], &sender_ll, &linkaddr_node_addr);
+  if(out_count != i) {
+    printf("fwd: duplicate FAILED, %d frames sent\n", out_count - i);
+    failures++;
+  } else {
+    printf("fwd: duplicate OK\n");
+  }
+
+  /* Nor may a copy of a later fragment, which would count twice
+     towards the packet and leave its last fragment unrelayed */
+  make_packet();
+  make_frames();
+  duplicate[0] = 0;
+  for(i = 1; i <= FRAGS; i++) {
+    duplicate[i] = i < 3 ? 1 : i - 1;
+  }
+  route_packet(duplicate, FRAGS + 1, &sender_ll);
+  if(out_count != FRAGS) {
+    printf("fwd: duplicate fragment FAILED, %d frames sent\n", out_count);
+    failures++;
+  } else if(check_output("duplicate fragment")) {
+    printf("fwd: duplicate fragment OK\n");
+  } else {
+    failures++;
+  }
+
+#if SICSLOWPAN_CONF_FRAG_FORWARDING
+  /* A neighbor that relays packets interleaves them, so its packets
+     still waiting for their first fragment are not taken for lost when
+     another one starts. Fragment 1 of B waits while the contexts fill
+     up, then B must be relayed in full. */
+  make_packet();
+  make_frames();
+  input_frame(&in[0], &sender_ll, &linkaddr_node_addr);
+  input_frame(&in[1], &sender_ll, &linkaddr_node_addr);
+  make_packet();
+  make_frames();
+  memcpy(interleaved, in, sizeof(in));
+  memcpy(interleaved_packet, packet, sizeof(packet));
+  input_frame(&interleaved[1], &sender_ll, &linkaddr_node_addr);
+  for(i = 0; i < 2; i++) {
+    make_packet();
+    make_frames();
+    input_frame(&in[1], &sender_ll, &linkaddr_node_addr);
+  }
+  memcpy(packet, interleaved_packet, sizeof(packet));
+  memcpy(in, interleaved, sizeof(in));
+  in_order[1] = 0;
+  route_packet(in_order + 1, FRAGS - 1, &sender_ll);
+  in_order[1] = 1;
+  if(check_output("interleaved")) {
+    printf("fwd: interleaved OK, %d frames\n", out_count);
+  } else {
+    failures++;
+  }
+#endif /* SICSLOWPAN_CONF_FRAG_FORWARDING */
+
+  first_out = 0;
+  for(i = 0; i < ROUNDS; i++) {
+    make_packet();
+    make_frames();
+    first_out += route_packet(in_order, FRAGS, &sender_ll);
+  }
+  printf("fwd: %5.2f us from first fragment in to first frame out, "
+         "forwarded %u, completed %u\n",
+         first_out * 1e6 / ROUNDS,
+         stats->forwarded, stats->completed);
+
+  printf("fwd: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
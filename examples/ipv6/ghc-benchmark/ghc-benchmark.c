@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Bytes on air and frames per packet with and without Generic
+ *         Header Compression (RFC 7400), for RPL control messages and
+ *         the requests and responses of the OSCOAP plugtests. Every
+ *         packet is sent through 6LoWPAN, its frames are fed back to
+ *         the input path and the result is compared with what was
+ *         sent.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=SICSLOWPAN_CONF_GHC=1
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/packetbuf.h"
+#include "net/netstack.h"
+#include "net/rime/rime.h"
+#include "net/rpl/rpl-private.h"
+#include "er-coap.h"
+#include "er-oscoap.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_FRAMES   8
+
+/* DIO flags, as in rpl-icmp6.c */
+#define DIO_GROUNDED 0x80
+#define DIO_MOP_SHIFT 3
+
+#define IP_BUF       ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UDP_BUF      ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define ICMP_BUF     ((struct uip_icmp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+/* What a plugtest client sends and the server answers. Both are sent
+   from this node to the parent, as they would be by a client and a
+   server. */
+struct plugtest {
+  const char *name;
+  uint8_t protected;
+  uint8_t method;
+  const char *path;
+  const char *query;
+  int accept;
+  int observe;
+  uint8_t if_match;
+  const char *payload;
+  uint8_t status;
+  const char *response;
+  uint8_t etag;
+  int max_age;
+};
+
+static const struct plugtest plugtests[] = {
+  { "coap GET",    0, COAP_GET,    "hello/coap", NULL,      -1, -1, 0,    NULL,
+    CONTENT_2_05, "Hello World!", 0,    -1 },
+  { "test 1",      1, COAP_GET,    "hello/1",    NULL,      -1, -1, 0,    NULL,
+    CONTENT_2_05, "Hello World!", 0,    -1 },
+  { "test 2",      1, COAP_GET,    "hello/2",    "first=1", -1, -1, 0,    NULL,
+    CONTENT_2_05, "Hello World!", 0x2b, -1 },
+  { "test 3",      1, COAP_GET,    "hello/3",    NULL,       0, -1, 0,    NULL,
+    CONTENT_2_05, "Hello World!", 0,     5 },
+  { "test 4",      1, COAP_GET,    "observe",    NULL,      -1,  0, 0,    NULL,
+    CONTENT_2_05, "one",          0,    -1 },
+  { "test 6",      1, COAP_POST,   "hello/6",    NULL,      -1, -1, 0,    "J",
+    CHANGED_2_04, "J",            0,    -1 },
+  { "test 7",      1, COAP_PUT,    "hello/7",    NULL,      -1, -1, 0x7b, "z",
+    CHANGED_2_04, NULL,           0,    -1 },
+  { "test 9",      1, COAP_DELETE, "test",       NULL,      -1, -1, 0,    NULL,
+    DELETED_2_02, NULL,           0,    -1 },
+};
+
+struct tally {
+  uint16_t packets;
+  uint16_t frames;
+  uint16_t fragmented;
+  uint32_t ip_bytes;
+  uint32_t air_bytes;
+};
+
+static uint8_t packet[UIP_BUFSIZE];
+static uint16_t packet_len;
+static uint8_t frames[MAX_FRAMES][PACKETBUF_SIZE];
+static uint16_t frame_len[MAX_FRAMES];
+static uint8_t frame_count;
+static uint16_t air_bytes;
+static uint8_t capture;
+static uint8_t delivered;
+
+static uip_lladdr_t parent_ll;
+static uip_lladdr_t root_ll;
+static uip_ipaddr_t my_global;
+static uip_ipaddr_t my_linklocal;
+static uip_ipaddr_t parent_global;
+static uip_ipaddr_t parent_linklocal;
+static uip_ipaddr_t root_global;
+static uip_ipaddr_t all_rpl_nodes;
+
+static uint8_t body[128];
+static uint8_t coap_buf[COAP_MAX_PACKET_SIZE + 1];
+static coap_packet_t request[1];
+static coap_packet_t incoming[1];
+static coap_packet_t response[1];
+static oscoap_ctx_t *client_ctx;
+static oscoap_ctx_t *server_ctx;
+static uint8_t master_secret[35];
+static uint8_t client_id[] = { 0x63, 0x6C, 0x69, 0x65, 0x6E, 0x74 };
+static uint8_t server_id[] = { 0x73, 0x65, 0x72, 0x76, 0x65, 0x72 };
+
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(ghc_benchmark_process, "GHC benchmark");
+AUTOSTART_PROCESSES(&ghc_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_input(void)
+{
+  delivered = uip_len == packet_len &&
+    memcmp(IP_BUF, packet, packet_len) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+  if(capture && frame_count < MAX_FRAMES) {
+    frame_len[frame_count] = packetbuf_datalen();
+    memcpy(frames[frame_count], packetbuf_dataptr(), packetbuf_datalen());
+    frame_count++;
+    /* MAC header, payload and FCS */
+    air_bytes += packetbuf_totlen() + 2;
+  }
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+static void
+ip_packet(uint8_t proto, uint8_t ttl, const uip_ipaddr_t *src,
+          const uip_ipaddr_t *dest, uint16_t len)
+{
+  memset(IP_BUF, 0, UIP_IPH_LEN);
+  IP_BUF->vtc = 0x60;
+  IP_BUF->len[0] = len >> 8;
+  IP_BUF->len[1] = len & 0xff;
+  IP_BUF->proto = proto;
+  IP_BUF->ttl = ttl;
+  uip_ipaddr_copy(&IP_BUF->srcipaddr, src);
+  uip_ipaddr_copy(&IP_BUF->destipaddr, dest);
+  uip_len = UIP_IPH_LEN + len;
+  uip_ext_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rpl_packet(uint8_t code, const uip_ipaddr_t *src, const uip_ipaddr_t *dest,
+           uint16_t len)
+{
+  ip_packet(UIP_PROTO_ICMP6, uip_is_addr_mcast(dest) ? 255 : 64, src, dest,
+            UIP_ICMPH_LEN + len);
+  ICMP_BUF->type = ICMP6_RPL;
+  ICMP_BUF->icode = code;
+  memcpy(&uip_buf[UIP_LLIPH_LEN + UIP_ICMPH_LEN], body, len);
+  ICMP_BUF->icmpchksum = 0;
+  ICMP_BUF->icmpchksum = ~uip_icmp6chksum();
+}
+/*---------------------------------------------------------------------------*/
+static void
+udp_packet(const uip_ipaddr_t *src, const uip_ipaddr_t *dest,
+           const uint8_t *payload, uint16_t len)
+{
+  ip_packet(UIP_PROTO_UDP, 64, src, dest, UIP_UDPH_LEN + len);
+  UDP_BUF->srcport = UIP_HTONS(COAP_DEFAULT_PORT);
+  UDP_BUF->destport = UIP_HTONS(COAP_DEFAULT_PORT);
+  UDP_BUF->udplen = UIP_HTONS(UIP_UDPH_LEN + len);
+  memcpy(&uip_buf[UIP_LLIPH_LEN + UIP_UDPH_LEN], payload, len);
+  UDP_BUF->udpchksum = 0;
+  UDP_BUF->udpchksum = ~uip_udpchksum();
+}
+/*---------------------------------------------------------------------------*/
+/* Send the packet in uip_buf to lladdr, or broadcast it, feed its
+   frames back to 6LoWPAN and add it up */
+static void
+measure(const char *name, const uip_lladdr_t *lladdr, struct tally *t)
+{
+  uint8_t i;
+
+  packet_len = uip_len;
+  memcpy(packet, IP_BUF, packet_len);
+
+  frame_count = 0;
+  air_bytes = 0;
+  capture = 1;
+  tcpip_output(lladdr);
+  capture = 0;
+
+  delivered = 0;
+  for(i = 0; i < frame_count; i++) {
+    packetbuf_clear();
+    packetbuf_copyfrom(frames[i], frame_len[i]);
+    packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+    packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER,
+                       lladdr == NULL ? &linkaddr_null : (const linkaddr_t *)lladdr);
+    NETSTACK_NETWORK.input();
+  }
+
+  printf("ghc: %-20s %3u bytes IPv6, %u frames, %3u bytes on air\n",
+         name, packet_len, frame_count, air_bytes);
+  if(!delivered) {
+    printf("ghc: %s FAILED\n", name);
+    failures++;
+  }
+
+  t->packets++;
+  t->frames += frame_count;
+  t->fragmented += frame_count > 1;
+  t->ip_bytes += packet_len;
+  t->air_bytes += air_bytes;
+}
+/*---------------------------------------------------------------------------*/
+static void
+summary(const char *name, const struct tally *t)
+{
+  printf("ghc: %s: %u packets, %lu bytes IPv6, %u frames, %u fragmented, %lu bytes on air\n",
+         name, t->packets, (unsigned long)t->ip_bytes, t->frames, t->fragmented,
+         (unsigned long)t->air_bytes);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+dio_body(void)
+{
+  uint16_t pos = 0;
+
+  body[pos++] = RPL_DEFAULT_INSTANCE;
+  body[pos++] = 240;                    /* version */
+  body[pos++] = 512 >> 8;               /* rank */
+  body[pos++] = 512 & 0xff;
+  body[pos++] = DIO_GROUNDED | (RPL_MOP_DEFAULT << DIO_MOP_SHIFT);
+  body[pos++] = 240;                    /* DTSN */
+  body[pos++] = 0;
+  body[pos++] = 0;
+  memcpy(&body[pos], &root_global, 16);
+  pos += 16;
+
+  body[pos++] = RPL_OPTION_DAG_CONF;
+  body[pos++] = 14;
+  body[pos++] = 0;
+  body[pos++] = RPL_DIO_INTERVAL_DOUBLINGS;
+  body[pos++] = RPL_DIO_INTERVAL_MIN;
+  body[pos++] = RPL_DIO_REDUNDANCY;
+  body[pos++] = (7 * RPL_MIN_HOPRANKINC) >> 8;
+  body[pos++] = (7 * RPL_MIN_HOPRANKINC) & 0xff;
+  body[pos++] = RPL_MIN_HOPRANKINC >> 8;
+  body[pos++] = RPL_MIN_HOPRANKINC & 0xff;
+  body[pos++] = 0;                      /* OCP: MRHOF */
+  body[pos++] = 1;
+  body[pos++] = 0;
+  body[pos++] = RPL_DEFAULT_LIFETIME;
+  body[pos++] = RPL_DEFAULT_LIFETIME_UNIT >> 8;
+  body[pos++] = RPL_DEFAULT_LIFETIME_UNIT & 0xff;
+
+  body[pos++] = RPL_OPTION_PREFIX_INFO;
+  body[pos++] = 30;
+  body[pos++] = 64;
+  body[pos++] = UIP_ND6_RA_FLAG_AUTONOMOUS;
+  memset(&body[pos], 0xff, 8);          /* valid and preferred lifetime */
+  pos += 8;
+  memset(&body[pos], 0, 4);
+  pos += 4;
+  memset(&body[pos], 0, 16);
+  memcpy(&body[pos], &root_global, 8);
+  pos += 16;
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+/* A DAO for targets addresses, through parent in non-storing mode */
+static uint16_t
+dao_body(uint8_t targets, const uip_ipaddr_t *parent)
+{
+  uint16_t pos = 0;
+  uint8_t i;
+
+  body[pos++] = RPL_DEFAULT_INSTANCE;
+  body[pos++] = RPL_DAO_K_FLAG;
+  body[pos++] = 0;
+  body[pos++] = 17;                     /* sequence */
+
+  for(i = 0; i < targets; i++) {
+    body[pos++] = RPL_OPTION_TARGET;
+    body[pos++] = 2 + 16;
+    body[pos++] = 0;
+    body[pos++] = 128;
+    memcpy(&body[pos], &my_global, 16);
+    body[pos + 15] += i;
+    pos += 16;
+  }
+
+  body[pos++] = RPL_OPTION_TRANSIT;
+  body[pos++] = parent != NULL ? 20 : 4;
+  body[pos++] = 0;
+  body[pos++] = 0;
+  body[pos++] = 0;
+  body[pos++] = RPL_DEFAULT_LIFETIME;
+  if(parent != NULL) {
+    memcpy(&body[pos], parent, 16);
+    pos += 16;
+  }
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static void
+rpl_messages(struct tally *t)
+{
+  uint16_t len;
+
+  memset(body, 0, 2);
+  rpl_packet(RPL_CODE_DIS, &my_linklocal, &all_rpl_nodes, 2);
+  measure("DIS", NULL, t);
+
+  len = dio_body();
+  rpl_packet(RPL_CODE_DIO, &my_linklocal, &all_rpl_nodes, len);
+  measure("DIO multicast", NULL, t);
+
+  rpl_packet(RPL_CODE_DIO, &my_linklocal, &parent_linklocal, len);
+  measure("DIO unicast", &parent_ll, t);
+
+  len = dao_body(1, NULL);
+  rpl_packet(RPL_CODE_DAO, &my_linklocal, &parent_linklocal, len);
+  measure("DAO storing", &parent_ll, t);
+
+  len = dao_body(1, &parent_global);
+  rpl_packet(RPL_CODE_DAO, &my_global, &root_global, len);
+  measure("DAO non-storing", &parent_ll, t);
+
+  len = dao_body(4, &parent_global);
+  rpl_packet(RPL_CODE_DAO, &my_global, &root_global, len);
+  measure("DAO 4 targets", &parent_ll, t);
+
+  body[0] = RPL_DEFAULT_INSTANCE;
+  body[1] = 0;
+  body[2] = 17;
+  body[3] = 0;
+  rpl_packet(RPL_CODE_DAO_ACK, &my_linklocal, &parent_linklocal, 4);
+  measure("DAO-ACK", &parent_ll, t);
+}
+/*---------------------------------------------------------------------------*/
+static void
+plugtest_messages(struct tally *t)
+{
+  static const uint8_t token[] = { 0x4a, 0x1f };
+  const struct plugtest *p;
+  char name[32];
+  uint16_t len;
+  uint8_t i;
+
+  for(i = 0; i < sizeof(plugtests) / sizeof(plugtests[0]); i++) {
+    p = &plugtests[i];
+
+    coap_init_message(request, COAP_TYPE_CON, p->method, 0x3a00 + i);
+    coap_set_token(request, token, sizeof(token));
+    coap_set_header_uri_path(request, p->path);
+    if(p->query != NULL) {
+      coap_set_header_uri_query(request, p->query);
+    }
+    if(p->accept >= 0) {
+      coap_set_header_accept(request, p->accept);
+    }
+    if(p->observe >= 0) {
+      coap_set_header_observe(request, p->observe);
+    }
+    if(p->if_match) {
+      coap_set_header_if_match(request, &p->if_match, 1);
+    }
+    if(p->payload != NULL) {
+      coap_set_header_content_format(request, TEXT_PLAIN);
+      coap_set_payload(request, p->payload, strlen(p->payload));
+    }
+    if(p->protected) {
+      coap_set_header_object_security(request);
+      request->context = client_ctx;
+    }
+    len = coap_serialize_message(request, coap_buf);
+    udp_packet(&my_global, &parent_global, coap_buf, len);
+    snprintf(name, sizeof(name), "%s request", p->name);
+    measure(name, &parent_ll, t);
+
+    if(oscoap_parser(incoming, coap_buf, len, ROLE_COAP) != NO_ERROR) {
+      printf("ghc: %s not parsed\n", name);
+      failures++;
+    }
+
+    coap_init_message(response, COAP_TYPE_ACK, p->status, 0x3a00 + i);
+    coap_set_token(response, token, sizeof(token));
+    if(p->etag) {
+      coap_set_header_etag(response, &p->etag, 1);
+    }
+    if(p->max_age >= 0) {
+      coap_set_header_max_age(response, p->max_age);
+    }
+    if(p->observe >= 0) {
+      coap_set_header_observe(response, 1);
+    }
+    if(p->response != NULL) {
+      coap_set_header_content_format(response, TEXT_PLAIN);
+      coap_set_payload(response, p->response, strlen(p->response));
+    }
+    if(p->protected) {
+      coap_set_header_object_security(response);
+      response->context = server_ctx;
+    }
+    len = coap_serialize_message(response, coap_buf);
+    udp_packet(&my_global, &parent_global, coap_buf, len);
+    snprintf(name, sizeof(name), "%s response", p->name);
+    measure(name, &parent_ll, t);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(ghc_benchmark_process, ev, data)
+{
+  static struct tally rpl;
+  static struct tally plugtest;
+
+  PROCESS_BEGIN();
+
+  rime_sniffer_add(&sniffer);
+
+  memset(&parent_ll, 0, sizeof(parent_ll));
+  parent_ll.addr[0] = 0x02;
+  parent_ll.addr[sizeof(parent_ll.addr) - 1] = 0x10;
+  memset(&root_ll, 0, sizeof(root_ll));
+  root_ll.addr[0] = 0x02;
+  root_ll.addr[sizeof(root_ll.addr) - 1] = 0x01;
+
+  uip_create_linklocal_prefix(&my_linklocal);
+  uip_ds6_set_addr_iid(&my_linklocal, &uip_lladdr);
+  uip_create_linklocal_prefix(&parent_linklocal);
+  uip_ds6_set_addr_iid(&parent_linklocal, &parent_ll);
+  uip_ip6addr(&my_global, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&my_global, &uip_lladdr);
+  uip_ip6addr(&parent_global, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&parent_global, &parent_ll);
+  uip_ip6addr(&root_global, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&root_global, &root_ll);
+  uip_ip6addr(&all_rpl_nodes, 0xff02, 0, 0, 0, 0, 0, 0, 0x001a);
+
+  oscoap_ctx_store_init();
+  memset(master_secret, 0x11, sizeof(master_secret));
+  client_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, client_id, sizeof(client_id),
+      server_id, sizeof(server_id), 32);
+  server_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, server_id, sizeof(server_id),
+      client_id, sizeof(client_id), 32);
+
+  rpl_messages(&rpl);
+  plugtest_messages(&plugtest);
+
+  summary("RPL", &rpl);
+  summary("plugtests", &plugtest);
+  printf("ghc: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
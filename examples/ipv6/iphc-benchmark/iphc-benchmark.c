@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Packets per second through the 6LoWPAN output path with IPHC.
+ *         Small UDP packets are sent to one or more flows round robin,
+ *         and link-local multicast ICMPv6 packets as RPL DIOs would be.
+ *         The first packets of each flow are decompressed again and
+ *         compared with what was sent.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=SICSLOWPAN_CONF_IPHC_CACHE_SIZE=2
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/packetbuf.h"
+#include "net/netstack.h"
+#include "net/rime/rime.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define PACKETS      100000
+/* The best of this many runs is reported */
+#define RUNS         5
+#define PAYLOAD_LEN  32
+#define PACKET_LEN   (UIP_IPH_LEN + UIP_UDPH_LEN + PAYLOAD_LEN)
+#define MAX_FLOWS    8
+/* Packets per flow that are checked */
+#define CHECKED      3
+
+#define UIP_IP_BUF   ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF  ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+struct scenario {
+  const char *name;
+  uint8_t flows;
+  uint8_t multicast;
+};
+
+static const struct scenario scenarios[] = {
+  { "1 flow",    1, 0 },
+  { "2 flows",   2, 0 },
+  { "8 flows",   8, 0 },
+  { "multicast", 1, 1 },
+};
+
+static uint8_t packet[PACKET_LEN];
+static uint8_t frame[PACKETBUF_SIZE];
+static uint16_t frame_len;
+static uint8_t capture;
+static uint8_t delivered;
+static uip_lladdr_t parents[MAX_FLOWS];
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(iphc_benchmark_process, "IPHC benchmark");
+AUTOSTART_PROCESSES(&iphc_benchmark_process);
+/*---------------------------------------------------------------------------*/
+/* CPU time, less disturbed by other load than wall clock time */
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_input(void)
+{
+  delivered = uip_len == PACKET_LEN &&
+    memcmp(UIP_IP_BUF, packet, PACKET_LEN) == 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+  if(capture) {
+    frame_len = packetbuf_datalen();
+    memcpy(frame, packetbuf_dataptr(), frame_len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* A UDP packet from this node to a global address of a parent, or an
+   ICMPv6 packet to all RPL nodes from the link-local address */
+static void
+make_packet(const struct scenario *s, int flow, uint16_t seq)
+{
+  struct uip_ip_hdr *ip;
+  struct uip_udp_hdr *udp;
+
+  memset(packet, 0, sizeof(packet));
+  ip = (struct uip_ip_hdr *)packet;
+  udp = (struct uip_udp_hdr *)&packet[UIP_IPH_LEN];
+  ip->vtc = 0x60;
+  ip->len[1] = PACKET_LEN - UIP_IPH_LEN;
+  if(s->multicast) {
+    ip->proto = UIP_PROTO_ICMP6;
+    ip->ttl = 255;
+    uip_create_linklocal_prefix(&ip->srcipaddr);
+    uip_ds6_set_addr_iid(&ip->srcipaddr, &uip_lladdr);
+    uip_ip6addr(&ip->destipaddr, 0xff02, 0, 0, 0, 0, 0, 0, 0x001a);
+    packet[UIP_IPH_LEN] = ICMP6_RPL;
+  } else {
+    ip->proto = UIP_PROTO_UDP;
+    ip->ttl = 64;
+    uip_ip6addr(&ip->srcipaddr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&ip->srcipaddr, &uip_lladdr);
+    uip_ip6addr(&ip->destipaddr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&ip->destipaddr, &parents[flow]);
+    udp->srcport = UIP_HTONS(5683);
+    udp->destport = UIP_HTONS(5683);
+    udp->udplen = UIP_HTONS(PACKET_LEN - UIP_IPH_LEN);
+    udp->udpchksum = UIP_HTONS(seq);
+  }
+  packet[PACKET_LEN - 1] = seq;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(const struct scenario *s, int flow)
+{
+  memcpy(UIP_IP_BUF, packet, PACKET_LEN);
+  uip_len = PACKET_LEN;
+  tcpip_output(s->multicast ? NULL : &parents[flow]);
+}
+/*---------------------------------------------------------------------------*/
+/* Decompress the frame as the receiver would */
+static int
+check_frame(const struct scenario *s, int flow)
+{
+  packetbuf_clear();
+  packetbuf_copyfrom(frame, frame_len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER,
+                     s->multicast ? &linkaddr_null : (linkaddr_t *)&parents[flow]);
+  delivered = 0;
+  NETSTACK_NETWORK.input();
+  return delivered;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(iphc_benchmark_process, ev, data)
+{
+  static const struct scenario *s;
+  static double start;
+  static double elapsed;
+  static double best;
+  static int run;
+  static int i;
+  static int n;
+  static int flow;
+  static int ok;
+
+  PROCESS_BEGIN();
+
+  rime_sniffer_add(&sniffer);
+  for(i = 0; i < MAX_FLOWS; i++) {
+    memset(&parents[i], 0, sizeof(parents[i]));
+    parents[i].addr[0] = 0x02;
+    parents[i].addr[sizeof(parents[i].addr) - 1] = 0x10 + i;
+  }
+  printf("iphc: %d byte packets\n", PACKET_LEN);
+
+  for(i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    s = &scenarios[i];
+
+    ok = 1;
+    for(n = 0; n < CHECKED * s->flows; n++) {
+      flow = n % s->flows;
+      make_packet(s, flow, n);
+      capture = 1;
+      send_packet(s, flow);
+      capture = 0;
+      if(!check_frame(s, flow)) {
+        ok = 0;
+      }
+    }
+
+    best = 0;
+    for(run = 0; run < RUNS; run++) {
+      start = now();
+      for(n = 0; n < PACKETS; n++) {
+        flow = n % s->flows;
+        make_packet(s, flow, n);
+        send_packet(s, flow);
+      }
+      elapsed = now() - start;
+      if(best == 0 || elapsed < best) {
+        best = elapsed;
+      }
+    }
+
+    printf("iphc: %-10s %8.0f packets/s, header %u bytes\n",
+           s->name, PACKETS / best, (unsigned)(frame_len - PAYLOAD_LEN -
+                                                 (s->multicast ? UIP_UDPH_LEN : 0)));
+    if(ok) {
+      printf("iphc: %s OK\n", s->name);
+    } else {
+      printf("iphc: %s FAILED\n", s->name);
+      failures++;
+    }
+  }
+  printf("iphc: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         A fixed workload for comparing MAC layers. The mote whose
+ *         link-layer address ends in 1 is the RPL root; every other
+ *         mote sends it a packet at random intervals around
+ *         MAC_BENCHMARK_PERIOD, once the network had
+ *         MAC_BENCHMARK_WARMUP to form. Packets are UDP datagrams,
+ *         or confirmable CoAP POSTs, optionally protected with
+ *         OSCOAP. Every mote logs what it sends and receives, and its
+ *         energest times at the start and end of the workload, for
+ *         mac-benchmark.js and tools/mac-benchmark.
+ *
+ *         make TARGET=z1 MAC=contikimac WORKLOAD=udp
+ *
+ *         MAC is one of nullrdc, contikimac, cxmac or tsch, WORKLOAD one
+ *         of udp, coap or oscoap. Run make clean when changing them.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/rpl/rpl.h"
+#include "simple-udp.h"
+#include "sys/energest.h"
+#if MAC_BENCHMARK_CONF_WITH_TSCH
+#include "net/mac/tsch/tsch.h"
+#endif /* MAC_BENCHMARK_CONF_WITH_TSCH */
+#if MAC_BENCHMARK_CONF_WITH_COAP
+#include "er-coap-engine.h"
+#include "rest-engine.h"
+#include "er-oscoap.h"
+#endif /* MAC_BENCHMARK_CONF_WITH_COAP */
+
+#include <stdio.h>
+#include <string.h>
+
+/* Time for RPL (and TSCH) to form the network */
+#ifdef MAC_BENCHMARK_CONF_WARMUP
+#define MAC_BENCHMARK_WARMUP MAC_BENCHMARK_CONF_WARMUP
+#else
+#define MAC_BENCHMARK_WARMUP (120 * CLOCK_SECOND)
+#endif
+
+/* Mean interval between two packets of a mote */
+#ifdef MAC_BENCHMARK_CONF_PERIOD
+#define MAC_BENCHMARK_PERIOD MAC_BENCHMARK_CONF_PERIOD
+#else
+#define MAC_BENCHMARK_PERIOD (10 * CLOCK_SECOND)
+#endif
+
+/* Packets sent by each mote */
+#ifdef MAC_BENCHMARK_CONF_PACKETS
+#define MAC_BENCHMARK_PACKETS MAC_BENCHMARK_CONF_PACKETS
+#else
+#define MAC_BENCHMARK_PACKETS 60
+#endif
+
+/* Application payload, the sequence number included */
+#ifdef MAC_BENCHMARK_CONF_PAYLOAD_LEN
+#define MAC_BENCHMARK_PAYLOAD_LEN MAC_BENCHMARK_CONF_PAYLOAD_LEN
+#else
+#define MAC_BENCHMARK_PAYLOAD_LEN 32
+#endif
+
+/* Time left for the last packets to arrive before the workload ends */
+#ifdef MAC_BENCHMARK_CONF_DRAIN
+#define MAC_BENCHMARK_DRAIN MAC_BENCHMARK_CONF_DRAIN
+#else
+#define MAC_BENCHMARK_DRAIN (30 * CLOCK_SECOND)
+#endif
+
+#define UDP_PORT 5678
+
+static struct simple_udp_connection udp_conn;
+static uint8_t payload[MAC_BENCHMARK_PAYLOAD_LEN];
+static uint8_t is_root;
+
+#if MAC_BENCHMARK_CONF_WITH_OSCOAP
+static uint8_t master_secret[16] = {
+  0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+  0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10
+};
+/* Contexts keep pointers to their IDs */
+static uint8_t server_id[] = { 's' };
+static uint8_t client_ids[MAC_BENCHMARK_MAX_NODES + 1][2];
+#endif /* MAC_BENCHMARK_CONF_WITH_OSCOAP */
+/*---------------------------------------------------------------------------*/
+PROCESS(mac_benchmark_process, "MAC benchmark");
+AUTOSTART_PROCESSES(&mac_benchmark_process);
+/*---------------------------------------------------------------------------*/
+/* The last byte of a link-layer address identifies a mote */
+static uint8_t
+node_of(const uip_ipaddr_t *addr)
+{
+  return addr->u8[15];
+}
+/*---------------------------------------------------------------------------*/
+static void
+log_energest(const char *event)
+{
+  energest_flush();
+  printf("mac-bench: %s %lu %lu %lu %lu\n", event,
+         energest_type_time(ENERGEST_TYPE_CPU),
+         energest_type_time(ENERGEST_TYPE_LPM),
+         energest_type_time(ENERGEST_TYPE_TRANSMIT),
+         energest_type_time(ENERGEST_TYPE_LISTEN));
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+payload_seqno(const uint8_t *data)
+{
+  return (data[0] << 8) | data[1];
+}
+/*---------------------------------------------------------------------------*/
+static void
+udp_rx_callback(struct simple_udp_connection *c,
+                const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+                const uip_ipaddr_t *receiver_addr, uint16_t receiver_port,
+                const uint8_t *data, uint16_t datalen)
+{
+  if(datalen >= 2) {
+    printf("mac-bench: rx %u %u\n", node_of(sender_addr), payload_seqno(data));
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if MAC_BENCHMARK_CONF_WITH_COAP
+static void
+res_post_handler(void *request, void *response, uint8_t *buffer,
+                 uint16_t preferred_size, int32_t *offset)
+{
+  REST.set_response_status(response, REST.status.CHANGED);
+}
+RESOURCE(res_bench, "title=\"MAC benchmark\"", NULL, res_post_handler,
+         NULL, NULL);
+/*---------------------------------------------------------------------------*/
+/* Responses reach the client: latencies are round trips */
+static void
+coap_response_handler(void *data, void *response)
+{
+  if(response != NULL) {
+    printf("mac-bench: rx %u %u\n", linkaddr_node_addr.u8[LINKADDR_SIZE - 1],
+           (uint16_t)(uintptr_t)data);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sends the payload in a confirmable POST without waiting for the
+   response, so that retransmissions do not delay the next packets */
+static void
+coap_send_request(uip_ipaddr_t *addr, oscoap_ctx_t *context)
+{
+  static coap_packet_t request[1];
+  coap_transaction_t *transaction;
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_POST, coap_get_mid());
+  coap_set_header_uri_path(request, "bench");
+  coap_set_payload(request, payload, sizeof(payload));
+#if MAC_BENCHMARK_CONF_WITH_OSCOAP
+  request->context = context;
+  coap_set_header_object_security(request);
+#endif /* MAC_BENCHMARK_CONF_WITH_OSCOAP */
+
+  transaction = coap_new_transaction(request->mid, addr,
+                                     UIP_HTONS(COAP_DEFAULT_PORT));
+  if(transaction == NULL) {
+    /* Every transaction is still waiting for a response: the packet
+       counts as lost */
+    return;
+  }
+  transaction->callback = coap_response_handler;
+  transaction->callback_data = (void *)(uintptr_t)payload_seqno(payload);
+  transaction->packet_len = coap_serialize_message(request,
+                                                   transaction->packet);
+  coap_send_transaction(transaction);
+}
+#endif /* MAC_BENCHMARK_CONF_WITH_COAP */
+/*---------------------------------------------------------------------------*/
+#if MAC_BENCHMARK_CONF_WITH_OSCOAP
+static oscoap_ctx_t *
+derive_context(uint8_t client)
+{
+  /* A master secret per client, as they share the server ID */
+  master_secret[sizeof(master_secret) - 1] = client;
+  client_ids[client][0] = 'c';
+  client_ids[client][1] = client;
+  if(is_root) {
+    return oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+                              OSCOAP_DEFAULT_ALG, 1,
+                              server_id, sizeof(server_id),
+                              client_ids[client], 2, 32);
+  }
+  return oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+                            OSCOAP_DEFAULT_ALG, 1,
+                            client_ids[client], 2,
+                            server_id, sizeof(server_id), 32);
+}
+#endif /* MAC_BENCHMARK_CONF_WITH_OSCOAP */
+/*---------------------------------------------------------------------------*/
+static void
+root_init(void)
+{
+  uip_ipaddr_t prefix;
+  uip_ipaddr_t ipaddr;
+
+  uip_ip6addr(&prefix, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+  uip_ipaddr_copy(&ipaddr, &prefix);
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+  rpl_set_root(RPL_DEFAULT_INSTANCE, &ipaddr);
+  rpl_set_prefix(rpl_get_any_dag(), &prefix, 64);
+  rpl_repair_root(RPL_DEFAULT_INSTANCE);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(mac_benchmark_process, ev, data)
+{
+  static struct etimer et;
+  static struct etimer end_timer;
+  static uint16_t seqno;
+#if MAC_BENCHMARK_CONF_WITH_COAP
+  static oscoap_ctx_t *context;
+#if MAC_BENCHMARK_CONF_WITH_OSCOAP
+  uint8_t i;
+#endif /* MAC_BENCHMARK_CONF_WITH_OSCOAP */
+#endif /* MAC_BENCHMARK_CONF_WITH_COAP */
+  rpl_dag_t *dag;
+
+  PROCESS_BEGIN();
+
+  is_root = linkaddr_node_addr.u8[LINKADDR_SIZE - 1] == 1;
+  if(is_root) {
+    root_init();
+  }
+#if MAC_BENCHMARK_CONF_WITH_TSCH
+  NETSTACK_MAC.on();
+#endif /* MAC_BENCHMARK_CONF_WITH_TSCH */
+
+  simple_udp_register(&udp_conn, UDP_PORT, NULL, UDP_PORT, udp_rx_callback);
+
+#if MAC_BENCHMARK_CONF_WITH_COAP
+  if(is_root) {
+    rest_init_engine();
+    rest_activate_resource(&res_bench, "bench");
+  } else {
+    coap_init_engine();
+  }
+#if MAC_BENCHMARK_CONF_WITH_OSCOAP
+  oscoap_ctx_store_init();
+  init_token_seq_store();
+  if(is_root) {
+    for(i = 2; i <= MAC_BENCHMARK_MAX_NODES; i++) {
+      derive_context(i);
+    }
+  } else {
+    context = derive_context(linkaddr_node_addr.u8[LINKADDR_SIZE - 1]);
+  }
+#endif /* MAC_BENCHMARK_CONF_WITH_OSCOAP */
+#endif /* MAC_BENCHMARK_CONF_WITH_COAP */
+
+  etimer_set(&et, MAC_BENCHMARK_WARMUP);
+  PROCESS_WAIT_UNTIL(etimer_expired(&et));
+  log_energest("start");
+  etimer_set(&end_timer, MAC_BENCHMARK_PACKETS * MAC_BENCHMARK_PERIOD +
+             MAC_BENCHMARK_DRAIN);
+
+  for(seqno = 0; !is_root && seqno < MAC_BENCHMARK_PACKETS; seqno++) {
+    etimer_set(&et, MAC_BENCHMARK_PERIOD / 2 +
+               random_rand() % MAC_BENCHMARK_PERIOD);
+    PROCESS_WAIT_UNTIL(etimer_expired(&et));
+
+    payload[0] = seqno >> 8;
+    payload[1] = seqno & 0xff;
+    printf("mac-bench: tx %u\n", seqno);
+
+    /* Packets sent before the mote joins a DODAG count as lost */
+    dag = rpl_get_any_dag();
+    if(dag == NULL) {
+      continue;
+    }
+#if MAC_BENCHMARK_CONF_WITH_COAP
+    coap_send_request(&dag->dag_id, context);
+#else /* MAC_BENCHMARK_CONF_WITH_COAP */
+    simple_udp_sendto(&udp_conn, payload, sizeof(payload), &dag->dag_id);
+#endif /* MAC_BENCHMARK_CONF_WITH_COAP */
+  }
+
+  PROCESS_WAIT_UNTIL(etimer_expired(&end_timer));
+  log_energest("done");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,22 @@
+/*
+ * Collects the mac-benchmark output of all motes, each line prefixed
+ * with the simulation time in microseconds and the mote ID, for
+ * tools/mac-benchmark/mac-benchmark-summary. Ends once every mote has
+ * finished the workload.
+ */
+TIMEOUT(3600000);
+
+var done = 0;
+
+while(true) {
+  if(msg.startsWith("mac-bench: ")) {
+    log.log(time + " " + id + " " + msg.substring(11) + "\n");
+    if(msg.startsWith("mac-bench: done")) {
+      done++;
+      if(done == sim.getMotesCount()) {
+        log.testOK();
+      }
+    }
+  }
+  YIELD();
+}
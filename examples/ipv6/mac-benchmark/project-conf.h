@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+/* Motes in the largest topology, the root included */
+#define MAC_BENCHMARK_MAX_NODES         10
+
+#if MAC_BENCHMARK_CONF_WITH_TSCH
+
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC               tschmac_driver
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC               nordc_driver
+#undef NETSTACK_CONF_FRAMER
+#define NETSTACK_CONF_FRAMER            framer_802154
+#undef FRAME802154_CONF_VERSION
+#define FRAME802154_CONF_VERSION        FRAME802154_IEEE802154E_2012
+
+#define RPL_CALLBACK_PARENT_SWITCH      tsch_rpl_callback_parent_switch
+#define RPL_CALLBACK_NEW_DIO_INTERVAL   tsch_rpl_callback_new_dio_interval
+#define TSCH_CALLBACK_JOINING_NETWORK   tsch_rpl_callback_joining_network
+#define TSCH_CALLBACK_LEAVING_NETWORK   tsch_rpl_callback_leaving_network
+
+/* Start TSCH once the root is configured */
+#undef TSCH_CONF_AUTOSTART
+#define TSCH_CONF_AUTOSTART             0
+#undef TSCH_SCHEDULE_CONF_DEFAULT_LENGTH
+#define TSCH_SCHEDULE_CONF_DEFAULT_LENGTH 3
+
+/* Timer B is used for SFD timestamps on cc2420 platforms */
+#undef DCOSYNCH_CONF_ENABLED
+#define DCOSYNCH_CONF_ENABLED           0
+#undef CC2420_CONF_SFD_TIMESTAMPS
+#define CC2420_CONF_SFD_TIMESTAMPS      1
+
+#else /* MAC_BENCHMARK_CONF_WITH_TSCH */
+
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC               MAC_BENCHMARK_CONF_RDC
+
+#endif /* MAC_BENCHMARK_CONF_WITH_TSCH */
+
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP                    0
+#undef QUEUEBUF_CONF_NUM
+#define QUEUEBUF_CONF_NUM               4
+#undef NBR_TABLE_CONF_MAX_NEIGHBORS
+#define NBR_TABLE_CONF_MAX_NEIGHBORS    MAC_BENCHMARK_MAX_NODES
+#undef UIP_CONF_MAX_ROUTES
+#define UIP_CONF_MAX_ROUTES             MAC_BENCHMARK_MAX_NODES
+
+#if MAC_BENCHMARK_CONF_WITH_COAP
+#undef REST_MAX_CHUNK_SIZE
+#define REST_MAX_CHUNK_SIZE             48
+/* Requests that are retransmitted overlap the next ones */
+#undef COAP_MAX_OPEN_TRANSACTIONS
+#define COAP_MAX_OPEN_TRANSACTIONS      4
+#undef COAP_MAX_OBSERVERS
+#define COAP_MAX_OBSERVERS              1
+/* The root keeps a context per client */
+#undef OSCOAP_CONF_CONTEXT_NUM
+#define OSCOAP_CONF_CONTEXT_NUM         MAC_BENCHMARK_MAX_NODES
+#endif /* MAC_BENCHMARK_CONF_WITH_COAP */
+
+#endif /* PROJECT_CONF_H_ */
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Cost of the neighbor table lookups made for every received
+ *         frame, with 16 to 256 neighbors: the link statistics update
+ *         and the IPv6 neighbor lookup of the sender, and the lookup
+ *         of a sender that is not a neighbor. Neighbors are then
+ *         renamed and evicted, checking that every address still finds
+ *         its own entry.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=NBR_TABLE_CONF_HASH_SIZE=0
+ */
+
+#include "contiki.h"
+#include "net/nbr-table.h"
+#include "net/link-stats.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define FRAMES        100000
+#define ADDRS         (2 * NBR_TABLE_MAX_NEIGHBORS)
+
+static const int steps[] = { 16, 64, 256 };
+static uip_lladdr_t addrs[ADDRS];
+static uint32_t seed = 1;
+static int failures;
+
+NBR_TABLE(uint8_t, benchmark_table);
+/*---------------------------------------------------------------------------*/
+PROCESS(nbr_table_benchmark_process, "Neighbor table benchmark");
+AUTOSTART_PROCESSES(&nbr_table_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rand16(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+/*---------------------------------------------------------------------------*/
+/* EUI-64 addresses from a few vendors, differing in the last bytes */
+static void
+make_addr(uip_lladdr_t *lladdr, int i)
+{
+  memset(lladdr, 0, sizeof(*lladdr));
+  lladdr->addr[0] = 0x02;
+  lladdr->addr[1] = 0x12;
+  lladdr->addr[2] = 0x4b + i % 3;
+  lladdr->addr[sizeof(*lladdr) - 2] = i >> 8;
+  lladdr->addr[sizeof(*lladdr) - 1] = i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_neighbor(uip_lladdr_t *lladdr)
+{
+  uip_ipaddr_t ipaddr;
+
+  uip_ip6addr(&ipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&ipaddr, lladdr);
+  uip_ds6_nbr_add(&ipaddr, lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  link_stats_input_callback((const linkaddr_t *)lladdr);
+}
+/*---------------------------------------------------------------------------*/
+/* A random IPv6 neighbor to evict */
+const linkaddr_t *
+nbr_table_benchmark_find_removable(nbr_table_reason_t reason, void *data)
+{
+  int start;
+  int i;
+
+  start = rand16() % ADDRS;
+  for(i = 0; i < ADDRS; i++) {
+    if(uip_ds6_nbr_ll_lookup(&addrs[(start + i) % ADDRS]) != NULL) {
+      return (const linkaddr_t *)&addrs[(start + i) % ADDRS];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Every address that finds an entry finds its own, and every entry is
+   found by its address */
+static int
+check(void)
+{
+  uip_ds6_nbr_t *nbr;
+  uint8_t *item;
+  int found;
+  int i;
+
+  found = 0;
+  for(i = 0; i < ADDRS; i++) {
+    nbr = uip_ds6_nbr_ll_lookup(&addrs[i]);
+    if(nbr != NULL) {
+      if(memcmp(uip_ds6_nbr_get_ll(nbr), &addrs[i], sizeof(addrs[i])) != 0) {
+        return 0;
+      }
+      found++;
+    }
+  }
+  if(found != uip_ds6_nbr_num()) {
+    return 0;
+  }
+
+  found = 0;
+  for(item = nbr_table_head(benchmark_table); item != NULL;
+      item = nbr_table_next(benchmark_table, item)) {
+    if(nbr_table_get_from_lladdr(benchmark_table,
+                                 nbr_table_get_lladdr(benchmark_table, item))
+       != item) {
+      return 0;
+    }
+    found++;
+  }
+  for(i = 0; i < ADDRS; i++) {
+    item = nbr_table_get_from_lladdr(benchmark_table,
+                                     (const linkaddr_t *)&addrs[i]);
+    if(item != NULL) {
+      if(*item != (uint8_t)i) {
+        return 0;
+      }
+      found--;
+    }
+  }
+  return found == 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(int count)
+{
+  static int senders[FRAMES / 10];
+  uip_lladdr_t stranger;
+  double start;
+  double frame_time;
+  int i;
+
+  for(i = uip_ds6_nbr_num(); i < count; i++) {
+    add_neighbor(&addrs[i]);
+  }
+  for(i = 0; i < FRAMES / 10; i++) {
+    senders[i] = rand16() % count;
+  }
+
+  start = now();
+  for(i = 0; i < FRAMES; i++) {
+    link_stats_input_callback((const linkaddr_t *)&addrs[senders[i % (FRAMES / 10)]]);
+    uip_ds6_nbr_ll_lookup(&addrs[senders[i % (FRAMES / 10)]]);
+  }
+  frame_time = (now() - start) * 1e6 / FRAMES;
+
+  make_addr(&stranger, ADDRS + 1);
+  start = now();
+  for(i = 0; i < FRAMES; i++) {
+    uip_ds6_nbr_ll_lookup(&stranger);
+  }
+  printf("nbr: %3d neighbors, %6.3f us per frame, %6.3f us per unknown sender\n",
+         uip_ds6_nbr_num(), frame_time, (now() - start) * 1e6 / FRAMES);
+
+  if(uip_ds6_nbr_num() != count || !check()) {
+    printf("nbr: %d neighbors FAILED\n", count);
+    failures++;
+  } else {
+    printf("nbr: %d neighbors OK\n", count);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(nbr_table_benchmark_process, ev, data)
+{
+  uint8_t *item;
+  int i;
+  int j;
+
+  PROCESS_BEGIN();
+
+  nbr_table_register(benchmark_table, NULL);
+  for(i = 0; i < ADDRS; i++) {
+    make_addr(&addrs[i], i);
+  }
+  printf("nbr: %s\n", NBR_TABLE_HASH_SIZE ? "hash" : "list");
+
+  for(i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    run(steps[i]);
+  }
+
+  /* Rename neighbors to unused addresses, and onto each other */
+  for(i = 0; i < NBR_TABLE_MAX_NEIGHBORS; i += 4) {
+    j = NBR_TABLE_MAX_NEIGHBORS + rand16() % NBR_TABLE_MAX_NEIGHBORS;
+    if(nbr_table_update_lladdr((const linkaddr_t *)&addrs[i],
+                               (const linkaddr_t *)&addrs[j], 1)) {
+      memcpy(&addrs[i], &addrs[j], sizeof(addrs[i]));
+      make_addr(&addrs[j], ADDRS + 2 + i);
+    }
+  }
+  for(i = 1; i < NBR_TABLE_MAX_NEIGHBORS; i += 8) {
+    nbr_table_update_lladdr((const linkaddr_t *)&addrs[i],
+                            (const linkaddr_t *)&addrs[i + 1], 1);
+  }
+  if(!check()) {
+    printf("nbr: rename FAILED\n");
+    failures++;
+  } else {
+    printf("nbr: rename OK, %d neighbors\n", uip_ds6_nbr_num());
+  }
+
+  /* Adding to a full table evicts neighbors */
+  for(i = 0; i < ADDRS; i++) {
+    item = nbr_table_add_lladdr(benchmark_table, (const linkaddr_t *)&addrs[i],
+                                NBR_TABLE_REASON_UNDEFINED, NULL);
+    if(item != NULL) {
+      *item = i;
+    }
+  }
+  j = 0;
+  for(item = nbr_table_head(benchmark_table); item != NULL;
+      item = nbr_table_next(benchmark_table, item)) {
+    j++;
+  }
+  if(!check()) {
+    printf("nbr: eviction FAILED\n");
+    failures++;
+  } else {
+    printf("nbr: eviction OK, %d IPv6 neighbors, %d in a new table\n",
+           uip_ds6_nbr_num(), j);
+  }
+
+  printf("nbr: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
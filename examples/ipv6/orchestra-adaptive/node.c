@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Convergecast over RPL+TSCH+Orchestra, for evaluating the
+ *         traffic-adaptive Orchestra rule. All nodes but the root send
+ *         UDP packets to the root, that logs the sequence number and the
+ *         latency (in timeslots, from the ASN at which the packet was created)
+ *         of every packet it receives. Node with MAC address
+ *         c1:0c:00:00:00:00:00:01 is the root.
+ *
+ *         Build with the adaptive rule (default) or the baseline rules:
+ *           make TARGET=z1
+ *           make TARGET=z1 MAKE_WITH_ADAPTIVE=0
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/rpl/rpl.h"
+#include "net/ip/simple-udp.h"
+#include "net/mac/tsch/tsch.h"
+#include "net/mac/tsch/tsch-private.h"
+#include "orchestra.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define UDP_PORT 5678
+
+/* Packets are sent every APP_SEND_INTERVAL, with some jitter */
+#ifdef APP_CONF_SEND_INTERVAL
+#define APP_SEND_INTERVAL APP_CONF_SEND_INTERVAL
+#else
+#define APP_SEND_INTERVAL (CLOCK_SECOND / 2)
+#endif
+
+/* Nodes start sending after APP_WARM_UP, once the network has formed */
+#ifdef APP_CONF_WARM_UP
+#define APP_WARM_UP APP_CONF_WARM_UP
+#else
+#define APP_WARM_UP (120 * CLOCK_SECOND)
+#endif
+
+struct app_msg {
+  uint32_t asn;       /* ls4b of the ASN when the packet was created */
+  uint16_t seqno;
+  uint8_t sender;     /* Last byte of the sender's link-layer address */
+};
+
+static struct simple_udp_connection udp_conn;
+
+/*---------------------------------------------------------------------------*/
+PROCESS(node_process, "Convergecast node");
+AUTOSTART_PROCESSES(&node_process);
+
+/*---------------------------------------------------------------------------*/
+static void
+receiver(struct simple_udp_connection *c,
+         const uip_ipaddr_t *sender_addr,
+         uint16_t sender_port,
+         const uip_ipaddr_t *receiver_addr,
+         uint16_t receiver_port,
+         const uint8_t *data,
+         uint16_t datalen)
+{
+  struct app_msg msg;
+  if(datalen == sizeof(msg)) {
+    memcpy(&msg, data, sizeof(msg));
+    printf("App: recv from %u seqno %u latency %lu\n",
+           msg.sender, msg.seqno, (unsigned long)(current_asn.ls4b - msg.asn));
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(node_process, ev, data)
+{
+  static struct etimer periodic_timer;
+  static struct etimer send_timer;
+  static uint16_t seqno;
+  static int is_root;
+  PROCESS_BEGIN();
+
+#ifdef CONTIKI_TARGET_Z1
+  {
+    extern unsigned char node_mac[8];
+    unsigned char root_mac[8] = { 0xc1, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    is_root = memcmp(node_mac, root_mac, 8) == 0;
+  }
+#endif /* CONTIKI_TARGET_Z1 */
+
+  if(is_root) {
+    uip_ipaddr_t prefix;
+    uip_ipaddr_t global_ipaddr;
+    uip_ip6addr(&prefix, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0, 0, 0, 0, 0);
+    memcpy(&global_ipaddr, &prefix, 16);
+    uip_ds6_set_addr_iid(&global_ipaddr, &uip_lladdr);
+    uip_ds6_addr_add(&global_ipaddr, 0, ADDR_AUTOCONF);
+    rpl_set_root(RPL_DEFAULT_INSTANCE, &global_ipaddr);
+    rpl_set_prefix(rpl_get_any_dag(), &prefix, 64);
+    rpl_repair_root(RPL_DEFAULT_INSTANCE);
+  }
+  printf("App: starting as %s, adaptive rule %s\n",
+         is_root ? "root" : "sender", WITH_ADAPTIVE ? "on" : "off");
+
+  NETSTACK_MAC.on();
+  orchestra_init();
+
+  simple_udp_register(&udp_conn, UDP_PORT, NULL, UDP_PORT, receiver);
+
+  while(is_root) {
+    /* The root only receives */
+    PROCESS_YIELD();
+  }
+
+  etimer_set(&periodic_timer, APP_WARM_UP);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+  etimer_set(&periodic_timer, APP_SEND_INTERVAL);
+
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    etimer_reset(&periodic_timer);
+    etimer_set(&send_timer, random_rand() % (APP_SEND_INTERVAL / 2 + 1));
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&send_timer));
+
+    {
+      rpl_dag_t *dag = rpl_get_any_dag();
+      if(dag != NULL && tsch_is_associated) {
+        struct app_msg msg;
+        msg.asn = current_asn.ls4b;
+        msg.seqno = ++seqno;
+        msg.sender = linkaddr_node_addr.u8[LINKADDR_SIZE - 1];
+        simple_udp_sendto(&udp_conn, &msg, sizeof(msg), &dag->dag_id);
+        printf("App: sent seqno %u\n", seqno);
+      }
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
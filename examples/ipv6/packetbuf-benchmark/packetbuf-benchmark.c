@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Cost of the output path from uIP through 6LoWPAN and CSMA to
+ *         the radio. UDP packets that fit in one frame and packets
+ *         that need fragmentation are sent to a neighbor; the frames
+ *         are captured and fed back to check that they reassemble
+ *         into the original packet, and the CPU time per packet is
+ *         reported.
+ *
+ *         make TARGET=native
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "net/rime/rime.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SMALL_LEN    80
+#define LARGE_LEN    600
+#define MAX_FRAMES   16
+#define ROUNDS       2000
+
+#define UIP_IP_BUF   (&uip_buf[UIP_LLH_LEN])
+
+struct frame {
+  uint8_t len;
+  uint8_t data[127];
+};
+
+static struct frame out[MAX_FRAMES];
+static int out_count;
+static uint8_t packet[LARGE_LEN];
+static uint8_t delivered[LARGE_LEN];
+static uint16_t delivered_len;
+static linkaddr_t next_hop_ll;
+static uip_ipaddr_t dest_addr;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(packetbuf_benchmark_process, "Packetbuf benchmark");
+AUTOSTART_PROCESSES(&packetbuf_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_input(void)
+{
+  delivered_len = MIN(uip_len, LARGE_LEN);
+  memcpy(delivered, UIP_IP_BUF, delivered_len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+  if(out_count < MAX_FRAMES && packetbuf_datalen() <= sizeof(out[0].data)) {
+    out[out_count].len = packetbuf_datalen();
+    memcpy(out[out_count].data, packetbuf_dataptr(), packetbuf_datalen());
+  }
+  out_count++;
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* A UDP packet from fd02::2 to dest_addr */
+static void
+make_packet(uint16_t len, uint8_t seed)
+{
+  int i;
+
+  memset(packet, 0, UIP_IPH_LEN + UIP_UDPH_LEN);
+  packet[0] = 0x60;
+  packet[4] = (len - UIP_IPH_LEN) >> 8;
+  packet[5] = (len - UIP_IPH_LEN) & 0xff;
+  packet[6] = UIP_PROTO_UDP;
+  packet[7] = 64;
+  packet[8] = 0xfd;
+  packet[9] = 0x02;
+  packet[23] = 0x02;
+  memcpy(&packet[24], &dest_addr, sizeof(dest_addr));
+  packet[UIP_IPH_LEN] = 0x16;
+  packet[UIP_IPH_LEN + 1] = 0x33;
+  packet[UIP_IPH_LEN + 2] = 0x16;
+  packet[UIP_IPH_LEN + 3] = 0x33;
+  packet[UIP_IPH_LEN + 4] = (len - UIP_IPH_LEN) >> 8;
+  packet[UIP_IPH_LEN + 5] = (len - UIP_IPH_LEN) & 0xff;
+  for(i = UIP_IPH_LEN + UIP_UDPH_LEN; i < len; i++) {
+    packet[i] = seed ^ (i * 7);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(uint16_t len)
+{
+  out_count = 0;
+  memcpy(UIP_IP_BUF, packet, len);
+  uip_len = len;
+  tcpip_output((uip_lladdr_t *)&next_hop_ll);
+  uip_clear_buf();
+}
+/*---------------------------------------------------------------------------*/
+/* Reassemble the captured frames as the neighbor would */
+static void
+check_output(const char *name, uint16_t len)
+{
+  struct frame copy[MAX_FRAMES];
+  int count;
+  int i;
+
+  if(out_count == 0 || out_count > MAX_FRAMES) {
+    printf("pbuf: %s FAILED, %d frames sent\n", name, out_count);
+    failures++;
+    return;
+  }
+
+  count = out_count;
+  memcpy(copy, out, sizeof(copy));
+  uip_ds6_addr_add(&dest_addr, 0, ADDR_MANUAL);
+  delivered_len = 0;
+  for(i = 0; i < count; i++) {
+    packetbuf_clear();
+    packetbuf_copyfrom(copy[i].data, copy[i].len);
+    packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+    packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &next_hop_ll);
+    NETSTACK_NETWORK.input();
+  }
+  uip_ds6_addr_rm(uip_ds6_addr_lookup(&dest_addr));
+
+  if(delivered_len != len || memcmp(delivered, packet, len) != 0) {
+    printf("pbuf: %s FAILED, packet not reassembled\n", name);
+    failures++;
+    return;
+  }
+  printf("pbuf: %s OK, %d frames\n", name, count);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(packetbuf_benchmark_process, ev, data)
+{
+  static const uint16_t lens[] = { SMALL_LEN, LARGE_LEN };
+  static const char *names[] = { "single frame", "fragmented" };
+  static double start;
+  static double elapsed;
+  static int frames;
+  static int i;
+  static int j;
+
+  PROCESS_BEGIN();
+
+  memset(&next_hop_ll, 0, sizeof(next_hop_ll));
+  next_hop_ll.u8[0] = 0x02;
+  next_hop_ll.u8[LINKADDR_SIZE - 1] = 0x10;
+  uip_ip6addr(&dest_addr, 0xfd00, 0, 0, 0, 0, 0, 0, 5);
+
+  rime_sniffer_add(&sniffer);
+
+  for(j = 0; j < 2; j++) {
+    make_packet(lens[j], j);
+    send_packet(lens[j]);
+    /* Wait until CSMA has sent the queued frames */
+    while(queuebuf_numfree() < QUEUEBUF_NUM) {
+      PROCESS_PAUSE();
+    }
+    check_output(names[j], lens[j]);
+
+    elapsed = 0;
+    frames = 0;
+    for(i = 0; i < ROUNDS; i++) {
+      start = now();
+      send_packet(lens[j]);
+      while(queuebuf_numfree() < QUEUEBUF_NUM) {
+        PROCESS_PAUSE();
+      }
+      elapsed += now() - start;
+      frames += out_count;
+    }
+    printf("pbuf: %s, %d bytes, %d frames, %5.2f us per packet\n",
+           names[j], lens[j], frames / ROUNDS, elapsed * 1e6 / ROUNDS);
+  }
+
+  printf("pbuf: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
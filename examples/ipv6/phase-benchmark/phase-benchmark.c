@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Phase locks under clock drift. A neighbor wakes up every
+ *         cycle of its own clock, which drifts from ours; packets are
+ *         sent to it at random intervals around a mean, and each
+ *         transmission starts where the phase lock predicts its next
+ *         wake-up. Time is simulated, in rtimer ticks of the native
+ *         platform (1 ms), with ContikiMAC-like timings at a
+ *         128-tick cycle. Reports, per interval, the strobing time per
+ *         packet (the sender's radio-on time), the latency and the
+ *         missed wake-ups, after each of which ContikiMAC would fall
+ *         back to strobing over a whole cycle.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=PHASE_CONF_DRIFT_CORRECT=0
+ */
+
+#include "contiki.h"
+#include "net/mac/phase.h"
+
+#include <stdio.h>
+
+#define CYCLE           128
+#define GUARD           14
+#define MIN_GUARD       5
+#define MAX_STROBE      17
+#define FRAME           1
+#define PACKETS         200
+#define DRIFT_PPM       40
+
+struct result {
+  double strobe;
+  double latency;
+  int misses;
+  /* Misses once the lock has seen the neighbor twice */
+  int settled_misses;
+};
+
+static int failures;
+static uint32_t seed = 1;
+/*---------------------------------------------------------------------------*/
+PROCESS(phase_benchmark_process, "Phase benchmark");
+AUTOSTART_PROCESSES(&phase_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+rand_unit(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) / 65536.0;
+}
+/*---------------------------------------------------------------------------*/
+/* The first wake-up of the neighbor at or after a time */
+static double
+next_wakeup(double t, double phase, double cycle)
+{
+  double k = (t - phase) / cycle;
+
+  return phase + (k > (long)k ? (long)k + 1 : (long)k) * cycle;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(double interval, struct result *r, struct phase_lock *l)
+{
+  double cycle = CYCLE * (1 + DRIFT_PPM / 1e6);
+  double phase = 37.25;
+  double t;
+  double start;
+  double w;
+  int i;
+
+  r->strobe = 0;
+  r->latency = 0;
+  r->misses = 0;
+  r->settled_misses = 0;
+
+  /* The first packet strobes until the neighbor wakes up */
+  t = 1000;
+  w = next_wakeup(t, phase, cycle);
+  phase_lock_init(l, (rtimer_clock_t)w, (clock_time_t)w);
+
+  for(i = 0; i < PACKETS; i++) {
+    t += interval * (0.5 + rand_unit());
+    start = t + phase_lock_wait(l, (rtimer_clock_t)t, (clock_time_t)t,
+                                CYCLE, GUARD, MIN_GUARD);
+    w = next_wakeup(start, phase, cycle);
+    if(w - start > MAX_STROBE) {
+      /* Missed: strobe over the next cycle instead */
+      r->misses++;
+      if(i > 0) {
+        r->settled_misses++;
+      }
+      phase_lock_miss(l);
+      start += MAX_STROBE;
+      w = next_wakeup(start, phase, cycle);
+    }
+    r->strobe += w - start + FRAME;
+    r->latency += w - t + FRAME;
+    /* The ACK comes back within a strobe of the wake-up */
+    w += rand_unit();
+    phase_lock_update(l, (rtimer_clock_t)w, (clock_time_t)w, CYCLE);
+  }
+  r->strobe /= PACKETS;
+  r->latency /= PACKETS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int ok)
+{
+  printf("phase: %s %s\n", name, ok ? "OK" : "FAILED");
+  if(!ok) {
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(phase_benchmark_process, ev, data)
+{
+  static const int intervals[] = { 10, 60, 300, 900 };
+  struct phase_lock l;
+  struct result r;
+  int misses;
+  int i;
+
+  PROCESS_BEGIN();
+
+  printf("phase: %d ppm drift, %d tick cycle, without a phase lock %d ticks strobing per packet\n",
+         DRIFT_PPM, CYCLE, CYCLE / 2 + FRAME);
+
+  misses = 0;
+  for(i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++) {
+    run(intervals[i] * 1000.0, &r, &l);
+    printf("phase: every %4d s: strobing %5.2f ticks per packet, latency %6.2f ticks, %3d missed\n",
+           intervals[i], r.strobe, r.latency, r.misses);
+    if(intervals[i] * 3 / 2 * DRIFT_PPM / 1000 < MAX_STROBE - GUARD - 1) {
+      /* The drift stays within the strobe time */
+      misses += r.settled_misses;
+    }
+#if PHASE_DRIFT_CORRECT
+    misses += r.settled_misses;
+    if(i == 1) {
+      double ppm = l.drift / 65536.0 / CYCLE * 1e6;
+      printf("phase: drift estimate %.1f ppm\n", ppm);
+      check("drift estimate", ppm > DRIFT_PPM * 0.75 && ppm < DRIFT_PPM * 1.25);
+      check("guard time", r.strobe < (GUARD + MIN_GUARD) / 2 + FRAME);
+    }
+#endif /* PHASE_DRIFT_CORRECT */
+  }
+  check("no missed wake-ups", misses == 0);
+
+  printf("phase: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Success rate and CPU cost of 6LoWPAN fragment reassembly.
+ *         FLOWS senders each send a PACKET_LEN byte packet per round.
+ *         Their fragments are interleaved and then, depending on the
+ *         scenario, shuffled, duplicated or lost before they are passed
+ *         to the network driver. Packets are counted as they leave
+ *         reassembly and their contents are checked. Between rounds the
+ *         senders are idle for ROUND_GAP, shorter than the reassembly
+ *         timeout.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=SICSLOWPAN_CONF_REASS_CONTEXTS=2
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/packetbuf.h"
+#include "net/netstack.h"
+#include "net/rime/rime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FLOWS        4
+#define ROUNDS       64
+#define ROUND_GAP    (CLOCK_SECOND / 8)
+#define PACKET_LEN   600
+/* IP bytes per fragment, a multiple of 8 */
+#define CHUNK        96
+#define FRAGS        ((PACKET_LEN + CHUNK - 1) / CHUNK)
+#define MAX_FRAMES   (2 * FLOWS * FRAGS)
+
+#define UIP_IP_BUF   (&uip_buf[UIP_LLH_LEN])
+
+struct frame {
+  uint8_t flow;
+  uint8_t len;
+  uint8_t data[CHUNK + SICSLOWPAN_FRAGN_HDR_LEN + 1];
+};
+
+struct scenario {
+  const char *name;
+  uint8_t shuffle;
+  uint8_t loss;        /* percent of fragments lost */
+  uint8_t duplicate;   /* percent of fragments sent twice */
+};
+
+static const struct scenario scenarios[] = {
+  { "in order",   0, 0, 0 },
+  { "shuffled",   1, 0, 0 },
+  { "duplicates", 1, 0, 10 },
+  { "loss 2%",    1, 2, 0 },
+  { "loss 5%",    1, 5, 0 },
+};
+
+static struct frame frames[MAX_FRAMES];
+static uint8_t packet[PACKET_LEN];
+static uint16_t tags[FLOWS];
+static uint8_t round_no;
+static unsigned long delivered;
+static unsigned long corrupt;
+static unsigned long deliverable;
+static unsigned long fragments;
+static double input_time;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(reassembly_benchmark_process, "Reassembly benchmark");
+AUTOSTART_PROCESSES(&reassembly_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+/* An IPv6 packet to ff02::1 with no next header. The payload identifies
+   the flow and round so that the receiver can rebuild it. */
+static void
+make_packet(uint8_t flow, uint8_t round)
+{
+  int i;
+
+  memset(packet, 0, UIP_IPH_LEN);
+  packet[0] = 0x60;
+  packet[4] = (PACKET_LEN - UIP_IPH_LEN) >> 8;
+  packet[5] = (PACKET_LEN - UIP_IPH_LEN) & 0xff;
+  packet[6] = UIP_PROTO_NONE;
+  packet[7] = 64;
+  packet[8] = 0xfe;
+  packet[9] = 0x80;
+  packet[23] = flow + 1;
+  packet[24] = 0xff;
+  packet[25] = 0x02;
+  packet[39] = 0x01;
+  for(i = UIP_IPH_LEN; i < PACKET_LEN; i++) {
+    packet[i] = flow ^ round ^ (i * 7);
+  }
+  packet[UIP_IPH_LEN] = flow;
+  packet[UIP_IPH_LEN + 1] = round;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_input(void)
+{
+  uint8_t flow;
+
+  flow = UIP_IP_BUF[UIP_IPH_LEN];
+  if(uip_len != PACKET_LEN || flow >= FLOWS) {
+    corrupt++;
+    return;
+  }
+  make_packet(flow, UIP_IP_BUF[UIP_IPH_LEN + 1]);
+  if(memcmp(UIP_IP_BUF, packet, PACKET_LEN) != 0) {
+    corrupt++;
+    return;
+  }
+  delivered++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* Fragment one packet per flow and interleave the fragments */
+static int
+make_frames(const struct scenario *s)
+{
+  struct frame tmp;
+  uint8_t lost[FLOWS];
+  int n;
+  int i;
+  int j;
+  int flow;
+  int offset;
+  int len;
+
+  n = 0;
+  memset(lost, 0, sizeof(lost));
+  for(i = 0; i < FRAGS; i++) {
+    for(flow = 0; flow < FLOWS; flow++) {
+      make_packet(flow, round_no);
+      offset = i * CHUNK;
+      len = MIN(CHUNK, PACKET_LEN - offset);
+      if(s->loss > 0 && rand() % 100 < s->loss) {
+        lost[flow] = 1;
+        continue;
+      }
+      frames[n].flow = flow;
+      frames[n].data[2] = tags[flow] >> 8;
+      frames[n].data[3] = tags[flow] & 0xff;
+      if(i == 0) {
+        frames[n].data[0] = SICSLOWPAN_DISPATCH_FRAG1 | (PACKET_LEN >> 8);
+        frames[n].data[SICSLOWPAN_FRAG1_HDR_LEN] = SICSLOWPAN_DISPATCH_IPV6;
+        memcpy(&frames[n].data[SICSLOWPAN_FRAG1_HDR_LEN + 1], packet, len);
+        frames[n].len = SICSLOWPAN_FRAG1_HDR_LEN + 1 + len;
+      } else {
+        frames[n].data[0] = SICSLOWPAN_DISPATCH_FRAGN | (PACKET_LEN >> 8);
+        frames[n].data[4] = offset >> 3;
+        memcpy(&frames[n].data[SICSLOWPAN_FRAGN_HDR_LEN], packet + offset, len);
+        frames[n].len = SICSLOWPAN_FRAGN_HDR_LEN + len;
+      }
+      frames[n].data[1] = PACKET_LEN & 0xff;
+      n++;
+      if(s->duplicate > 0 && rand() % 100 < s->duplicate) {
+        frames[n] = frames[n - 1];
+        n++;
+      }
+    }
+  }
+  for(flow = 0; flow < FLOWS; flow++) {
+    if(!lost[flow]) {
+      deliverable++;
+    }
+    tags[flow]++;
+  }
+
+  if(s->shuffle) {
+    for(i = n - 1; i > 0; i--) {
+      j = rand() % (i + 1);
+      tmp = frames[i];
+      frames[i] = frames[j];
+      frames[j] = tmp;
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_frames(int n)
+{
+  linkaddr_t sender;
+  double start;
+  int i;
+
+  start = now();
+  for(i = 0; i < n; i++) {
+    memset(&sender, 0, sizeof(sender));
+    sender.u8[LINKADDR_SIZE - 1] = frames[i].flow + 1;
+    packetbuf_clear();
+    packetbuf_copyfrom(frames[i].data, frames[i].len);
+    packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &sender);
+    packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &linkaddr_node_addr);
+    NETSTACK_NETWORK.input();
+  }
+  input_time += now() - start;
+  fragments += n;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(reassembly_benchmark_process, ev, data)
+{
+  static struct etimer et;
+  static const struct scenario *s;
+  static const struct sicslowpan_reass_stats *stats;
+  static struct sicslowpan_reass_stats start;
+  static int i;
+
+  PROCESS_BEGIN();
+
+  srand(1);
+  rime_sniffer_add(&sniffer);
+  stats = sicslowpan_get_reass_stats();
+  printf("reass: %d flows, %d byte packets, %d fragments each, %d rounds\n",
+         FLOWS, PACKET_LEN, FRAGS, ROUNDS);
+
+  for(i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    s = &scenarios[i];
+    delivered = corrupt = deliverable = fragments = 0;
+    input_time = 0;
+    start = *stats;
+
+    for(round_no = 0; round_no < ROUNDS; round_no++) {
+      send_frames(make_frames(s));
+      etimer_set(&et, ROUND_GAP);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    }
+    /* Let anything incomplete time out before the next scenario */
+    etimer_set(&et, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16 + CLOCK_SECOND / 4);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+    printf("reass: %-10s delivered %3lu/%3lu (%5.1f%%), %5.2f us/fragment, "
+           "timed out %u, discarded %u, duplicates %u, no context %u\n",
+           s->name, delivered, deliverable, 100.0 * delivered / deliverable,
+           input_time * 1e6 / fragments,
+           (uint16_t)(stats->timed_out - start.timed_out),
+           (uint16_t)(stats->discarded - start.discarded),
+           (uint16_t)(stats->duplicates - start.duplicates),
+           (uint16_t)(stats->no_context - start.no_context));
+    if(corrupt > 0 || (s->loss == 0 && delivered != deliverable)) {
+      printf("reass: %s FAILED, %lu corrupt\n", s->name, corrupt);
+      failures++;
+    } else {
+      printf("reass: %s OK\n", s->name);
+    }
+  }
+  printf("reass: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Longest prefix match in the uIPv6 routing table with 100, 1k
+ *         and 10k routes. Host routes and a few shorter prefixes are
+ *         added through four next hops; lookups of random addresses
+ *         are checked against a scan of the added routes, and the time
+ *         per lookup, add and remove is reported.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=UIP_CONF_DS6_ROUTE_TRIE=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NEXT_HOPS     4
+#define LOOKUPS       10000
+/* One route in PREFIX_EVERY is a prefix shorter than 128 bits */
+#define PREFIX_EVERY  16
+
+struct route {
+  uip_ipaddr_t addr;
+  uint8_t length;
+  uint8_t added;
+};
+
+static const int steps[] = { 100, 1000, 10000 };
+static struct route routes[UIP_DS6_ROUTE_NB];
+static uip_ipaddr_t next_hops[NEXT_HOPS];
+static uint32_t seed = 1;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(route_benchmark_process, "Route benchmark");
+AUTOSTART_PROCESSES(&route_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rand16(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+/*---------------------------------------------------------------------------*/
+/* Host routes in fd00::/64 and prefixes from /48 to /112 in fd00::/16,
+   made distinct by the route index. uip_ds6_route_add() looks up the
+   new route by longest match, so no prefix covers another route. */
+static void
+make_route(struct route *r, int i)
+{
+  uip_ip6addr(&r->addr, 0xfd00, 0, 0, 0,
+              rand16(), rand16(), rand16(), rand16());
+  r->length = 128;
+  if(i % PREFIX_EVERY == 0) {
+    r->addr.u16[1] = UIP_HTONS(i + 1);
+    r->length = 48 + (rand16() % 5) * 16;
+    memset(&r->addr.u8[r->length >> 3], 0, 16 - (r->length >> 3));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* An address of a host route, or under a prefix, or random */
+static void
+make_address(uip_ipaddr_t *addr, int count)
+{
+  const struct route *r;
+  int i;
+
+  r = &routes[rand16() % count];
+  uip_ipaddr_copy(addr, &r->addr);
+  switch(rand16() % 3) {
+  case 0:
+    break;
+  case 1:
+    for(i = r->length >> 3; i < 16; i++) {
+      addr->u8[i] = rand16();
+    }
+    break;
+  default:
+    for(i = 2; i < 16; i++) {
+      addr->u8[i] = rand16();
+    }
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The longest match among the routes in the table */
+static const struct route *
+scan(const uip_ipaddr_t *addr, int count)
+{
+  const struct route *found;
+  int i;
+
+  found = NULL;
+  for(i = 0; i < count; i++) {
+    if(routes[i].added &&
+       (found == NULL || routes[i].length > found->length) &&
+       uip_ipaddr_prefixcmp(addr, &routes[i].addr, routes[i].length)) {
+      found = &routes[i];
+    }
+  }
+  return found;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_lookups(int count)
+{
+  const struct route *expected;
+  uip_ds6_route_t *r;
+  uip_ipaddr_t addr;
+  int i;
+
+  for(i = 0; i < 1000; i++) {
+    make_address(&addr, count);
+    expected = scan(&addr, count);
+    r = uip_ds6_route_lookup(&addr);
+    if(expected == NULL ? r != NULL :
+       r == NULL || r->length != expected->length ||
+       !uip_ipaddr_cmp(&r->ipaddr, &expected->addr)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(int *count, int target)
+{
+  uip_ipaddr_t addrs[LOOKUPS / 10];
+  uip_ds6_route_t *r;
+  double start;
+  double add_time;
+  int i;
+  int removed;
+
+  start = now();
+  for(; *count < target; (*count)++) {
+    make_route(&routes[*count], *count);
+    routes[*count].added = uip_ds6_route_add(&routes[*count].addr,
+                                             routes[*count].length,
+                                             &next_hops[*count % NEXT_HOPS])
+      != NULL;
+  }
+  add_time = now() - start;
+
+  for(i = 0; i < LOOKUPS / 10; i++) {
+    make_address(&addrs[i], *count);
+  }
+  start = now();
+  for(i = 0; i < LOOKUPS; i++) {
+    uip_ds6_route_lookup(&addrs[i % (LOOKUPS / 10)]);
+  }
+  printf("route: %5d routes, %7.3f us per lookup, %7.3f us per add",
+         uip_ds6_route_num_routes(), (now() - start) * 1e6 / LOOKUPS,
+         add_time * 1e6 / (target - (target == steps[0] ? 0 : target / 10)));
+
+  /* Remove and add back a tenth of the routes */
+  start = now();
+  removed = 0;
+  for(i = 0; i < *count; i += 10) {
+    r = uip_ds6_route_lookup(&routes[i].addr);
+    if(r != NULL && r->length == routes[i].length) {
+      uip_ds6_route_rm(r);
+      routes[i].added = 0;
+      removed++;
+    }
+  }
+  printf(", %7.3f us per remove\n", (now() - start) * 1e6 / removed);
+
+  if(uip_ds6_route_num_routes() + removed != *count ||
+     !check_lookups(*count)) {
+    printf("route: %d routes FAILED with routes removed\n", *count);
+    failures++;
+  }
+  for(i = 0; i < *count; i += 10) {
+    if(!routes[i].added) {
+      routes[i].added = uip_ds6_route_add(&routes[i].addr, routes[i].length,
+                                          &next_hops[i % NEXT_HOPS]) != NULL;
+    }
+  }
+  if(uip_ds6_route_num_routes() != *count || !check_lookups(*count)) {
+    printf("route: %d routes FAILED\n", *count);
+    failures++;
+  } else {
+    printf("route: %d routes OK\n", *count);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(route_benchmark_process, ev, data)
+{
+  static int count;
+  uip_lladdr_t lladdr;
+  uip_ds6_route_t *r;
+  int i;
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i < NEXT_HOPS; i++) {
+    memset(&lladdr, 0, sizeof(lladdr));
+    lladdr.addr[0] = 0x02;
+    lladdr.addr[sizeof(lladdr) - 1] = i + 1;
+    uip_ip6addr(&next_hops[i], 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&next_hops[i], &lladdr);
+    uip_ds6_nbr_add(&next_hops[i], &lladdr, 1, NBR_REACHABLE,
+                    NBR_TABLE_REASON_UNDEFINED, NULL);
+  }
+  printf("route: %s\n", UIP_DS6_ROUTE_TRIE ? "trie" : "list");
+
+  count = 0;
+  for(i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    run(&count, steps[i]);
+  }
+
+  /* Removing a next hop removes its routes */
+  uip_ds6_route_rm_by_nexthop(&next_hops[0]);
+  for(i = 0; i < count; i++) {
+    if(i % NEXT_HOPS == 0) {
+      routes[i].added = 0;
+    }
+  }
+  for(r = uip_ds6_route_head(), i = 0; r != NULL; r = uip_ds6_route_next(r)) {
+    i++;
+  }
+  if(i != uip_ds6_route_num_routes() || !check_lookups(count)) {
+    printf("route: next hop removal FAILED\n");
+    failures++;
+  } else {
+    printf("route: next hop removal OK, %d routes left\n", i);
+  }
+
+  printf("route: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         Cost of routing downward packets at a non-storing RPL root
+ *         with 1k and 5k nodes: the source routing header is inserted
+ *         and the next hop looked up, for destinations picked from all
+ *         nodes and from 256 busy ones. Every source route is checked
+ *         against the tree, again after nodes change parent, expire
+ *         and join.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=RPL_NS_CONF_HASH_SIZE=0,RPL_NS_CONF_SRH_CACHE_SIZE=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/rpl/rpl-private.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NODES         5000
+#define PACKETS       100000
+#define BUSY          256
+#define PAYLOAD_LEN   32
+
+#define UIP_IP_BUF    ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_RH_BUF    ((struct uip_routing_hdr *)&uip_buf[UIP_LLIPH_LEN])
+#define UIP_SRH_BUF   ((struct uip_rpl_srh_hdr *)&uip_buf[UIP_LLIPH_LEN + RPL_RH_LEN])
+
+static const int steps[] = { 1000, NODES };
+/* The tree, by node number. The root is node 0. */
+static uint16_t parents[NODES + 1];
+static uint16_t ids[NODES + 1];
+static uint8_t joined[NODES + 1];
+static int next_id;
+static rpl_dag_t *dag;
+static uint32_t seed = 1;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(rpl_ns_benchmark_process, "RPL non-storing benchmark");
+AUTOSTART_PROCESSES(&rpl_ns_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rand16(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+/*---------------------------------------------------------------------------*/
+static void
+node_addr(uip_ipaddr_t *addr, int node)
+{
+  uip_ip6addr(addr, 0xfd00, 0, 0, 0, 0x0212, 0x4b00, 0, ids[node]);
+}
+/*---------------------------------------------------------------------------*/
+/* Each node picks a parent that joined before it */
+static void
+join(int node, int parent)
+{
+  uip_ipaddr_t child_addr;
+  uip_ipaddr_t parent_addr;
+
+  node_addr(&child_addr, node);
+  node_addr(&parent_addr, parent);
+  if(rpl_ns_update_node(dag, &child_addr, &parent_addr, 0xffffffff) != NULL) {
+    parents[node] = parent;
+    joined[node] = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+random_parent(int node)
+{
+  int parent;
+
+  do {
+    parent = node < 8 ? 0 : rand16() % node;
+  } while(!joined[parent]);
+  return parent;
+}
+/*---------------------------------------------------------------------------*/
+static void
+route(int node)
+{
+  uip_ipaddr_t next_hop;
+
+  memset(uip_buf, 0, UIP_LLIPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = 64;
+  UIP_IP_BUF->len[1] = PAYLOAD_LEN;
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &dag->dag_id);
+  node_addr(&UIP_IP_BUF->destipaddr, node);
+  uip_len = UIP_IPH_LEN + PAYLOAD_LEN;
+  uip_ext_len = 0;
+
+  rpl_update_header();
+  rpl_srh_get_next_hop(&next_hop);
+}
+/*---------------------------------------------------------------------------*/
+/* The packet is sent to the child of the root on the path to the node,
+   with the rest of the path in the source routing header */
+static int
+check_route(int node)
+{
+  uip_ipaddr_t dest;
+  uip_ipaddr_t addr;
+  uint16_t path[NODES];
+  uint8_t cmpr;
+  int len;
+  int i;
+
+  route(node);
+  if(!joined[node]) {
+    node_addr(&addr, node);
+    return UIP_IP_BUF->proto == UIP_PROTO_UDP &&
+      uip_ipaddr_cmp(&UIP_IP_BUF->destipaddr, &addr);
+  }
+
+  for(len = 0, i = node; i != 0; i = parents[i]) {
+    path[len++] = i;
+  }
+  node_addr(&addr, path[len - 1]);
+  if(!uip_ipaddr_cmp(&UIP_IP_BUF->destipaddr, &addr)) {
+    return 0;
+  }
+  if(len == 1) {
+    return UIP_IP_BUF->proto == UIP_PROTO_UDP;
+  }
+  if(UIP_IP_BUF->proto != UIP_PROTO_ROUTING ||
+     UIP_RH_BUF->seg_left != len - 1) {
+    return 0;
+  }
+  cmpr = UIP_SRH_BUF->cmpr >> 4;
+  node_addr(&dest, node);
+  for(i = 0; i < len - 1; i++) {
+    uip_ipaddr_copy(&addr, &dest);
+    memcpy(&addr.u8[cmpr], (uint8_t *)UIP_SRH_BUF + RPL_SRH_LEN + i * (16 - cmpr),
+           16 - cmpr);
+    node_addr(&dest, path[len - 2 - i]);
+    if(!uip_ipaddr_cmp(&addr, &dest)) {
+      return 0;
+    }
+    node_addr(&dest, node);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_routes(int count)
+{
+  int i;
+
+  for(i = 1; i <= count; i++) {
+    if(!check_route(i)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static double
+time_routes(int count, int busy)
+{
+  static uint16_t dests[PACKETS / 10];
+  double start;
+  int i;
+
+  for(i = 0; i < PACKETS / 10; i++) {
+    dests[i] = 1 + rand16() % (busy ? BUSY : count);
+    if(busy) {
+      dests[i] = 1 + dests[i] * (count / BUSY) % count;
+    }
+  }
+  start = now();
+  for(i = 0; i < PACKETS; i++) {
+    route(dests[i % (PACKETS / 10)]);
+  }
+  return (now() - start) * 1e6 / PACKETS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *name, int ok)
+{
+  if(ok) {
+    printf("ns: %s OK\n", name);
+  } else {
+    printf("ns: %s FAILED\n", name);
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(rpl_ns_benchmark_process, ev, data)
+{
+  static int count;
+  uip_ipaddr_t addr;
+  uip_ipaddr_t parent_addr;
+  double uniform;
+  int i;
+  int j;
+  char name[32];
+
+  PROCESS_BEGIN();
+
+  for(i = 0; i <= NODES; i++) {
+    ids[i] = i;
+  }
+  next_id = NODES + 1;
+  node_addr(&addr, 0);
+  uip_ds6_addr_add(&addr, 0, ADDR_MANUAL);
+  dag = rpl_set_root(RPL_DEFAULT_INSTANCE, &addr);
+  uip_ip6addr(&addr, 0xfd00, 0, 0, 0, 0, 0, 0, 0);
+  rpl_set_prefix(dag, &addr, 64);
+  joined[0] = 1;
+  printf("ns: hash %d, cache %d\n", RPL_NS_HASH_SIZE, RPL_NS_SRH_CACHE_SIZE);
+
+  count = 0;
+  for(i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    for(; count < steps[i]; count++) {
+      join(count + 1, random_parent(count + 1));
+    }
+    uniform = time_routes(count, 0);
+    printf("ns: %4d nodes, %6.3f us per packet to any node, %6.3f us to busy nodes\n",
+           rpl_ns_num_nodes(), uniform, time_routes(count, 1));
+    sprintf(name, "%d nodes", count);
+    report(name, rpl_ns_num_nodes() == count + 1 && check_routes(count));
+  }
+
+  /* A tenth of the nodes change parent */
+  for(i = 0; i < count / 10; i++) {
+    j = 1 + rand16() % count;
+    join(j, random_parent(j));
+    route(j);
+  }
+  report("parent change", check_routes(count));
+
+  /* Leaves go away */
+  for(i = 1; i <= count; i++) {
+    joined[i] = 2;
+  }
+  for(i = 1; i <= count; i++) {
+    joined[parents[i]] = 1;
+  }
+  for(i = 1; i <= count; i++) {
+    if(joined[i] == 2 && rand16() % 2) {
+      node_addr(&addr, i);
+      node_addr(&parent_addr, parents[i]);
+      rpl_ns_expire_parent(dag, &addr, &parent_addr);
+      joined[i] = 0;
+    } else {
+      joined[i] = 1;
+    }
+  }
+  for(i = 0; i < RPL_NOPATH_REMOVAL_DELAY; i++) {
+    rpl_ns_periodic();
+  }
+  report("expiry", check_routes(count));
+
+  /* New nodes take their place */
+  for(i = 1; i <= count; i++) {
+    if(!joined[i]) {
+      ids[i] = next_id++;
+      join(i, random_parent(i));
+    }
+  }
+  report("rejoin", rpl_ns_num_nodes() == count + 1 && check_routes(count));
+
+  printf("ns: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+#ifndef PROJECT_CONF_H_
+#define PROJECT_CONF_H_
+
+#ifndef TSCH_QUEUE_CONF_NBR_HASH_SIZE
+#define TSCH_QUEUE_CONF_NBR_HASH_SIZE   32
+#endif /* TSCH_QUEUE_CONF_NBR_HASH_SIZE */
+
+#ifndef TSCH_QUEUE_CONF_WITH_READY_LIST
+#define TSCH_QUEUE_CONF_WITH_READY_LIST 1
+#endif /* TSCH_QUEUE_CONF_WITH_READY_LIST */
+
+/* 64 unicast neighbors, plus the EB and broadcast queues */
+#define TSCH_QUEUE_CONF_MAX_NEIGHBOR_QUEUES 66
+#define QUEUEBUF_CONF_NUM               64
+#define TSCH_QUEUE_CONF_NUM_PER_NEIGHBOR 8
+
+/* No log of every link that is added or removed */
+#define TSCH_LOG_CONF_LEVEL             0
+
+#endif /* PROJECT_CONF_H_ */
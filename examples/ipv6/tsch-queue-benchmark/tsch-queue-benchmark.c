@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         TSCH neighbor queues. A node with 64 unicast neighbors, a
+ *         shared broadcast link and dedicated links to some of the
+ *         neighbors sends packets that fail now and then, so that
+ *         neighbors go in and out of backoff. At each shared slot the
+ *         neighbor chosen for a unicast packet is checked against all
+ *         neighbors, and so are the backoff windows after each slot;
+ *         the dedicated links move from neighbor to neighbor and
+ *         unused neighbors are freed along the way. The same traffic
+ *         is then run without the checks to report the CPU time per
+ *         slot.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=TSCH_QUEUE_CONF_NBR_HASH_SIZE=0,TSCH_QUEUE_CONF_WITH_READY_LIST=0
+ */
+
+#include "contiki.h"
+#include "lib/list.h"
+#include "lib/random.h"
+#include "net/packetbuf.h"
+#include "net/mac/tsch/tsch-queue.h"
+#include "net/mac/tsch/tsch-schedule.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NEIGHBORS      64
+#define DEDICATED      8
+#define CHECKED_SLOTS  100000UL
+#define TIMED_SLOTS    1000000UL
+#define LOAD           6        /* One packet every LOAD slots */
+#define FAILURE        4        /* One transmission in FAILURE fails */
+#define DEDICATED_SLOT 5        /* One slot in DEDICATED_SLOT is dedicated */
+#define MOVE_PERIOD    1000     /* Slots between moves of a dedicated link */
+#define MAX_RETRIES    8
+
+static linkaddr_t addrs[NEIGHBORS];
+static struct tsch_link *dedicated[DEDICATED];
+static struct tsch_link *shared_link;
+static uint8_t expected_windows[NEIGHBORS];
+static unsigned long shared_slots;
+static unsigned long sent;
+static int selection_ok;
+static int windows_ok;
+static int lookups_ok;
+static uint32_t seed = 1;
+static int failures;
+
+/* What the queues and the schedule need from the rest of TSCH */
+const linkaddr_t tsch_broadcast_address = { { 0xff, 0xff, 0xff, 0xff,
+                                              0xff, 0xff, 0xff, 0xff } };
+const linkaddr_t tsch_eb_address = { { 0, 0, 0, 0, 0, 0, 0, 0 } };
+struct tsch_link *current_link;
+int tsch_is_coordinator = 1;
+/*---------------------------------------------------------------------------*/
+int
+tsch_is_locked(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_get_lock(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_release_lock(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(tsch_queue_benchmark_process, "TSCH queue benchmark");
+AUTOSTART_PROCESSES(&tsch_queue_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rand16(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+/*---------------------------------------------------------------------------*/
+static void
+enqueue(int i)
+{
+  packetbuf_clear();
+  packetbuf_copyfrom(&i, sizeof(i));
+  tsch_queue_add_packet(&addrs[i], NULL, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Transmission of the head packet of a neighbor, as the slot operation
+ * does it after the slot */
+static void
+transmit(struct tsch_neighbor *n, struct tsch_packet *p, int is_shared)
+{
+  p->transmissions++;
+  if(rand16() % FAILURE != 0) {
+    tsch_queue_remove_packet_from_queue(n);
+    tsch_queue_free_packet(p);
+    if(is_shared || tsch_queue_is_empty(n)) {
+      tsch_queue_backoff_reset(n);
+    }
+  } else {
+    if(p->transmissions >= MAX_RETRIES + 1) {
+      tsch_queue_remove_packet_from_queue(n);
+      tsch_queue_free_packet(p);
+    }
+    if(is_shared) {
+      tsch_queue_backoff_inc(n);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Backoff windows after a slot, computed from all neighbors */
+static void
+expect_windows(const linkaddr_t *dest_addr)
+{
+  int is_broadcast = linkaddr_cmp(dest_addr, &tsch_broadcast_address);
+  int i;
+
+  for(i = 0; i < NEIGHBORS; i++) {
+    struct tsch_neighbor *n = tsch_queue_get_nbr(&addrs[i]);
+    expected_windows[i] = 0;
+    if(n != NULL) {
+      expected_windows[i] = n->backoff_window;
+      if(n->backoff_window != 0
+         && ((n->tx_links_count == 0 && is_broadcast)
+             || (n->tx_links_count > 0 && linkaddr_cmp(dest_addr, &n->addr)))) {
+        expected_windows[i]--;
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_windows(void)
+{
+  int i;
+
+  for(i = 0; i < NEIGHBORS; i++) {
+    struct tsch_neighbor *n = tsch_queue_get_nbr(&addrs[i]);
+    if((n != NULL ? n->backoff_window : 0) != expected_windows[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* May this neighbor send a unicast packet in the shared slot? */
+static int
+may_send(const struct tsch_neighbor *n)
+{
+  return n != NULL && !n->is_broadcast && n->tx_links_count == 0
+    && !tsch_queue_is_empty(n) && tsch_queue_backoff_expired(n);
+}
+/*---------------------------------------------------------------------------*/
+static int
+any_may_send(void)
+{
+  int i;
+
+  for(i = 0; i < NEIGHBORS; i++) {
+    if(may_send(tsch_queue_get_nbr(&addrs[i]))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Moves a dedicated link to a neighbor that does not have one */
+static void
+move_dedicated_link(struct tsch_slotframe *sf, int d)
+{
+  int i;
+
+  do {
+    i = rand16() % NEIGHBORS;
+  } while(tsch_queue_get_nbr(&addrs[i]) != NULL
+          && tsch_queue_get_nbr(&addrs[i])->tx_links_count > 0);
+  tsch_schedule_remove_link(sf, dedicated[d]);
+  dedicated[d] = tsch_schedule_add_link(sf, LINK_OPTION_TX, LINK_TYPE_NORMAL,
+                                        &addrs[i], d, 0);
+}
+/*---------------------------------------------------------------------------*/
+/* One slot of the schedule, checked against all neighbors or not */
+static void
+run_slot(struct tsch_slotframe *sf, unsigned long slot, int check)
+{
+  struct tsch_neighbor *n;
+  struct tsch_packet *p;
+  int i;
+
+  if(rand16() % LOAD == 0) {
+    enqueue(rand16() % NEIGHBORS);
+  }
+
+  if(slot % DEDICATED_SLOT == 0) {
+    /* A dedicated slot */
+    const linkaddr_t *addr = &dedicated[rand16() % DEDICATED]->addr;
+    n = tsch_queue_get_nbr(addr);
+    p = tsch_queue_get_packet_for_nbr(n, NULL);
+    if(p != NULL) {
+      transmit(n, p, 0);
+    }
+    if(check) {
+      expect_windows(addr);
+    }
+    tsch_queue_update_all_backoff_windows(addr);
+  } else {
+    /* A shared broadcast slot with no broadcast packet */
+    int expected = check && any_may_send();
+    shared_slots++;
+    n = tsch_queue_get_nbr(&shared_link->addr);
+    p = tsch_queue_get_packet_for_nbr(n, shared_link);
+    if(p == NULL && n == n_broadcast) {
+      p = tsch_queue_get_unicast_packet_for_any(&n, shared_link);
+    }
+    if(check && ((p != NULL) != expected || (p != NULL && !may_send(n)))) {
+      selection_ok = 0;
+    }
+    if(p != NULL) {
+      sent++;
+      transmit(n, p, 1);
+    }
+    if(check) {
+      expect_windows(&tsch_broadcast_address);
+    }
+    tsch_queue_update_all_backoff_windows(&tsch_broadcast_address);
+  }
+  if(check && !check_windows()) {
+    windows_ok = 0;
+  }
+
+  if(slot % MOVE_PERIOD == 0) {
+    move_dedicated_link(sf, rand16() % DEDICATED);
+    /* Neighbors without packets nor links go, and come back */
+    tsch_queue_free_unused_neighbors();
+    for(i = 0; i < NEIGHBORS; i++) {
+      n = tsch_queue_add_nbr(&addrs[i]);
+      if(check && (n == NULL || !linkaddr_cmp(&n->addr, &addrs[i])
+                   || tsch_queue_get_nbr(&addrs[i]) != n)) {
+        lookups_ok = 0;
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tsch_queue_benchmark_process, ev, data)
+{
+  struct tsch_slotframe *sf;
+  unsigned long slot;
+  double start;
+  int i;
+
+  PROCESS_BEGIN();
+
+  printf("tsch-queue: hash %d, ready list %d\n",
+         TSCH_QUEUE_NBR_HASH_SIZE, TSCH_QUEUE_WITH_READY_LIST);
+  random_init(1);
+  tsch_schedule_init();
+  tsch_queue_init();
+
+  for(i = 0; i < NEIGHBORS; i++) {
+    memset(&addrs[i], 0, sizeof(addrs[i]));
+    addrs[i].u8[0] = 0x02;
+    addrs[i].u8[LINKADDR_SIZE - 2] = i / 16;
+    addrs[i].u8[LINKADDR_SIZE - 1] = i * 7;
+    tsch_queue_add_nbr(&addrs[i]);
+  }
+  sf = tsch_schedule_add_slotframe(0, 7);
+  shared_link = tsch_schedule_add_link(sf,
+                                       LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
+                                       LINK_TYPE_NORMAL, &tsch_broadcast_address, 0, 0);
+  sf = tsch_schedule_add_slotframe(1, DEDICATED);
+  for(i = 0; i < DEDICATED; i++) {
+    dedicated[i] = tsch_schedule_add_link(sf, LINK_OPTION_TX, LINK_TYPE_NORMAL,
+                                          &addrs[i * 8], i, 0);
+  }
+
+  /* Every slot checked */
+  selection_ok = 1;
+  windows_ok = 1;
+  lookups_ok = 1;
+  for(slot = 0; slot < CHECKED_SLOTS; slot++) {
+    run_slot(sf, slot, 1);
+  }
+  if(selection_ok && sent > 0) {
+    printf("tsch-queue: selection OK\n");
+  } else {
+    printf("tsch-queue: selection FAILED\n");
+    failures++;
+  }
+  if(windows_ok) {
+    printf("tsch-queue: backoff windows OK\n");
+  } else {
+    printf("tsch-queue: backoff windows FAILED\n");
+    failures++;
+  }
+  if(lookups_ok) {
+    printf("tsch-queue: lookups OK\n");
+  } else {
+    printf("tsch-queue: lookups FAILED\n");
+    failures++;
+  }
+
+  /* The same traffic, timed */
+  shared_slots = 0;
+  sent = 0;
+  start = now();
+  for(slot = 0; slot < TIMED_SLOTS; slot++) {
+    run_slot(sf, slot, 0);
+  }
+  printf("tsch-queue: %lu unicast packets sent in %lu shared slots\n",
+         sent, shared_slots);
+  printf("tsch-queue: %5.3f us per slot\n",
+         (now() - start) * 1e6 / TIMED_SLOTS);
+
+  printf("tsch-queue: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
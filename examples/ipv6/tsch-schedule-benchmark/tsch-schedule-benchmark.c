@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         TSCH schedule lookups. A node with a slotframe for EBs, a
+ *         large slotframe with a growing number of unicast links and
+ *         a short slotframe that overlaps with both is asked for its
+ *         next active link at every slot; the answers are compared
+ *         with a full scan of all links, also after links are removed
+ *         and added again, and the CPU time per slot is reported for
+ *         each link count.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=TSCH_SCHEDULE_CONF_WITH_INDEX=0
+ */
+
+#include "contiki.h"
+#include "lib/list.h"
+#include "net/mac/tsch/tsch-asn.h"
+#include "net/mac/tsch/tsch-queue.h"
+#include "net/mac/tsch/tsch-schedule.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define EB_SIZE        101
+#define UNICAST_SIZE   1021
+#define SHORT_SIZE     31
+#define CHECK_SLOTS    (3 * UNICAST_SIZE)
+#define TIMED_SLOTS    100000UL
+#define CHURN          4
+
+static const uint16_t link_counts[] = { 8, 32, 128, 512 };
+
+static struct tsch_neighbor nbr;
+static uint32_t seed = 1;
+static int failures;
+
+/* What the schedule needs from the rest of TSCH */
+const linkaddr_t tsch_broadcast_address = { { 0xff, 0xff, 0xff, 0xff,
+                                              0xff, 0xff, 0xff, 0xff } };
+struct tsch_link *current_link;
+/*---------------------------------------------------------------------------*/
+int
+tsch_is_locked(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+tsch_get_lock(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+tsch_release_lock(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+struct tsch_neighbor *
+tsch_queue_add_nbr(const linkaddr_t *addr)
+{
+  return &nbr;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(tsch_schedule_benchmark_process, "TSCH schedule benchmark");
+AUTOSTART_PROCESSES(&tsch_schedule_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+rand16(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+/*---------------------------------------------------------------------------*/
+/* A unicast link at a free timeslot, to send, receive or both */
+static void
+add_unicast_link(struct tsch_slotframe *sf)
+{
+  static const uint8_t options[] = {
+    LINK_OPTION_TX, LINK_OPTION_RX,
+    LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED
+  };
+  linkaddr_t addr;
+  uint16_t timeslot;
+
+  do {
+    timeslot = rand16() % sf->size.val;
+  } while(tsch_schedule_get_link_by_timeslot(sf, timeslot) != NULL);
+  memset(&addr, 0, sizeof(addr));
+  addr.u8[0] = 0x02;
+  addr.u8[LINKADDR_SIZE - 1] = rand16();
+  tsch_schedule_add_link(sf, options[rand16() % 3], LINK_TYPE_NORMAL,
+                         &addr, timeslot, rand16() % 16);
+}
+/*---------------------------------------------------------------------------*/
+static void
+build_schedule(int count)
+{
+  struct tsch_slotframe *sf;
+  int i;
+
+  tsch_schedule_remove_all_slotframes();
+  sf = tsch_schedule_add_slotframe(0, EB_SIZE);
+  tsch_schedule_add_link(sf,
+                         LINK_OPTION_TX | LINK_OPTION_RX | LINK_OPTION_SHARED,
+                         LINK_TYPE_ADVERTISING, &tsch_broadcast_address, 0, 0);
+  sf = tsch_schedule_add_slotframe(1, UNICAST_SIZE);
+  for(i = 0; i < count; i++) {
+    add_unicast_link(sf);
+  }
+  sf = tsch_schedule_add_slotframe(2, SHORT_SIZE);
+  tsch_schedule_add_link(sf, LINK_OPTION_RX, LINK_TYPE_NORMAL,
+                         &tsch_broadcast_address, 0, 1);
+  tsch_schedule_add_link(sf, LINK_OPTION_TX | LINK_OPTION_SHARED,
+                         LINK_TYPE_NORMAL, &tsch_broadcast_address, 7, 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Replaces some of the unicast links with new ones */
+static void
+churn_schedule(int count)
+{
+  struct tsch_slotframe *sf;
+  int i;
+
+  sf = tsch_schedule_get_slotframe_by_handle(1);
+  for(i = 0; i < count; i++) {
+    struct tsch_link *l = list_head(sf->links_list);
+    int skip = rand16() % list_length(sf->links_list);
+    while(skip-- > 0) {
+      l = list_item_next(l);
+    }
+    tsch_schedule_remove_link(sf, l);
+  }
+  for(i = 0; i < count; i++) {
+    add_unicast_link(sf);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The next active link, found by looking at every link */
+static struct tsch_link *
+scan_next_active_link(struct asn_t *asn, uint16_t *time_offset,
+                      struct tsch_link **backup_link)
+{
+  uint16_t time_to_curr_best = 0;
+  struct tsch_link *curr_best = NULL;
+  struct tsch_link *curr_backup = NULL;
+  uint16_t handle;
+
+  /* Slotframes were added in the order of their handles */
+  for(handle = 0; handle <= 2; handle++) {
+    struct tsch_slotframe *sf = tsch_schedule_get_slotframe_by_handle(handle);
+    uint16_t timeslot = ASN_MOD(*asn, sf->size);
+    struct tsch_link *l;
+    for(l = list_head(sf->links_list); l != NULL; l = list_item_next(l)) {
+      uint16_t time_to_timeslot =
+        l->timeslot > timeslot ?
+        l->timeslot - timeslot :
+        sf->size.val + l->timeslot - timeslot;
+      if(curr_best == NULL || time_to_timeslot < time_to_curr_best) {
+        time_to_curr_best = time_to_timeslot;
+        curr_best = l;
+        curr_backup = NULL;
+      } else if(time_to_timeslot == time_to_curr_best) {
+        struct tsch_link *new_best = NULL;
+        if((curr_best->link_options & LINK_OPTION_TX) == (l->link_options & LINK_OPTION_TX)) {
+          if(l->slotframe_handle < curr_best->slotframe_handle) {
+            new_best = l;
+          }
+        } else if(l->link_options & LINK_OPTION_TX) {
+          new_best = l;
+        }
+        if(curr_backup == NULL) {
+          if(new_best != l && (l->link_options & LINK_OPTION_RX)) {
+            curr_backup = l;
+          }
+          if(new_best != curr_best && (curr_best->link_options & LINK_OPTION_RX)) {
+            curr_backup = curr_best;
+          }
+        }
+        if(new_best != NULL) {
+          curr_best = new_best;
+        }
+      }
+    }
+  }
+  *time_offset = time_to_curr_best;
+  *backup_link = curr_backup;
+  return curr_best;
+}
+/*---------------------------------------------------------------------------*/
+/* Compares the schedule with a full scan at every slot of a few
+ * iterations of the unicast slotframe */
+static int
+check_schedule(void)
+{
+  struct tsch_slotframe *sf;
+  struct asn_t asn;
+  uint16_t timeslot;
+  unsigned long i;
+
+  sf = tsch_schedule_get_slotframe_by_handle(1);
+  for(timeslot = 0; timeslot < UNICAST_SIZE; timeslot++) {
+    struct tsch_link *l = tsch_schedule_get_link_by_timeslot(sf, timeslot);
+    struct tsch_link *expected;
+    for(expected = list_head(sf->links_list); expected != NULL;
+        expected = list_item_next(expected)) {
+      if(expected->timeslot == timeslot) {
+        break;
+      }
+    }
+    if(l != expected) {
+      return 0;
+    }
+  }
+
+  ASN_INIT(asn, 0, 0x7fff0000UL + rand16());
+  for(i = 0; i < CHECK_SLOTS; i++) {
+    struct tsch_link *link, *backup;
+    struct tsch_link *expected_link, *expected_backup;
+    uint16_t offset, expected_offset;
+    link = tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+    expected_link = scan_next_active_link(&asn, &expected_offset,
+                                          &expected_backup);
+    if(link != expected_link || offset != expected_offset ||
+       backup != expected_backup) {
+      return 0;
+    }
+    ASN_INC(asn, 1);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tsch_schedule_benchmark_process, ev, data)
+{
+  struct tsch_link *link, *backup;
+  struct asn_t asn;
+  uint16_t offset;
+  unsigned long i;
+  unsigned long links;
+  double start;
+  int count;
+  int n;
+
+  PROCESS_BEGIN();
+
+  printf("tsch-schedule: index %s\n",
+         TSCH_SCHEDULE_WITH_INDEX ? "enabled" : "disabled");
+  tsch_schedule_init();
+
+  for(n = 0; n < sizeof(link_counts) / sizeof(link_counts[0]); n++) {
+    count = link_counts[n];
+    build_schedule(count);
+    if(check_schedule()) {
+      printf("tsch-schedule: %d links OK\n", count);
+    } else {
+      printf("tsch-schedule: %d links FAILED\n", count);
+      failures++;
+    }
+
+    churn_schedule(count / CHURN + 1);
+    if(check_schedule()) {
+      printf("tsch-schedule: %d links after churn OK\n", count);
+    } else {
+      printf("tsch-schedule: %d links after churn FAILED\n", count);
+      failures++;
+    }
+
+    /* One lookup per slot, as the slot operation does */
+    links = 0;
+    ASN_INIT(asn, 0, 0);
+    start = now();
+    for(i = 0; i < TIMED_SLOTS; i++) {
+      link = tsch_schedule_get_next_active_link(&asn, &offset, &backup);
+      links += link != NULL;
+      ASN_INC(asn, 1);
+    }
+    printf("tsch-schedule: %3d links, %6.3f us per slot\n",
+           count, (now() - start) * 1e6 / TIMED_SLOTS);
+    if(links != TIMED_SLOTS) {
+      printf("tsch-schedule: timed lookups FAILED\n");
+      failures++;
+    }
+  }
+
+  printf("tsch-schedule: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
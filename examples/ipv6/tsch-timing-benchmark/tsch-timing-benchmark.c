@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         TSCH slot timing. Slots with known phase durations are fed to
+ *         the timing module, and its min, max, histograms and ring of
+ *         last slots are checked against them. The cost of timing a
+ *         phase and of recording a slot is then reported, as this is
+ *         what the instrumentation adds to slot operation.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=TSCH_SLOT_TIMING_CONF_HISTORY_LEN=3
+ */
+
+#include "contiki.h"
+#include "net/mac/tsch/tsch-asn.h"
+#include "net/mac/tsch/tsch-slot-timing.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define TIMED_SLOTS    1000000UL
+#define PHASES_PER_SLOT 4
+
+static int failures;
+
+/*---------------------------------------------------------------------------*/
+PROCESS(tsch_timing_benchmark_process, "TSCH timing benchmark");
+AUTOSTART_PROCESSES(&tsch_timing_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int ok)
+{
+  printf("tsch-timing: %s %s\n", name, ok ? "OK" : "FAILED");
+  if(!ok) {
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* A slot with a single phase of a given duration */
+static void
+run_slot(struct asn_t *asn, enum tsch_slot_phase phase, rtimer_clock_t t)
+{
+  tsch_slot_timing_slot_start(asn);
+  tsch_slot_timing_add(phase, t);
+  tsch_slot_timing_slot_end();
+  ASN_INC(*asn, 1);
+}
+/*---------------------------------------------------------------------------*/
+static int
+stats_empty(void)
+{
+  const struct tsch_slot_timing_stats *s;
+  struct tsch_slot_timing slot;
+  int i;
+  int j;
+
+  for(i = 0; i < TSCH_SLOT_PHASE_COUNT; i++) {
+    s = tsch_slot_timing_stats(i);
+    if(s->count != 0) {
+      return 0;
+    }
+    for(j = 0; j < TSCH_SLOT_TIMING_BINS; j++) {
+      if(s->bins[j] != 0) {
+        return 0;
+      }
+    }
+  }
+  return !tsch_slot_timing_get_slot(0, &slot);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tsch_timing_benchmark_process, ev, data)
+{
+  static const rtimer_clock_t durations[] = { 3, 0, 100, 1, 1000 };
+  const struct tsch_slot_timing_stats *s;
+  struct tsch_slot_timing slot;
+  struct asn_t asn;
+  rtimer_clock_t phase_start;
+  unsigned long n;
+  double start;
+  int ok;
+  int i;
+
+  PROCESS_BEGIN();
+
+  printf("tsch-timing: history %d, bins %d\n",
+         TSCH_SLOT_TIMING_HISTORY_LEN, TSCH_SLOT_TIMING_BINS);
+  tsch_slot_timing_init();
+  ASN_INIT(asn, 0, 0);
+
+  check("empty", stats_empty());
+
+  /* Min, max and log2 bins of known durations. 1000 ticks is beyond
+   * the last bin and counts there */
+  for(i = 0; i < sizeof(durations) / sizeof(durations[0]); i++) {
+    run_slot(&asn, TSCH_SLOT_PHASE_SECURITY, durations[i]);
+  }
+  s = tsch_slot_timing_stats(TSCH_SLOT_PHASE_SECURITY);
+  check("min and max", s->count == 5 && s->min == 0 && s->max == 1000);
+  ok = s->bins[0] == 1 && s->bins[1] == 1 && s->bins[2] == 1
+    && s->bins[7] == 1 && s->bins[TSCH_SLOT_TIMING_BINS - 1] == 1;
+  for(i = 0, n = 0; i < TSCH_SLOT_TIMING_BINS; i++) {
+    n += s->bins[i];
+  }
+  check("bins", ok && n == 5);
+  check("other phases untouched",
+        tsch_slot_timing_stats(TSCH_SLOT_PHASE_QUEUE)->count == 0);
+
+  /* A phase that runs twice in a slot adds up, the slack keeps the
+   * tightest deadline, and phases outside of a slot are dropped */
+  tsch_slot_timing_reset();
+  tsch_slot_timing_add(TSCH_SLOT_PHASE_PREPARE, 50);
+  tsch_slot_timing_slot_start(&asn);
+  tsch_slot_timing_add(TSCH_SLOT_PHASE_SECURITY, 20);
+  tsch_slot_timing_add(TSCH_SLOT_PHASE_SECURITY, 30);
+  tsch_slot_timing_slack(40);
+  tsch_slot_timing_slack(12);
+  tsch_slot_timing_slack(25);
+  tsch_slot_timing_slot_end();
+  tsch_slot_timing_add(TSCH_SLOT_PHASE_PREPARE, 50);
+  tsch_slot_timing_slot_end();
+  ok = tsch_slot_timing_get_slot(0, &slot);
+  check("repeated phase", ok && slot.time[TSCH_SLOT_PHASE_SECURITY] == 50);
+  check("slack", ok && slot.time[TSCH_SLOT_PHASE_SLACK] == 12
+        && tsch_slot_timing_stats(TSCH_SLOT_PHASE_SLACK)->min == 12);
+  check("outside of a slot",
+        ok && !(slot.phases & (1 << TSCH_SLOT_PHASE_PREPARE))
+        && tsch_slot_timing_stats(TSCH_SLOT_PHASE_PREPARE)->count == 0
+        && !tsch_slot_timing_get_slot(1, &slot));
+
+  /* The ring keeps the last slots, last one first, across wraps */
+  tsch_slot_timing_reset();
+  ASN_INIT(asn, 0, 0xfffffffe);
+  for(i = 0; i < 2 * TSCH_SLOT_TIMING_HISTORY_LEN + 3; i++) {
+    run_slot(&asn, TSCH_SLOT_PHASE_QUEUE, i);
+  }
+  ok = 1;
+  for(i = 0; i < TSCH_SLOT_TIMING_HISTORY_LEN; i++) {
+    struct asn_t expected = asn;
+
+    ASN_DEC(expected, i + 1);
+    if(!tsch_slot_timing_get_slot(i, &slot)
+       || slot.asn.ms1b != expected.ms1b
+       || ASN_DIFF(slot.asn, expected) != 0
+       || slot.time[TSCH_SLOT_PHASE_QUEUE]
+          != 2 * TSCH_SLOT_TIMING_HISTORY_LEN + 2 - i) {
+      ok = 0;
+    }
+  }
+  check("ring", ok && !tsch_slot_timing_get_slot(TSCH_SLOT_TIMING_HISTORY_LEN, &slot)
+        && !tsch_slot_timing_get_slot(-1, &slot));
+
+  /* Bins keep counting past 16 bits, as the count does */
+  for(n = 0; n < 0x10000UL + 10; n++) {
+    run_slot(&asn, TSCH_SLOT_PHASE_SCHEDULE, 1);
+  }
+  s = tsch_slot_timing_stats(TSCH_SLOT_PHASE_SCHEDULE);
+  check("wide bins", s->count == 0x10000UL + 10
+        && s->bins[1] == 0x10000UL + 10);
+
+  tsch_slot_timing_reset();
+  check("reset", stats_empty());
+
+  /* What the instrumentation costs per slot */
+  start = now();
+  for(n = 0; n < TIMED_SLOTS; n++) {
+    tsch_slot_timing_slot_start(&asn);
+    for(i = 0; i < PHASES_PER_SLOT; i++) {
+      TSCH_SLOT_TIMING_BEGIN(phase_start);
+      TSCH_SLOT_TIMING_END(i, phase_start);
+    }
+    tsch_slot_timing_slack(n & 0xff);
+    tsch_slot_timing_slot_end();
+  }
+  printf("tsch-timing: %5.3f us per slot with %d timed phases\n",
+         (now() - start) * 1e6 / TIMED_SLOTS, PHASES_PER_SLOT);
+  tsch_slot_timing_print();
+
+  printf("tsch-timing: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
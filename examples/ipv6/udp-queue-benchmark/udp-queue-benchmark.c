@@ -0,0 +1,389 @@
+/*
+ * Copyright (c) 2016, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *         UDP transmit queue of the tcpip process. A data process and
+ *         a control process, whose connection has a higher priority,
+ *         send bursts of datagrams to a neighbor at the same time; the
+ *         frames that CSMA passes to the radio are captured to check
+ *         their order, and the CPU time per datagram is reported. An
+ *         echo process answers a request twice from its tcpip_event
+ *         handler, which only works when uip_buf is not overwritten
+ *         by the first answer. A connection removed with datagrams
+ *         still queued must not pass them to the next owner of its
+ *         slot, and a datagram sent from uip_appdata while the queue
+ *         is full must not be overwritten by the queued ones.
+ *
+ *         make TARGET=native
+ *         make TARGET=native DEFINES=TCPIP_CONF_UDP_QUEUE_NUM=0
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ip/uip-udp-packet.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include "net/netstack.h"
+#include "net/rime/rime.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define DATA_BURST     6
+#define CONTROL_BURST  2
+#define FRAMES         (DATA_BURST + CONTROL_BURST)
+#define MAX_FRAMES     16
+#define ROUNDS         2000
+#define PAYLOAD_LEN    32
+
+#define PEER_PORT      4000
+#define DATA_PORT      3000
+#define CONTROL_PORT   3001
+#define ECHO_PORT      3002
+#define REUSED_PORT    3003
+#define OTHER_PORT     3004
+
+#define UIP_IP_BUF     ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define UIP_UDP_BUF    ((struct uip_udp_hdr *)&uip_buf[UIP_LLIPH_LEN])
+
+struct frame {
+  uint8_t len;
+  uint8_t data[127];
+};
+
+static struct frame out[MAX_FRAMES];
+static int out_count;
+static linkaddr_t peer_ll;
+static uip_ipaddr_t peer_addr;
+static process_event_t go_event;
+static int failures;
+/*---------------------------------------------------------------------------*/
+PROCESS(udp_queue_benchmark_process, "UDP queue benchmark");
+PROCESS(data_process, "Data sender");
+PROCESS(control_process, "Control sender");
+PROCESS(echo_process, "Echo server");
+AUTOSTART_PROCESSES(&udp_queue_benchmark_process);
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static void
+sniffer_output(int mac_status)
+{
+  if(out_count < MAX_FRAMES && packetbuf_datalen() <= sizeof(out[0].data)) {
+    out[out_count].len = packetbuf_datalen();
+    memcpy(out[out_count].data, packetbuf_dataptr(), packetbuf_datalen());
+  }
+  out_count++;
+}
+/*---------------------------------------------------------------------------*/
+RIME_SNIFFER(sniffer, sniffer_input, sniffer_output);
+/*---------------------------------------------------------------------------*/
+/* The payload ends the frame */
+static const uint8_t *
+frame_payload(const struct frame *f, int len)
+{
+  return &f->data[f->len - len];
+}
+/*---------------------------------------------------------------------------*/
+static struct uip_udp_conn *
+new_conn(uint16_t port)
+{
+  struct uip_udp_conn *conn;
+
+  conn = udp_new(NULL, UIP_HTONS(PEER_PORT), NULL);
+  udp_bind(conn, UIP_HTONS(port));
+  return conn;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_burst(struct uip_udp_conn *conn, int count, uint8_t marker)
+{
+  uint8_t payload[PAYLOAD_LEN];
+  int i;
+
+  memset(payload, marker, sizeof(payload));
+  for(i = 0; i < count; i++) {
+    uip_udp_packet_sendto(conn, payload, sizeof(payload),
+                          &peer_addr, UIP_HTONS(PEER_PORT));
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(data_process, ev, data)
+{
+  static struct uip_udp_conn *conn;
+
+  PROCESS_BEGIN();
+
+  conn = new_conn(DATA_PORT);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == go_event);
+    send_burst(conn, DATA_BURST, 'd');
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(control_process, ev, data)
+{
+  static struct uip_udp_conn *conn;
+
+  PROCESS_BEGIN();
+
+  conn = new_conn(CONTROL_PORT);
+#if TCPIP_UDP_QUEUE_NUM
+  tcpip_udp_set_priority(conn, TCPIP_UDP_PRIO_CONTROL);
+#endif /* TCPIP_UDP_QUEUE_NUM */
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == go_event);
+    send_burst(conn, CONTROL_BURST, 'c');
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(echo_process, ev, data)
+{
+  static struct uip_udp_conn *conn;
+  uint8_t reply[PAYLOAD_LEN + 1];
+  uint16_t len;
+
+  PROCESS_BEGIN();
+
+  conn = new_conn(ECHO_PORT);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == tcpip_event && uip_newdata());
+    /* Two answers, each built from the request in uip_appdata */
+    len = MIN(uip_datalen(), PAYLOAD_LEN);
+    reply[0] = 'A';
+    memcpy(&reply[1], uip_appdata, len);
+    uip_udp_packet_sendto(conn, reply, len + 1,
+                          &UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport);
+    reply[0] = 'B';
+    memcpy(&reply[1], uip_appdata, len);
+    uip_udp_packet_sendto(conn, reply, len + 1,
+                          &UIP_IP_BUF->srcipaddr, UIP_UDP_BUF->srcport);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+/* A request from the neighbor to the echo server */
+static void
+input_request(const char *payload)
+{
+  uint16_t len;
+
+  len = UIP_IPUDPH_LEN + strlen(payload);
+  memset(UIP_IP_BUF, 0, UIP_IPUDPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[0] = (len - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (len - UIP_IPH_LEN) & 0xff;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&UIP_IP_BUF->srcipaddr, &peer_addr);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr,
+                  &uip_ds6_get_link_local(-1)->ipaddr);
+  UIP_UDP_BUF->srcport = UIP_HTONS(PEER_PORT);
+  UIP_UDP_BUF->destport = UIP_HTONS(ECHO_PORT);
+  UIP_UDP_BUF->udplen = UIP_HTONS(len - UIP_IPH_LEN);
+  /* A zero checksum is not checked */
+  memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], payload, strlen(payload));
+  uip_len = len;
+  tcpip_input();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(udp_queue_benchmark_process, ev, data)
+{
+  static const char request[] = "ping 0123456789";
+  static double start;
+  static double elapsed;
+  static int control_first;
+  static int sent;
+  static int i;
+  static int j;
+#if TCPIP_UDP_QUEUE_NUM
+  static struct uip_udp_conn *removed;
+  static struct uip_udp_conn *reused;
+  static struct uip_udp_conn *other;
+#endif /* TCPIP_UDP_QUEUE_NUM */
+  int ok;
+
+  PROCESS_BEGIN();
+
+  go_event = process_alloc_event();
+  memset(&peer_ll, 0, sizeof(peer_ll));
+  peer_ll.u8[0] = 0x02;
+  peer_ll.u8[LINKADDR_SIZE - 1] = 0x10;
+  uip_ip6addr(&peer_addr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&peer_addr, (uip_lladdr_t *)&peer_ll);
+  uip_ds6_nbr_add(&peer_addr, (uip_lladdr_t *)&peer_ll, 1, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+
+  rime_sniffer_add(&sniffer);
+  process_start(&data_process, NULL);
+  process_start(&control_process, NULL);
+  process_start(&echo_process, NULL);
+  printf("udpq: %d datagram queue\n", TCPIP_UDP_QUEUE_NUM);
+
+  /* Answers from the event handler */
+  out_count = 0;
+  input_request(request);
+  for(i = 0; i < 100 && out_count < 2; i++) {
+    PROCESS_PAUSE();
+  }
+  ok = out_count == 2;
+  for(i = 0; ok && i < 2; i++) {
+    ok = out[i].data[out[i].len - sizeof(request)] == "AB"[i] &&
+      memcmp(frame_payload(&out[i], sizeof(request) - 1), request,
+             sizeof(request) - 1) == 0;
+  }
+  if(ok) {
+    printf("udpq: echo OK\n");
+  } else {
+    printf("udpq: echo %s, %d answers\n",
+           TCPIP_UDP_QUEUE_NUM ? "FAILED" : "overwritten", out_count);
+    failures += TCPIP_UDP_QUEUE_NUM ? 1 : 0;
+  }
+
+#if TCPIP_UDP_QUEUE_NUM
+  /* A removed connection takes its queued datagram and its priority
+     along; the next owner of the slot sends only its own datagram, in
+     order after one of the default priority */
+  out_count = 0;
+  other = new_conn(OTHER_PORT);
+  removed = new_conn(REUSED_PORT);
+  tcpip_udp_set_priority(removed, TCPIP_UDP_PRIO_CONTROL);
+  send_burst(removed, 1, 'r');
+  uip_udp_remove(removed);
+  reused = new_conn(REUSED_PORT);
+  send_burst(other, 1, 'o');
+  send_burst(reused, 1, 'n');
+  for(i = 0; i < 100 && out_count < 3; i++) {
+    PROCESS_PAUSE();
+  }
+  while(queuebuf_numfree() < QUEUEBUF_NUM) {
+    PROCESS_PAUSE();
+  }
+  if(reused == removed && out_count == 2 &&
+     *frame_payload(&out[0], PAYLOAD_LEN) == 'o' &&
+     *frame_payload(&out[1], PAYLOAD_LEN) == 'n') {
+    printf("udpq: removed connection OK\n");
+  } else {
+    printf("udpq: removed connection FAILED, %d datagrams\n", out_count);
+    failures++;
+  }
+  uip_udp_remove(reused);
+
+  /* With the queue full, a payload in uip_appdata goes out as it is,
+     as do the queued datagrams */
+  out_count = 0;
+  send_burst(other, TCPIP_UDP_QUEUE_NUM, 'q');
+  memset(uip_appdata, 'u', PAYLOAD_LEN);
+  uip_udp_packet_sendto(other, uip_appdata, PAYLOAD_LEN,
+                        &peer_addr, UIP_HTONS(PEER_PORT));
+  for(i = 0; i < 100 && out_count < TCPIP_UDP_QUEUE_NUM + 1; i++) {
+    PROCESS_PAUSE();
+  }
+  while(queuebuf_numfree() < QUEUEBUF_NUM) {
+    PROCESS_PAUSE();
+  }
+  ok = out_count == TCPIP_UDP_QUEUE_NUM + 1;
+  j = 0;
+  for(i = 0; ok && i < out_count; i++) {
+    const uint8_t *p = frame_payload(&out[i], PAYLOAD_LEN);
+    if(memcmp(p, p + 1, PAYLOAD_LEN - 1) != 0 || (*p != 'q' && *p != 'u')) {
+      ok = 0;
+    }
+    j += *p == 'u';
+  }
+  if(ok && j == 1) {
+    printf("udpq: full queue OK\n");
+  } else {
+    printf("udpq: full queue FAILED, %d datagrams\n", out_count);
+    failures++;
+  }
+  uip_udp_remove(other);
+#endif /* TCPIP_UDP_QUEUE_NUM */
+
+  /* Bursts from both senders */
+  elapsed = 0;
+  control_first = 0;
+  sent = 0;
+  for(i = 0; i < ROUNDS; i++) {
+    out_count = 0;
+    start = now();
+    process_post(&data_process, go_event, NULL);
+    process_post(&control_process, go_event, NULL);
+    for(j = 0; j < 100 && out_count < FRAMES; j++) {
+      PROCESS_PAUSE();
+    }
+    while(queuebuf_numfree() < QUEUEBUF_NUM) {
+      PROCESS_PAUSE();
+    }
+    elapsed += now() - start;
+    sent += out_count;
+    if(out_count == FRAMES &&
+       *frame_payload(&out[0], PAYLOAD_LEN) == 'c' &&
+       *frame_payload(&out[1], PAYLOAD_LEN) == 'c') {
+      control_first++;
+    }
+  }
+  printf("udpq: %d of %d datagrams sent, control first in %d of %d bursts\n",
+         sent, ROUNDS * FRAMES, control_first, ROUNDS);
+  printf("udpq: %5.2f us per datagram\n", elapsed * 1e6 / sent);
+  if(sent != ROUNDS * FRAMES ||
+     (TCPIP_UDP_QUEUE_NUM && control_first != ROUNDS)) {
+    printf("udpq: bursts FAILED\n");
+    failures++;
+  }
+
+  printf("udpq: done, %d failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,432 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Native test of the asynchronous AEAD backends. Runs jobs on the
+ *      simulated accelerator and checks them against the software
+ *      reference, runs the same jobs through the sliced software worker,
+ *      then decrypts OSCOAP requests through oscoap_parser_async() and the
+ *      CoAP engine and encrypts a response with
+ *      oscoap_prepare_message_start(). Requests decrypted at the same time,
+ *      forged or duplicated, must leave the replay window as if they had
+ *      been decrypted one after the other.
+ *
+ *      make cose-aead-backend-test TARGET=native \
+ *        DEFINES=COSE_AEAD_CONF_BACKEND=cose_aead_sim_backend,OSCOAP_CONF_CONTEXT_NUM=2
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "rest-engine.h"
+#include "er-coap-engine.h"
+#include "er-oscoap.h"
+#include "cose-aead-backend.h"
+#include "cose-aead-sim.h"
+
+#define TEST_JOBS 4
+#define TEST_MAX_LEN 64
+
+#define IN_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define IN_UDP_BUF ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+#define CHECK(cond, name) do { \
+    if(cond) { \
+      printf("backend-test: %s OK\n", name); \
+    } else { \
+      printf("backend-test: %s FAILED\n", name); \
+      failures++; \
+    } \
+  } while(0)
+
+static const uint8_t lengths[TEST_JOBS] = { 0, 15, 32, TEST_MAX_LEN };
+
+static uint8_t key[COSE_AEAD_MAX_KEY_LEN];
+static uint8_t nonce[COSE_AEAD_MAX_NONCE_LEN];
+static uint8_t aad[20];
+static uint8_t msg[TEST_JOBS][TEST_MAX_LEN + COSE_AEAD_MAX_TAG_LEN];
+static uint8_t ref[TEST_JOBS][TEST_MAX_LEN + COSE_AEAD_MAX_TAG_LEN];
+static cose_aead_job_t jobs[TEST_JOBS];
+static uint8_t failures;
+
+static uint8_t master_secret[35];
+static uint8_t client_id[] = { 0x63, 0x6C, 0x69, 0x65, 0x6E, 0x74 };
+static uint8_t server_id[] = { 0x73, 0x65, 0x72, 0x76, 0x65, 0x72 };
+static oscoap_ctx_t *client_ctx;
+static oscoap_ctx_t *server_ctx;
+static coap_packet_t request[1];
+static coap_packet_t incoming[1];
+static coap_packet_t response[2];
+static uint8_t response_buffer[2][COAP_MAX_PACKET_SIZE + 1];
+static oscoap_crypto_job_t oscoap_job;
+static uint8_t buffer[COAP_MAX_PACKET_SIZE + 1];
+static coap_packet_t overlapping[1];
+static oscoap_crypto_job_t overlapping_job;
+static uint8_t overlapping_buffer[COAP_MAX_PACKET_SIZE + 1];
+static uint8_t replay_buffer[COAP_MAX_PACKET_SIZE + 1];
+static uint16_t mid = 0x1200;
+static uint8_t resource_hits;
+
+PROCESS(cose_aead_backend_test, "COSE AEAD backend test");
+AUTOSTART_PROCESSES(&cose_aead_backend_test);
+
+/*---------------------------------------------------------------------------*/
+static void res_get_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+RESOURCE(res_async,
+         "title=\"AEAD backend test\"",
+         res_get_handler,
+         NULL,
+         NULL,
+         NULL);
+
+static void
+res_get_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  coap_packet_t *const coap_request = (coap_packet_t *)request;
+  coap_packet_t *const coap_response = (coap_packet_t *)response;
+
+  if(IS_OPTION(coap_request, COAP_OPTION_OBJECT_SECURITY)) {
+    coap_set_header_object_security(response);
+    coap_response->context = coap_request->context;
+  }
+  REST.set_response_payload(response, "async", 5);
+  resource_hits++;
+  process_poll(&cose_aead_backend_test);
+}
+/*---------------------------------------------------------------------------*/
+static void
+job_init(cose_aead_job_t *job, const struct cose_aead_driver *aead,
+    uint8_t *m, uint8_t m_len, int forward)
+{
+  memset(job, 0, sizeof(*job));
+  job->aead = aead;
+  job->key = key;
+  job->nonce = nonce;
+  job->a = aad;
+  job->a_len = sizeof(aad);
+  job->m = m;
+  job->m_len = m_len;
+  job->tag = m + m_len;
+  job->forward = forward;
+  job->process = &cose_aead_backend_test;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+jobs_pending(void)
+{
+  uint8_t i;
+  uint8_t pending = 0;
+
+  for(i = 0; i < TEST_JOBS; i++) {
+    if(jobs[i].status == COSE_AEAD_JOB_PENDING) {
+      pending++;
+    }
+  }
+  return pending;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+jobs_status(uint8_t status)
+{
+  uint8_t i;
+
+  for(i = 0; i < TEST_JOBS; i++) {
+    if(jobs[i].status != status) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+submit_all(const struct cose_aead_backend *backend,
+    const struct cose_aead_driver *aead, int forward)
+{
+  uint8_t i;
+
+  for(i = 0; i < TEST_JOBS; i++) {
+    job_init(&jobs[i], aead, msg[i], lengths[i], forward);
+    jobs[i].status = COSE_AEAD_JOB_PENDING;
+    backend->submit(&jobs[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+serialize_request(void)
+{
+  static const uint8_t token[] = { 0xab, 0xcd };
+
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, mid++);
+  coap_set_header_uri_path(request, "test/async");
+  coap_set_token(request, token, sizeof(token));
+  coap_set_header_object_security(request);
+  request->context = client_ctx;
+  return coap_serialize_message(request, buffer);
+}
+/*---------------------------------------------------------------------------*/
+static void
+inject_datagram(const uint8_t *payload, uint16_t len, const uip_ipaddr_t *dest)
+{
+  memset(&uip_buf[UIP_LLH_LEN], 0, UIP_IPUDPH_LEN);
+  IN_IP_BUF->vtc = 0x60;
+  IN_IP_BUF->len[0] = (UIP_UDPH_LEN + len) >> 8;
+  IN_IP_BUF->len[1] = (UIP_UDPH_LEN + len) & 0xff;
+  IN_IP_BUF->proto = UIP_PROTO_UDP;
+  IN_IP_BUF->ttl = 64;
+  uip_ip6addr(&IN_IP_BUF->srcipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  uip_ipaddr_copy(&IN_IP_BUF->destipaddr, dest);
+  IN_UDP_BUF->srcport = UIP_HTONS(61616);
+  IN_UDP_BUF->destport = UIP_HTONS(COAP_DEFAULT_PORT);
+  IN_UDP_BUF->udplen = UIP_HTONS(UIP_UDPH_LEN + len);
+  memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], payload, len);
+  uip_len = UIP_IPUDPH_LEN + len;
+  uip_ext_len = 0;
+  IN_UDP_BUF->udpchksum = ~(uip_udpchksum());
+  if(IN_UDP_BUF->udpchksum == 0) {
+    IN_UDP_BUF->udpchksum = 0xffff;
+  }
+  tcpip_input();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(cose_aead_backend_test, ev, data)
+{
+  static const struct cose_aead_driver *aead;
+  static const struct cose_aead_backend *backend;
+  static const struct cose_aead_backend *const backends[] = {
+    &cose_aead_sim_backend, &cose_aead_sw_backend
+  };
+  static uint8_t b;
+  static const struct cose_aead_driver unsupported = {
+    COSE_Algorithm_ChaCha20_Poly1305, 32, 12, 16, NULL, NULL
+  };
+  static struct etimer timeout;
+  static clock_time_t start;
+  static uint8_t i;
+  static uint8_t a;
+  static uint16_t len;
+  static uint16_t overlapping_len;
+  static coap_status_t status;
+  cose_aead_job_t ref_job;
+  uip_ds6_addr_t *lladdr;
+
+  PROCESS_BEGIN();
+
+  /* the engine initializes the configured backend */
+  rest_init_engine();
+  rest_activate_resource(&res_async, "test/async");
+  PROCESS_PAUSE();
+
+  cose_aead_sim_backend.init();
+  memset(key, 0x2b, sizeof(key));
+  memset(nonce, 0x5a, sizeof(nonce));
+  memset(aad, 0xa5, sizeof(aad));
+
+  printf("backend-test: configured backend %s\n", COSE_AEAD_BACKEND.name);
+
+  for(b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+    backend = backends[b];
+    for(a = 0; (aead = cose_aead_get_by_index(a)) != NULL; a++) {
+      if(backend == &cose_aead_sim_backend
+         && aead->alg != COSE_Algorithm_AES_CCM_16_64_128
+         && aead->alg != COSE_Algorithm_AES_CCM_64_64_128) {
+        continue;
+      }
+
+      for(i = 0; i < TEST_JOBS; i++) {
+        memset(msg[i], 0x40 + i, sizeof(msg[i]));
+        memcpy(ref[i], msg[i], sizeof(ref[i]));
+        job_init(&ref_job, aead, ref[i], lengths[i], 1);
+        cose_aead_run(&ref_job);
+      }
+
+      /* all jobs queue up on the single engine or worker */
+      start = clock_time();
+      submit_all(backend, aead, 1);
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL && jobs_pending() == 0);
+      printf("backend-test: %s alg %u, %u jobs in %lu ticks\n", backend->name,
+          aead->alg, TEST_JOBS, (unsigned long)(clock_time() - start));
+
+      CHECK(jobs_status(COSE_AEAD_JOB_DONE), "encrypt status");
+      for(i = 0; i < TEST_JOBS; i++) {
+        if(memcmp(msg[i], ref[i], lengths[i] + aead->tag_len) != 0) {
+          break;
+        }
+      }
+      CHECK(i == TEST_JOBS, "encrypt matches software");
+
+      submit_all(backend, aead, 0);
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL && jobs_pending() == 0);
+      CHECK(jobs_status(COSE_AEAD_JOB_DONE), "decrypt status");
+      for(i = 0; i < TEST_JOBS; i++) {
+        memset(ref[i], 0x40 + i, lengths[i]);
+        if(memcmp(msg[i], ref[i], lengths[i]) != 0) {
+          break;
+        }
+      }
+      CHECK(i == TEST_JOBS, "decrypt restores plaintext");
+
+      /* the plaintext does not match the tag */
+      submit_all(backend, aead, 0);
+      PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL && jobs_pending() == 0);
+      for(i = 0; i < TEST_JOBS; i++) {
+        if(lengths[i] > 0 && jobs[i].status != COSE_AEAD_JOB_AUTH_FAILED) {
+          break;
+        }
+      }
+      CHECK(i == TEST_JOBS, "tag mismatch detected");
+    }
+  }
+
+  aead = cose_aead_get(COSE_Algorithm_AES_CCM_64_64_128);
+  cose_aead_sim_fail_next(1);
+  job_init(&jobs[0], aead, msg[0], 16, 1);
+  jobs[0].status = COSE_AEAD_JOB_PENDING;
+  cose_aead_sim_backend.submit(&jobs[0]);
+  PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL
+                           && jobs[0].status != COSE_AEAD_JOB_PENDING);
+  CHECK(jobs[0].status == COSE_AEAD_JOB_ERROR, "injected fault");
+
+  job_init(&jobs[0], &unsupported, msg[0], 16, 1);
+  CHECK(cose_aead_sim_backend.submit(&jobs[0]) == 0, "other algorithms rejected");
+
+  printf("backend-test: sim %lu jobs, busy %lu us, max queued %u\n",
+      (unsigned long)cose_aead_sim_get_stats()->jobs,
+      (unsigned long)cose_aead_sim_get_stats()->busy_us,
+      cose_aead_sim_get_stats()->max_queued);
+
+  /* OSCOAP requests from a client context to a server context */
+  oscoap_ctx_store_init();
+  memset(master_secret, 0x11, sizeof(master_secret));
+  client_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, client_id, sizeof(client_id),
+      server_id, sizeof(server_id), 32);
+  server_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, server_id, sizeof(server_id),
+      client_id, sizeof(client_id), 32);
+  if(client_ctx == NULL || server_ctx == NULL) {
+    printf("backend-test: OSCOAP tests need OSCOAP_CONF_CONTEXT_NUM 2\n");
+  } else {
+    len = serialize_request();
+    status = oscoap_parser_async(incoming, buffer, len, &oscoap_job);
+    CHECK(status == OSCOAP_CRYPTO_PENDING, "request submitted");
+    PROCESS_WAIT_EVENT_UNTIL(oscoap_job.aead.status != COSE_AEAD_JOB_PENDING);
+    status = oscoap_decode_packet_finish(incoming, &oscoap_job);
+    CHECK(status == NO_ERROR && incoming->uri_path_len == 10
+          && memcmp(incoming->uri_path, "test/async", 10) == 0,
+          "request decrypted");
+
+    len = serialize_request();
+    buffer[len - 1] ^= 0x01;
+    status = oscoap_parser_async(incoming, buffer, len, &oscoap_job);
+    PROCESS_WAIT_EVENT_UNTIL(oscoap_job.aead.status != COSE_AEAD_JOB_PENDING);
+    status = oscoap_decode_packet_finish(incoming, &oscoap_job);
+    CHECK(status == BAD_REQUEST_4_00, "forged request rejected");
+
+    /* a response encrypted by the backend is the one encrypted inline */
+    coap_init_message(response, COAP_TYPE_ACK, CONTENT_2_05, mid);
+    coap_set_token(response, incoming->token, incoming->token_len);
+    coap_set_payload(response, "async", 5);
+    coap_set_header_object_security(response);
+    response->context = server_ctx;
+    memcpy(&response[1], response, sizeof(coap_packet_t));
+    status = oscoap_prepare_message_start(&response[1], &oscoap_job);
+    CHECK(status == OSCOAP_CRYPTO_PENDING, "response submitted");
+    PROCESS_WAIT_EVENT_UNTIL(oscoap_job.aead.status != COSE_AEAD_JOB_PENDING);
+    len = oscoap_prepare_message_finish(&response[1], response_buffer[1],
+        &oscoap_job);
+    CHECK(len > 0 && len == oscoap_prepare_message(response, response_buffer[0])
+          && memcmp(response_buffer[0], response_buffer[1], len) == 0,
+          "response matches inline encryption");
+
+    /* two requests accepted out of order leave a bit in the replay window */
+    len = serialize_request();
+    memcpy(replay_buffer, buffer, len);
+    overlapping_len = serialize_request();
+    oscoap_parser_async(incoming, buffer, overlapping_len, &oscoap_job);
+    PROCESS_WAIT_EVENT_UNTIL(oscoap_job.aead.status != COSE_AEAD_JOB_PENDING);
+    status = oscoap_decode_packet_finish(incoming, &oscoap_job);
+    memcpy(buffer, replay_buffer, len);
+    oscoap_parser_async(incoming, buffer, len, &oscoap_job);
+    PROCESS_WAIT_EVENT_UNTIL(oscoap_job.aead.status != COSE_AEAD_JOB_PENDING);
+    CHECK(status == NO_ERROR
+          && oscoap_decode_packet_finish(incoming, &oscoap_job) == NO_ERROR,
+          "reordered requests accepted");
+
+    /* a forged request decrypted while a genuine one is in flight does
+       not take the genuine one out of the replay window. The forged one
+       claims a later sequence number, so the genuine one arrives reordered */
+    len = serialize_request();
+    memcpy(replay_buffer, buffer, len);
+    overlapping_len = serialize_request();
+    memcpy(overlapping_buffer, buffer, overlapping_len);
+    overlapping_buffer[overlapping_len - 1] ^= 0x01;
+    memcpy(buffer, replay_buffer, len);
+    status = oscoap_parser_async(overlapping, overlapping_buffer,
+        overlapping_len, &overlapping_job);
+    CHECK(status == OSCOAP_CRYPTO_PENDING
+          && oscoap_parser_async(incoming, buffer, len, &oscoap_job)
+          == OSCOAP_CRYPTO_PENDING, "overlapping requests submitted");
+    PROCESS_WAIT_EVENT_UNTIL(oscoap_job.aead.status != COSE_AEAD_JOB_PENDING
+                             && overlapping_job.aead.status != COSE_AEAD_JOB_PENDING);
+    CHECK(oscoap_decode_packet_finish(incoming, &oscoap_job) == NO_ERROR,
+          "overlapping genuine request accepted");
+    CHECK(oscoap_decode_packet_finish(overlapping, &overlapping_job)
+          == BAD_REQUEST_4_00, "overlapping forged request rejected");
+    memcpy(buffer, replay_buffer, len);
+    CHECK(oscoap_parser_async(incoming, buffer, len, &oscoap_job)
+          == BAD_REQUEST_4_00, "overlapping genuine request not replayed");
+
+    /* two copies of a request in flight, only the first is accepted */
+    len = serialize_request();
+    memcpy(overlapping_buffer, buffer, len);
+    oscoap_parser_async(incoming, buffer, len, &oscoap_job);
+    oscoap_parser_async(overlapping, overlapping_buffer, len, &overlapping_job);
+    PROCESS_WAIT_EVENT_UNTIL(oscoap_job.aead.status != COSE_AEAD_JOB_PENDING
+                             && overlapping_job.aead.status != COSE_AEAD_JOB_PENDING);
+    CHECK(oscoap_decode_packet_finish(incoming, &oscoap_job) == NO_ERROR
+          && oscoap_decode_packet_finish(overlapping, &overlapping_job)
+          == BAD_REQUEST_4_00, "duplicate request in flight rejected");
+
+    lladdr = uip_ds6_get_link_local(-1);
+    if(lladdr == NULL) {
+      printf("backend-test: no link-local address, skipping engine test\n");
+    } else {
+      /* the engine resumes the request when the backend is done */
+      len = serialize_request();
+      inject_datagram(buffer, len, &lladdr->ipaddr);
+      etimer_set(&timeout, CLOCK_SECOND);
+      PROCESS_WAIT_EVENT_UNTIL(resource_hits > 0 || etimer_expired(&timeout));
+      CHECK(resource_hits == 1, "engine handled request");
+    }
+  }
+
+  printf("backend-test: done, %u failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
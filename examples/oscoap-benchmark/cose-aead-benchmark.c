@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Encrypt/decrypt benchmark of the COSE AEAD algorithms compiled into
+ *      er-oscoap. Times are printed in rtimer ticks per run. In Cooja,
+ *      cose-aead-benchmark-wis.csc converts the output into msp430 cycles.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "sys/rtimer.h"
+#include "dev/watchdog.h"
+#include "cose-aead.h"
+
+/* The native rtimer only has millisecond resolution */
+#ifndef COSE_AEAD_BENCHMARK_ITERATIONS
+#if CONTIKI_TARGET_NATIVE
+#define COSE_AEAD_BENCHMARK_ITERATIONS 20000
+#else
+#define COSE_AEAD_BENCHMARK_ITERATIONS 32
+#endif
+#endif
+
+static const uint8_t payload_lengths[] = { 16, 32, 64, 128 };
+
+static uint8_t key[COSE_AEAD_MAX_KEY_LEN];
+static uint8_t nonce[COSE_AEAD_MAX_NONCE_LEN];
+static uint8_t aad[20];
+static uint8_t message[128];
+static uint8_t tag[COSE_AEAD_MAX_TAG_LEN];
+
+/*---------------------------------------------------------------------------*/
+static unsigned long
+run(const struct cose_aead_driver *aead, uint8_t len, int forward)
+{
+  rtimer_clock_t start;
+  uint16_t i;
+
+  start = RTIMER_NOW();
+  for(i = 0; i < COSE_AEAD_BENCHMARK_ITERATIONS; i++) {
+    aead->set_key(key);
+    aead->aead(nonce, message, len, aad, sizeof(aad), tag, forward);
+    watchdog_periodic();
+  }
+  return (unsigned long)(rtimer_clock_t)(RTIMER_NOW() - start);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS(cose_aead_benchmark, "COSE AEAD benchmark");
+AUTOSTART_PROCESSES(&cose_aead_benchmark);
+
+PROCESS_THREAD(cose_aead_benchmark, ev, data)
+{
+  static const struct cose_aead_driver *aead;
+  static uint8_t i;
+  static uint8_t j;
+  unsigned long ticks;
+
+  PROCESS_BEGIN();
+
+  memset(key, 0x2b, sizeof(key));
+  memset(nonce, 0x5a, sizeof(nonce));
+  memset(aad, 0xa5, sizeof(aad));
+  memset(message, 0x42, sizeof(message));
+
+  printf("aead-bench: %u iterations, RTIMER_SECOND %lu\n",
+      COSE_AEAD_BENCHMARK_ITERATIONS, (unsigned long)RTIMER_SECOND);
+
+  for(i = 0; (aead = cose_aead_get_by_index(i)) != NULL; i++) {
+    for(j = 0; j < sizeof(payload_lengths); j++) {
+      printf("aead-bench start\n");
+      ticks = run(aead, payload_lengths[j], 1);
+      printf("aead-bench alg %u len %u enc %lu\n",
+          aead->alg, payload_lengths[j], ticks);
+
+      printf("aead-bench start\n");
+      ticks = run(aead, payload_lengths[j], 0);
+      printf("aead-bench alg %u len %u dec %lu\n",
+          aead->alg, payload_lengths[j], ticks);
+
+      /* let the serial line drain between runs */
+      PROCESS_PAUSE();
+    }
+  }
+
+  printf("aead-bench done\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
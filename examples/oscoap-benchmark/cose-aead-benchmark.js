@@ -0,0 +1,25 @@
+/*
+ * Converts the cose-aead-benchmark output into msp430 CPU cycles per
+ * operation, using the cycle counter of the simulated CPU.
+ */
+TIMEOUT(600000);
+
+var iterations = 1;
+var start_cycles = 0;
+
+while(true) {
+  if(msg.startsWith("aead-bench:")) {
+    iterations = parseInt(msg.split(" ")[1]);
+  } else if(msg.equals("aead-bench start")) {
+    start_cycles = mote.getCPU().cycles;
+  } else if(msg.startsWith("aead-bench alg")) {
+    /* aead-bench alg <alg> len <len> <enc|dec> <ticks> */
+    var f = msg.split(" ");
+    var cycles = (mote.getCPU().cycles - start_cycles) / iterations;
+    log.log("alg " + f[2] + " len " + f[4] + " " + f[5] + " " +
+            Math.round(cycles) + " cycles/op\n");
+  } else if(msg.equals("aead-bench done")) {
+    log.testOK();
+  }
+  YIELD();
+}
@@ -0,0 +1,199 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Scheduling latency of an unrelated process while OSCOAP messages are
+ *      being protected. A probe process polls itself back to back and
+ *      records how long each poll waits; a load process keeps the AEAD
+ *      busy with 64 byte messages, first running each exchange (decrypt
+ *      request, encrypt response) inline as the CoAP engine used to, then
+ *      through the software crypto worker.
+ *
+ *      make cose-aead-latency TARGET=native
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "sys/rtimer.h"
+#include "dev/watchdog.h"
+#include "cose-aead-backend.h"
+#include "opt-cose.h"
+
+#ifndef COSE_AEAD_LATENCY_SECONDS
+#define COSE_AEAD_LATENCY_SECONDS 2
+#endif
+
+#define LOAD_LEN 64
+
+/* The native rtimer only has millisecond resolution */
+#if CONTIKI_TARGET_NATIVE
+#include <time.h>
+typedef uint32_t stamp_t;
+static stamp_t
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (stamp_t)(ts.tv_sec * 1000000UL + ts.tv_nsec / 1000);
+}
+#define STAMP_TO_US(d) (d)
+#else
+typedef rtimer_clock_t stamp_t;
+#define now() RTIMER_NOW()
+#define STAMP_TO_US(d) ((uint32_t)((uint64_t)(d) * 1000000 / RTIMER_SECOND))
+#endif
+
+#define MODE_IDLE    0
+#define MODE_INLINE  1
+#define MODE_WORKER  2
+
+static const char *const mode_names[] = { "idle", "inline", "worker" };
+
+static uint8_t key[COSE_AEAD_MAX_KEY_LEN];
+static uint8_t nonce[COSE_AEAD_MAX_NONCE_LEN];
+static uint8_t aad[30];
+static uint8_t message[2][LOAD_LEN + COSE_AEAD_MAX_TAG_LEN];
+static cose_aead_job_t jobs[2];
+
+static volatile uint8_t mode;
+static stamp_t polled_at;
+static uint32_t samples;
+static uint32_t max_us;
+static uint32_t sum_us;
+static uint32_t exchanges;
+
+PROCESS(cose_aead_latency, "COSE AEAD latency");
+PROCESS(latency_probe, "Latency probe");
+PROCESS(latency_load, "Latency load");
+AUTOSTART_PROCESSES(&cose_aead_latency);
+
+/*---------------------------------------------------------------------------*/
+static void
+job_init(cose_aead_job_t *job, uint8_t *m, int forward)
+{
+  memset(job, 0, sizeof(*job));
+  job->aead = cose_aead_get(COSE_Algorithm_AES_CCM_16_64_128);
+  job->key = key;
+  job->nonce = nonce;
+  job->a = aad;
+  job->a_len = sizeof(aad);
+  job->m = m;
+  job->m_len = LOAD_LEN;
+  job->tag = m + LOAD_LEN;
+  job->forward = forward;
+  job->process = &latency_load;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(latency_probe, ev, data)
+{
+  stamp_t delay;
+
+  PROCESS_BEGIN();
+
+  while(1) {
+    polled_at = now();
+    process_poll(&latency_probe);
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    delay = STAMP_TO_US((stamp_t)(now() - polled_at));
+    samples++;
+    sum_us += delay;
+    if(delay > max_us) {
+      max_us = delay;
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(latency_load, ev, data)
+{
+  PROCESS_BEGIN();
+
+  while(1) {
+    /* a request is decrypted and its response encrypted */
+    job_init(&jobs[0], message[0], 0);
+    job_init(&jobs[1], message[1], 1);
+    if(mode == MODE_INLINE) {
+      cose_aead_run(&jobs[0]);
+      cose_aead_run(&jobs[1]);
+      exchanges++;
+      PROCESS_PAUSE();
+    } else if(mode == MODE_WORKER) {
+      cose_aead_submit(&jobs[0]);
+      PROCESS_WAIT_EVENT_UNTIL(jobs[0].status != COSE_AEAD_JOB_PENDING);
+      cose_aead_submit(&jobs[1]);
+      PROCESS_WAIT_EVENT_UNTIL(jobs[1].status != COSE_AEAD_JOB_PENDING);
+      exchanges++;
+    } else {
+      PROCESS_WAIT_EVENT();
+    }
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(cose_aead_latency, ev, data)
+{
+  static struct etimer et;
+
+  PROCESS_BEGIN();
+
+  memset(key, 0x2b, sizeof(key));
+  memset(nonce, 0x5a, sizeof(nonce));
+  memset(aad, 0xa5, sizeof(aad));
+  cose_aead_backend_init();
+
+  process_start(&latency_probe, NULL);
+  process_start(&latency_load, NULL);
+
+  printf("latency: backend %s, %u byte messages, %u s per mode\n",
+      COSE_AEAD_BACKEND.name, LOAD_LEN, COSE_AEAD_LATENCY_SECONDS);
+
+  for(mode = MODE_IDLE; mode <= MODE_WORKER; mode++) {
+    samples = 0;
+    max_us = 0;
+    sum_us = 0;
+    exchanges = 0;
+    process_poll(&latency_load);
+
+    etimer_set(&et, COSE_AEAD_LATENCY_SECONDS * CLOCK_SECOND);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+
+    printf("latency: %s exchanges %lu, probe samples %lu, avg %lu us, max %lu us\n",
+        mode_names[mode], (unsigned long)exchanges, (unsigned long)samples,
+        (unsigned long)(samples ? sum_us / samples : 0),
+        (unsigned long)max_us);
+    watchdog_periodic();
+  }
+  mode = MODE_IDLE;
+
+  printf("latency: done\n");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
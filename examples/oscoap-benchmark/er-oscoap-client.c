@@ -136,7 +136,7 @@ PROCESS_THREAD(er_example_client, ev, data)
   oscoap_ctx_store_init();
   init_token_seq_store();
 
-if(oscoap_derrive_ctx(master_secret, 35, NULL, 0, 12, 1,sender_id, 6, receiver_id, 6, 32) == 0) {
+if(oscoap_derrive_ctx(master_secret, 35, NULL, 0, OSCOAP_DEFAULT_ALG, 1,sender_id, 6, receiver_id, 6, 32) == 0) {
   printf("Error: Could not derive new Context!\n");
 }
 	//if(oscoap_new_ctx( sender_key, sender_iv, receiver_key, receiver_iv, sender_id, 6, receiver_id, 6, 32) == 0){
@@ -198,7 +198,7 @@ oscoap_ctx_store_init();
 //Interop
 
 
-if(oscoap_derrive_ctx(master_secret, 35, NULL, 0, 12, 1,sender_id, 6, receiver_id, 6, 32) == 0) {
+if(oscoap_derrive_ctx(master_secret, 35, NULL, 0, OSCOAP_DEFAULT_ALG, 1,sender_id, 6, receiver_id, 6, 32) == 0) {
   printf("Error: Could not derive new Context!\n");
 }
 
@@ -0,0 +1,362 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Separate responses to OSCOAP requests, interleaved with fast
+ *      requests. Requests are injected into the CoAP engine and the
+ *      datagrams it sends are captured and decrypted with the client
+ *      context. Each separate response goes out after several newer
+ *      requests have been received, so it only decrypts if it was
+ *      protected with the sequence number of its own request. Last, a
+ *      separate response is resumed after the server context was freed
+ *      and its slot taken by another peer's, and must not be sent.
+ *
+ *      make oscoap-separate-test TARGET=native \
+ *        DEFINES=OSCOAP_CONF_CONTEXT_NUM=2,OSCOAP_CONF_TOKEN_SEQ_NUM=8
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "rest-engine.h"
+#include "er-coap-engine.h"
+#include "er-coap-separate.h"
+#include "er-coap-transactions.h"
+#include "er-oscoap.h"
+
+/* Separate responses in total, and requests received before each is sent */
+#define SEPARATE_NUM 16
+#define SEPARATE_LAG 4
+
+#define CAPTURE_NUM 4
+
+#define TOKEN_FAST 'f'
+#define TOKEN_SLOW 's'
+
+#define IN_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define IN_UDP_BUF ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+#define CHECK(cond, name) do { \
+    if(cond) { \
+      printf("separate-test: %s OK\n", name); \
+    } else { \
+      printf("separate-test: %s FAILED\n", name); \
+      failures++; \
+    } \
+  } while(0)
+
+/* Waits for the engine until cond holds, decrypting what it sends */
+#define WAIT_FOR(cond) do { \
+    etimer_set(&timeout, CLOCK_SECOND); \
+    while(!(cond) && !etimer_expired(&timeout)) { \
+      PROCESS_WAIT_EVENT(); \
+      drain(); \
+    } \
+  } while(0)
+
+static uint8_t master_secret[35];
+static uint8_t client_id[] = { 0x63, 0x6C, 0x69, 0x65, 0x6E, 0x74 };
+static uint8_t server_id[] = { 0x73, 0x65, 0x72, 0x76, 0x65, 0x72 };
+static uint8_t other_secret[35];
+static uint8_t other_id[] = { 0x6F, 0x74, 0x68, 0x65, 0x72 };
+static oscoap_ctx_t *client_ctx;
+static oscoap_ctx_t *server_ctx;
+static uip_ipaddr_t client_addr;
+static uint16_t mid = 0x3400;
+
+static coap_separate_t stores[SEPARATE_NUM];
+
+static uint8_t captured[CAPTURE_NUM][COAP_MAX_PACKET_SIZE + 1];
+static uint16_t captured_len[CAPTURE_NUM];
+static uint8_t captured_head;
+static uint8_t captured_count;
+static uint16_t sent;
+
+static uint8_t accepted;
+static uint8_t empty_acks;
+static uint8_t fast_ok;
+static uint8_t slow_ok;
+static uint8_t failures;
+
+PROCESS(oscoap_separate_test, "OSCOAP separate response test");
+AUTOSTART_PROCESSES(&oscoap_separate_test);
+
+/*---------------------------------------------------------------------------*/
+static void res_fast_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+static void res_slow_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+RESOURCE(res_fast, "title=\"Fast\"", res_fast_handler, NULL, NULL, NULL);
+SEPARATE_RESOURCE(res_slow, "title=\"Slow\"", res_slow_handler, NULL, NULL, NULL, NULL);
+
+static void
+res_fast_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  coap_packet_t *const coap_request = (coap_packet_t *)request;
+  coap_packet_t *const coap_response = (coap_packet_t *)response;
+
+  if(IS_OPTION(coap_request, COAP_OPTION_OBJECT_SECURITY)) {
+    coap_set_header_object_security(response);
+    coap_response->context = coap_request->context;
+  }
+  REST.set_response_payload(response, "fast", 4);
+}
+/*---------------------------------------------------------------------------*/
+static void
+res_slow_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  coap_packet_t *const coap_request = (coap_packet_t *)request;
+  uint8_t i = coap_request->token[1];
+
+  if(coap_request->token_len != 2 || i >= SEPARATE_NUM) {
+    coap_separate_reject();
+    return;
+  }
+  coap_separate_accept(request, &stores[i]);
+  accepted++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+resume_separate(uint8_t i)
+{
+  coap_transaction_t *transaction;
+  coap_packet_t response[1];
+  char payload[8];
+
+  transaction = coap_new_transaction(stores[i].mid, &stores[i].addr,
+                                     stores[i].port);
+  if(transaction == NULL) {
+    printf("separate-test: no transaction for %u\n", i);
+    failures++;
+    return;
+  }
+  coap_separate_resume(response, &stores[i], CONTENT_2_05);
+  coap_set_payload(response, payload,
+                   snprintf(payload, sizeof(payload), "slow%u", i));
+  transaction->packet_len = coap_serialize_message(response,
+                                                   transaction->packet);
+  coap_send_transaction(transaction);
+}
+/*---------------------------------------------------------------------------*/
+static void
+inject_datagram(const uint8_t *payload, uint16_t len, const uip_ipaddr_t *dest)
+{
+  memset(&uip_buf[UIP_LLH_LEN], 0, UIP_IPUDPH_LEN);
+  IN_IP_BUF->vtc = 0x60;
+  IN_IP_BUF->len[0] = (UIP_UDPH_LEN + len) >> 8;
+  IN_IP_BUF->len[1] = (UIP_UDPH_LEN + len) & 0xff;
+  IN_IP_BUF->proto = UIP_PROTO_UDP;
+  IN_IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&IN_IP_BUF->srcipaddr, &client_addr);
+  uip_ipaddr_copy(&IN_IP_BUF->destipaddr, dest);
+  IN_UDP_BUF->srcport = UIP_HTONS(61616);
+  IN_UDP_BUF->destport = UIP_HTONS(COAP_DEFAULT_PORT);
+  IN_UDP_BUF->udplen = UIP_HTONS(UIP_UDPH_LEN + len);
+  memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], payload, len);
+  uip_len = UIP_IPUDPH_LEN + len;
+  uip_ext_len = 0;
+  IN_UDP_BUF->udpchksum = ~(uip_udpchksum());
+  if(IN_UDP_BUF->udpchksum == 0) {
+    IN_UDP_BUF->udpchksum = 0xffff;
+  }
+  tcpip_input();
+}
+/*---------------------------------------------------------------------------*/
+static void
+inject_request(uint8_t kind, uint8_t i)
+{
+  static uint8_t buffer[COAP_MAX_PACKET_SIZE + 1];
+  coap_packet_t request[1];
+  uint8_t token[2];
+
+  token[0] = kind;
+  token[1] = i;
+  coap_init_message(request, COAP_TYPE_CON, COAP_GET, mid++);
+  coap_set_header_uri_path(request, kind == TOKEN_FAST ? "test/fast" : "test/slow");
+  coap_set_token(request, token, sizeof(token));
+  coap_set_header_object_security(request);
+  request->context = client_ctx;
+  inject_datagram(buffer, coap_serialize_message(request, buffer),
+                  &uip_ds6_get_link_local(-1)->ipaddr);
+}
+/*---------------------------------------------------------------------------*/
+/* Takes the datagrams the engine sends to the client */
+static uint8_t
+capture_output(const uip_lladdr_t *lladdr)
+{
+  uint8_t slot;
+  uint16_t len;
+
+  if(IN_IP_BUF->proto != UIP_PROTO_UDP
+     || !uip_ipaddr_cmp(&IN_IP_BUF->destipaddr, &client_addr)
+     || captured_count == CAPTURE_NUM) {
+    return 0;
+  }
+  len = uip_len - UIP_IPUDPH_LEN;
+  if(len > sizeof(captured[0])) {
+    return 0;
+  }
+  slot = (captured_head + captured_count) % CAPTURE_NUM;
+  memcpy(captured[slot], &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], len);
+  captured_len[slot] = len;
+  captured_count++;
+  sent++;
+  process_poll(&oscoap_separate_test);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Decrypts the captured datagrams as the client would */
+static void
+drain(void)
+{
+  static coap_packet_t response[1];
+  static uint8_t ack[COAP_MAX_HEADER_SIZE];
+  coap_packet_t ack_packet[1];
+  char expected[8];
+  coap_status_t status;
+  uint8_t *buffer;
+
+  while(captured_count > 0) {
+    buffer = captured[captured_head];
+    status = oscoap_parser(response, buffer, captured_len[captured_head],
+                           ROLE_COAP);
+    captured_head = (captured_head + 1) % CAPTURE_NUM;
+    captured_count--;
+
+    if(response->code == 0 && response->type == COAP_TYPE_ACK) {
+      empty_acks++;
+      continue;
+    }
+    if(response->token_len != 2) {
+      printf("separate-test: unexpected message, MID %u\n", response->mid);
+      failures++;
+      continue;
+    }
+    if(response->token[0] == TOKEN_FAST) {
+      strcpy(expected, "fast");
+    } else {
+      snprintf(expected, sizeof(expected), "slow%u", response->token[1]);
+    }
+    if(status != NO_ERROR || response->payload_len != strlen(expected)
+       || memcmp(response->payload, expected, response->payload_len) != 0) {
+      printf("separate-test: response %c%u not decrypted, status %u\n",
+             response->token[0], response->token[1], status);
+      failures++;
+    } else if(response->token[0] == TOKEN_FAST) {
+      fast_ok++;
+    } else {
+      slow_ok++;
+    }
+
+    if(response->type == COAP_TYPE_CON) {
+      /* acknowledge the separate response, closing its transaction */
+      coap_init_message(ack_packet, COAP_TYPE_ACK, 0, response->mid);
+      inject_datagram(ack, coap_serialize_message(ack_packet, ack),
+                      &uip_ds6_get_link_local(-1)->ipaddr);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(oscoap_separate_test, ev, data)
+{
+  static struct etimer timeout;
+  static uint8_t i;
+  static uint8_t resumed;
+  uip_lladdr_t lladdr;
+
+  PROCESS_BEGIN();
+
+  rest_init_engine();
+  rest_activate_resource(&res_fast, "test/fast");
+  rest_activate_resource(&res_slow, "test/slow");
+  PROCESS_PAUSE();
+
+  if(uip_ds6_get_link_local(-1) == NULL) {
+    printf("separate-test: no link-local address\n");
+    PROCESS_EXIT();
+  }
+
+  /* the client is a reachable neighbor whose traffic is captured */
+  uip_ip6addr(&client_addr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  memset(&lladdr, 0x02, sizeof(lladdr));
+  uip_ds6_nbr_add(&client_addr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  tcpip_set_outputfunc(capture_output);
+
+  oscoap_ctx_store_init();
+  init_token_seq_store();
+  memset(master_secret, 0x11, sizeof(master_secret));
+  client_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, client_id, sizeof(client_id),
+      server_id, sizeof(server_id), 32);
+  server_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret),
+      NULL, 0, OSCOAP_DEFAULT_ALG, 1, server_id, sizeof(server_id),
+      client_id, sizeof(client_id), 32);
+  if(client_ctx == NULL || server_ctx == NULL) {
+    printf("separate-test: needs OSCOAP_CONF_CONTEXT_NUM 2\n");
+    PROCESS_EXIT();
+  }
+
+  resumed = 0;
+  for(i = 0; i < SEPARATE_NUM; i++) {
+    inject_request(TOKEN_SLOW, i);
+    WAIT_FOR(empty_acks == i + 1);
+    inject_request(TOKEN_FAST, i);
+    WAIT_FOR(fast_ok == i + 1);
+    if(i >= SEPARATE_LAG) {
+      resume_separate(resumed++);
+      WAIT_FOR(slow_ok == resumed);
+    }
+  }
+  /* the rest in reverse order */
+  for(i = SEPARATE_NUM; i > resumed; i--) {
+    resume_separate(i - 1);
+    WAIT_FOR(slow_ok == resumed + SEPARATE_NUM - i + 1);
+  }
+
+  printf("separate-test: %u separate, %u empty ACKs, %u fast, %u slow decrypted\n",
+         accepted, empty_acks, fast_ok, slow_ok);
+  CHECK(accepted == SEPARATE_NUM && empty_acks == SEPARATE_NUM, "separate requests accepted");
+  CHECK(fast_ok == SEPARATE_NUM, "fast responses decrypted");
+  CHECK(slow_ok == SEPARATE_NUM, "separate responses decrypted");
+
+  /* the server context is freed while a separate response is pending */
+  inject_request(TOKEN_SLOW, 0);
+  WAIT_FOR(empty_acks == SEPARATE_NUM + 1);
+  oscoap_free_ctx(server_ctx);
+  memset(other_secret, 0x22, sizeof(other_secret));
+  oscoap_derrive_ctx(other_secret, sizeof(other_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, server_id, sizeof(server_id),
+      other_id, sizeof(other_id), 32);
+  sent = 0;
+  resume_separate(0);
+  WAIT_FOR(sent > 0);
+  CHECK(sent == 0, "freed context not used");
+  printf("separate-test: done, %u failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,420 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      CPU and radio cost of OSCOAP notifications at high update rates.
+ *      The node observes OBS_RESOURCES of its own resources through a
+ *      loopback peer: datagrams sent to fe80::2 are captured and injected
+ *      back as coming from it. Each round updates every resource
+ *      UPDATES_PER_ROUND times before the application gets to run, then
+ *      the registrations are left to refresh for REFRESH_PHASE seconds.
+ *      Last, the server context is freed, after which the observers of
+ *      the peer must not be notified.
+ *      Times are native CPU time, bytes are IPv6 datagram bytes before
+ *      6LoWPAN compression.
+ *
+ *      make TARGET=native
+ *      make TARGET=native DEFINES=COAP_OBS_CLIENT_CONF_COALESCE=0
+ *      make TARGET=native DEFINES=COAP_OBS_CLIENT_CONF_REFRESH_WINDOW=0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "contiki.h"
+#include "contiki-net.h"
+#include "rest-engine.h"
+#include "er-coap-engine.h"
+#include "er-coap-observe.h"
+#include "er-coap-observe-client.h"
+#include "er-oscoap.h"
+
+#define ROUNDS            16
+#define UPDATES_PER_ROUND 4
+#define REFRESH_PHASE     10
+#define REGISTER_SPREAD   (2 * CLOCK_SECOND)
+
+#define CAPTURE_NUM (OBS_RESOURCES * UPDATES_PER_ROUND + 8)
+
+#define IN_IP_BUF  ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+#define IN_UDP_BUF ((struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN])
+
+#define CHECK(cond, name) do { \
+    if(cond) { \
+      printf("observe-benchmark: %s OK\n", name); \
+    } else { \
+      printf("observe-benchmark: %s FAILED\n", name); \
+      failures++; \
+    } \
+  } while(0)
+
+/* Traffic of one phase, split by direction */
+struct traffic {
+  uint32_t notifications;  /* responses, peer to client */
+  uint32_t notification_bytes;
+  uint32_t requests;       /* registrations, client to peer */
+  uint32_t request_bytes;
+  uint32_t acks;           /* empty ACKs and RSTs */
+  uint32_t ack_bytes;
+};
+
+static uint8_t master_secret[35];
+static uint8_t client_id[] = { 0x63, 0x6C, 0x69, 0x65, 0x6E, 0x74 };
+static uint8_t server_id[] = { 0x73, 0x65, 0x72, 0x76, 0x65, 0x72 };
+static uint8_t other_secret[35];
+static uint8_t other_id[] = { 0x6F, 0x74, 0x68, 0x65, 0x72 };
+static oscoap_ctx_t *client_ctx;
+static oscoap_ctx_t *server_ctx;
+static uip_ipaddr_t peer_addr;
+
+static char urls[OBS_RESOURCES][8];
+static char subpaths[OBS_RESOURCES][4];
+static uint32_t values[OBS_RESOURCES];
+static uint32_t seen[OBS_RESOURCES];
+
+static uint8_t captured[CAPTURE_NUM][UIP_BUFSIZE];
+static uint16_t captured_len[CAPTURE_NUM];
+static uint8_t captured_head;
+static uint8_t captured_count;
+static uint32_t dropped;
+
+static struct traffic traffic;
+static uint32_t registered;
+static uint32_t out_of_order;
+static uint8_t failures;
+
+PROCESS(oscoap_observe_benchmark, "OSCOAP observe benchmark");
+AUTOSTART_PROCESSES(&oscoap_observe_benchmark);
+
+/*---------------------------------------------------------------------------*/
+static void res_obs_get_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset);
+
+resource_t res_obs = { NULL, NULL, IS_OBSERVABLE | HAS_SUB_RESOURCES,
+                       "title=\"Observed\";obs", res_obs_get_handler,
+                       NULL, NULL, NULL, { .trigger = NULL } };
+
+static void
+res_obs_get_handler(void *request, void *response, uint8_t *buffer, uint16_t preferred_size, int32_t *offset)
+{
+  coap_packet_t *const coap_request = (coap_packet_t *)request;
+  coap_packet_t *const coap_response = (coap_packet_t *)response;
+  const char *uri_path;
+  int len;
+  int i;
+
+  len = REST.get_url(request, &uri_path);
+  i = len > 4 ? atoi(uri_path + 4) : OBS_RESOURCES;
+  if(i < 0 || i >= OBS_RESOURCES) {
+    REST.set_response_status(response, REST.status.NOT_FOUND);
+    return;
+  }
+  /* notifications are protected by the observe layer */
+  if(IS_OPTION(coap_request, COAP_OPTION_OBJECT_SECURITY)) {
+    coap_set_header_object_security(response);
+    coap_response->context = coap_request->context;
+  }
+  REST.set_header_content_type(response, REST.type.TEXT_PLAIN);
+  REST.set_response_payload(response, buffer,
+                            snprintf((char *)buffer, preferred_size, "%lu",
+                                     (unsigned long)values[i]));
+}
+/*---------------------------------------------------------------------------*/
+static void
+notification_callback(coap_observee_t *obs, void *notification,
+                      coap_notification_flag_t flag)
+{
+  coap_packet_t *const pkt = (coap_packet_t *)notification;
+  int i = (int)(uintptr_t)obs->data;
+  uint32_t value;
+
+  if(flag == OBSERVE_OK) {
+    registered++;
+    return;
+  }
+  if(flag != NOTIFICATION_OK || pkt->payload_len == 0) {
+    printf("observe-benchmark: /%s flag %u\n", obs->url, flag);
+    failures++;
+    return;
+  }
+  value = strtoul((const char *)pkt->payload, NULL, 10);
+  if(value < seen[i]) {
+    out_of_order++;
+  }
+  seen[i] = value;
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+usecs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+/*---------------------------------------------------------------------------*/
+static void
+inject_datagram(const uint8_t *payload, uint16_t len)
+{
+  memset(&uip_buf[UIP_LLH_LEN], 0, UIP_IPUDPH_LEN);
+  IN_IP_BUF->vtc = 0x60;
+  IN_IP_BUF->len[0] = (UIP_UDPH_LEN + len) >> 8;
+  IN_IP_BUF->len[1] = (UIP_UDPH_LEN + len) & 0xff;
+  IN_IP_BUF->proto = UIP_PROTO_UDP;
+  IN_IP_BUF->ttl = 64;
+  uip_ipaddr_copy(&IN_IP_BUF->srcipaddr, &peer_addr);
+  uip_ipaddr_copy(&IN_IP_BUF->destipaddr, &uip_ds6_get_link_local(-1)->ipaddr);
+  IN_UDP_BUF->srcport = UIP_HTONS(COAP_DEFAULT_PORT);
+  IN_UDP_BUF->destport = UIP_HTONS(COAP_DEFAULT_PORT);
+  IN_UDP_BUF->udplen = UIP_HTONS(UIP_UDPH_LEN + len);
+  memcpy(&uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN], payload, len);
+  uip_len = UIP_IPUDPH_LEN + len;
+  uip_ext_len = 0;
+  IN_UDP_BUF->udpchksum = ~(uip_udpchksum());
+  if(IN_UDP_BUF->udpchksum == 0) {
+    IN_UDP_BUF->udpchksum = 0xffff;
+  }
+  tcpip_input();
+}
+/*---------------------------------------------------------------------------*/
+/* Takes the datagrams sent to the peer, both directions go through here */
+static uint8_t
+capture_output(const uip_lladdr_t *lladdr)
+{
+  uint8_t *coap;
+  uint8_t slot;
+  uint16_t len;
+
+  if(IN_IP_BUF->proto != UIP_PROTO_UDP
+     || !uip_ipaddr_cmp(&IN_IP_BUF->destipaddr, &peer_addr)) {
+    return 0;
+  }
+  len = uip_len - UIP_IPUDPH_LEN;
+  if(captured_count == CAPTURE_NUM || len > sizeof(captured[0])) {
+    dropped++;
+    return 0;
+  }
+  coap = &uip_buf[UIP_LLH_LEN + UIP_IPUDPH_LEN];
+  if(coap[1] >= 64) {
+    traffic.notifications++;
+    traffic.notification_bytes += uip_len;
+  } else if(coap[1] == 0) {
+    traffic.acks++;
+    traffic.ack_bytes += uip_len;
+  } else {
+    traffic.requests++;
+    traffic.request_bytes += uip_len;
+  }
+  slot = (captured_head + captured_count) % CAPTURE_NUM;
+  memcpy(captured[slot], coap, len);
+  captured_len[slot] = len;
+  captured_count++;
+  process_poll(&oscoap_observe_benchmark);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Loops the captured datagrams back, returns the time spent receiving the
+   notifications */
+static uint32_t
+drain(void)
+{
+  uint32_t spent = 0;
+  uint32_t start;
+  uint8_t *buffer;
+
+  while(captured_count > 0) {
+    buffer = captured[captured_head];
+    start = usecs();
+    inject_datagram(buffer, captured_len[captured_head]);
+    if(buffer[1] >= 64) {
+      spent += usecs() - start;
+    }
+    captured_head = (captured_head + 1) % CAPTURE_NUM;
+    captured_count--;
+  }
+  return spent;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_stats(const char *phase, const struct coap_obs_client_stats *s)
+{
+  printf("observe-benchmark: %s: received %lu delivered %lu coalesced %lu "
+         "duplicates %lu reregistrations %lu batches %lu\n", phase,
+         (unsigned long)s->received, (unsigned long)s->delivered,
+         (unsigned long)s->coalesced, (unsigned long)s->duplicates,
+         (unsigned long)s->reregistrations, (unsigned long)s->batches);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(oscoap_observe_benchmark, ev, data)
+{
+  static struct etimer timer;
+  static struct coap_obs_client_stats before;
+  static uint32_t notify_us;
+  static uint32_t receive_us;
+  static uint32_t start;
+  static uint32_t sent;
+  static int i;
+  static int r;
+  static int u;
+  static const struct coap_obs_client_stats *stats;
+  uip_lladdr_t lladdr;
+
+  PROCESS_BEGIN();
+
+  rest_init_engine();
+  rest_activate_resource(&res_obs, "obs");
+  PROCESS_PAUSE();
+
+  if(uip_ds6_get_link_local(-1) == NULL) {
+    printf("observe-benchmark: no link-local address\n");
+    PROCESS_EXIT();
+  }
+
+  uip_ip6addr(&peer_addr, 0xfe80, 0, 0, 0, 0, 0, 0, 2);
+  memset(&lladdr, 0x02, sizeof(lladdr));
+  uip_ds6_nbr_add(&peer_addr, &lladdr, 0, NBR_REACHABLE,
+                  NBR_TABLE_REASON_UNDEFINED, NULL);
+  tcpip_set_outputfunc(capture_output);
+
+  oscoap_ctx_store_init();
+  init_token_seq_store();
+  memset(master_secret, 0x11, sizeof(master_secret));
+  client_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, client_id, sizeof(client_id),
+      server_id, sizeof(server_id), 32);
+  server_ctx = oscoap_derrive_ctx(master_secret, sizeof(master_secret),
+      NULL, 0, OSCOAP_DEFAULT_ALG, 1, server_id, sizeof(server_id),
+      client_id, sizeof(client_id), 32);
+
+  printf("observe-benchmark: %u resources, %u rounds of %u updates, "
+         "coalescing %u, refresh every %u s within %u s\n",
+         OBS_RESOURCES, ROUNDS, UPDATES_PER_ROUND, COAP_OBS_CLIENT_COALESCE,
+         COAP_OBS_CLIENT_REFRESH_INTERVAL, COAP_OBS_CLIENT_REFRESH_WINDOW);
+
+  /* registrations spread out, so that their refreshes would be too */
+  for(i = 0; i < OBS_RESOURCES; i++) {
+    snprintf(urls[i], sizeof(urls[i]), "obs/%d", i);
+    snprintf(subpaths[i], sizeof(subpaths[i]), "/%d", i);
+    oscoap_obs_request_registration(&peer_addr,
+        UIP_HTONS(COAP_DEFAULT_PORT), urls[i], notification_callback,
+        (void *)(uintptr_t)i, client_ctx);
+    etimer_set(&timer, REGISTER_SPREAD / OBS_RESOURCES);
+    while(!etimer_expired(&timer)) {
+      PROCESS_WAIT_EVENT();
+      drain();
+    }
+  }
+  CHECK(registered == OBS_RESOURCES, "protected registrations");
+  printf("observe-benchmark: registration: %lu requests %lu bytes, "
+         "%lu responses %lu bytes\n",
+         (unsigned long)traffic.requests, (unsigned long)traffic.request_bytes,
+         (unsigned long)traffic.notifications,
+         (unsigned long)traffic.notification_bytes);
+
+  /* notifications faster than the application runs */
+  memset(&traffic, 0, sizeof(traffic));
+  before = *coap_obs_client_get_stats();
+  notify_us = 0;
+  receive_us = 0;
+  sent = 0;
+  for(r = 0; r < ROUNDS; r++) {
+    for(u = 0; u < UPDATES_PER_ROUND; u++) {
+      for(i = 0; i < OBS_RESOURCES; i++) {
+        values[i]++;
+        start = usecs();
+        coap_notify_observers_sub(&res_obs, subpaths[i]);
+        notify_us += usecs() - start;
+        sent++;
+      }
+    }
+    receive_us += drain();
+    /* the application gets to run */
+    PROCESS_PAUSE();
+    receive_us += drain();
+  }
+  PROCESS_PAUSE();
+  stats = coap_obs_client_get_stats();
+  print_stats("notifications", stats);
+  printf("observe-benchmark: notify %lu us, receive %lu us per notification\n",
+         (unsigned long)(notify_us / sent), (unsigned long)(receive_us / sent));
+  printf("observe-benchmark: %lu notifications %lu bytes, %lu ACKs %lu bytes, "
+         "%lu bytes per notification\n",
+         (unsigned long)traffic.notifications,
+         (unsigned long)traffic.notification_bytes,
+         (unsigned long)traffic.acks, (unsigned long)traffic.ack_bytes,
+         (unsigned long)((traffic.notification_bytes + traffic.ack_bytes)
+                         / traffic.notifications));
+  CHECK(traffic.notifications == sent && dropped == 0, "notifications sent");
+  CHECK(stats->received - before.received == sent
+        && stats->duplicates == before.duplicates, "notifications decrypted");
+  CHECK(stats->delivered - before.delivered
+        + stats->coalesced - before.coalesced == sent, "notifications accounted");
+  for(i = 0; i < OBS_RESOURCES && seen[i] == values[i]; i++);
+  CHECK(i == OBS_RESOURCES && out_of_order == 0, "latest values delivered");
+
+  /* refreshes, batched per server */
+  memset(&traffic, 0, sizeof(traffic));
+  before = *stats;
+  etimer_set(&timer, REFRESH_PHASE * CLOCK_SECOND);
+  while(!etimer_expired(&timer)) {
+    PROCESS_WAIT_EVENT();
+    drain();
+  }
+  print_stats("refresh", stats);
+  if(stats->batches > before.batches) {
+    printf("observe-benchmark: %lu requests %lu bytes, %lu responses "
+           "%lu bytes, %lu bytes per batch\n",
+           (unsigned long)traffic.requests, (unsigned long)traffic.request_bytes,
+           (unsigned long)traffic.notifications,
+           (unsigned long)traffic.notification_bytes,
+           (unsigned long)((traffic.request_bytes + traffic.notification_bytes)
+                           / (stats->batches - before.batches)));
+  }
+  CHECK(COAP_OBS_CLIENT_REFRESH_INTERVAL == 0
+        || stats->reregistrations - before.reregistrations >= OBS_RESOURCES,
+        "registrations refreshed");
+  CHECK(traffic.notifications == traffic.requests
+        && stats->duplicates == before.duplicates, "refreshes answered");
+
+  /* the server context is freed and its slot taken by another peer's */
+  drain();
+  memset(&traffic, 0, sizeof(traffic));
+  oscoap_free_ctx(server_ctx);
+  memset(other_secret, 0x22, sizeof(other_secret));
+  oscoap_derrive_ctx(other_secret, sizeof(other_secret), NULL, 0,
+      OSCOAP_DEFAULT_ALG, 1, server_id, sizeof(server_id),
+      other_id, sizeof(other_id), 32);
+  for(i = 0; i < OBS_RESOURCES; i++) {
+    values[i]++;
+    coap_notify_observers_sub(&res_obs, subpaths[i]);
+  }
+  CHECK(traffic.notifications == 0, "freed context not used");
+
+  printf("observe-benchmark: done, %u failures\n", failures);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
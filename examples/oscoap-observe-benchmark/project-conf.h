@@ -0,0 +1,83 @@
+/*
+Copyright (c) 2016, SICS
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are permitted provided that the 
+following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this list of conditions and the 
+following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the 
+following disclaimer in the documentation and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors may be used to endorse or promote 
+products derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, 
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, 
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE 
+USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * \file
+ *      Configuration of the OSCOAP observe benchmark: one node is both
+ *      the server and the client of OBS_RESOURCES protected observations.
+ */
+
+#ifndef __PROJECT_OBSERVE_BENCHMARK_CONF_H__
+#define __PROJECT_OBSERVE_BENCHMARK_CONF_H__
+
+/* Observed resources, each with one observer and one observee */
+#ifndef OBS_RESOURCES
+#define OBS_RESOURCES                  8
+#endif
+
+#undef UIP_CONF_BUFFER_SIZE
+#define UIP_CONF_BUFFER_SIZE           256
+
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC              nullrdc_driver
+#undef NETSTACK_CONF_MAC
+#define NETSTACK_CONF_MAC              nullmac_driver
+
+#undef UIP_CONF_TCP
+#define UIP_CONF_TCP                   0
+
+#undef REST_MAX_CHUNK_SIZE
+#define REST_MAX_CHUNK_SIZE            64
+
+#undef COAP_MAX_HEADER_SIZE
+#define COAP_MAX_HEADER_SIZE           70
+
+/* Registrations of all observees may be in flight at once */
+#undef COAP_MAX_OPEN_TRANSACTIONS
+#define COAP_MAX_OPEN_TRANSACTIONS     (OBS_RESOURCES + 4)
+
+#undef COAP_MAX_OBSERVERS
+#define COAP_MAX_OBSERVERS             OBS_RESOURCES
+
+#define COAP_OBSERVE_CLIENT            1
+#define COAP_CONF_MAX_OBSERVEES        OBS_RESOURCES
+
+/* Client and server context, and one registration sequence number per
+   observee plus requests in flight */
+#define OSCOAP_CONF_CONTEXT_NUM        2
+#define OSCOAP_CONF_TOKEN_SEQ_NUM      (OBS_RESOURCES + 2)
+
+/* Defaults of the runs, override with DEFINES= */
+#ifndef COAP_OBS_CLIENT_CONF_COALESCE
+#define COAP_OBS_CLIENT_CONF_COALESCE  1
+#endif
+#ifndef COAP_OBS_CLIENT_CONF_REFRESH_INTERVAL
+#define COAP_OBS_CLIENT_CONF_REFRESH_INTERVAL 4
+#endif
+
+/* Measure the crypto inline, not in the worker process */
+#define COAP_CRYPTO_SLOTS              0
+
+#endif /* __PROJECT_OBSERVE_BENCHMARK_CONF_H__ */
@@ -147,6 +147,9 @@ typedef unsigned short uip_stats_t;
 #define UIP_CONF_FWCACHE_SIZE    30
 #define UIP_CONF_BROADCAST       1
 #define UIP_ARCH_IPCHKSUM        1
+#ifndef UIP_ARCH_CHKSUM_ADD
+#define UIP_ARCH_CHKSUM_ADD      1 /* cpu/native/net/uip-chksum-arch.c */
+#endif /* UIP_ARCH_CHKSUM_ADD */
 #define UIP_CONF_UDP             1
 #define UIP_CONF_UDP_CHECKSUMS   1
 #define UIP_CONF_PINGADDRCONF    0